@@ -1,8 +1,17 @@
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <filesystem>
 #include <random>
+#include <utility>
+#include <vector>
 
 #include <benchmark/benchmark.h>
+
+// BINARY_LOG_TRACE is compiled out
+#define BINARY_LOG_ACTIVE_LEVEL BINARY_LOG_LEVEL_DEBUG
 #include <binary_log/binary_log.hpp>
+#include <binary_log/call_site_control.hpp>
 
 template<typename T>
 static void BM_binary_log_static_integer(benchmark::State& state)
@@ -178,6 +187,489 @@ static void BM_binary_log_billion_integers(benchmark::State& state)
   remove("log.out.runlength");
 }
 
+// Same as BM_binary_log_random_integer, written as a single-file container
+template<typename T>
+static void BM_binary_log_container_random_integer(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<T> distr(std::numeric_limits<T>::min(),
+                                         std::numeric_limits<T>::max());
+
+  {
+    binary_log::binary_log<binary_log::container_packer<>> log("/dev/null");
+
+    for (auto _ : state) {
+      // This code gets timed
+      BINARY_LOG(log, "{}", distr(rng));
+    }
+  }
+
+  state.counters["Logs/s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+// A debug call site, below the logger's level unless Enabled. Its arg, a
+// random number, is only drawn when it logs. The level is loaded at every
+// call, as if it could change.
+template<bool Enabled>
+static void BM_binary_log_runtime_level(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+    log.set_level(Enabled ? binary_log::level::debug
+                          : binary_log::level::info);
+    benchmark::DoNotOptimize(log);
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG_DEBUG(log, "{}", distr(rng));
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// A trace call site, below BINARY_LOG_ACTIVE_LEVEL: nothing is left of it
+static void BM_binary_log_compiled_out_level(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG_TRACE(log, "{}", distr(rng));
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// A call site switched off by format string. Its arg, a random number, is
+// not drawn.
+static void BM_binary_log_disabled_call_site(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+    binary_log::disable_call_sites("Disabled call site");
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG(log, "Disabled call site {}", distr(rng));
+    }
+    binary_log::enable_call_sites("Disabled call site");
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// A probe, detached (which costs a load and a branch, and draws no random
+// number) or attached by the process itself (which logs like BINARY_LOG)
+template<bool Attached>
+static void BM_binary_log_probe(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+#if defined(BINARY_LOG_HAS_PROBES)
+    if (Attached) {
+      binary_log::attach_probes("Probe");
+    }
+#endif
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG_PROBE(log, "Probe {}", distr(rng));
+    }
+#if defined(BINARY_LOG_HAS_PROBES)
+    if (Attached) {
+      binary_log::detach_probes("Probe");
+    }
+#endif
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// A call site that logs 1 in N calls: the others, which draw no random
+// number, cost the sampling decision alone
+template<uint32_t N>
+static void BM_binary_log_sampled(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG_SAMPLED(log, N, "Sampled {}", distr(rng));
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// A rate-limited call site whose window lets every call log, or one whose
+// window is full, which costs a read of the coarse clock per call
+template<bool Suppressed>
+static void BM_binary_log_rate_limited(benchmark::State& state)
+{
+  std::random_device dev;
+  std::mt19937 rng(dev());
+  std::uniform_int_distribution<uint32_t> distr;
+
+  {
+    binary_log::binary_log log("log.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      benchmark::ClobberMemory();
+      BINARY_LOG_RATE_LIMITED(log,
+                              Suppressed ? 1 : UINT32_MAX,
+                              std::chrono::hours(1),
+                              "Rate limited {}",
+                              distr(rng));
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// Call sites of the first-call benchmarks, one per instantiation
+static constexpr std::size_t num_call_sites = 256;
+
+template<std::size_t Site, bool Constant>
+static void log_at_call_site(binary_log::binary_log<>& log)
+{
+  if constexpr (Constant) {
+    BINARY_LOG(log, "Site {}", binary_log::constant(Site));
+  } else {
+    BINARY_LOG(log, "Site {}", Site);
+  }
+}
+
+template<bool Constant, std::size_t... Sites>
+static void log_at_call_sites(binary_log::binary_log<>& log,
+                              std::index_sequence<Sites...>)
+{
+  ((void)log_at_call_site<Sites, Constant>(log), ...);
+}
+
+// The first call at each of num_call_sites call sites. Sites with a
+// constant add their index entry then; the others before main().
+template<bool Constant>
+static void BM_binary_log_first_call(benchmark::State& state)
+{
+  {
+    binary_log::binary_log log("log.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      log_at_call_sites<Constant>(
+          log, std::make_index_sequence<num_call_sites> {});
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations() * num_call_sites,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// The same call sites once they have been called
+static void BM_binary_log_steady_call(benchmark::State& state)
+{
+  {
+    binary_log::binary_log log("log.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      log_at_call_sites<false>(log,
+                               std::make_index_sequence<num_call_sites> {});
+    }
+  }
+
+  state.counters["Logs/s"] = benchmark::Counter(
+      state.iterations() * num_call_sites, benchmark::Counter::kIsRate);
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations() * num_call_sites,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// The same call sites logging to two loggers in turn, which number them
+// each in its own table
+static void BM_binary_log_shared_call_sites(benchmark::State& state)
+{
+  {
+    binary_log::binary_log log("log.out");
+    binary_log::binary_log other("other.out");
+
+    for (auto _ : state) {
+      // This code gets timed
+      log_at_call_sites<false>(log,
+                               std::make_index_sequence<num_call_sites> {});
+      log_at_call_sites<false>(other,
+                               std::make_index_sequence<num_call_sites> {});
+    }
+  }
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations() * num_call_sites * 2,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  for (const auto* name : {"log.out", "other.out"}) {
+    remove(name);
+    remove((std::string(name) + ".index").c_str());
+    remove((std::string(name) + ".runlength").c_str());
+  }
+}
+
+// A large application: generated call sites, each logging one integer
+static constexpr std::size_t num_generated_call_sites = 10000;
+
+using generated_call_site = void (*)(binary_log::binary_log<>&, uint32_t);
+
+template<std::size_t Site>
+static void log_at_generated_call_site(binary_log::binary_log<>& log,
+                                       uint32_t value)
+{
+  BINARY_LOG(log, "Site {}", value);
+}
+
+template<std::size_t... Sites>
+static constexpr auto make_generated_call_sites(std::index_sequence<Sites...>)
+{
+  return std::array<generated_call_site, sizeof...(Sites)> {
+      &log_at_generated_call_site<Sites>...};
+}
+
+static constexpr auto generated_call_sites = make_generated_call_sites(
+    std::make_index_sequence<num_generated_call_sites> {});
+
+// Records go round the first state.range(0) generated call sites, so that
+// no two records in a row share one. Bytes/record counts the log and
+// runlength files.
+static void BM_binary_log_many_call_sites(benchmark::State& state)
+{
+  const auto num_sites = static_cast<std::size_t>(state.range(0));
+  {
+    binary_log::binary_log log("log.out");
+
+    std::size_t site = 0;
+    for (auto _ : state) {
+      // This code gets timed
+      generated_call_sites[site](log, static_cast<uint32_t>(site));
+      if (++site == num_sites) {
+        site = 0;
+      }
+    }
+  }
+
+  state.counters["Logs/s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  state.counters["Bytes/record"] = benchmark::Counter(
+      static_cast<double>(std::filesystem::file_size("log.out")
+                          + std::filesystem::file_size("log.out.runlength"))
+      / static_cast<double>(state.iterations()));
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+}
+
+// Call sites logging with Zipf frequencies: the k-th most frequent one
+// logs 1 / k^s times as often as the first
+static constexpr std::size_t num_skewed_call_sites = 256;
+
+template<typename Packer>
+using skewed_call_site = void (*)(binary_log::binary_log<Packer>&, uint32_t);
+
+template<typename Packer, std::size_t Site>
+static void log_at_skewed_call_site(binary_log::binary_log<Packer>& log,
+                                    uint32_t value)
+{
+  BINARY_LOG(log, "Skewed site {}", value);
+}
+
+template<typename Packer, std::size_t... Sites>
+static constexpr auto make_skewed_call_sites(std::index_sequence<Sites...>)
+{
+  return std::array<skewed_call_site<Packer>, sizeof...(Sites)> {
+      &log_at_skewed_call_site<Packer, Sites>...};
+}
+
+// The sites of 64K records, in random order, for an exponent s
+static std::vector<uint16_t> make_skewed_sequence(double exponent)
+{
+  std::vector<double> weights;
+  for (std::size_t k = 1; k <= num_skewed_call_sites; ++k) {
+    weights.push_back(1.0 / std::pow(static_cast<double>(k), exponent));
+  }
+  std::mt19937 rng(42);
+  std::discrete_distribution<uint16_t> distr(weights.begin(), weights.end());
+  std::vector<uint16_t> sequence(64 * 1024);
+  for (auto& site : sequence) {
+    site = distr(rng);
+  }
+  return sequence;
+}
+
+// A loop over state.range(0) call sites, one record each per iteration,
+// as a repeat of their call sites while there are at most
+// binary_log::max_repeat_period of them. Bytes/record counts the log and
+// runlength files, or the whole container.
+template<typename Packer>
+static void BM_binary_log_repeating_call_sites(benchmark::State& state)
+{
+  static constexpr auto call_sites = make_skewed_call_sites<Packer>(
+      std::make_index_sequence<num_skewed_call_sites> {});
+  const auto num_sites = static_cast<std::size_t>(state.range(0));
+  {
+    binary_log::binary_log<Packer> log("log.out");
+
+    std::size_t site = 0;
+    for (auto _ : state) {
+      // This code gets timed
+      call_sites[site](log, static_cast<uint32_t>(site));
+      if (++site == num_sites) {
+        site = 0;
+      }
+    }
+  }
+
+  state.counters["Logs/s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  auto bytes = std::filesystem::file_size("log.out");
+  if (std::filesystem::exists("log.out.runlength")) {
+    bytes += std::filesystem::file_size("log.out.runlength");
+  }
+  state.counters["Bytes/record"] = benchmark::Counter(
+      static_cast<double>(bytes) / static_cast<double>(state.iterations()));
+
+  remove("log.out");
+  remove("log.out.index");
+  remove("log.out.runlength");
+  remove("log.out.seek");
+}
+
+// Records of the skewed call sites written to a container, with varint or
+// Huffman coded indices; the exponent is state.range(0) / 10. Bytes/record
+// counts the whole container, and Latency the coding of each block as it
+// is closed.
+template<binary_log::index_coding Coding>
+static void BM_binary_log_skewed_call_sites(benchmark::State& state)
+{
+  using packer = binary_log::container_packer<64 * 1024, Coding>;
+  static constexpr auto call_sites = make_skewed_call_sites<packer>(
+      std::make_index_sequence<num_skewed_call_sites> {});
+  const auto sequence =
+      make_skewed_sequence(static_cast<double>(state.range(0)) / 10);
+  {
+    binary_log::binary_log<packer> log("log.out");
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+      // This code gets timed
+      call_sites[sequence[i]](log, static_cast<uint32_t>(i));
+      i = (i + 1) % sequence.size();
+    }
+  }
+
+  state.counters["Logs/s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+  state.counters["Latency"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+
+  state.counters["Bytes/record"] = benchmark::Counter(
+      static_cast<double>(std::filesystem::file_size("log.out"))
+      / static_cast<double>(state.iterations()));
+
+  remove("log.out");
+}
+
 BENCHMARK_TEMPLATE(BM_binary_log_static_integer, uint8_t)->Arg(42);
 BENCHMARK_TEMPLATE(BM_binary_log_static_integer, uint16_t)->Arg(395);
 BENCHMARK_TEMPLATE(BM_binary_log_static_integer, uint32_t)->Arg(3123456789);
@@ -201,7 +693,37 @@ BENCHMARK_TEMPLATE(BM_binary_log_random_integer, int32_t);
 BENCHMARK_TEMPLATE(BM_binary_log_random_integer, int64_t);
 BENCHMARK_TEMPLATE(BM_binary_log_random_real, float);
 BENCHMARK_TEMPLATE(BM_binary_log_random_real, double);
+BENCHMARK_TEMPLATE(BM_binary_log_container_random_integer, uint32_t);
 BENCHMARK(BM_binary_log_billion_integers);
+BENCHMARK_TEMPLATE(BM_binary_log_runtime_level, false);
+BENCHMARK_TEMPLATE(BM_binary_log_runtime_level, true);
+BENCHMARK(BM_binary_log_compiled_out_level);
+BENCHMARK(BM_binary_log_disabled_call_site);
+BENCHMARK_TEMPLATE(BM_binary_log_probe, false);
+BENCHMARK_TEMPLATE(BM_binary_log_probe, true);
+BENCHMARK_TEMPLATE(BM_binary_log_sampled, 1);
+BENCHMARK_TEMPLATE(BM_binary_log_sampled, 1000);
+BENCHMARK_TEMPLATE(BM_binary_log_rate_limited, false);
+BENCHMARK_TEMPLATE(BM_binary_log_rate_limited, true);
+// A single iteration, for the first calls to be first
+BENCHMARK_TEMPLATE(BM_binary_log_first_call, false)->Iterations(1);
+BENCHMARK_TEMPLATE(BM_binary_log_first_call, true)->Iterations(1);
+BENCHMARK(BM_binary_log_steady_call);
+BENCHMARK(BM_binary_log_shared_call_sites);
+BENCHMARK(BM_binary_log_many_call_sites)->Arg(100)->Arg(10000);
+BENCHMARK_TEMPLATE(BM_binary_log_repeating_call_sites, binary_log::packer<>)
+    ->DenseRange(2, 5);
+BENCHMARK_TEMPLATE(BM_binary_log_repeating_call_sites,
+                   binary_log::container_packer<>)
+    ->DenseRange(2, 5);
+BENCHMARK_TEMPLATE(BM_binary_log_skewed_call_sites,
+                   binary_log::index_coding::varint)
+    ->Arg(10)
+    ->Arg(15);
+BENCHMARK_TEMPLATE(BM_binary_log_skewed_call_sites,
+                   binary_log::index_coding::huffman)
+    ->Arg(10)
+    ->Arg(15);
 
 // Run the benchmark
 BENCHMARK_MAIN();
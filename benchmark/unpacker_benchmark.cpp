@@ -0,0 +1,705 @@
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <binary_log/binary_log.hpp>
+#include <binary_log/reader.hpp>
+#include <fcntl.h>
+#include <log_extractor.hpp>
+#include <log_file_parser.hpp>
+#include <log_merger.hpp>
+#include <output_writer.hpp>
+#include <segment_unpacker.hpp>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static constexpr auto log_path = "unpacker_benchmark.out";
+static constexpr auto index_path = "unpacker_benchmark.out.index";
+static constexpr auto runlength_path = "unpacker_benchmark.out.runlength";
+static constexpr auto seek_path = "unpacker_benchmark.out.seek";
+static constexpr int num_records = 10000000;
+
+// Two call sites taking turns, so that there are no runs to skip at once
+static constexpr auto interleaved_log_path = "unpacker_benchmark_interleaved.out";
+
+// The same two logs as single-file containers
+static constexpr auto container_path = "unpacker_benchmark_container.out";
+static constexpr auto interleaved_container_path =
+    "unpacker_benchmark_interleaved_container.out";
+
+// Two call sites taking turns every four records
+static constexpr auto short_runs_log_path = "unpacker_benchmark_short_runs.out";
+static constexpr auto short_runs_container_path =
+    "unpacker_benchmark_short_runs_container.out";
+
+// 256 call sites logging with Zipf frequencies (s = 1), in random order,
+// with varint and Huffman coded indices
+static constexpr auto skewed_container_path =
+    "unpacker_benchmark_skewed_container.out";
+static constexpr auto skewed_huffman_path =
+    "unpacker_benchmark_skewed_huffman.out";
+
+static constexpr auto export_directory = "unpacker_benchmark_export";
+static constexpr auto extract_path = "unpacker_benchmark_extract.out";
+
+// Copies of the log standing for rotated segments
+static constexpr auto segment_prefix = "unpacker_benchmark_segment";
+static constexpr int num_segments = 4;
+
+static std::string segment_path(int i)
+{
+  return std::string(segment_prefix) + std::to_string(i) + ".out";
+}
+
+static struct remove_generated_log
+{
+  ~remove_generated_log()
+  {
+    remove(log_path);
+    remove(index_path);
+    remove(runlength_path);
+    remove(seek_path);
+    for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+      remove((std::string(interleaved_log_path) + extension).c_str());
+    }
+    remove(container_path);
+    remove(interleaved_container_path);
+    for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+      remove((std::string(short_runs_log_path) + extension).c_str());
+    }
+    remove(short_runs_container_path);
+    remove(skewed_container_path);
+    remove(skewed_huffman_path);
+    std::filesystem::remove_all(export_directory);
+    for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+      remove((std::string(extract_path) + extension).c_str());
+    }
+    for (int i = 0; i < num_segments; ++i) {
+      for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+        remove((segment_path(i) + extension).c_str());
+      }
+    }
+  }
+} cleanup;
+
+static void generate_log()
+{
+  if (std::filesystem::exists(log_path)) {
+    return;
+  }
+  binary_log::binary_log log(log_path);
+  for (int i = 0; i < num_records; ++i) {
+    BINARY_LOG(log, "Hello logger, msg number: {}", i);
+  }
+}
+
+static void generate_interleaved_log()
+{
+  if (std::filesystem::exists(interleaved_log_path)) {
+    return;
+  }
+  binary_log::binary_log log(interleaved_log_path);
+  for (int i = 0; i < num_records; i += 2) {
+    BINARY_LOG(log, "Hello logger, msg number: {}", i);
+    BINARY_LOG(log, "Hello again, msg number: {}", i + 1);
+  }
+}
+
+static void generate_container_log()
+{
+  if (std::filesystem::exists(container_path)) {
+    return;
+  }
+  binary_log::binary_log<binary_log::container_packer<1024 * 1024>> log(
+      container_path);
+  for (int i = 0; i < num_records; ++i) {
+    BINARY_LOG(log, "Hello logger, msg number: {}", i);
+  }
+}
+
+static void generate_interleaved_container_log()
+{
+  if (std::filesystem::exists(interleaved_container_path)) {
+    return;
+  }
+  binary_log::binary_log<binary_log::container_packer<1024 * 1024>> log(
+      interleaved_container_path);
+  for (int i = 0; i < num_records; i += 2) {
+    BINARY_LOG(log, "Hello logger, msg number: {}", i);
+    BINARY_LOG(log, "Hello again, msg number: {}", i + 1);
+  }
+}
+
+// Instantiated once per Packer, since a call site belongs to one logger
+template<typename Packer>
+static void generate_short_runs_log(const char* path)
+{
+  if (std::filesystem::exists(path)) {
+    return;
+  }
+  binary_log::binary_log<Packer> log(path);
+  for (int i = 0; i < num_records; i += 8) {
+    for (int j = 0; j < 4; ++j) {
+      BINARY_LOG(log, "Hello logger, msg number: {}", i + j);
+    }
+    for (int j = 4; j < 8; ++j) {
+      BINARY_LOG(log, "Hello again, msg number: {}", i + j);
+    }
+  }
+}
+
+static constexpr std::size_t num_skewed_call_sites = 256;
+
+template<typename Packer, std::size_t Site>
+static void log_at_skewed_call_site(binary_log::binary_log<Packer>& log,
+                                    uint32_t value)
+{
+  BINARY_LOG(log, "Skewed site {}", value);
+}
+
+template<typename Packer, std::size_t... Sites>
+static void generate_skewed_log(const char* path,
+                                std::index_sequence<Sites...>)
+{
+  if (std::filesystem::exists(path)) {
+    return;
+  }
+  using call_site = void (*)(binary_log::binary_log<Packer>&, uint32_t);
+  static constexpr std::array<call_site, sizeof...(Sites)> call_sites {
+      &log_at_skewed_call_site<Packer, Sites>...};
+
+  std::vector<double> weights;
+  for (std::size_t k = 1; k <= sizeof...(Sites); ++k) {
+    weights.push_back(1.0 / static_cast<double>(k));
+  }
+  std::mt19937 rng(42);
+  std::discrete_distribution<std::size_t> distr(weights.begin(),
+                                                weights.end());
+
+  binary_log::binary_log<Packer> log(path);
+  for (int i = 0; i < num_records; ++i) {
+    call_sites[distr(rng)](log, static_cast<uint32_t>(i));
+  }
+}
+
+static std::vector<std::string> generate_segments()
+{
+  generate_log();
+  std::vector<std::string> paths;
+  for (int i = 0; i < num_segments; ++i) {
+    paths.push_back(segment_path(i));
+    for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+      std::filesystem::copy_file(
+          std::string(log_path) + extension,
+          paths.back() + extension,
+          std::filesystem::copy_options::skip_existing);
+    }
+  }
+  return paths;
+}
+
+static double system_time_seconds()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_stime.tv_sec)
+      + static_cast<double>(usage.ru_stime.tv_usec) / 1E6;
+}
+
+// Baseline: one stdio call per formatted line
+static void BM_unpacker_fmt_print(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  const auto& index_entries = log.index_table();
+  std::FILE* devnull = std::fopen("/dev/null", "w");
+
+  std::size_t bytes = 0;
+  const double sys_start = system_time_seconds();
+  for (auto _ : state) {
+    for (int i = 0; i < num_records; ++i) {
+      fmt::dynamic_format_arg_store<fmt::format_context> store;
+      store.push_back(i);
+      auto line = fmt::vformat(index_entries[0].format_string, store);
+      fmt::print(devnull, "{}\n", line);
+      bytes += line.size() + 1;
+    }
+  }
+  state.counters["SysTime"] = system_time_seconds() - sys_start;
+  state.counters["Output"] = benchmark::Counter(
+      static_cast<double>(bytes),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+
+  std::fclose(devnull);
+}
+
+static void BM_unpacker_buffered_output(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  std::size_t bytes = 0;
+  const double sys_start = system_time_seconds();
+  for (auto _ : state) {
+    binary_log::output_writer output(devnull,
+                                     static_cast<std::size_t>(state.range(0)));
+    binary_log::log_file_parser(log).parse_and_print(output);
+    bytes += output.bytes_written();
+  }
+  state.counters["SysTime"] = system_time_seconds() - sys_start;
+  state.counters["Output"] = benchmark::Counter(
+      static_cast<double>(bytes),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+
+  close(devnull);
+}
+
+// Selective query: only ~0.01% of the records match and get formatted
+static void BM_unpacker_query(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  const auto& index_entries = log.index_table();
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  for (auto _ : state) {
+    auto where = binary_log::query("arg0 >= 9999000");
+    where.compile(index_entries);
+    binary_log::output_writer output(devnull);
+    auto parser = binary_log::log_file_parser(log);
+    parser.set_query(std::move(where));
+    parser.parse_and_print(output);
+  }
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+
+  close(devnull);
+}
+
+// The same selection done today: format everything, then grep the text
+static void BM_unpacker_full_decode_grep(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+
+  std::FILE* grep = popen("grep -c 'number: 9999' > /dev/null", "w");
+  if (grep == nullptr) {
+    state.SkipWithError("popen failed");
+    return;
+  }
+  const int grep_fd = fileno(grep);
+
+  for (auto _ : state) {
+    binary_log::output_writer output(grep_fd);
+    binary_log::log_file_parser(log).parse_and_print(output);
+  }
+  pclose(grep);
+
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+}
+
+// Statistics of the logged integer straight from the binary values
+static void BM_unpacker_aggregate(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  const auto& index_entries = log.index_table();
+
+  for (auto _ : state) {
+    auto statistics = binary_log::aggregator(index_entries);
+    binary_log::log_file_parser(log).parse_and_aggregate(statistics);
+    benchmark::DoNotOptimize(statistics);
+  }
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+  state.counters["Input"] = benchmark::Counter(
+      static_cast<double>(state.iterations())
+          * static_cast<double>(std::filesystem::file_size(log_path)),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+}
+
+static void set_input_rate(benchmark::State& state,
+                           const char* path = log_path)
+{
+  state.counters["Input"] = benchmark::Counter(
+      static_cast<double>(state.iterations())
+          * static_cast<double>(std::filesystem::file_size(path)),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+}
+
+// Typed export, to compare with the text of BM_unpacker_buffered_output
+static void BM_unpacker_export_jsonl(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  for (auto _ : state) {
+    binary_log::output_writer output(devnull);
+    auto exporter = binary_log::jsonl_exporter(output, log.index_table(), {});
+    binary_log::log_file_parser(log).parse_and_export(exporter);
+  }
+  set_input_rate(state);
+
+  close(devnull);
+}
+
+static void BM_unpacker_export_csv(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+
+  for (auto _ : state) {
+    auto exporter =
+        binary_log::csv_exporter(export_directory, log.index_table(), {});
+    binary_log::log_file_parser(log).parse_and_export(exporter);
+  }
+  set_input_rate(state);
+}
+
+// Runs of fixed-size records are copied column by column
+static void BM_unpacker_export_columnar(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+
+  for (auto _ : state) {
+    auto exporter =
+        binary_log::columnar_exporter(export_directory, log.index_table(), {});
+    binary_log::log_file_parser(log).parse_and_export(exporter);
+  }
+  set_input_rate(state);
+}
+
+// Native-format copy of one of two interleaved call sites
+static void BM_unpacker_extract(benchmark::State& state)
+{
+  generate_interleaved_log();
+  const auto log = binary_log::reader(interleaved_log_path);
+
+  for (auto _ : state) {
+    auto parser = binary_log::log_file_parser(log);
+    parser.set_filter(
+        binary_log::record_filter(log.index_table(), {"again"}, {}));
+    auto extractor = binary_log::log_extractor(extract_path);
+    extractor.set_source(log);
+    parser.parse_and_extract(extractor);
+  }
+  set_input_rate(state, interleaved_log_path);
+}
+
+// Both logs merged by time a block of records (between checkpoints) at a
+// time, with a prefix on every line
+static void BM_unpacker_merge(benchmark::State& state)
+{
+  generate_log();
+  generate_interleaved_log();
+  const auto log = binary_log::reader(log_path);
+  const auto interleaved = binary_log::reader(interleaved_log_path);
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  for (auto _ : state) {
+    auto parser = binary_log::log_file_parser(log);
+    auto interleaved_parser = binary_log::log_file_parser(interleaved);
+    parser.set_prefix("[a] ");
+    interleaved_parser.set_prefix("[b] ");
+    binary_log::log_merger merger;
+    merger.add(log, parser, 0, log.record_count());
+    merger.add(
+        interleaved, interleaved_parser, 0, interleaved.record_count());
+
+    binary_log::output_writer output(devnull);
+    merger.merge(
+        [&](std::size_t position)
+        {
+          (position == 0 ? parser : interleaved_parser).print_records(output);
+        });
+    output.flush();
+  }
+  state.counters["Input"] = benchmark::Counter(
+      static_cast<double>(state.iterations())
+          * static_cast<double>(std::filesystem::file_size(log_path)
+                                + std::filesystem::file_size(
+                                    interleaved_log_path)),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+
+  close(devnull);
+}
+
+// Baseline for --segments: the segments one after the other, as by a
+// shell loop over the unpacker
+static void BM_unpacker_segments_loop(benchmark::State& state)
+{
+  const auto paths = generate_segments();
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  for (auto _ : state) {
+    for (const auto& path : paths) {
+      const auto log = binary_log::reader(path);
+      binary_log::output_writer output(devnull);
+      binary_log::log_file_parser(log).parse_and_print(output);
+    }
+  }
+  state.counters["Input"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_segments
+          * static_cast<double>(std::filesystem::file_size(log_path)),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+
+  close(devnull);
+}
+
+// The segments decoded by one thread per core, written in order
+static void BM_unpacker_segments_parallel(benchmark::State& state)
+{
+  const auto paths = generate_segments();
+  const int devnull = open("/dev/null", O_WRONLY);
+
+  for (auto _ : state) {
+    binary_log::segment_unpacker(paths,
+                                 std::thread::hardware_concurrency(),
+                                 binary_log::output_writer::default_buffer_size,
+                                 {})
+        .unpack_in_order(devnull);
+  }
+  state.counters["Input"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_segments
+          * static_cast<double>(std::filesystem::file_size(log_path)),
+      benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+
+  close(devnull);
+}
+
+// In-process analysis through the record range: no formatting, no output
+static void BM_reader_records(benchmark::State& state)
+{
+  generate_log();
+  const auto log = binary_log::reader(log_path);
+  // Call site indices are process-wide; take the one of the log
+  const auto index = (*log.records().begin()).index();
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (const auto& record : log.records()
+             | std::views::filter([index](const binary_log::record& r)
+                                  { return r.index() == index; }))
+    {
+      sum += record[0].as<uint32_t>();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+}
+
+// Every record decoded by a record_decoder. Arguments: dense runs (0),
+// no runs (1) or runs of four (2), and runs in the .runlength file (0)
+// or inline in a container (1)
+static void BM_reader_decode(benchmark::State& state)
+{
+  const auto workload = state.range(0);
+  const bool container = state.range(1) == 1;
+  std::string path;
+  if (workload == 0) {
+    container ? generate_container_log() : generate_log();
+    path = container ? container_path : log_path;
+  } else if (workload == 1) {
+    container ? generate_interleaved_container_log()
+              : generate_interleaved_log();
+    path = container ? interleaved_container_path : interleaved_log_path;
+  } else if (container) {
+    generate_short_runs_log<binary_log::container_packer<1024 * 1024>>(
+        short_runs_container_path);
+    path = short_runs_container_path;
+  } else {
+    generate_short_runs_log<binary_log::packer<>>(short_runs_log_path);
+    path = short_runs_log_path;
+  }
+  const auto log = binary_log::reader(path);
+
+  std::vector<binary_log::arg_view> args;
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    auto decoder = log.decoder();
+    while (!decoder.at_end()) {
+      const auto [index, count] = decoder.next_run();
+      const auto& entry = log.index_table()[index];
+      for (std::size_t i = 0; i < count; ++i) {
+        decoder.decode(entry, args);
+        sum += args[0].as<uint32_t>();
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+
+  std::size_t bytes = 0;
+  for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+    const auto file = path + extension;
+    if (std::filesystem::exists(file)) {
+      bytes += std::filesystem::file_size(file);
+    }
+  }
+  state.counters["Bytes"] = static_cast<double>(bytes);
+}
+
+// Every record of the skewed log decoded by a record_decoder, with varint
+// (0) or Huffman (1) coded indices
+static void BM_reader_decode_skewed(benchmark::State& state)
+{
+  const bool huffman = state.range(0) == 1;
+  if (huffman) {
+    generate_skewed_log<binary_log::container_packer<
+        64 * 1024,
+        binary_log::index_coding::huffman>>(
+        skewed_huffman_path,
+        std::make_index_sequence<num_skewed_call_sites> {});
+  } else {
+    generate_skewed_log<binary_log::container_packer<64 * 1024>>(
+        skewed_container_path,
+        std::make_index_sequence<num_skewed_call_sites> {});
+  }
+  const auto path = huffman ? skewed_huffman_path : skewed_container_path;
+  const auto log = binary_log::reader(path);
+
+  std::vector<binary_log::arg_view> args;
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    auto decoder = log.decoder();
+    while (!decoder.at_end()) {
+      const auto [index, count] = decoder.next_run();
+      const auto& entry = log.index_table()[index];
+      for (std::size_t i = 0; i < count; ++i) {
+        decoder.decode(entry, args);
+        sum += args[0].as<uint32_t>();
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.counters["Records/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * num_records,
+      benchmark::Counter::kIsRate);
+  state.counters["Bytes"] =
+      static_cast<double>(std::filesystem::file_size(path));
+}
+
+// Time to the first record near the end of the log
+static void BM_reader_seek_record(benchmark::State& state)
+{
+  generate_interleaved_log();
+  const auto log = binary_log::reader(interleaved_log_path);
+  const std::size_t record_number = num_records - 10;
+
+  for (auto _ : state) {
+    for (const auto& record : log.records(record_number, record_number + 1)) {
+      benchmark::DoNotOptimize(record[0].as<uint32_t>());
+    }
+  }
+}
+
+// The same without a seek index: decode from byte 0
+static void BM_reader_scan_to_record(benchmark::State& state)
+{
+  generate_interleaved_log();
+  const std::string path = interleaved_log_path;
+  const auto log_file = binary_log::mapped_file(path);
+  const auto index_file = binary_log::mapped_file(path + ".index");
+  const auto runlength_file = binary_log::mapped_file(path + ".runlength");
+  const auto log = binary_log::reader(
+      log_file.view(), index_file.view(), runlength_file.view());
+  const std::size_t record_number = num_records - 10;
+
+  for (auto _ : state) {
+    for (const auto& record : log.records(record_number, record_number + 1)) {
+      benchmark::DoNotOptimize(record[0].as<uint32_t>());
+    }
+  }
+}
+
+static void BM_reader_tail(benchmark::State& state)
+{
+  generate_interleaved_log();
+  const auto log = binary_log::reader(interleaved_log_path);
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (const auto& record : log.tail(1000)) {
+      sum += record[0].as<uint32_t>();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+static void BM_reader_reverse_records(benchmark::State& state)
+{
+  generate_interleaved_log();
+  const auto log = binary_log::reader(interleaved_log_path);
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (const auto& record : log.reverse_records() | std::views::take(1000)) {
+      sum += record[0].as<uint32_t>();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+BENCHMARK(BM_unpacker_fmt_print)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_buffered_output)
+    ->Arg(4 * 1024)
+    ->Arg(64 * 1024)
+    ->Arg(1024 * 1024)
+    ->Arg(4 * 1024 * 1024)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_query)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_full_decode_grep)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_aggregate)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_export_jsonl)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_export_csv)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_export_columnar)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_extract)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_merge)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_segments_loop)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_unpacker_segments_parallel)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_reader_records)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_reader_decode)
+    ->Args({0, 0})
+    ->Args({0, 1})
+    ->Args({1, 0})
+    ->Args({1, 1})
+    ->Args({2, 0})
+    ->Args({2, 1})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_reader_decode_skewed)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_reader_seek_record)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_reader_scan_to_record)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_reader_tail)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_reader_reverse_records)->Unit(benchmark::kMicrosecond);
+
+// Run the benchmark
+BENCHMARK_MAIN();
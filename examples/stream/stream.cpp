@@ -0,0 +1,22 @@
+#include <binary_log/binary_log.hpp>
+
+#include <chrono>
+#include <thread>
+
+// Logs to stdout as one stream, to be decoded as it is written:
+//
+//   ./stream | unpacker -
+int main()
+{
+  binary_log::binary_log<binary_log::container_packer<>> log("-");
+
+  for (int i = 0; i < 10; ++i) {
+    BINARY_LOG(log, "Tick {} of {}", i, binary_log::constant(10));
+    for (int j = 0; j < 1000; ++j) {
+      BINARY_LOG(log, "Work item {}", j);
+    }
+    // The unpacker prints the records up to here
+    log.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
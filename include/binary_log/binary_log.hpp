@@ -1,12 +1,21 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include <binary_log/constant.hpp>
+#include <binary_log/level.hpp>
 #include <binary_log/detail/args.hpp>
+#include <binary_log/detail/call_site.hpp>
 #include <binary_log/detail/packer.hpp>
+#include <binary_log/detail/probe.hpp>
+#include <binary_log/detail/sampling.hpp>
 #include <binary_log/detail/ringbuffer_packer.hpp>
+#include <binary_log/detail/container_packer.hpp>
 
 namespace binary_log
 {
@@ -14,7 +23,110 @@ template<class Packer = packer<1 * 1024 * 1024, 32, 32>>
 class binary_log
 {
   Packer m_packer;
-  uint8_t m_format_string_index {0};
+
+  // Index of each call site in this log plus one, by the id of the call
+  // site in the registry (see call_site), or 0 until it logs here. Call
+  // sites are numbered by each logger in the order they first log to it,
+  // so a log only has the call sites that log to it, with the lowest
+  // indices for the first ones.
+  std::vector<uint16_t> m_indices;
+
+  // Call sites that have logged here so far
+  uint16_t m_call_sites {0};
+
+  // State of the sampled and rate-limited call sites in this log, by the
+  // index of the call site in the registry (its id minus one)
+  std::vector<sampling_state> m_sampling;
+
+  // State of the call site whose first call is being logged while the
+  // call site is not in the registry yet (one with constants), moved to
+  // m_sampling once its record has added it
+  std::optional<sampling_state> m_first_call;
+
+  // Records of the leveled macros below this level are not logged
+  level m_level {level::trace};
+
+  // Gives the call site of `id` the next index of this log, writing its
+  // entry to the index
+  uint16_t add_call_site(std::size_t id)
+  {
+    const auto& registry = call_site_registry::instance();
+    if (id >= m_indices.size()) {
+      m_indices.resize(std::max(id, registry.size()) + 1);
+    }
+    m_packer.write_encoded_entry_to_index_file(registry.entry(id - 1));
+    m_indices[id] = ++m_call_sites;
+    return m_call_sites;
+  }
+
+  // Position of the state of `site` in m_sampling, past its end until
+  // the call site first calls here
+  template<class site>
+  static std::size_t sampling_slot()
+  {
+    return (site::id.load(std::memory_order_relaxed)
+            & ~call_site_registry::disabled)
+        - 1;
+  }
+
+  // Adds the state at `slot`, or m_first_call while the call site is not
+  // in the registry. Out of line, as are the records and the clock, for
+  // the decision of a call that does not log to need no registers saved.
+  BINARY_LOG_NOINLINE sampling_state& add_sampling_state(std::size_t slot)
+  {
+    if (slot == static_cast<std::size_t>(-1)) {
+      return m_first_call.emplace();
+    }
+    if (slot >= m_sampling.size()) {
+      m_sampling.resize(
+          std::max(slot + 1, call_site_registry::instance().size()));
+    }
+    return m_sampling[slot];
+  }
+
+  // Starts the next window of a rate-limited call site if its window is
+  // over, and counts the call as suppressed otherwise
+  template<class suppressed_count_site>
+  BINARY_LOG_NOINLINE bool next_window(sampling_state& state,
+                                       uint32_t max_records,
+                                       coarse_clock::duration window)
+  {
+    const auto now = coarse_clock::now();
+    if (now < state.window_end) {
+      if (state.suppressed == 0) {
+        (void)suppressed_count_site::added_before_main;
+        if (suppressed_count_site::id.load(std::memory_order_relaxed) == 0) {
+          suppressed_count_site::add(uint32_t {});
+        }
+        state.suppressed_count_id =
+            suppressed_count_site::id.load(std::memory_order_acquire)
+            & ~call_site_registry::disabled;
+      }
+      if (++state.suppressed == UINT32_MAX) {
+        log_suppressed_count(state);
+      }
+      return false;
+    }
+    if (state.suppressed != 0) {
+      log_suppressed_count(state);
+    }
+    state.window_end = now + window;
+    state.countdown = max_records - 1;
+    return true;
+  }
+
+  // Logs how many calls the rate-limited call site of `state` suppressed
+  void log_suppressed_count(sampling_state& state)
+  {
+    const auto id = state.suppressed_count_id;
+    uint16_t index = id < m_indices.size() ? m_indices[id] : 0;
+    if (index == 0) {
+      index = add_call_site(id);
+    }
+    m_packer.pack_format_string_index(static_cast<uint16_t>(index - 1));
+    m_packer.update_log_file(state.suppressed);
+    state.suppressed = 0;
+  }
 
 public:
   binary_log(const char* path)
@@ -34,6 +146,12 @@ public:
 
   ~binary_log()
   {
+    // The calls suppressed in the last window of each call site
+    for (auto& state : m_sampling) {
+      if (state.suppressed != 0) {
+        log_suppressed_count(state);
+      }
+    }
     m_packer.flush();
   }
 
@@ -42,40 +160,108 @@ public:
     m_packer.flush();
   }
 
-  template<const char* format_string, class... Args>
-  constexpr inline uint8_t log_index(Args&&... args)
+  void set_level(level threshold)
   {
-    // SPEC:
-    // <format-string-length> <format-string>
-    // <number-of-arguments> <arg-type-1> <arg-type-2> ... <arg-type-N>
-    // <arg-1-is- const> <arg-1-value>? <arg-2-is- const> <arg-2-value>?
-    // ...
-    //
-    // If the arg is not an lvalue, it is stored in the index file
-    // and the value is not stored in the log file
-    constexpr uint8_t num_args = sizeof...(Args);
+    m_level = threshold;
+  }
 
-    m_format_string_index++;
+  level get_level() const
+  {
+    return m_level;
+  }
 
-    // Write the length of the format string
-    m_packer. template write_format_string_to_index_file<format_string>();
+  // Checked by the leveled macros before their args are evaluated
+  bool should_log(level severity) const
+  {
+    return severity >= m_level;
+  }
 
-    // Write the number of args taken by the format string
-    m_packer.write_num_args_to_index_file(num_args);
+  // Whether the call of `site` is the first of every `n` calls, the one
+  // that BINARY_LOG_SAMPLED logs: a decrement and a compare
+  template<class site, uint32_t n>
+  bool sample()
+  {
+    static_assert(n > 0, "a sampled call site logs 1 in n calls");
+    const auto slot = sampling_slot<site>();
+    if (slot >= m_sampling.size()) [[unlikely]] {
+      add_sampling_state(slot).countdown = n - 1;
+      return true;
+    }
+    auto& countdown = m_sampling[slot].countdown;
+    if (countdown != 0) {
+      --countdown;
+      return false;
+    }
+    countdown = n - 1;
+    return true;
+  }
 
-    // Write the type of each argument
-    if constexpr (num_args > 0) {
-      m_packer.update_index_file(std::forward<Args>(args)...);
+  // Whether BINARY_LOG_RATE_LIMITED logs the call of `site`: the first
+  // `max_records` calls of a window do, a decrement and a compare each,
+  // and the next window starts at the first call after it is over. The
+  // calls in between are counted, a read of coarse_clock each, and the
+  // count is logged at site::suppressed_count before the first record of
+  // the next window (or when the log is closed).
+  template<class site, uint32_t max_records>
+  bool rate_limit(coarse_clock::duration window)
+  {
+    static_assert(max_records > 0, "a rate-limited call site logs records");
+    const auto slot = sampling_slot<site>();
+    if (slot >= m_sampling.size()) [[unlikely]] {
+      return next_window<typename site::suppressed_count>(
+          add_sampling_state(slot), max_records, window);
+    }
+    auto& state = m_sampling[slot];
+    if (state.countdown != 0) {
+      --state.countdown;
+      return true;
     }
+    return next_window<typename site::suppressed_count>(
+        state, max_records, window);
+  }
 
-    return m_format_string_index - 1;
+  // log(), out of line for the sampled and rate-limited macros (see
+  // add_sampling_state), which keeps the state of the first call of a
+  // call site once the record has added the call site to the registry
+  template<const char* format_string, class... Args>
+  BINARY_LOG_NOINLINE void log_sampled(Args&&... args)
+  {
+    log<format_string>(std::forward<Args>(args)...);
+    if (m_first_call) [[unlikely]] {
+      using site =
+          call_site<format_string, level::info, std::decay_t<Args>...>;
+      add_sampling_state(sampling_slot<site>()) = *m_first_call;
+      m_first_call.reset();
+    }
   }
 
-  template<class... Args>
-  inline void log(std::size_t pos, Args&&... args)
+  // Logs whatever the level set, as BINARY_LOG does, at info unless
+  // given a level
+  template<const char* format_string,
+           level severity = level::info,
+           class... Args>
+  inline void log(Args&&... args)
   {
+    using site = call_site<format_string, severity, std::decay_t<Args>...>;
     constexpr auto num_args = sizeof...(Args);
 
+    // The call site's id, then its index in this log: two loads once it
+    // has logged here
+    const auto id = site::id.load(std::memory_order_relaxed)
+        & ~call_site_registry::disabled;
+    uint16_t index = id < m_indices.size() ? m_indices[id] : 0;
+    if (index == 0) [[unlikely]] {
+      // Call sites without constants are in the registry since before
+      // main(), and naming added_before_main is what has it initialized
+      // then; the others are added at their first call
+      (void)site::added_before_main;
+      if (id == 0) {
+        site::add(args...);
+      }
+      index = add_call_site(site::id.load(std::memory_order_acquire)
+                            & ~call_site_registry::disabled);
+    }
+
     // Write to the main log file
     // SPEC:
     // <format-string-index> <arg1> <arg2> ... <argN>
@@ -83,8 +269,7 @@ public:
     //   <format-string-index> is the index of the format string in the index
     //   file <arg1> <arg2> ... <argN> are the arguments to the format string
     //     Each <arg> is a pair: <type, value>
-    uint16_t current_index = static_cast<uint16_t>(pos);
-    m_packer.pack_format_string_index(current_index);
+    m_packer.pack_format_string_index(static_cast<uint16_t>(index - 1));
 
     // Write the args
     if constexpr (num_args > 0) {
@@ -100,14 +285,136 @@ public:
 #define BINARY_LOG_CONCAT0(a, b) a##b
 #define BINARY_LOG_CONCAT(a, b) BINARY_LOG_CONCAT0(a, b)
 
-#define BINARY_LOG(logger, format_string, ...) \
+#define BINARY_LOG_FORMAT_STRING \
+  BINARY_LOG_CONCAT(__binary_log_format_string, __LINE__)
+
+// Logs at `severity` if the call site is enabled (see
+// call_site_control.hpp), checked before the args are evaluated
+#define BINARY_LOG_IF_ENABLED(logger, severity, format_string, ...) \
   { \
-    constexpr static char BINARY_LOG_CONCAT(__binary_log_format_string, \
-                                            __LINE__)[] = format_string; \
-    static std::size_t BINARY_LOG_CONCAT(__binary_log_format_string_id_pos, \
-                                         __LINE__) = \
-        logger.template log_index<BINARY_LOG_CONCAT(__binary_log_format_string, \
-                                           __LINE__)>(__VA_ARGS__); \
-    logger.template log(BINARY_LOG_CONCAT(__binary_log_format_string_id_pos, __LINE__), \
-               ##__VA_ARGS__); \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             severity>::of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled()) { \
+      logger.template log<BINARY_LOG_FORMAT_STRING, severity>(__VA_ARGS__); \
+    } \
   }
+
+#define BINARY_LOG(logger, ...) \
+  BINARY_LOG_IF_ENABLED(logger, ::binary_log::level::info, __VA_ARGS__)
+
+// Logs at `severity` if the logger's level lets it, a single branch before
+// the args are evaluated
+#define BINARY_LOG_AT_LEVEL(logger, severity, ...) \
+  { \
+    if (logger.should_log(severity)) { \
+      BINARY_LOG_IF_ENABLED(logger, severity, __VA_ARGS__) \
+    } \
+  }
+
+// Logs 1 in `n` calls, the first of every `n`, like BINARY_LOG; the
+// others cost a decrement and a compare, before the args are evaluated
+#define BINARY_LOG_SAMPLED(logger, n, format_string, ...) \
+  { \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             ::binary_log::level::info>:: \
+                     of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled() \
+        && logger.template sample<binary_log_call_site, n>()) \
+    { \
+      logger.template log_sampled<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+    } \
+  }
+
+// Logs at most `max_records` calls per `window` (a std::chrono duration)
+// like BINARY_LOG, and then a record of how many calls it suppressed,
+// which the unpacker prints as "[<count> suppressed] <format string>"
+#define BINARY_LOG_RATE_LIMITED( \
+    logger, max_records, window, format_string, ...) \
+  { \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             ::binary_log::level::info>:: \
+                     of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled() \
+        && logger.template rate_limit<binary_log_call_site, max_records>( \
+            window)) \
+    { \
+      logger.template log_sampled<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+    } \
+  }
+
+// Logs like BINARY_LOG while a tool is attached to the call site (see
+// probe.hpp), and costs a relaxed load of its semaphore otherwise
+#if defined(BINARY_LOG_HAS_PROBES)
+#  define BINARY_LOG_PROBE(logger, format_string, ...) \
+    { \
+      constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+      static std::atomic<uint16_t> binary_log_semaphore {0}; \
+      asm volatile(".pushsection binary_log_probes, \"aw?\"\n" \
+                   ".balign 8\n" \
+                   ".quad %c0\n" \
+                   ".quad %c1\n" \
+                   ".popsection" \
+                   : \
+                   : "i"(&binary_log_semaphore), \
+                     "i"(BINARY_LOG_FORMAT_STRING)); \
+      if (binary_log_semaphore.load(std::memory_order_relaxed) != 0) \
+          [[unlikely]] { \
+        using binary_log_call_site = decltype(::binary_log::call_site_for< \
+                                              BINARY_LOG_FORMAT_STRING, \
+                                              ::binary_log::level::info>:: \
+                                                  of(__VA_ARGS__)); \
+        if (binary_log_call_site::enabled()) { \
+          logger.template log<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+        } \
+      } \
+    }
+#else
+#  define BINARY_LOG_PROBE(logger, ...) BINARY_LOG(logger, __VA_ARGS__)
+#endif
+
+// The leveled macros below this level (BINARY_LOG_LEVEL_TRACE and so on)
+// expand to nothing: no code, no call site and no index entry
+#ifndef BINARY_LOG_ACTIVE_LEVEL
+#  define BINARY_LOG_ACTIVE_LEVEL BINARY_LOG_LEVEL_TRACE
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_TRACE
+#  define BINARY_LOG_TRACE(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::trace, __VA_ARGS__)
+#else
+#  define BINARY_LOG_TRACE(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_DEBUG
+#  define BINARY_LOG_DEBUG(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::debug, __VA_ARGS__)
+#else
+#  define BINARY_LOG_DEBUG(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_INFO
+#  define BINARY_LOG_INFO(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::info, __VA_ARGS__)
+#else
+#  define BINARY_LOG_INFO(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_WARN
+#  define BINARY_LOG_WARN(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::warn, __VA_ARGS__)
+#else
+#  define BINARY_LOG_WARN(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_ERROR
+#  define BINARY_LOG_ERROR(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::error, __VA_ARGS__)
+#else
+#  define BINARY_LOG_ERROR(logger, ...) {}
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <binary_log/detail/call_site.hpp>
+
+namespace binary_log
+{
+// Enables or disables the call sites of the process whose format string
+// contains `pattern` (all of them if it is empty) and returns how many
+// there are. A call site with a constant is only known from its first
+// call on, and is enabled then.
+inline std::size_t set_call_sites_enabled(std::string_view pattern,
+                                          bool enabled)
+{
+  auto& registry = call_site_registry::instance();
+  std::size_t matched = 0;
+  for (std::size_t index = 0, size = registry.size(); index < size; ++index) {
+    if (registry.format_string(index).find(pattern) != std::string_view::npos)
+    {
+      registry.set_enabled(index, enabled);
+      ++matched;
+    }
+  }
+  return matched;
+}
+
+inline std::size_t enable_call_sites(std::string_view pattern)
+{
+  return set_call_sites_enabled(pattern, true);
+}
+
+inline std::size_t disable_call_sites(std::string_view pattern)
+{
+  return set_call_sites_enabled(pattern, false);
+}
+
+// Switches call sites as a control file says, whenever it changes. Each
+// line of the file is
+//
+//   -<pattern>    to disable the call sites whose format string contains
+//                 the pattern
+//   +<pattern>    to enable them again
+//
+// applied in order to call sites that are all enabled to begin with, so
+// that the last matching line wins; other lines, such as # comments, are
+// skipped. Removing the file enables all call sites again. Call sites
+// added since the file was applied, such as those with constants at their
+// first call, are switched at the next poll.
+class call_site_control
+{
+  std::filesystem::path m_path;
+
+  // Write time of the file when it was last applied, if it was
+  std::optional<std::filesystem::file_time_type> m_applied;
+  std::vector<std::pair<bool, std::string>> m_rules;
+
+  // Number of call sites of the registry the rules were applied to
+  std::size_t m_switched {0};
+
+  // Switches the call sites from `first` on, each once, to the state the
+  // rules give it
+  void apply(std::size_t first)
+  {
+    auto& registry = call_site_registry::instance();
+    std::size_t index = first;
+    for (const auto size = registry.size(); index < size; ++index) {
+      const auto format_string = registry.format_string(index);
+      bool enabled = true;
+      for (const auto& [enable, pattern] : m_rules) {
+        if (format_string.find(pattern) != std::string_view::npos) {
+          enabled = enable;
+        }
+      }
+      registry.set_enabled(index, enabled);
+    }
+    m_switched = index;
+  }
+
+public:
+  explicit call_site_control(std::filesystem::path path)
+      : m_path(std::move(path))
+  {
+    poll();
+  }
+
+  // Applies the file if it changed since it was last applied, or to the
+  // call sites added since, and returns whether it did. Costs a stat()
+  // otherwise, to be called from a timer or an idle loop.
+  bool poll()
+  {
+    std::error_code error;
+    const auto write_time = std::filesystem::last_write_time(m_path, error);
+    if (error) {
+      if (!m_applied) {
+        return false;
+      }
+      m_applied.reset();
+      m_rules.clear();
+      apply(0);
+      return true;
+    }
+    if (m_applied == write_time) {
+      if (m_switched == call_site_registry::instance().size()) {
+        return false;
+      }
+      apply(m_switched);
+      return true;
+    }
+
+    m_rules.clear();
+    std::ifstream file(m_path);
+    for (std::string line; std::getline(file, line);) {
+      if (!line.empty() && (line.front() == '+' || line.front() == '-')) {
+        m_rules.emplace_back(line.front() == '+', line.substr(1));
+      }
+    }
+    apply(0);
+    m_applied = write_time;
+    return true;
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,266 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <binary_log/constant.hpp>
+#include <binary_log/detail/args.hpp>
+#include <binary_log/level.hpp>
+#include <binary_log/detail/repeats.hpp>
+
+namespace binary_log
+{
+// Index entries are encoded as
+//
+//   <format-string-length> <format-string>
+//   <number-of-arguments> <arg-type-1> <arg-type-2> ... <arg-type-N>
+//   <arg-1-is-const> <arg-1-value>? <arg-2-is-const> <arg-2-value>? ...
+//   <level>
+//
+// where only constants have their value in the entry (and none in the
+// log), and the level is one byte, with suppressed_count_flag set in the
+// entries of call_site::suppressed_count
+template<typename T>
+inline void append_index_bytes(std::string& entry, const T& value)
+{
+  entry.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void append_index_value(std::string& entry, const char* value)
+{
+  const auto size = static_cast<uint16_t>(std::strlen(value));
+  append_index_bytes(entry, size);
+  entry.append(value, size);
+}
+
+template<typename T>
+requires is_numeric_type<T> inline void append_index_value(std::string& entry,
+                                                           const T& value)
+{
+  append_index_bytes(entry, value);
+}
+
+template<typename T>
+requires is_string_type<T> inline void append_index_value(std::string& entry,
+                                                          const T& value)
+{
+  const auto size = static_cast<uint16_t>(value.size());
+  append_index_bytes(entry, size);
+  entry.append(value.data(), size);
+}
+
+template<typename T>
+inline void append_arg_type(std::string& entry)
+{
+  using type = std::decay_t<T>;
+  if constexpr (is_specialization<type, constant> {}) {
+    append_index_bytes(
+        entry, static_cast<uint8_t>(get_arg_type<typename type::type>()));
+  } else {
+    append_index_bytes(entry, static_cast<uint8_t>(get_arg_type<type>()));
+  }
+}
+
+template<typename T>
+inline void append_arg_constness(std::string& entry, const T& arg)
+{
+  if constexpr (is_specialization<std::decay_t<T>, constant> {}) {
+    append_index_bytes(entry, true);
+    append_index_value(entry, arg.value);
+  } else {
+    append_index_bytes(entry, false);
+  }
+}
+
+template<class... Args>
+inline std::string make_index_entry_head(std::string_view format_string)
+{
+  std::string entry;
+  const auto length = static_cast<uint16_t>(format_string.size());
+  append_index_bytes(entry, length);
+  entry.append(format_string.data(), length);
+  append_index_bytes(entry, static_cast<uint8_t>(sizeof...(Args)));
+  ((void)append_arg_type<Args>(entry), ...);
+  return entry;
+}
+
+// Entry of a call site logging `args`
+template<class... Args>
+inline std::string make_index_entry(std::string_view format_string,
+                                    level severity,
+                                    const Args&... args)
+{
+  auto entry = make_index_entry_head<Args...>(format_string);
+  ((void)append_arg_constness(entry, args), ...);
+  append_index_bytes(entry, severity);
+  return entry;
+}
+
+// Entry of a call site without constants, from the types of its args
+template<class... Args>
+inline std::string make_index_entry_of(std::string_view format_string,
+                                       level severity)
+{
+  auto entry = make_index_entry_head<Args...>(format_string);
+  entry.append(sizeof...(Args), '\0');
+  append_index_bytes(entry, severity);
+  return entry;
+}
+
+// The index entries of all the call sites of the process, numbered in the
+// order they are added. A logger writes the entry of a call site to its
+// index when the call site first logs to it, with an index of its own.
+class call_site_registry
+{
+  mutable std::mutex m_mutex;
+  std::deque<std::string> m_entries;
+  std::deque<std::atomic<std::size_t>*> m_ids;
+
+public:
+  // Format string indices are 16-bit in the packers and the runlength
+  // file (and varints in the log), and the last one starts a repeat, so
+  // that any logger can take all the call sites
+  static constexpr std::size_t max_call_sites = repeat_index;
+
+  // Set in the id of a call site while it is disabled, for the macros to
+  // check with the relaxed load of the id they make anyway, before they
+  // evaluate their args (see call_site_control.hpp)
+  static constexpr std::size_t disabled = ~(~std::size_t {0} >> 1);
+
+  static call_site_registry& instance()
+  {
+    static call_site_registry registry;
+    return registry;
+  }
+
+  // Adds `entry` for the call site whose index plus one is `id`, unless
+  // it is added already
+  void add(std::atomic<std::size_t>& id, std::string entry)
+  {
+    std::lock_guard lock(m_mutex);
+    if (id.load(std::memory_order_relaxed) == 0) {
+      if (m_entries.size() == max_call_sites) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+        throw std::length_error("too many call sites");
+#else
+        abort();
+#endif
+      }
+      m_entries.push_back(std::move(entry));
+      m_ids.push_back(&id);
+      id.store(m_entries.size(), std::memory_order_release);
+    }
+  }
+
+  std::size_t size() const
+  {
+    std::lock_guard lock(m_mutex);
+    return m_entries.size();
+  }
+
+  // Entries are never moved, so the view stays valid
+  std::string_view entry(std::size_t index) const
+  {
+    std::lock_guard lock(m_mutex);
+    return m_entries[index];
+  }
+
+  void set_enabled(std::size_t index, bool enabled)
+  {
+    std::lock_guard lock(m_mutex);
+    if (enabled) {
+      m_ids[index]->fetch_and(~disabled, std::memory_order_relaxed);
+    } else {
+      m_ids[index]->fetch_or(disabled, std::memory_order_relaxed);
+    }
+  }
+
+  std::string_view format_string(std::size_t index) const
+  {
+    const auto bytes = entry(index);
+    uint16_t length = 0;
+    std::memcpy(&length, bytes.data(), sizeof(length));
+    return bytes.substr(sizeof(length), length);
+  }
+};
+
+// The call site of one BINARY_LOG expansion, whose format string array is
+// its own, logging at `severity`. Call sites without constants are added
+// to the registry before main(), when their static members are
+// initialized; the others at their first call, since the values of their
+// constants are only known then.
+template<const char* format_string, level severity, class... Args>
+struct call_site
+{
+  static constexpr bool has_constants =
+      (is_specialization<Args, constant> {} || ...);
+
+  // A copy of the format string: the array of an expansion in a function
+  // that is never emitted is not emitted either, while the registration
+  // of its call site is
+  static constexpr std::size_t length =
+      std::char_traits<char>::length(format_string);
+  static constexpr auto text = []
+  {
+    std::array<char, length + 1> text {};
+    std::copy_n(format_string, length, text.begin());
+    return text;
+  }();
+
+  static constexpr std::string_view format() { return {text.data(), length}; }
+
+  // The call site that logs how many calls a rate-limited call site
+  // suppressed, with its format string
+  using suppressed_count =
+      call_site<format_string, counting_suppressed(severity), uint32_t>;
+
+  // Index of the call site plus one, or zero until it is added, with
+  // call_site_registry::disabled set while it is disabled
+  static inline std::atomic<std::size_t> id {0};
+
+  static bool enabled()
+  {
+    return (id.load(std::memory_order_relaxed) & call_site_registry::disabled)
+        == 0;
+  }
+
+  static void add(const Args&... args)
+  {
+    call_site_registry::instance().add(
+        id, make_index_entry(format(), severity, args...));
+  }
+
+  static bool add_before_main()
+  {
+    if constexpr (!has_constants) {
+      call_site_registry::instance().add(
+          id, make_index_entry_of<Args...>(format(), severity));
+    }
+    return true;
+  }
+
+  static inline const bool added_before_main = add_before_main();
+};
+
+// The call site that binary_log::log() logs `args` at is the type of
+// of(args...), for the macros to name it in an unevaluated operand,
+// without evaluating the args
+template<const char* format_string, level severity>
+struct call_site_for
+{
+  template<class... Args>
+  static call_site<format_string, severity, std::decay_t<Args>...> of(
+      Args&&... args);
+};
+
+}  // namespace binary_log
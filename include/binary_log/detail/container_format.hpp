@@ -0,0 +1,216 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+// A log, its index entries and its runs in one file or one byte stream
+// (see container_packer), for pipes, sockets and any log that is easier
+// to handle as a single file:
+//
+//   <container_header> <block> <block> ...
+//
+// A block holds whole records, and is written by the packer at once:
+//
+//   <block tag> <size: 4 bytes> <call sites> <records>
+//
+// The `size` bytes after the marker are the call site entries added by
+// the block, if any, and its records. Each call site entry is
+//
+//   <call site tag> <size: 4 bytes> <index entry>
+//
+// with the entry as in an index file; the call sites are numbered in the
+// order of their entries. Each record is
+//
+//   <code: varint> <args>
+//
+// where the code is the format string index plus container_tag::count,
+// the codes below it being the tags, unless it starts a run of records of
+// the same call site:
+//
+//   <run tag> <count: varint> <code: varint> <args>...
+//
+// where the code is followed by the args of all `count` records, or a
+// repeat (see repeats.hpp):
+//
+//   <repeat tag> <count: varint> <period: varint> <code: varint>...
+//
+// where the codes of the `period` call sites are followed by the args of
+// `count` records that log at them in turn. Varints are unsigned LEB128
+// (see varint.hpp), and each tag is a single byte. No run or repeat goes
+// on from one block to the next.
+//
+// A packer writing with index_coding::huffman moves the codes of the
+// records of each block, and those of its runs and repeats, into a bit
+// stream in
+// front of them:
+//
+//   <block tag> <size: 4 bytes> <call sites> <codes tag> <size: 4 bytes>
+//   <codes> <rest>
+//
+// where the `size` bytes of <codes> hold the codes with Huffman codes
+// built for the block (see huffman.hpp), and <rest> what remains of its
+// records: the count of each run, the count and period of each repeat,
+// and the args.
+struct container_header
+{
+  char magic[6];
+  uint16_t version;
+  uint32_t flags;  // none defined yet
+  uint32_t block_size;  // of the packer's buffer, as a hint for readers
+};
+static_assert(sizeof(container_header) == 16);
+
+static constexpr std::string_view container_magic = "BINLOG";
+// Version 1 had 4-byte run counts, version 2 2-byte tags and indices,
+// version 3 no coded blocks, version 4 no repeats, version 5 no level in
+// the call site entries
+static constexpr uint16_t container_version = 6;
+
+// Codes of the record positions that are not records
+namespace container_tag
+{
+static constexpr uint8_t run = 0;
+static constexpr uint8_t call_site = 1;
+static constexpr uint8_t block = 2;
+static constexpr uint8_t codes = 3;
+static constexpr uint8_t repeat = 4;
+static constexpr uint8_t count = 5;
+}  // namespace container_tag
+
+// How a container_packer writes the codes of its records: as varints,
+// or with Huffman codes, which spend fewer bits on the call sites that
+// log the most in each block at some cost to the packer at the end of
+// the block and to readers
+enum class index_coding
+{
+  varint,
+  huffman
+};
+
+static constexpr std::size_t container_marker_size =
+    sizeof(uint8_t) + sizeof(uint32_t);
+
+inline uint64_t container_code(std::size_t index)
+{
+  return index + container_tag::count;
+}
+
+[[noreturn]] inline void invalid_container(const char* reason)
+{
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+  throw std::runtime_error(std::string("Invalid log container: ") + reason);
+#else
+  (void)reason;
+  abort();
+#endif
+}
+
+inline bool has_container_header(std::string_view data)
+{
+  return data.starts_with(container_magic);
+}
+
+// The header at the start of `data`, which must be a container whose
+// version this reader knows
+inline container_header read_container_header(std::string_view data)
+{
+  container_header header;
+  if (data.size() < sizeof(header) || !has_container_header(data)) {
+    invalid_container("no container header");
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.version != container_version) {
+    invalid_container(("unsupported version "
+                       + std::to_string(header.version))
+                          .c_str());
+  }
+  return header;
+}
+
+// Reads the tag and size of the marker at `offset` of `data`
+inline bool read_container_marker(std::string_view data,
+                                  std::size_t offset,
+                                  uint8_t& tag,
+                                  uint32_t& size)
+{
+  if (offset + container_marker_size > data.size()) {
+    return false;
+  }
+  std::memcpy(&tag, data.data() + offset, sizeof(tag));
+  std::memcpy(&size, data.data() + offset + sizeof(tag), sizeof(size));
+  return true;
+}
+
+// The call site entries at the start of `block`, the bytes that follow a
+// block marker
+inline std::string_view container_call_sites(std::string_view block)
+{
+  std::size_t end = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(block, end, tag, size)
+         && tag == container_tag::call_site)
+  {
+    if (size > block.size() - end - container_marker_size) {
+      invalid_container("truncated call site");
+    }
+    end += container_marker_size + size;
+  }
+  return block.substr(0, end);
+}
+
+// Adds the entries of `call_sites`, as returned by container_call_sites(),
+// to `index_table`. The entries view `call_sites`.
+inline void parse_container_call_sites(std::string_view call_sites,
+                                       std::vector<index_entry>& index_table)
+{
+  std::size_t offset = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(call_sites, offset, tag, size)) {
+    const auto bytes = call_sites.substr(offset + container_marker_size, size);
+    auto entries = index_parser(bytes).parse();
+    if (entries.size() != 1 || entries.front().bytes.size() != size) {
+      invalid_container("malformed call site");
+    }
+    index_table.push_back(std::move(entries.front()));
+    offset += container_marker_size + size;
+  }
+}
+
+// Adds the call sites of the blocks of `log`, the container after its
+// header, to `index_table` and the offsets of the blocks to `blocks`,
+// going from block to block. Returns the size of the whole blocks: the
+// log of a logger that is still writing may end in part of a block.
+inline std::size_t scan_container(std::string_view log,
+                                  std::vector<index_entry>& index_table,
+                                  std::vector<std::size_t>& blocks)
+{
+  std::size_t offset = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(log, offset, tag, size)) {
+    if (tag != container_tag::block) {
+      invalid_container("expected a block");
+    }
+    if (size > log.size() - offset - container_marker_size) {
+      break;
+    }
+    const auto block = log.substr(offset + container_marker_size, size);
+    parse_container_call_sites(container_call_sites(block), index_table);
+    blocks.push_back(offset);
+    offset += container_marker_size + size;
+  }
+  return offset;
+}
+
+}  // namespace binary_log
@@ -0,0 +1,496 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/constant.hpp>
+#include <binary_log/detail/args.hpp>
+#include <binary_log/detail/container_format.hpp>
+#include <binary_log/detail/huffman.hpp>
+#include <binary_log/detail/repeats.hpp>
+
+namespace binary_log
+{
+/// This Packer implementation writes the log, its index entries and its
+/// runs to a single file (see container_format.hpp), through one buffer,
+/// instead of a log file and its side files. A pipe or a socket is enough
+/// to carry it, e.g.
+///
+///   binary_log::binary_log<binary_log::container_packer<>> log("-");
+///
+/// logs to stdout, for `app | unpacker -`. The records are written in
+/// blocks of about `log_buffer_size` bytes, which end at a record, and at
+/// every flush().
+///
+/// With index_coding::huffman, the codes of the records of each block are
+/// kept apart and Huffman coded as the block is closed, e.g.
+///
+///   binary_log::binary_log<binary_log::container_packer<
+///       64 * 1024, binary_log::index_coding::huffman>> log("app.log");
+///
+/// so that a call site logging most of the records of a block spends a
+/// bit or two on each instead of a byte.
+template<size_t log_buffer_size = 64 * 1024,
+         index_coding coding = index_coding::varint>
+class container_packer
+{
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  std::filesystem::path m_path;
+  std::FILE* m_file;
+
+  std::vector<uint8_t> m_buffer;
+  std::vector<uint8_t> m_index_buffer;  // entries of new call sites
+
+  std::size_t m_block_start {npos};  // of the open block in m_buffer
+
+  // With index_coding::huffman, the codes of the open block, whose
+  // records start at m_records_start of m_buffer
+  std::vector<uint32_t> m_codes;
+  std::size_t m_records_start {0};
+  huffman_encoder m_encoder;
+  std::vector<uint8_t> m_encoded_codes;
+
+  // A tagged run costs the tag and the count (2 bytes up to 127 records)
+  // more than the code of its first record, and saves the code of the
+  // others: records only become a run from the min_run_length-th record
+  // of the same call site in a row
+  static constexpr std::size_t min_run_length = 3;
+
+  // The last records of the same call site: m_record_offsets holds their
+  // offsets in m_buffer until they become a run, and m_run_offset the
+  // offset of the count of the run, which takes m_run_count_size bytes.
+  // Coded records start with their args in m_buffer.
+  std::size_t m_record_offsets[min_run_length - 1] {};
+  std::size_t m_run_offset {0};
+  std::size_t m_run_count_size {0};
+  uint16_t m_run_index {0};
+  std::size_t m_run_count {0};
+  std::vector<uint8_t> m_run_args;
+
+  // The repeat of the open block (see repeats.hpp), if m_repeat_count > 0:
+  // the records that log at m_repeat_call_sites in turn, whose count takes
+  // m_repeat_count_size bytes at m_repeat_offset of m_buffer
+  repeat_detector m_repeats;
+  uint16_t m_repeat_call_sites[max_repeat_period] {};
+  std::size_t m_repeat_period {0};
+  std::size_t m_repeat_position {0};  // of the next record
+  std::size_t m_repeat_count {0};
+  std::size_t m_repeat_offset {0};
+  std::size_t m_repeat_count_size {0};
+
+  template<typename T, std::size_t size>
+  void buffer_or_write(T* input)
+  {
+    buffer_or_write(input, size);
+  }
+
+  template<typename T>
+  void buffer_or_write(T* input, std::size_t size)
+  {
+    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    m_buffer.insert(m_buffer.end(), byte_array, byte_array + size);
+  }
+
+  template<typename T>
+  constexpr void buffer_or_write_index_file(T* input, std::size_t size)
+  {
+    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    m_index_buffer.insert(m_index_buffer.end(), byte_array, byte_array + size);
+  }
+
+  void write_marker(uint8_t tag, uint32_t size)
+  {
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&tag);
+    buffer_or_write<uint32_t, sizeof(uint32_t)>(&size);
+  }
+
+  void write_code(uint16_t index)
+  {
+    const auto value = container_code(index);
+    if constexpr (coding == index_coding::huffman) {
+      m_codes.push_back(static_cast<uint32_t>(value));
+      return;
+    }
+    if (value < 0x80) {
+      auto code = static_cast<uint8_t>(value);
+      buffer_or_write<uint8_t, sizeof(uint8_t)>(&code);
+      return;
+    }
+    uint8_t code[max_varint_size];
+    buffer_or_write(code, write_varint(code, value));
+  }
+
+  void write_tag(uint8_t tag)
+  {
+    if constexpr (coding == index_coding::huffman) {
+      m_codes.push_back(tag);
+      return;
+    }
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&tag);
+  }
+
+  void close_block()
+  {
+    end_repeat();
+    if (m_block_start == npos) {
+      return;
+    }
+    if (coding == index_coding::huffman && !m_codes.empty()) {
+      m_encoded_codes.resize(container_marker_size);
+      m_encoder.encode(m_codes, m_encoded_codes);
+      m_encoded_codes[0] = container_tag::codes;
+      const auto size = static_cast<uint32_t>(m_encoded_codes.size()
+                                              - container_marker_size);
+      std::memcpy(&m_encoded_codes[sizeof(uint8_t)], &size, sizeof(size));
+      m_buffer.insert(
+          m_buffer.begin() + static_cast<std::ptrdiff_t>(m_records_start),
+          m_encoded_codes.begin(),
+          m_encoded_codes.end());
+      m_codes.clear();
+    }
+    const auto size = static_cast<uint32_t>(m_buffer.size() - m_block_start
+                                            - container_marker_size);
+    auto* marker = m_buffer.data() + m_block_start;
+    std::memcpy(marker + sizeof(uint8_t), &size, sizeof(size));
+    m_block_start = npos;
+  }
+
+  // Runs do not go on from one block to the next
+  void open_block()
+  {
+    close_block();
+    m_block_start = m_buffer.size();
+    write_marker(container_tag::block, 0);
+    m_records_start = m_buffer.size();
+    m_run_count = 0;
+  }
+
+  // Rewrites the last records, of m_run_index, as a run that the next
+  // record joins
+  void start_run()
+  {
+    if constexpr (coding == index_coding::huffman) {
+      // The run only takes its count in front of the args
+      m_codes.resize(m_codes.size() - m_run_count);
+      m_codes.push_back(container_tag::run);
+      m_codes.push_back(static_cast<uint32_t>(container_code(m_run_index)));
+      m_run_count++;
+      m_run_offset = m_record_offsets[0];
+      m_run_count_size = varint_size(m_run_count);
+      uint8_t count[max_varint_size];
+      write_varint(count, m_run_count);
+      m_buffer.insert(m_buffer.begin()
+                          + static_cast<std::ptrdiff_t>(m_run_offset),
+                      count,
+                      count + m_run_count_size);
+      return;
+    }
+    const auto first = m_record_offsets[0];
+    const auto code_size = varint_size(container_code(m_run_index));
+    m_run_args.clear();
+    for (std::size_t i = 0; i < m_run_count; ++i) {
+      const auto end =
+          i + 1 < m_run_count ? m_record_offsets[i + 1] : m_buffer.size();
+      m_run_args.insert(m_run_args.end(),
+                        m_buffer.begin() + static_cast<std::ptrdiff_t>(
+                            m_record_offsets[i] + code_size),
+                        m_buffer.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+    m_run_count++;
+    m_run_offset = first + sizeof(uint8_t);
+    m_run_count_size = varint_size(m_run_count);
+    m_buffer.resize(m_run_offset + m_run_count_size);
+    m_buffer[first] = container_tag::run;
+    write_varint(m_buffer.data() + m_run_offset, m_run_count);
+    write_code(m_run_index);
+    m_buffer.insert(m_buffer.end(), m_run_args.begin(), m_run_args.end());
+  }
+
+  // Starts a repeat of `period` call sites with the record of `index`
+  void start_repeat(uint16_t index, std::size_t period)
+  {
+    write_tag(container_tag::repeat);
+    m_repeat_offset = m_buffer.size();
+    m_repeat_count = 1;
+    m_repeat_count_size = 1;
+    const uint8_t header[2] = {1, static_cast<uint8_t>(period)};
+    buffer_or_write<const uint8_t, sizeof(header)>(header);
+    for (std::size_t i = 0; i < period; ++i) {
+      m_repeat_call_sites[i] = i == 0 ? index : m_repeats.at(period - i);
+      write_code(m_repeat_call_sites[i]);
+    }
+    m_repeat_period = period;
+    m_repeat_position = 1;
+  }
+
+  // Counts the record of `index` in the repeat, if it logs at the next of
+  // its call sites
+  bool continue_repeat(uint16_t index)
+  {
+    if (index != m_repeat_call_sites[m_repeat_position]) {
+      return false;
+    }
+    m_repeat_count++;
+    if (varint_size(m_repeat_count) > m_repeat_count_size) {
+      m_buffer.insert(
+          m_buffer.begin() + static_cast<std::ptrdiff_t>(m_repeat_offset), 0);
+      m_repeat_count_size++;
+    }
+    write_varint(m_buffer.data() + m_repeat_offset, m_repeat_count);
+    if (++m_repeat_position == m_repeat_period) {
+      m_repeat_position = 0;
+    }
+    return true;
+  }
+
+  // The next record of the next call site starts another repeat
+  void end_repeat()
+  {
+    if (m_repeat_count > 0) {
+      m_repeats.resume(
+          m_repeat_call_sites, m_repeat_period, m_repeat_position);
+      m_repeat_count = 0;
+    }
+  }
+
+  // New call sites open a block, so that readers find their entries
+  // without decoding the records
+  void write_call_sites()
+  {
+    open_block();
+    m_buffer.insert(
+        m_buffer.end(), m_index_buffer.begin(), m_index_buffer.end());
+    m_index_buffer.clear();
+    m_records_start = m_buffer.size();
+  }
+
+  void write_blocks()
+  {
+    close_block();
+    fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    m_buffer.clear();
+    m_run_count = 0;
+  }
+
+public:
+  // Writes to stdout if `path` is "-"
+  container_packer(const std::filesystem::path& path) : m_path(path)
+  {
+    if (m_path == "-") {
+      m_file = stdout;
+    } else {
+      m_file = fopen(m_path.c_str(), "wb");
+    }
+    if (m_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::invalid_argument("fopen failed");
+#else
+      abort();
+#endif
+    }
+    // A record may overshoot the block a little
+    m_buffer.reserve(log_buffer_size + 4096);
+
+    container_header header {};
+    std::memcpy(header.magic, container_magic.data(), sizeof(header.magic));
+    header.version = container_version;
+    header.block_size = static_cast<uint32_t>(log_buffer_size);
+    fwrite(&header, sizeof(header), 1, m_file);
+  }
+
+  container_packer(const char* path)
+      : container_packer(std::filesystem::path {path})
+  {
+  }
+
+  ~container_packer()
+  {
+    flush();
+    if (m_file != stdout) {
+      fclose(m_file);
+    }
+  }
+
+  std::filesystem::path get_log_path() const
+  {
+    return m_path;
+  }
+
+  void flush()
+  {
+    if (!m_index_buffer.empty()) {
+      write_call_sites();
+    }
+    write_blocks();
+    fflush(m_file);
+  }
+
+  template<typename T>
+  inline void write_arg_value_to_log_file(T&& input) = delete;
+
+  inline void write_arg_value_to_log_file(const char* input)
+  {
+    uint16_t size = static_cast<uint16_t>(std::strlen(input));
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input, size);
+  }
+
+  inline void write_arg_value_to_log_file(char input)
+  {
+    buffer_or_write<char, sizeof(char)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(bool input)
+  {
+    buffer_or_write<bool, sizeof(bool)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint8_t input)
+  {
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint16_t input)
+  {
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint32_t input)
+  {
+    buffer_or_write<uint32_t, sizeof(uint32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint64_t input)
+  {
+    buffer_or_write<uint64_t, sizeof(uint64_t)>(&input);
+  }
+
+  template<typename U>
+  inline void write_arg_value_to_log_file(U &input) requires (std::is_same_v<U, std::size_t>)
+  {
+    buffer_or_write<U, sizeof(U)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int8_t input)
+  {
+    buffer_or_write<int8_t, sizeof(int8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int16_t input)
+  {
+    buffer_or_write<int16_t, sizeof(int16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int32_t input)
+  {
+    buffer_or_write<int32_t, sizeof(int32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int64_t input)
+  {
+    buffer_or_write<int64_t, sizeof(int64_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(float input)
+  {
+    buffer_or_write<float, sizeof(float)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(double input)
+  {
+    buffer_or_write<double, sizeof(double)>(&input);
+  }
+
+  template<typename T>
+  requires is_string_type<T> inline void write_arg_value_to_log_file(T&& input)
+  {
+    uint16_t size = static_cast<uint16_t>(input.size());
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input.data(), size);
+  }
+
+  template<typename T>
+  constexpr inline void pack_arg(T&& input)
+  {
+    if constexpr (!is_specialization<T, constant> {}) {
+      write_arg_value_to_log_file(std::forward<T>(input));
+    }
+  }
+
+  constexpr inline void pack_format_string_index(uint16_t index)
+  {
+    // A full buffer is written before the next record
+    if (m_buffer.size() >= log_buffer_size) {
+      write_blocks();
+    }
+    if (!m_index_buffer.empty()) {
+      write_call_sites();
+    } else if (m_block_start == npos) {
+      open_block();
+    }
+
+    if (m_repeat_count > 0) [[unlikely]] {
+      if (continue_repeat(index)) {
+        return;
+      }
+      end_repeat();
+    }
+
+    if (m_run_count >= min_run_length && m_run_index == index) {
+      m_run_count++;
+      if (varint_size(m_run_count) > m_run_count_size) {
+        // Rarely: the count needs one more byte, in front of the args
+        m_buffer.insert(m_buffer.begin()
+                            + static_cast<std::ptrdiff_t>(m_run_offset),
+                        0);
+        m_run_count_size++;
+      }
+      write_varint(m_buffer.data() + m_run_offset, m_run_count);
+    } else if (m_run_count == min_run_length - 1 && m_run_index == index) {
+      start_run();
+    } else {
+      if (m_run_count == 0 || m_run_index != index
+          || m_run_count >= min_run_length)
+      {
+        // Only call sites of one record each make up a repeat
+        if (m_run_count > 1) {
+          m_repeats.clear();
+        }
+        if (const auto period = m_repeats.add(index)) [[unlikely]] {
+          start_repeat(index, period);
+          m_run_count = 0;
+          return;
+        }
+        m_run_index = index;
+        m_run_count = 0;
+      }
+      m_record_offsets[m_run_count++] = m_buffer.size();
+      write_code(index);
+    }
+  }
+
+  template<class... Args>
+  constexpr inline void update_log_file(Args&&... args)
+  {
+    ((void)pack_arg(std::forward<Args>(args)), ...);
+  }
+
+  // The entries of new call sites go out with the next record
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
+  {
+    const uint8_t tag = container_tag::call_site;
+    const auto size = static_cast<uint32_t>(entry.size());
+    buffer_or_write_index_file(&tag, sizeof(tag));
+    buffer_or_write_index_file(&size, sizeof(size));
+    buffer_or_write_index_file(entry.data(), entry.size());
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,332 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <binary_log/detail/container_format.hpp>
+#include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+// Canonical Huffman codes for the codes of the records of a container
+// block (see container_format.hpp), which are written as
+//
+//   <symbol count: varint> (<delta: varint> <length: 1 byte>)...
+//   <code count: varint> <bits>
+//
+// listing the symbols that occur in the block in increasing order, each
+// as its difference from the previous one (the first from 0), with the
+// length in bits of its code. Codes are assigned in order of length, then
+// of symbol, and the bits hold the codes of `code count` symbols, most
+// significant bit first, up to the end of the codes.
+static constexpr unsigned max_huffman_code_length = 24;
+
+class huffman_encoder
+{
+  struct node
+  {
+    uint64_t weight;
+    uint32_t id;
+
+    bool operator>(const node& other) const
+    {
+      return weight > other.weight;
+    }
+  };
+
+  // By symbol, kept zero for the symbols of no block
+  std::vector<uint32_t> m_frequencies;
+  std::vector<uint32_t> m_codes;
+  std::vector<uint8_t> m_lengths;
+
+  // Scratch space, kept from block to block
+  std::vector<uint32_t> m_symbols;  // of the block, in increasing order
+  std::vector<uint64_t> m_weights;
+  std::vector<uint32_t> m_parents;
+  std::vector<uint8_t> m_depths;
+  std::vector<node> m_heap;
+
+  // Code lengths from a Huffman tree of the symbol frequencies. Rare
+  // symbols of large alphabets may be deeper than the longest code: the
+  // frequencies are then halved, flattening the tree, until they fit.
+  void build_lengths()
+  {
+    const auto count = m_symbols.size();
+    if (count == 1) {
+      m_lengths[m_symbols.front()] = 1;
+      return;
+    }
+
+    m_weights.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      m_weights[i] = m_frequencies[m_symbols[i]];
+    }
+    for (;;) {
+      // Leaves are the nodes [0, count), and each internal node comes
+      // after its children
+      m_heap.clear();
+      for (std::size_t i = 0; i < count; ++i) {
+        m_heap.push_back({m_weights[i], static_cast<uint32_t>(i)});
+      }
+      std::make_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+      m_parents.resize(2 * count - 1);
+      auto next = static_cast<uint32_t>(count);
+      while (m_heap.size() > 1) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+        const auto first = m_heap.back();
+        m_heap.pop_back();
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+        const auto second = m_heap.back();
+        m_heap.pop_back();
+        m_parents[first.id] = next;
+        m_parents[second.id] = next;
+        m_heap.push_back({first.weight + second.weight, next++});
+        std::push_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+      }
+
+      m_depths.assign(2 * count - 1, 0);
+      unsigned longest = 0;
+      for (auto i = 2 * count - 1; i-- > 0;) {
+        if (i + 1 < 2 * count - 1) {
+          m_depths[i] = static_cast<uint8_t>(m_depths[m_parents[i]] + 1);
+        }
+        if (i < count) {
+          longest = std::max<unsigned>(longest, m_depths[i]);
+        }
+      }
+      if (longest <= max_huffman_code_length) {
+        break;
+      }
+      for (auto& weight : m_weights) {
+        weight = 1 + weight / 2;
+      }
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+      m_lengths[m_symbols[i]] = m_depths[i];
+    }
+  }
+
+  void assign_codes()
+  {
+    // Symbols by length, then symbol
+    std::stable_sort(m_symbols.begin(),
+                     m_symbols.end(),
+                     [this](uint32_t a, uint32_t b)
+                     { return m_lengths[a] < m_lengths[b]; });
+    uint32_t code = 0;
+    unsigned length = m_lengths[m_symbols.front()];
+    for (const auto symbol : m_symbols) {
+      code <<= m_lengths[symbol] - length;
+      length = m_lengths[symbol];
+      m_codes[symbol] = code++;
+    }
+  }
+
+  static void append_varint(std::vector<uint8_t>& out, uint64_t value)
+  {
+    uint8_t bytes[max_varint_size];
+    out.insert(out.end(), bytes, bytes + write_varint(bytes, value));
+  }
+
+public:
+  // Appends the table and the codes of `symbols` to `out`
+  void encode(const std::vector<uint32_t>& symbols, std::vector<uint8_t>& out)
+  {
+    m_symbols.clear();
+    for (const auto symbol : symbols) {
+      if (symbol >= m_frequencies.size()) {
+        m_frequencies.resize(symbol + 1);
+        m_codes.resize(symbol + 1);
+        m_lengths.resize(symbol + 1);
+      }
+      if (m_frequencies[symbol]++ == 0) {
+        m_symbols.push_back(symbol);
+      }
+    }
+    std::sort(m_symbols.begin(), m_symbols.end());
+
+    append_varint(out, m_symbols.size());
+    if (!m_symbols.empty()) {
+      build_lengths();
+      uint32_t previous = 0;
+      for (const auto symbol : m_symbols) {
+        append_varint(out, symbol - previous);
+        out.push_back(m_lengths[symbol]);
+        previous = symbol;
+      }
+      assign_codes();
+    }
+
+    append_varint(out, symbols.size());
+    for (const auto symbol : m_symbols) {
+      m_frequencies[symbol] = 0;
+    }
+
+    // Whole bytes leave the top of `pending`
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+    for (const auto symbol : symbols) {
+      pending = (pending << m_lengths[symbol]) | m_codes[symbol];
+      pending_bits += m_lengths[symbol];
+      while (pending_bits >= 8) {
+        pending_bits -= 8;
+        out.push_back(static_cast<uint8_t>(pending >> pending_bits));
+      }
+    }
+    if (pending_bits > 0) {
+      out.push_back(static_cast<uint8_t>(pending << (8 - pending_bits)));
+    }
+  }
+};
+
+class huffman_decoder
+{
+  // Codes up to lookup_bits long are decoded with one lookup of the
+  // next bits, as (symbol << 8) | length; longer codes, a length at a
+  // time
+  static constexpr unsigned lookup_bits = 11;
+
+  unsigned m_lookup_bits {0};
+  unsigned m_max_length {0};
+  std::vector<uint32_t> m_lookup;
+  std::vector<uint32_t> m_sorted;  // symbols in the order of their codes
+  std::array<uint32_t, max_huffman_code_length + 1> m_first_code {};
+  std::array<uint32_t, max_huffman_code_length + 1> m_first_position {};
+  std::array<uint32_t, max_huffman_code_length + 1> m_count {};
+
+  // Compilers make a single instruction of this
+  static constexpr uint64_t byteswap(uint64_t value)
+  {
+    value = ((value & 0x00FF00FF00FF00FF) << 8)
+        | ((value >> 8) & 0x00FF00FF00FF00FF);
+    value = ((value & 0x0000FFFF0000FFFF) << 16)
+        | ((value >> 16) & 0x0000FFFF0000FFFF);
+    return (value << 32) | (value >> 32);
+  }
+
+  // The 32 bits at bit `position` of `bits`, past its end as zeros
+  static uint32_t peek(std::string_view bits, std::size_t position)
+  {
+    const auto byte = position / 8;
+    uint64_t window = 0;
+    if (byte + sizeof(window) <= bits.size()) {
+      std::memcpy(&window, bits.data() + byte, sizeof(window));
+      if constexpr (std::endian::native == std::endian::little) {
+        window = byteswap(window);
+      }
+    } else {
+      for (std::size_t i = 0; byte + i < bits.size(); ++i) {
+        window |= uint64_t {static_cast<uint8_t>(bits[byte + i])}
+            << (56 - 8 * i);
+      }
+    }
+    return static_cast<uint32_t>((window << (position % 8)) >> 32);
+  }
+
+public:
+  // Reads the table at `offset` of `data`, and moves past it
+  void read_table(std::string_view data, std::size_t& offset)
+  {
+    const auto count = read_varint(data, offset);
+    if (count > data.size() - std::min(offset, data.size())) {
+      invalid_container("truncated code table");
+    }
+
+    m_sorted.clear();
+    m_count.fill(0);
+    m_max_length = 0;
+    std::vector<uint8_t> lengths;
+    lengths.reserve(count);
+    uint64_t symbol = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+      symbol += read_varint(data, offset);
+      if (offset >= data.size()) {
+        invalid_container("truncated code table");
+      }
+      const auto length = static_cast<uint8_t>(data[offset++]);
+      if (length == 0 || length > max_huffman_code_length
+          || symbol > std::numeric_limits<uint32_t>::max() >> 8)
+      {
+        invalid_container("malformed code table");
+      }
+      m_sorted.push_back(static_cast<uint32_t>(symbol));
+      lengths.push_back(length);
+      m_count[length]++;
+      m_max_length = std::max<unsigned>(m_max_length, length);
+    }
+
+    // Canonical order: by length, then symbol
+    std::vector<uint32_t> order(m_sorted.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = static_cast<uint32_t>(i);
+    }
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&lengths](uint32_t a, uint32_t b)
+                     { return lengths[a] < lengths[b]; });
+
+    uint64_t code = 0;
+    uint32_t position = 0;
+    for (unsigned length = 1; length <= m_max_length; ++length) {
+      m_first_code[length] = static_cast<uint32_t>(code);
+      m_first_position[length] = position;
+      code += m_count[length];
+      position += m_count[length];
+      if (code > (uint64_t {1} << length)) {
+        invalid_container("oversubscribed code table");
+      }
+      code <<= 1;
+    }
+
+    m_lookup_bits = std::min(lookup_bits, m_max_length);
+    m_lookup.assign(std::size_t {1} << m_lookup_bits, 0);
+    std::vector<uint32_t> sorted(m_sorted.size());
+    std::vector<uint32_t> next_code(m_first_code.begin(), m_first_code.end());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      const auto symbol = m_sorted[order[i]];
+      const auto length = lengths[order[i]];
+      sorted[i] = symbol;
+      const auto symbol_code = next_code[length]++;
+      if (length <= m_lookup_bits) {
+        const auto first = symbol_code << (m_lookup_bits - length);
+        std::fill_n(m_lookup.begin() + first,
+                    std::size_t {1} << (m_lookup_bits - length),
+                    (symbol << 8) | length);
+      }
+    }
+    m_sorted = std::move(sorted);
+  }
+
+  // Decodes the symbol at bit `position` of `bits`, and moves past it
+  uint32_t decode(std::string_view bits, std::size_t& position) const
+  {
+    const auto window = peek(bits, position);
+    if (m_lookup_bits > 0) {
+      const auto entry = m_lookup[window >> (32 - m_lookup_bits)];
+      if (entry != 0) {
+        position += entry & 0xFF;
+        return entry >> 8;
+      }
+    }
+    for (auto length = m_lookup_bits + 1; length <= m_max_length; ++length) {
+      const auto code = window >> (32 - length);
+      if (code - m_first_code[length] < m_count[length]) {
+        position += length;
+        return m_sorted[m_first_position[length] + code
+                        - m_first_code[length]];
+      }
+    }
+    invalid_container("invalid code");
+  }
+};
+
+}  // namespace binary_log
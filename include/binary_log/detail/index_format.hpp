@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace binary_log
+{
+// An index file starts with a header, followed by the entries of its call
+// sites:
+//
+//   <magic: "BLINDX"> <version: 2 bytes>
+//
+// The version is that of the format of the log file and its side files
+// as a whole. The index files of older versions of binary_log had no
+// header, and their logs, whose format string indices were single bytes
+// and whose entries did not end with the level of the call site, cannot
+// be read with this one. Version 1 keyed runlength entries by format
+// string index instead of by log file offset.
+struct index_header
+{
+  char magic[6];
+  uint16_t version;
+};
+static_assert(sizeof(index_header) == 8);
+
+static constexpr std::string_view index_magic = "BLINDX";
+static constexpr uint16_t index_version = 2;
+
+inline index_header make_index_header()
+{
+  index_header header {};
+  std::memcpy(header.magic, index_magic.data(), sizeof(header.magic));
+  header.version = index_version;
+  return header;
+}
+
+[[noreturn]] inline void invalid_index(const std::string& reason)
+{
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+  throw std::runtime_error("Invalid index file: " + reason);
+#else
+  (void)reason;
+  abort();
+#endif
+}
+
+// The entries of the index file `data`, after its header. An empty file
+// (of a logger that has just opened it) has none.
+inline std::string_view index_file_entries(std::string_view data)
+{
+  if (data.empty()) {
+    return data;
+  }
+  if (data.size() < sizeof(index_header) || !data.starts_with(index_magic)) {
+    invalid_index(
+        "no header, the log was written by an older version of "
+        "binary_log");
+  }
+  index_header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.version != index_version) {
+    invalid_index("unsupported version " + std::to_string(header.version)
+                  + " (this reader decodes version "
+                  + std::to_string(index_version) + ")");
+  }
+  return data.substr(sizeof(index_header));
+}
+
+}  // namespace binary_log
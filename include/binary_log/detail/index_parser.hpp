@@ -0,0 +1,191 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/args.hpp>
+#include <binary_log/detail/index_format.hpp>
+#include <binary_log/level.hpp>
+
+namespace binary_log
+{
+// One row of the index file: the static part of a call site
+struct index_entry
+{
+  struct arg
+  {
+    fmt_arg_type type;
+    bool is_constant;
+
+    // if constant, this will have the static data
+    std::string_view arg_data;
+  };
+
+  std::string_view format_string;
+  std::vector<arg> args;
+  ::binary_log::level level {::binary_log::level::info};
+
+  // Whether the records of this entry have one arg, the number of calls
+  // that the rate-limited call site of the same format string suppressed
+  bool counts_suppressed {false};
+
+  // Number of bytes each record of this entry occupies in the log file
+  // (after the index) when none of its logged args are strings
+  std::optional<std::size_t> fixed_record_size;
+
+  // The entry as it is in the index file
+  std::string_view bytes;
+};
+
+// Parses the contents of an index file.
+//
+// The entries are views into `buffer`, which must outlive them.
+class index_parser
+{
+  std::string_view m_buffer;
+  std::size_t m_index {0};  // into m_buffer
+
+  std::vector<index_entry> m_entries;
+
+  bool available(std::size_t size) const
+  {
+    return m_buffer.size() - m_index >= size;
+  }
+
+  uint8_t next_byte()
+  {
+    return static_cast<uint8_t>(m_buffer[m_index++]);
+  }
+
+  uint16_t next_two_bytes()
+  {
+    uint16_t bytes;
+    std::memcpy(&bytes, m_buffer.data() + m_index, sizeof(bytes));
+    m_index += sizeof(bytes);
+    return bytes;
+  }
+
+  // Returns false, leaving m_index unchanged, if the buffer ends before
+  // the entry does (the writer may not have flushed all of it yet)
+  bool parse_entry()
+  {
+    const std::size_t entry_start = m_index;
+    auto incomplete = [&]
+    {
+      m_index = entry_start;
+      return false;
+    };
+
+    index_entry entry;
+
+    // First, parse the size of the format string
+    if (!available(sizeof(uint16_t))) {
+      return incomplete();
+    }
+    const std::size_t format_string_size = next_two_bytes();
+
+    // Next, parse the format string and the number of arguments
+    if (!available(format_string_size + 1)) {
+      return incomplete();
+    }
+    entry.format_string = m_buffer.substr(m_index, format_string_size);
+    m_index += format_string_size;
+    const std::size_t num_args = next_byte();
+
+    // Parse the arg type of each arg
+    // This is 1 byte * num_args
+    if (!available(num_args)) {
+      return incomplete();
+    }
+    entry.args.resize(num_args);
+    for (auto& arg : entry.args) {
+      arg.type = static_cast<fmt_arg_type>(next_byte());
+    }
+
+    // The next set of bytes will have the format
+    // <is_constant> <arg-value>? <is_constant> <arg-value>? ...
+    for (auto& arg : entry.args) {
+      if (!available(1)) {
+        return incomplete();
+      }
+      arg.is_constant = next_byte();
+      if (!arg.is_constant) {
+        continue;
+      }
+
+      std::size_t size = 0;
+      if (arg.type == fmt_arg_type::type_string) {
+        // the next two bytes will be the size of the string
+        if (!available(sizeof(uint16_t))) {
+          return incomplete();
+        }
+        size = next_two_bytes();
+      } else {
+        // size is determined by the type of the arg
+        size = sizeof_arg_type(arg.type);
+      }
+      if (!available(size)) {
+        return incomplete();
+      }
+      arg.arg_data = m_buffer.substr(m_index, size);
+      m_index += size;
+    }
+
+    if (!available(1)) {
+      return incomplete();
+    }
+    // The entries of a log of another format would be misread from here
+    // on
+    const auto level_byte = next_byte();
+    const auto level =
+        static_cast<uint8_t>(level_byte & ~suppressed_count_flag);
+    if (level >= level_names.size()) {
+      invalid_index("unknown level " + std::to_string(level) + " of \""
+                    + std::string(entry.format_string) + "\"");
+    }
+    entry.level = static_cast<::binary_log::level>(level);
+    entry.counts_suppressed = (level_byte & suppressed_count_flag) != 0;
+
+    std::size_t record_size = 0;
+    bool is_fixed_size = true;
+    for (const auto& arg : entry.args) {
+      if (arg.is_constant) {
+        continue;
+      }
+      if (arg.type == fmt_arg_type::type_string) {
+        is_fixed_size = false;
+        break;
+      }
+      record_size += sizeof_arg_type(arg.type);
+    }
+    if (is_fixed_size) {
+      entry.fixed_record_size = record_size;
+    }
+    entry.bytes = m_buffer.substr(entry_start, m_index - entry_start);
+
+    m_entries.push_back(std::move(entry));
+    return true;
+  }
+
+public:
+  index_parser() = default;
+
+  explicit index_parser(std::string_view buffer)
+      : m_buffer(buffer)
+  {
+  }
+
+  // Parses every complete entry in the buffer; a partially written entry
+  // at the end is left out
+  std::vector<index_entry> parse()
+  {
+    while (m_index < m_buffer.size() && parse_entry()) {
+    }
+    return m_entries;
+  }
+};
+
+}  // namespace binary_log
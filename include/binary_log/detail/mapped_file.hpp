@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define BINARY_LOG_HAS_MMAP 1
+#endif
+
+namespace binary_log
+{
+// Read-only view of a whole file: memory mapped where mmap is available,
+// read into memory otherwise. Views of the contents stay valid when the
+// mapped_file is moved.
+class mapped_file
+{
+  const char* m_data {nullptr};
+  std::size_t m_size {0};
+#if !defined(BINARY_LOG_HAS_MMAP)
+  std::unique_ptr<char[]> m_contents;
+#endif
+
+  [[noreturn]] static void open_failed(const std::filesystem::path& path)
+  {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+    throw std::runtime_error("Could not open " + path.string());
+#else
+    (void)path;
+    abort();
+#endif
+  }
+
+  void unmap()
+  {
+#if defined(BINARY_LOG_HAS_MMAP)
+    if (m_data != nullptr) {
+      munmap(const_cast<char*>(m_data), m_size);
+    }
+#else
+    m_contents.reset();
+#endif
+    m_data = nullptr;
+    m_size = 0;
+  }
+
+public:
+  mapped_file() = default;
+
+  explicit mapped_file(const std::filesystem::path& path)
+  {
+#if defined(BINARY_LOG_HAS_MMAP)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      open_failed(path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      ::close(fd);
+      open_failed(path);
+    }
+    m_size = static_cast<std::size_t>(status.st_size);
+    if (m_size > 0) {
+      void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        open_failed(path);
+      }
+      m_data = static_cast<const char*>(data);
+    }
+    ::close(fd);
+#else
+    std::FILE* file = std::fopen(path.string().c_str(), "rb");
+    if (file == nullptr) {
+      open_failed(path);
+    }
+    std::fseek(file, 0, SEEK_END);
+    m_size = static_cast<std::size_t>(std::ftell(file));
+    std::fseek(file, 0, SEEK_SET);
+    m_contents = std::make_unique<char[]>(m_size);
+    m_size = std::fread(m_contents.get(), 1, m_size, file);
+    std::fclose(file);
+    m_data = m_contents.get();
+#endif
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  mapped_file(mapped_file&& other) noexcept
+  {
+    *this = std::move(other);
+  }
+
+  mapped_file& operator=(mapped_file&& other) noexcept
+  {
+    if (this != &other) {
+      unmap();
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+#if !defined(BINARY_LOG_HAS_MMAP)
+      m_contents = std::move(other.m_contents);
+#endif
+    }
+    return *this;
+  }
+
+  ~mapped_file()
+  {
+    unmap();
+  }
+
+  std::string_view view() const
+  {
+    return {m_data, m_size};
+  }
+};
+
+}  // namespace binary_log
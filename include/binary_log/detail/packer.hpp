@@ -1,23 +1,30 @@
 #pragma once
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <filesystem>
 #include <limits>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <binary_log/constant.hpp>
 #include <binary_log/detail/args.hpp>
+#include <binary_log/detail/index_format.hpp>
+#include <binary_log/detail/repeats.hpp>
+#include <binary_log/detail/seek_index.hpp>
+#include <binary_log/detail/varint.hpp>
 
 namespace binary_log
 {
-template<size_t log_buffer_size= 1 * 1024 * 1024, size_t index_buffer_size = 32, size_t runlength_buffer_size = 32>
+template<size_t log_buffer_size= 1 * 1024 * 1024, size_t index_buffer_size = 32, size_t runlength_buffer_size = 32, size_t seek_interval = default_seek_interval>
 class packer
 {
   std::filesystem::path m_path;
   std::FILE* m_log_file;
   std::FILE* m_index_file;
   std::FILE* m_runlength_file;
+  std::FILE* m_seek_file {nullptr};
 
   // This buffer is buffering fwrite calls
   // to the log file.
@@ -28,8 +35,9 @@ class packer
   std::array<uint8_t, log_buffer_size> m_buffer;
   std::size_t m_buffer_index = 0;
 
-  std::array<uint8_t, index_buffer_size> m_index_buffer;
-  std::size_t m_index_buffer_index = 0;
+  // Index entries waiting to be written, all at once, before the log
+  // file is next written to
+  std::vector<uint8_t> m_index_buffer;
 
   // Members for run-length encoding
   // of the log file.
@@ -39,6 +47,30 @@ class packer
   std::size_t m_runlength_index = 0;
   uint64_t m_current_runlength = 0;
 
+  // Log file offset of the index of the run in progress, which keys its
+  // runlength entry: runs of one record have none, and a reader tells
+  // them from the run the next entry belongs to by their offsets
+  uint64_t m_run_offset = 0;
+
+  // Members for the seek index: a checkpoint is written
+  // every `seek_interval` bytes of the log file.
+  uint64_t m_log_file_size = 0;
+  uint64_t m_runlength_file_size = 0;
+  uint64_t m_record_count = 0;
+  uint64_t m_next_seek_offset = seek_interval;
+  uint64_t m_flushed_record_count = 0;
+
+  // Members for repeats (see repeats.hpp): while m_repeat_count > 0, the
+  // records that log at m_repeat_call_sites in turn are counted in the
+  // repeat at m_repeat_count_offset of m_buffer, which must not be
+  // written out before the repeat ends
+  repeat_detector m_repeats;
+  uint16_t m_repeat_call_sites[max_repeat_period] {};
+  std::size_t m_repeat_period = 0;
+  std::size_t m_repeat_position = 0;  // of the next record
+  std::size_t m_repeat_count = 0;
+  std::size_t m_repeat_count_offset = 0;
+
   template<typename T, std::size_t size>
   void buffer_or_write(T* input)
   {
@@ -52,7 +84,10 @@ class packer
     auto* byte_array = reinterpret_cast<const uint8_t*>(input);
     while (bytes_left) {
       if (m_buffer_index + bytes_left >= log_buffer_size) {
+        end_repeat();
+        write_index_buffer();
         fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
+        m_log_file_size += m_buffer_index;
         m_buffer_index = 0;
       }
 
@@ -64,25 +99,79 @@ class packer
     }
   }
 
-  template<typename T>
-  constexpr void buffer_or_write_index_file(T* input, std::size_t size)
+  void write_index_buffer()
   {
-    std::size_t bytes_left = size;
-    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
-    while (bytes_left) {
-      if (m_index_buffer_index + bytes_left >= index_buffer_size) {
-        fwrite(m_index_buffer.data(),
-               sizeof(uint8_t),
-               m_index_buffer_index,
-               m_index_file);
-        m_index_buffer_index = 0;
+    if (m_index_buffer.empty()) {
+      return;
+    }
+    fwrite(m_index_buffer.data(),
+           sizeof(uint8_t),
+           m_index_buffer.size(),
+           m_index_file);
+    m_index_buffer.clear();
+  }
+
+  // Indices are varints: one byte for the first 128 call sites, two up
+  // to 16384 and three beyond
+  void write_format_string_index(uint16_t index)
+  {
+    uint8_t bytes[varint_size(UINT16_MAX)];
+    buffer_or_write(bytes, write_varint(bytes, index));
+  }
+
+  // Writes the repeat header for the record of `index`, which starts a
+  // repeat of `period` call sites
+  void start_repeat(uint16_t index, std::size_t period)
+  {
+    constexpr std::size_t index_size = varint_size(UINT16_MAX);
+    const uint16_t count = 1;
+    uint8_t header[index_size * (1 + max_repeat_period) + sizeof(count) + 1];
+    const auto count_offset = write_varint(header, repeat_index);
+    std::memcpy(header + count_offset, &count, sizeof(count));
+    header[count_offset + sizeof(count)] = static_cast<uint8_t>(period);
+    std::size_t size = count_offset + sizeof(count) + 1;
+    for (std::size_t i = 0; i < period; ++i) {
+      m_repeat_call_sites[i] = i == 0 ? index : m_repeats.at(period - i);
+      size += write_varint(header + size, m_repeat_call_sites[i]);
+    }
+    buffer_or_write(header, size);
+    m_repeat_count_offset = m_buffer_index - size + count_offset;
+    m_repeat_count = 1;
+    m_repeat_period = period;
+    m_repeat_position = 1;
+  }
+
+  // Counts the record of `index` in the repeat, if it logs at the next of
+  // its call sites. A repeat ends before a checkpoint, which must be at a
+  // format string index.
+  bool continue_repeat(uint16_t index)
+  {
+    if (index != m_repeat_call_sites[m_repeat_position]
+        || m_repeat_count == max_repeat_count)
+    {
+      return false;
+    }
+    if constexpr (seek_interval > 0) {
+      if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+        return false;
       }
+      m_record_count++;
+    }
+    const auto count = static_cast<uint16_t>(++m_repeat_count);
+    std::memcpy(&m_buffer[m_repeat_count_offset], &count, sizeof(count));
+    if (++m_repeat_position == m_repeat_period) {
+      m_repeat_position = 0;
+    }
+    return true;
+  }
 
-      std::size_t num_bytes_to_copy = std::min(bytes_left, index_buffer_size-1);
-      std::memcpy(&m_index_buffer[m_index_buffer_index], byte_array, num_bytes_to_copy);
-      byte_array += num_bytes_to_copy;
-      m_index_buffer_index += num_bytes_to_copy;
-      bytes_left -= num_bytes_to_copy;
+  // The next record of the next call site starts another repeat
+  void end_repeat()
+  {
+    if (m_repeat_count > 0) {
+      m_repeats.resume(
+          m_repeat_call_sites, m_repeat_period, m_repeat_position);
+      m_repeat_count = 0;
     }
   }
 
@@ -115,6 +204,8 @@ public:
 
     // No fwrite buffering
     setvbuf(m_index_file, nullptr, _IONBF, 0);
+    const auto header = make_index_header();
+    fwrite(&header, sizeof(header), 1, m_index_file);
 
     // Create the runlength file
     m_runlength_file = fopen(get_runlength_path().c_str(), "wb");
@@ -126,6 +217,19 @@ public:
 #endif
     }
 
+    // Create the seek file
+    if constexpr (seek_interval > 0) {
+      m_seek_file = fopen(get_seek_path().c_str(), "wb");
+      if (m_seek_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+        throw std::invalid_argument("fopen failed");
+#else
+        abort();
+#endif
+      }
+    }
+
+    m_index_buffer.reserve(index_buffer_size);
     m_runlength_index = 0;
     m_current_runlength = 0;
   }
@@ -140,6 +244,9 @@ public:
     fclose(m_log_file);
     fclose(m_index_file);
     fclose(m_runlength_file);
+    if (m_seek_file != nullptr) {
+      fclose(m_seek_file);
+    }
   }
 
   std::filesystem::path get_log_path() const
@@ -161,12 +268,21 @@ public:
     return runlength_file_path;
   }
 
+  std::filesystem::path get_seek_path() const
+  {
+    std::filesystem::path seek_file_path = m_path;
+    seek_file_path.replace_extension(m_path.extension().string() + ".seek");
+    return seek_file_path;
+  }
+
   void flush_log_file()
   {
     if (m_log_file == nullptr) {
       return;
     }
+    end_repeat();
     fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
+    m_log_file_size += m_buffer_index;
     m_buffer_index = 0;
     fflush(m_log_file);
   }
@@ -176,11 +292,7 @@ public:
     if (m_index_file == nullptr) {
       return;
     }
-    fwrite(m_index_buffer.data(),
-           sizeof(uint8_t),
-           m_index_buffer_index,
-           m_index_file);
-    m_index_buffer_index = 0;
+    write_index_buffer();
     fflush(m_index_file);
   }
 
@@ -189,20 +301,41 @@ public:
     if (m_runlength_file == nullptr) {
       return;
     }
+    // End the run in progress, so the next record starts a new run and
+    // everything flushed so far can be decoded
     write_current_runlength_to_runlength_file();
+    m_current_runlength = 0;
     fwrite(m_runlength_buffer.data(),
            sizeof(uint8_t),
            m_runlength_buffer_index,
            m_runlength_file);
+    m_runlength_file_size += m_runlength_buffer_index;
     m_runlength_buffer_index = 0;
     fflush(m_runlength_file);
   }
 
+  // Ends the seek file with a checkpoint at the end of the flushed log,
+  // which tells a reader following the log how far it can decode
+  void flush_seek_file()
+  {
+    if (m_seek_file == nullptr) {
+      return;
+    }
+    if (m_record_count > m_flushed_record_count) {
+      write_seek_entry(0, 0);
+      m_flushed_record_count = m_record_count;
+    }
+    fflush(m_seek_file);
+  }
+
+  // The index and runlength entries of the flushed records reach the disk
+  // before the records themselves, and the checkpoint last
   void flush()
   {
     flush_index_file();
-    flush_log_file();
     flush_runlength_file();
+    flush_log_file();
+    flush_seek_file();
   }
 
   template<typename T>
@@ -289,6 +422,14 @@ public:
     buffer_or_write(input.data(), size);
   }
 
+  // Appends the args of a record as they are encoded in a log file, e.g.
+  // when copying records from another log
+  inline void write_encoded_args_to_log_file(const char* input,
+                                             std::size_t size)
+  {
+    buffer_or_write(input, size);
+  }
+
   template<typename T>
   constexpr inline void pack_arg(T&& input)
   {
@@ -297,160 +438,134 @@ public:
     }
   }
 
+  // A runlength entry is the log file offset of the index of its run and
+  // the runlength, as varints
+  inline void write_runlength_entry(uint64_t offset, uint64_t count)
+  {
+    // make the bytes we'll write to the runlength file
+    uint8_t bytes[2 * max_varint_size];
+    // fill the bytes
+    size_t size = write_varint(bytes, offset);
+    size += write_varint(bytes + size, count);
+    size_t bytes_left = size;
+    const uint8_t* input = bytes;
+    // write the bytes
+    while (bytes_left) {
+      if (m_runlength_buffer_index + bytes_left >= runlength_buffer_size) {
+        fwrite(m_runlength_buffer.data(),
+               sizeof(uint8_t),
+               m_runlength_buffer_index,
+               m_runlength_file);
+        m_runlength_file_size += m_runlength_buffer_index;
+        m_runlength_buffer_index = 0;
+      }
+
+      std::size_t num_bytes_to_copy = std::min(bytes_left, runlength_buffer_size);
+      std::memcpy(&m_runlength_buffer[m_runlength_buffer_index], input, num_bytes_to_copy);
+      m_runlength_buffer_index += num_bytes_to_copy;
+      input += num_bytes_to_copy;
+      bytes_left -= num_bytes_to_copy;
+    }
+  }
+
   inline void write_current_runlength_to_runlength_file()
   {
     if (m_current_runlength > 1) {
-      size_t size = sizeof(uint16_t) + sizeof(uint64_t);
-      size_t bytes_left = size;
-      // make the bytes we'll write to the runlength file
-      uint8_t bytes[size];
-      // fill the bytes
-      std::memcpy(&bytes[0], &m_runlength_index, sizeof(uint16_t));
-      std::memcpy(&bytes[sizeof(uint16_t)], &m_current_runlength, sizeof(uint64_t));
-      // write the bytes
-      while (bytes_left) {
-        if (m_runlength_buffer_index + bytes_left >= runlength_buffer_size) {
-          fwrite(m_runlength_buffer.data(),
-                 sizeof(uint8_t),
-                 m_runlength_buffer_index,
-                 m_runlength_file);
-          m_runlength_buffer_index = 0;
-        }
-
-        std::size_t num_bytes_to_copy = std::min(bytes_left, runlength_buffer_size);
-        std::memcpy(&m_runlength_buffer[m_runlength_buffer_index], bytes, num_bytes_to_copy);
-        m_runlength_buffer_index += num_bytes_to_copy;
-        bytes_left -= num_bytes_to_copy;
-      }
+      write_runlength_entry(m_run_offset, m_current_runlength);
       // reset the runlength
       m_current_runlength = 0;
     }
   }
 
+  // Writes a checkpoint for the record about to be packed, the
+  // `run_position`-th record of a run of `index`
+  inline void write_seek_entry(uint16_t index, uint64_t run_position)
+  {
+    const seek_entry entry {
+        m_log_file_size + m_buffer_index,
+        m_record_count,
+        m_runlength_file_size + m_runlength_buffer_index,
+        index,
+        run_position,
+        seek_index::to_nanoseconds(std::chrono::system_clock::now())};
+    fwrite(&entry, sizeof(entry), 1, m_seek_file);
+    m_next_seek_offset = entry.log_offset + seek_interval;
+  }
+
   constexpr inline void pack_format_string_index(uint16_t index)
   {
     // Evaluate this index
     //
     // If index is the same as the m_runlength_index
-    // but m_current_runlength is 0, write it and increment m_current_runlength
-    // else, no need to write it, just update the runlength
+    // and a run is in progress, no need to write it, just update the runlength
     //
-    // If the index is different from m_runlength_index
-    // then, write (m_runlength_index + m_current_runlength)
+    // Otherwise, write (m_runlength_index + m_current_runlength)
     // to the m_runlength_file and write the new index
     // to the logfile
-
-    if (m_runlength_index == 0 && index == 0) {
-      // First index
-      if (m_current_runlength == 0) {
-        // First call
-        // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
-        m_current_runlength++;
-      } else if (m_current_runlength >= 1) {
-        m_current_runlength++;
+    //
+    // A flush writes out the run in progress and resets m_current_runlength,
+    // so the next record starts a new run with its index in the log file
+    //
+    // Records of a single call site in a row that log at the call sites of
+    // the ones before them in turn are written as a repeat instead, with
+    // no index of their own (m_current_runlength is 0 meanwhile)
+
+    if (m_current_runlength > 0 && m_runlength_index == index) {
+      // No change to index
+      if constexpr (seek_interval > 0) {
+        if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+          write_seek_entry(index, m_current_runlength);
+        }
+        m_record_count++;
       }
+      m_current_runlength++;
     } else {
-      // Not first index
-      if (m_runlength_index == index) {
-        // No change to index
-        m_current_runlength++;
-      } else {
-        // Write current runlength to file
-        write_current_runlength_to_runlength_file();
-
-        // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
-        m_current_runlength = 1;
-        m_runlength_index = index;
+      if (m_repeat_count > 0) [[unlikely]] {
+        if (continue_repeat(index)) {
+          return;
+        }
+        end_repeat();
       }
-    }
-  }
-
-  template<class... Args>
-  constexpr inline void update_log_file(Args&&... args)
-  {
-    ((void)pack_arg(std::forward<Args>(args)), ...);
-  }
 
-  template<fmt_arg_type T>
-  constexpr inline void write_arg_type()
-  {
-    constexpr uint8_t type_byte = static_cast<uint8_t>(T);
-    buffer_or_write_index_file(&type_byte, sizeof(uint8_t));
-  }
-
-  template<typename T>
-  constexpr inline void save_arg_type()
-  {
-    using type = typename std::decay<T>::type;
-
-    if constexpr (is_specialization<type, constant> {}) {
-      // This is a constant
-      using inner_type = typename T::type;
-      write_arg_type<binary_log::get_arg_type<inner_type>()>();
-    } else {
-      write_arg_type<binary_log::get_arg_type<type>()>();
-    }
-  }
-
-  template<typename T>
-  inline void write_arg_value_to_index_file(T&& input) = delete;
+      // Only call sites of one record each make up a repeat
+      if (m_current_runlength > 1) {
+        m_repeats.clear();
+      }
 
-  inline void write_arg_value_to_index_file(const char* input)
-  {
-    const uint16_t size = static_cast<uint16_t>(std::strlen(input));
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input, size);
-  }
+      // Write current runlength to file
+      write_current_runlength_to_runlength_file();
 
-  template<typename T>
-  requires is_numeric_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    buffer_or_write_index_file(&input, sizeof(T));
-  }
+      if constexpr (seek_interval > 0) {
+        if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+          write_seek_entry(index, 0);
+        }
+        m_record_count++;
+      }
 
-  template<typename T>
-  requires is_string_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    const uint16_t size = static_cast<uint16_t>(input.size());
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input.data(), input.size());
-  }
+      if (const auto period = m_repeats.add(index)) [[unlikely]] {
+        start_repeat(index, period);
+        m_current_runlength = 0;
+        return;
+      }
 
-  template<typename T>
-  constexpr inline void save_arg_constness(T&& input)
-  {
-    if constexpr (!is_specialization<T, constant> {}) {
-      constexpr bool is_constant = false;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-    } else {
-      constexpr bool is_constant = true;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-      write_arg_value_to_index_file(input.value);
+      // Write index to log file
+      m_run_offset = m_log_file_size + m_buffer_index;
+      write_format_string_index(index);
+      m_current_runlength = 1;
+      m_runlength_index = index;
     }
   }
 
   template<class... Args>
-  constexpr inline void update_index_file(Args&&... args)
-  {
-    ((void)save_arg_type<Args>(), ...);
-    ((void)save_arg_constness(std::forward<Args>(args)), ...);
-  }
-
-  template<const char* format_string>
-  void write_format_string_to_index_file()
+  constexpr inline void update_log_file(Args&&... args)
   {
-    const uint16_t length = static_cast<uint16_t>(std::strlen(format_string));
-    buffer_or_write_index_file(&length, sizeof(uint16_t));
-    buffer_or_write_index_file(format_string, length);
+    ((void)pack_arg(std::forward<Args>(args)), ...);
   }
 
-  constexpr inline void write_num_args_to_index_file(const uint8_t& num_args)
+  // Appends an entry as it is encoded in an index file
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
   {
-    buffer_or_write_index_file(&num_args, sizeof(uint8_t));
+    m_index_buffer.insert(m_index_buffer.end(), entry.begin(), entry.end());
   }
 };
 
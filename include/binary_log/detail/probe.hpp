@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace binary_log
+{
+// A BINARY_LOG_PROBE call site only logs while its semaphore is not zero,
+// like a USDT probe: a tool that attaches to it increments the semaphore,
+// and decrements it when it detaches. The call site is described to tools
+// by an entry in the binary_log_probes section of the executable, which
+// tools/probes reads, with the process' memory, through /proc.
+struct probe
+{
+  std::atomic<uint16_t>* semaphore;
+  const char* format_string;
+};
+static_assert(sizeof(probe) == 16);
+
+// The entries are written by the assembler, with the addresses of the
+// semaphore and format string as constants, which only an executable (or
+// code that is not position independent) has for the statics of inline
+// functions
+#if defined(__ELF__) && defined(__x86_64__) \
+    && (!defined(__PIC__) || defined(__PIE__))
+#  define BINARY_LOG_HAS_PROBES 1
+
+extern "C"
+{
+  extern const probe __start_binary_log_probes[] __attribute__((weak));
+  extern const probe __stop_binary_log_probes[] __attribute__((weak));
+}
+
+// The entries of the probes of the executable. A call site that is
+// inlined more than once has an entry for each copy, with one semaphore.
+inline std::span<const probe> probes()
+{
+  if (__start_binary_log_probes == nullptr) {
+    return {};
+  }
+  return {__start_binary_log_probes, __stop_binary_log_probes};
+}
+
+// Attaches to (or detaches from) the probes whose format string contains
+// `pattern`, in the process itself, and returns how many there are
+inline std::size_t attach_probes(std::string_view pattern, bool attach = true)
+{
+  std::vector<std::atomic<uint16_t>*> semaphores;
+  for (const auto& entry : probes()) {
+    if (std::string_view(entry.format_string).find(pattern)
+        != std::string_view::npos)
+    {
+      semaphores.push_back(entry.semaphore);
+    }
+  }
+  std::sort(semaphores.begin(), semaphores.end());
+  semaphores.erase(std::unique(semaphores.begin(), semaphores.end()),
+                   semaphores.end());
+  for (auto* semaphore : semaphores) {
+    if (attach) {
+      semaphore->fetch_add(1, std::memory_order_relaxed);
+    } else if (semaphore->load(std::memory_order_relaxed) != 0) {
+      semaphore->fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  return semaphores.size();
+}
+
+inline std::size_t detach_probes(std::string_view pattern)
+{
+  return attach_probes(pattern, false);
+}
+#endif
+
+}  // namespace binary_log
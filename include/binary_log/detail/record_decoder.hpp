@@ -0,0 +1,615 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/args.hpp>
+#include <binary_log/detail/container_format.hpp>
+#include <binary_log/detail/huffman.hpp>
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/repeats.hpp>
+#include <binary_log/detail/seek_index.hpp>
+
+namespace binary_log
+{
+// The value of an integer argument, as its sign and magnitude, which hold
+// the values of all the 64-bit integer types. The 128-bit values beyond
+// them saturate.
+struct integer_value
+{
+  uint64_t magnitude {0};
+  bool negative {false};  // never with a magnitude of 0
+
+  static constexpr integer_value of(uint64_t value)
+  {
+    return {value, false};
+  }
+
+  static constexpr integer_value of(int64_t value)
+  {
+    return {value < 0 ? 0 - static_cast<uint64_t>(value)
+                      : static_cast<uint64_t>(value),
+            value < 0};
+  }
+
+  // The value of a 128-bit integer, given its low and high 64 bits
+  static constexpr integer_value of_128_bits(uint64_t low,
+                                             uint64_t high,
+                                             bool is_signed)
+  {
+    constexpr auto max = std::numeric_limits<uint64_t>::max();
+    if (!is_signed || (high >> 63) == 0) {
+      return {high == 0 ? low : max, false};
+    }
+    return {high == max && low != 0 ? 0 - low : max, true};
+  }
+
+  // The value, which must fit in an int64_t
+  constexpr int64_t as_int64() const
+  {
+    return static_cast<int64_t>(negative ? 0 - magnitude : magnitude);
+  }
+
+  constexpr double as_double() const
+  {
+    const auto result = static_cast<double>(magnitude);
+    return negative ? -result : result;
+  }
+
+  constexpr bool operator==(const integer_value&) const = default;
+
+  constexpr std::strong_ordering operator<=>(
+      const integer_value& other) const
+  {
+    if (negative != other.negative) {
+      return negative ? std::strong_ordering::less
+                      : std::strong_ordering::greater;
+    }
+    return negative ? other.magnitude <=> magnitude
+                    : magnitude <=> other.magnitude;
+  }
+};
+
+// A decoded argument: its type and a view of its raw bytes in the log
+// (or, for constants, the index) buffer
+struct arg_view
+{
+  fmt_arg_type type;
+  std::string_view value;
+
+  template<typename T>
+  T as() const
+  {
+    T result;
+    std::memcpy(&result, value.data(), sizeof(T));
+    return result;
+  }
+
+  bool is_string() const
+  {
+    return type == fmt_arg_type::type_string;
+  }
+
+  bool is_floating_point() const
+  {
+    return type == fmt_arg_type::type_float
+        || type == fmt_arg_type::type_double;
+  }
+
+  // Value of a bool, char or integer argument
+  integer_value as_integer() const
+  {
+    switch (type) {
+      case fmt_arg_type::type_bool:
+        return integer_value::of(uint64_t {as<bool>()});
+      case fmt_arg_type::type_char:
+        return integer_value::of(int64_t {as<char>()});
+      case fmt_arg_type::type_uint8:
+        return integer_value::of(uint64_t {as<uint8_t>()});
+      case fmt_arg_type::type_uint16:
+        return integer_value::of(uint64_t {as<uint16_t>()});
+      case fmt_arg_type::type_uint32:
+        return integer_value::of(uint64_t {as<uint32_t>()});
+      case fmt_arg_type::type_uint64:
+        return integer_value::of(as<uint64_t>());
+      case fmt_arg_type::type_uint128:
+        return integer_value::of_128_bits(low_word(), high_word(), false);
+      case fmt_arg_type::type_int8:
+        return integer_value::of(int64_t {as<int8_t>()});
+      case fmt_arg_type::type_int16:
+        return integer_value::of(int64_t {as<int16_t>()});
+      case fmt_arg_type::type_int32:
+        return integer_value::of(int64_t {as<int32_t>()});
+      case fmt_arg_type::type_int64:
+        return integer_value::of(as<int64_t>());
+      case fmt_arg_type::type_int128:
+        return integer_value::of_128_bits(low_word(), high_word(), true);
+      default:
+        return {};
+    }
+  }
+
+  // Value of any numeric argument
+  double as_double() const
+  {
+    if (type == fmt_arg_type::type_float) {
+      return as<float>();
+    } else if (type == fmt_arg_type::type_double) {
+      return as<double>();
+    }
+    return as_integer().as_double();
+  }
+
+private:
+  // The halves of a 128-bit argument, which is in the byte order of the
+  // host that logged it
+  uint64_t low_word() const
+  {
+    return word(std::endian::native == std::endian::little ? 0 : 1);
+  }
+
+  uint64_t high_word() const
+  {
+    return word(std::endian::native == std::endian::little ? 1 : 0);
+  }
+
+  uint64_t word(std::size_t position) const
+  {
+    uint64_t result;
+    std::memcpy(&result,
+                value.data() + position * sizeof(result),
+                sizeof(result));
+    return result;
+  }
+};
+
+// Walks the log and runlength buffers in lockstep, one run of records
+// sharing a format string index at a time. In a container, the runs are
+// tagged in the log itself.
+//
+// A run is started with next_run(), after which exactly `count` records
+// of the run must be consumed with decode() or skip().
+class record_decoder
+{
+public:
+  struct run
+  {
+    std::size_t index;  // into the index table
+    std::size_t count;
+  };
+
+private:
+  std::string_view m_log;
+  std::string_view m_runlength;
+  const std::vector<index_entry>* m_index_table {nullptr};
+
+  std::size_t m_log_index {0};  // into m_log
+  std::size_t m_runlength_index {0};  // into m_runlength
+  bool m_container {false};
+
+  // The Huffman codes of the block being decoded, m_codes_size bytes at
+  // m_codes_offset of m_log, of which m_codes_left are left from bit
+  // m_code_position on
+  huffman_decoder m_huffman;
+  std::size_t m_codes_offset {0};
+  std::size_t m_codes_size {0};
+  std::size_t m_code_position {0};
+  std::size_t m_codes_left {0};
+
+  // The repeat being decoded: m_repeat_left records, that log at
+  // m_repeat_call_sites in turn from m_repeat_position on
+  std::size_t m_repeat_call_sites[max_repeat_period] {};
+  std::size_t m_repeat_period {0};
+  std::size_t m_repeat_position {0};
+  std::size_t m_repeat_left {0};
+
+  // Rest of a run entered in the middle by seek() or skip_records(), or
+  // cut short by the limit
+  run m_pending {0, 0};
+
+  // Number of records left to hand out
+  std::size_t m_limit {std::numeric_limits<std::size_t>::max()};
+
+  template<typename T>
+  static T read(std::string_view buffer, std::size_t index)
+  {
+    T result;
+    std::memcpy(&result, buffer.data() + index, sizeof(T));
+    return result;
+  }
+
+  void check_index(std::size_t index) const
+  {
+    if (index >= m_index_table->size()) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::runtime_error("format string index out of range");
+#else
+      abort();
+#endif
+    }
+  }
+
+  // Most format string indices and run counts fit in a byte
+  std::size_t read_small_varint()
+  {
+    const std::size_t value = static_cast<uint8_t>(m_log[m_log_index]);
+    if (value < 0x80) {
+      ++m_log_index;
+      return value;
+    }
+    return read_varint(m_log, m_log_index);
+  }
+
+  // Reads the runlength entry at `position` of the runlength buffer into
+  // `count` if it is that of the run whose index is at `offset` of the log:
+  // the offset and the runlength, as varints. A runlength file being
+  // written may end in the middle of an entry, which is then not read.
+  bool read_runlength_entry(std::size_t& position,
+                            std::size_t offset,
+                            std::size_t& count) const
+  {
+    if (position >= m_runlength.size()
+        || read_varint(m_runlength, position) != offset
+        || position >= m_runlength.size())
+    {
+      return false;
+    }
+    const auto runlength = read_varint(m_runlength, position);
+    if (static_cast<uint8_t>(m_runlength[position - 1]) >= 0x80) {
+      return false;
+    }
+    count = runlength;
+    return true;
+  }
+
+  std::size_t read_code()
+  {
+    if (m_codes_left == 0) {
+      invalid_container("missing code");
+    }
+    --m_codes_left;
+    return m_huffman.decode(m_log.substr(m_codes_offset, m_codes_size),
+                            m_code_position);
+  }
+
+  // Reads the Huffman codes of the records of a block, which the rest of
+  // its records follows
+  void read_codes()
+  {
+    const std::size_t size = read<uint32_t>(m_log, m_log_index);
+    m_log_index += sizeof(uint32_t);
+    if (size > m_log.size() - m_log_index) {
+      invalid_container("truncated codes");
+    }
+    const auto end = m_log_index + size;
+    const auto codes = m_log.substr(0, end);
+    m_huffman.read_table(codes, m_log_index);
+    m_codes_left = read_varint(codes, m_log_index);
+    m_codes_offset = m_log_index;
+    m_codes_size = end - m_log_index;
+    m_code_position = 0;
+    m_log_index = end;
+  }
+
+  void invalid_repeat() const
+  {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+    throw std::runtime_error("malformed repeat");
+#else
+    abort();
+#endif
+  }
+
+  // Starts a repeat of `count` records, whose call sites are to be set
+  // in m_repeat_call_sites
+  void start_repeat(std::size_t count, std::size_t period)
+  {
+    if (count == 0 || period < 2 || period > max_repeat_period) {
+      invalid_repeat();
+    }
+    m_repeat_left = count;
+    m_repeat_period = period;
+    m_repeat_position = 0;
+  }
+
+  run next_repeated_run()
+  {
+    const auto index = m_repeat_call_sites[m_repeat_position];
+    if (++m_repeat_position == m_repeat_period) {
+      m_repeat_position = 0;
+    }
+    --m_repeat_left;
+    return {index, 1};
+  }
+
+  run read_coded_run()
+  {
+    const auto code = read_code();
+    if (code >= container_tag::count) {
+      check_index(code - container_tag::count);
+      return {code - container_tag::count, 1};
+    }
+    if (code == container_tag::repeat) {
+      const auto count = read_small_varint();
+      start_repeat(count, read_small_varint());
+      for (std::size_t i = 0; i < m_repeat_period; ++i) {
+        m_repeat_call_sites[i] = read_code() - container_tag::count;
+        check_index(m_repeat_call_sites[i]);
+      }
+      return next_repeated_run();
+    }
+    if (code != container_tag::run) {
+      invalid_container("unexpected code");
+    }
+    const auto count = read_small_varint();
+    const auto index = read_code() - container_tag::count;
+    check_index(index);
+    return {index, count};
+  }
+
+  // Steps over the block markers and call site entries on the way
+  run read_container_run()
+  {
+    for (;;) {
+      if (m_codes_left > 0) {
+        return read_coded_run();
+      }
+      if (m_log_index >= m_log.size()) {
+        // The log ends with a block of call sites and no records
+        return {0, 0};
+      }
+      const auto code = read_small_varint();
+      if (code >= container_tag::count) {
+        check_index(code - container_tag::count);
+        return {code - container_tag::count, 1};
+      }
+      if (code == container_tag::run) {
+        const auto count = read_small_varint();
+        const auto index = read_small_varint() - container_tag::count;
+        check_index(index);
+        return {index, count};
+      }
+      if (code == container_tag::repeat) {
+        const auto count = read_small_varint();
+        start_repeat(count, read_small_varint());
+        for (std::size_t i = 0; i < m_repeat_period; ++i) {
+          m_repeat_call_sites[i] = read_small_varint() - container_tag::count;
+          check_index(m_repeat_call_sites[i]);
+        }
+        return next_repeated_run();
+      }
+      if (code == container_tag::codes) {
+        read_codes();
+        continue;
+      }
+      if (code == container_tag::call_site) {
+        m_log_index += read<uint32_t>(m_log, m_log_index);
+      }
+      m_log_index += sizeof(uint32_t);
+    }
+  }
+
+  run read_run()
+  {
+    if (m_container) {
+      return read_container_run();
+    }
+
+    // A run of length > 1 has its index written once in the log file, as
+    // a varint, and an entry in the runlength file keyed by the offset of
+    // that index
+    const std::size_t offset = m_log_index;
+    const std::size_t index = read_small_varint();
+    if (index == repeat_index) {
+      start_repeat(read<uint16_t>(m_log, m_log_index),
+                   static_cast<uint8_t>(m_log[m_log_index + sizeof(uint16_t)]));
+      m_log_index += sizeof(uint16_t) + sizeof(uint8_t);
+      for (std::size_t i = 0; i < m_repeat_period; ++i) {
+        m_repeat_call_sites[i] = read_small_varint();
+        check_index(m_repeat_call_sites[i]);
+      }
+      return next_repeated_run();
+    }
+
+    std::size_t count = 1;
+    auto entry = m_runlength_index;
+    if (read_runlength_entry(entry, offset, count)) {
+      m_runlength_index = entry;
+    }
+
+    check_index(index);
+    return {index, count};
+  }
+
+  run take_run()
+  {
+    if (m_pending.count > 0) {
+      const auto pending = m_pending;
+      m_pending = {0, 0};
+      return pending;
+    }
+    if (m_repeat_left > 0) {
+      return next_repeated_run();
+    }
+    return read_run();
+  }
+
+public:
+  record_decoder() = default;
+
+  record_decoder(std::string_view log,
+                 std::string_view runlength,
+                 const std::vector<index_entry>& index_table)
+      : m_log(log)
+      , m_runlength(runlength)
+      , m_index_table(&index_table)
+  {
+  }
+
+  // Decodes `log`, the blocks of a container after its header
+  record_decoder(std::string_view log,
+                 const std::vector<index_entry>& index_table)
+      : m_log(log)
+      , m_index_table(&index_table)
+      , m_container(true)
+  {
+  }
+
+  bool at_end() const
+  {
+    return m_limit == 0
+        || (m_pending.count == 0 && m_repeat_left == 0 && m_codes_left == 0
+            && m_log_index >= m_log.size());
+  }
+
+  // Whether the next run is one of the records of a repeat, rather than
+  // read at offset()
+  bool in_repeat() const
+  {
+    return m_pending.count == 0 && m_repeat_left > 0;
+  }
+
+  // Offset of the next byte to be read from the log buffer
+  std::size_t offset() const
+  {
+    return m_log_index;
+  }
+
+  // Offset of the next entry to be read from the runlength buffer
+  std::size_t runlength_offset() const
+  {
+    return m_runlength_index;
+  }
+
+  const char* position() const
+  {
+    return m_log.data() + m_log_index;
+  }
+
+  // Continues on `log` and `runlength`, which extend the buffers decoded
+  // so far, e.g. after reader::refresh() on a log still being written
+  void extend(std::string_view log, std::string_view runlength)
+  {
+    m_log = log;
+    m_runlength = runlength;
+  }
+
+  // Stops after `count` more records; decoding continues where it stopped
+  // if the limit is set again
+  void set_limit(std::size_t count)
+  {
+    m_limit = count;
+  }
+
+  // Reads the format string index of the next record and the number of
+  // consecutive records (the runlength) that share it
+  run next_run()
+  {
+    auto result = take_run();
+    if (result.count > m_limit) {
+      m_pending = {result.index, result.count - m_limit};
+      result.count = m_limit;
+    }
+    m_limit -= result.count;
+    return result;
+  }
+
+  // Resumes decoding at a checkpoint of the seek index
+  void seek(const seek_entry& checkpoint)
+  {
+    m_log_index = checkpoint.log_offset;
+    m_runlength_index = checkpoint.runlength_offset;
+    m_pending = {0, 0};
+    m_repeat_left = 0;
+    if (checkpoint.run_position > 0) {
+      // The run being entered is the next one in the runlength file
+      read_varint(m_runlength, m_runlength_index);
+      const std::size_t count = read_varint(m_runlength, m_runlength_index);
+      m_pending = {checkpoint.run_index, count - checkpoint.run_position};
+    }
+  }
+
+  // Resumes decoding at `offset` of the log of a container, where a block
+  // starts: no run or repeat goes on from the block before
+  void seek_block(std::size_t offset)
+  {
+    m_log_index = offset;
+    m_pending = {0, 0};
+    m_repeat_left = 0;
+    m_codes_left = 0;
+  }
+
+  // Advances over the next `count` records, a run at a time
+  void skip_records(std::size_t count)
+  {
+    while (count > 0
+           && (m_pending.count > 0 || m_repeat_left > 0 || m_codes_left > 0
+               || m_log_index < m_log.size()))
+    {
+      const auto current = take_run();
+      const auto skipped = std::min(count, current.count);
+      skip((*m_index_table)[current.index], skipped);
+      if (skipped < current.count) {
+        m_pending = {current.index, current.count - skipped};
+      }
+      count -= skipped;
+    }
+  }
+
+  // Advances over `count` records of `entry` without decoding them
+  void skip(const index_entry& entry, std::size_t count)
+  {
+    if (entry.fixed_record_size) {
+      m_log_index += count * *entry.fixed_record_size;
+      return;
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+      for (const auto& arg : entry.args) {
+        if (arg.is_constant) {
+          continue;
+        }
+        if (arg.type == fmt_arg_type::type_string) {
+          m_log_index +=
+              sizeof(uint16_t) + read<uint16_t>(m_log, m_log_index);
+        } else {
+          m_log_index += sizeof_arg_type(arg.type);
+        }
+      }
+    }
+  }
+
+  // Decodes the args of the next record of `entry` into `args`, reusing
+  // its storage
+  void decode(const index_entry& entry, std::vector<arg_view>& args)
+  {
+    args.clear();
+    for (const auto& arg : entry.args) {
+      if (arg.is_constant) {
+        // The argument value is in the index table
+        args.push_back({arg.type, arg.arg_data});
+        continue;
+      }
+
+      std::size_t size = 0;
+      if (arg.type == fmt_arg_type::type_string) {
+        // Strings are prefixed with their length
+        size = read<uint16_t>(m_log, m_log_index);
+        m_log_index += sizeof(uint16_t);
+      } else {
+        size = sizeof_arg_type(arg.type);
+      }
+      args.push_back({arg.type, m_log.substr(m_log_index, size)});
+      m_log_index += size;
+    }
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,100 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace binary_log
+{
+// A loop that logs at a few call sites in turn, e.g. A B C A B C ..., has
+// no two records of the same call site in a row, and so no runs. The
+// packers write such records as a repeat: the call sites of a period of 2
+// to max_repeat_period records, listed once, and the args of the records
+// that log at them in turn, without an index of their own.
+static constexpr std::size_t max_repeat_period = 4;
+
+// The format string index that starts a repeat in a log file:
+//
+//   <repeat_index: varint> <count: 2 bytes> <period: 1 byte>
+//   <format-string-index: varint>...
+//
+// followed by the args of `count` records, of the `period` listed call
+// sites in turn. No call site has this index.
+static constexpr uint16_t repeat_index = 0xFFFF;
+static constexpr std::size_t max_repeat_count = 0xFFFF;
+
+// Finds the records that repeat the call sites of the records before them.
+// It is given the records that change call site, so that runs stay runs
+// and no period has the same call site twice in a row.
+class repeat_detector
+{
+  // One 16-bit lane of the history per record
+  static constexpr uint64_t lanes = 0x0001000100010001;
+  static_assert(max_repeat_period == 4);
+
+  // Indices of the last max_repeat_period records, 16 bits each, the last
+  // one in the lowest bits
+  uint64_t m_history {0};
+
+  // The records in a row, m_matches of them, that have had the index of
+  // the record m_period before them (0 if none)
+  std::size_t m_period {0};
+  std::size_t m_matches {0};
+
+public:
+  // Adds a record of `index` and returns the period of the repeat it
+  // starts, or 0. A record starts a repeat if it and the `period` records
+  // before it have the call site of the record `period` before them; the
+  // repeated call sites are then at(period), ..., at(1), `index` first.
+  std::size_t add(uint16_t index)
+  {
+    if (m_period > 0 && index == at(m_period)) {
+      if (++m_matches > m_period) {
+        return m_period;
+      }
+    } else {
+      // The lanes of the history with `index` are zero in `same`, and the
+      // lowest one of them is the first set in `found` (above it, lanes
+      // may be set by the borrow); the last record is not looked at
+      const uint64_t same = m_history ^ (lanes * index);
+      const uint64_t found =
+          (same - lanes) & ~same & (lanes << 15) & ~uint64_t {0xFFFF};
+      m_period = found == 0
+          ? 0
+          : static_cast<std::size_t>(std::countr_zero(found)) / 16 + 1;
+      m_matches = 1;
+    }
+    m_history = (m_history << 16) | index;
+    return 0;
+  }
+
+  // Forgets the matches so far, e.g. after a run
+  void clear()
+  {
+    m_period = 0;
+  }
+
+  // Index of the `back`-th last record
+  uint16_t at(std::size_t back) const
+  {
+    return static_cast<uint16_t>(m_history >> (16 * (back - 1)));
+  }
+
+  // Picks up after a repeat of `period` call sites that stopped before
+  // the `position`-th of them, so that the next record of the same call
+  // site starts another one
+  void resume(const uint16_t* call_sites,
+              std::size_t period,
+              std::size_t position)
+  {
+    for (std::size_t i = 0; i < max_repeat_period; ++i) {
+      m_history = (m_history << 16)
+          | call_sites[(position + i + period * max_repeat_period
+                        - max_repeat_period)
+                       % period];
+    }
+    m_period = period;
+    m_matches = period;
+  }
+};
+
+}  // namespace binary_log
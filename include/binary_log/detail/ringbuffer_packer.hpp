@@ -7,9 +7,12 @@
 #include <queue>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <binary_log/constant.hpp>
 #include <binary_log/detail/args.hpp>
+#include <binary_log/detail/index_format.hpp>
+#include <binary_log/detail/varint.hpp>
 
 namespace binary_log
 {
@@ -29,8 +32,10 @@ class ringbuffer_packer
   std::deque<uint8_t> m_buffer;
   std::size_t m_buffer_index = 0;
 
-  std::array<uint8_t, index_buffer_size> m_index_buffer;
-  std::size_t m_index_buffer_index = 0;
+  // The index: the entries of the call sites the logger has logged at, in
+  // the order of their indices, copied from the call_site_registry of the
+  // process (the logger maps call site ids to indices in its m_indices)
+  std::vector<uint8_t> m_index_buffer;
 
   // Members for run-length encoding
   // of the log file.
@@ -39,6 +44,7 @@ class ringbuffer_packer
   std::size_t m_runlength_buffer_index = 0;
   std::size_t m_runlength_index = 0;
   uint64_t m_current_runlength = 0;
+  uint64_t m_run_offset = 0;  // in m_buffer, of the index of the run
 
   template<typename T, std::size_t size>
   void buffer_or_write(T* input)
@@ -74,22 +80,21 @@ class ringbuffer_packer
     m_buffer_index += num_bytes_to_copy;
   }
 
-  template<typename T>
-  constexpr void buffer_or_write_index_file(T* input, std::size_t size)
+  // Indices are varints: one byte for the first 128 call sites, two up
+  // to 16384 and three beyond
+  void write_format_string_index(uint16_t index)
   {
-    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
-    if (m_index_buffer_index + size >= index_buffer_size) {
-      abort();
-    }
-
-    std::size_t num_bytes_to_copy = std::min(size, index_buffer_size-1);
-    std::memcpy(&m_index_buffer[m_index_buffer_index], byte_array, num_bytes_to_copy);
-    m_index_buffer_index += num_bytes_to_copy;
+    uint8_t bytes[varint_size(UINT16_MAX)];
+    buffer_or_write(bytes, write_varint(bytes, index));
   }
 
 public:
   ringbuffer_packer(const std::filesystem::path& path) : m_path(path)
   {
+    m_index_buffer.reserve(index_buffer_size);
+    const auto header = make_index_header();
+    const auto* header_bytes = reinterpret_cast<const uint8_t*>(&header);
+    m_index_buffer.assign(header_bytes, header_bytes + sizeof(header));
     m_runlength_index = 0;
     m_current_runlength = 0;
   }
@@ -128,7 +133,7 @@ public:
 
   std::string_view get_index_buffer() const
   {
-    return std::string_view(reinterpret_cast<const char*>(m_index_buffer.data()), m_index_buffer_index);
+    return std::string_view(reinterpret_cast<const char*>(m_index_buffer.data()), m_index_buffer.size());
   }
 
   std::string_view get_runlength_buffer() const
@@ -251,15 +256,15 @@ public:
   inline void write_current_runlength_to_runlength_file()
   {
     if (m_current_runlength > 1) {
-      size_t size = sizeof(uint16_t) + sizeof(uint64_t);
+      // make the bytes we'll write to the runlength file: the offset of
+      // the index of the run and the runlength, as varints
+      uint8_t bytes[2 * max_varint_size];
+      // fill the bytes
+      size_t size = write_varint(bytes, m_run_offset);
+      size += write_varint(bytes + size, m_current_runlength);
       if (m_runlength_buffer_index + size >= runlength_buffer_size) {
         abort();
       }
-      // make the bytes we'll write to the runlength file
-      uint8_t bytes[size];
-      // fill the bytes
-      std::memcpy(&bytes[0], &m_runlength_index, sizeof(uint16_t));
-      std::memcpy(&bytes[sizeof(uint16_t)], &m_current_runlength, sizeof(uint64_t));
       // write the bytes
       std::size_t num_bytes_to_copy = std::min(size, runlength_buffer_size);
       std::memcpy(&m_runlength_buffer[m_runlength_buffer_index], bytes, num_bytes_to_copy);
@@ -292,7 +297,8 @@ public:
       if (m_current_runlength == 0) {
         // First call
         // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
+        m_run_offset = m_buffer.size();
+        write_format_string_index(index);
         m_current_runlength++;
       } else if (m_current_runlength >= 1) {
         m_current_runlength++;
@@ -307,7 +313,8 @@ public:
         write_current_runlength_to_runlength_file();
 
         // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
+        m_run_offset = m_buffer.size();
+        write_format_string_index(index);
         m_current_runlength = 1;
         m_runlength_index = index;
       }
@@ -320,84 +327,10 @@ public:
     ((void)pack_arg(std::forward<Args>(args)), ...);
   }
 
-  template<fmt_arg_type T>
-  constexpr inline void write_arg_type()
-  {
-    constexpr uint8_t type_byte = static_cast<uint8_t>(T);
-    buffer_or_write_index_file(&type_byte, sizeof(uint8_t));
-  }
-
-  template<typename T>
-  constexpr inline void save_arg_type()
-  {
-    using type = typename std::decay<T>::type;
-
-    if constexpr (is_specialization<type, constant> {}) {
-      // This is a constant
-      using inner_type = typename T::type;
-      write_arg_type<binary_log::get_arg_type<inner_type>()>();
-    } else {
-      write_arg_type<binary_log::get_arg_type<type>()>();
-    }
-  }
-
-  template<typename T>
-  inline void write_arg_value_to_index_file(T&& input) = delete;
-
-  inline void write_arg_value_to_index_file(const char* input)
-  {
-    const uint16_t size = static_cast<uint16_t>(std::strlen(input));
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input, size);
-  }
-
-  template<typename T>
-  requires is_numeric_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    buffer_or_write_index_file(&input, sizeof(T));
-  }
-
-  template<typename T>
-  requires is_string_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    const uint16_t size = static_cast<uint16_t>(input.size());
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input.data(), input.size());
-  }
-
-  template<typename T>
-  constexpr inline void save_arg_constness(T&& input)
-  {
-    if constexpr (!is_specialization<T, constant> {}) {
-      constexpr bool is_constant = false;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-    } else {
-      constexpr bool is_constant = true;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-      write_arg_value_to_index_file(input.value);
-    }
-  }
-
-  template<class... Args>
-  constexpr inline void update_index_file(Args&&... args)
-  {
-    ((void)save_arg_type<Args>(), ...);
-    ((void)save_arg_constness(std::forward<Args>(args)), ...);
-  }
-
-  template<const char* format_string>
-  void write_format_string_to_index_file()
-  {
-    const uint16_t length = static_cast<uint16_t>(std::strlen(format_string));
-    buffer_or_write_index_file(&length, sizeof(uint16_t));
-    buffer_or_write_index_file(format_string, length);
-  }
-
-  constexpr inline void write_num_args_to_index_file(const uint8_t& num_args)
+  // Appends an entry as it is encoded in an index file
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
   {
-    buffer_or_write_index_file(&num_args, sizeof(uint8_t));
+    m_index_buffer.insert(m_index_buffer.end(), entry.begin(), entry.end());
   }
 };
 
@@ -0,0 +1,65 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__)
+#  include <time.h>
+#endif
+
+// Keeps the rare paths of the sampled and rate-limited call sites out of
+// their callers
+#if defined(__GNUC__)
+#  define BINARY_LOG_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#  define BINARY_LOG_NOINLINE __declspec(noinline)
+#else
+#  define BINARY_LOG_NOINLINE
+#endif
+
+namespace binary_log
+{
+// The clock of the windows of rate-limited call sites, read by a call
+// site once per window and then at each call it suppresses: on Linux,
+// CLOCK_MONOTONIC_COARSE, a few ns against tens for steady_clock, with
+// the resolution of the scheduler tick (a few ms)
+struct coarse_clock
+{
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<coarse_clock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept
+  {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return time_point(std::chrono::seconds(now.tv_sec)
+                      + std::chrono::nanoseconds(now.tv_nsec));
+#else
+    return time_point(std::chrono::duration_cast<duration>(
+        std::chrono::steady_clock::now().time_since_epoch()));
+#endif
+  }
+};
+
+// What a logger keeps of a sampled or rate-limited call site, next to its
+// index in the log
+struct sampling_state
+{
+  // Calls to skip before the next sampled record, or records left in the
+  // window of a rate-limited call site
+  uint32_t countdown {0};
+
+  // Calls suppressed since the window was full
+  uint32_t suppressed {0};
+
+  // Id of the call site that logs how many calls were suppressed (see
+  // call_site::suppressed_count)
+  std::size_t suppressed_count_id {0};
+
+  coarse_clock::time_point window_end {};
+};
+
+}  // namespace binary_log
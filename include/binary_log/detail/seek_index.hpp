@@ -0,0 +1,132 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+namespace binary_log
+{
+// Distance in log file bytes between two checkpoints of the seek index
+static constexpr std::size_t default_seek_interval = 1 * 1024 * 1024;
+
+// A checkpoint in the .seek file: where decoding can resume from.
+//
+// A checkpoint may fall inside a run of records; `run_position` records
+// of the run precede it, and the runlength entry of the run is the one at
+// `runlength_offset`.
+struct seek_entry
+{
+  uint64_t log_offset;
+  uint64_t record_number;  // of the first record after the checkpoint
+  uint64_t runlength_offset;
+  uint64_t run_index;  // format string index of the run
+  uint64_t run_position;
+  int64_t timestamp;  // nanoseconds since the epoch, 0 if unknown
+};
+
+// Sorted checkpoints of a log, searched in place in the .seek buffer
+class seek_index
+{
+  std::string_view m_buffer;
+
+  // First checkpoint for which `is_after` is true, or size()
+  template<typename Predicate>
+  std::size_t partition_point(Predicate is_after) const
+  {
+    std::size_t first = 0;
+    std::size_t count = size();
+    while (count > 0) {
+      const std::size_t step = count / 2;
+      if (!is_after(entry(first + step))) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
+  }
+
+public:
+  using clock = std::chrono::system_clock;
+
+  seek_index() = default;
+
+  explicit seek_index(std::string_view buffer)
+      : m_buffer(buffer)
+  {
+  }
+
+  std::size_t size() const
+  {
+    return m_buffer.size() / sizeof(seek_entry);
+  }
+
+  seek_entry entry(std::size_t position) const
+  {
+    seek_entry result;
+    std::memcpy(&result,
+                m_buffer.data() + position * sizeof(seek_entry),
+                sizeof(seek_entry));
+    return result;
+  }
+
+  // Indexes built offline from an existing log have no timestamps
+  bool has_timestamps() const
+  {
+    return size() > 0 && entry(size() - 1).timestamp != 0;
+  }
+
+  // Time of the last checkpoint
+  clock::time_point last_time() const
+  {
+    return clock::time_point(std::chrono::duration_cast<clock::duration>(
+        std::chrono::nanoseconds(entry(size() - 1).timestamp)));
+  }
+
+  // Last checkpoint at or before record `record_number`
+  std::optional<seek_entry> before_record(uint64_t record_number) const
+  {
+    const auto position = partition_point(
+        [record_number](const seek_entry& checkpoint)
+        { return checkpoint.record_number > record_number; });
+    if (position == 0) {
+      return std::nullopt;
+    }
+    return entry(position - 1);
+  }
+
+  // Record number from which records may have been logged at or after
+  // `time`, to the precision of the checkpoints
+  uint64_t first_record_at(clock::time_point time) const
+  {
+    const auto nanoseconds = to_nanoseconds(time);
+    const auto position = partition_point(
+        [nanoseconds](const seek_entry& checkpoint)
+        { return checkpoint.timestamp > nanoseconds; });
+    return position == 0 ? 0 : entry(position - 1).record_number;
+  }
+
+  // Record number before which all records were logged at or before
+  // `time`, to the precision of the checkpoints
+  uint64_t last_record_at(clock::time_point time) const
+  {
+    const auto nanoseconds = to_nanoseconds(time);
+    const auto position = partition_point(
+        [nanoseconds](const seek_entry& checkpoint)
+        { return checkpoint.timestamp > nanoseconds; });
+    return position == size() ? std::numeric_limits<uint64_t>::max()
+                              : entry(position).record_number;
+  }
+
+  static int64_t to_nanoseconds(clock::time_point time)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               time.time_since_epoch())
+        .count();
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/record_decoder.hpp>
+#include <binary_log/detail/seek_index.hpp>
+
+namespace binary_log
+{
+// A record and the time it is known to have been logged at or after
+// (and the records before it at or before)
+struct timed_record
+{
+  uint64_t record_number;
+  int64_t timestamp;
+};
+
+// Builds the checkpoints of a log that was written without a seek index,
+// decoded by `decoder` from its start, with one roughly every `interval`
+// bytes of the log file. The log carries no times, so the checkpoints have
+// no timestamps, unless `times` (sorted by record) gives some: then
+// checkpoints are only placed at those records, with their timestamps.
+inline std::vector<seek_entry> build_checkpoints(
+    record_decoder decoder,
+    const std::vector<index_entry>& index_table,
+    std::size_t interval = default_seek_interval,
+    const std::vector<timed_record>& times = {})
+{
+  std::vector<seek_entry> checkpoints;
+
+  // Next of `times` at or after `record_number`
+  std::size_t next_time = 0;
+  auto time_at = [&](uint64_t record_number) -> std::optional<int64_t>
+  {
+    if (times.empty()) {
+      return 0;
+    }
+    while (next_time < times.size()
+           && times[next_time].record_number < record_number)
+    {
+      ++next_time;
+    }
+    if (next_time < times.size()
+        && times[next_time].record_number == record_number)
+    {
+      return times[next_time].timestamp;
+    }
+    return std::nullopt;
+  };
+
+  uint64_t record_number = 0;
+  std::size_t next_checkpoint = interval;
+  while (!decoder.at_end()) {
+    const std::size_t run_offset = decoder.offset();
+    const std::size_t runlength_offset = decoder.runlength_offset();
+    // No checkpoint goes between the records of a repeat, whose call sites
+    // are at its start
+    const bool in_repeat = decoder.in_repeat();
+    const auto [index, count] = decoder.next_run();
+    if (run_offset >= next_checkpoint && !in_repeat) {
+      if (const auto timestamp = time_at(record_number)) {
+        checkpoints.push_back({run_offset,
+                               record_number,
+                               runlength_offset,
+                               index,
+                               0,
+                               *timestamp});
+        next_checkpoint = run_offset + interval;
+      }
+    }
+
+    // Long runs get checkpoints of their own, if they reach the next one
+    const auto& entry = index_table[index];
+    if (entry.fixed_record_size
+        && decoder.offset() + (count - 1) * *entry.fixed_record_size
+            < next_checkpoint)
+    {
+      decoder.skip(entry, count);
+      record_number += count;
+      continue;
+    }
+    for (std::size_t position = 0; position < count;) {
+      if (position > 0 && decoder.offset() >= next_checkpoint) {
+        if (const auto timestamp = time_at(record_number + position)) {
+          checkpoints.push_back({decoder.offset(),
+                                 record_number + position,
+                                 runlength_offset,
+                                 index,
+                                 position,
+                                 *timestamp});
+          next_checkpoint = decoder.offset() + interval;
+        }
+      }
+
+      std::size_t records = 1;
+      if (entry.fixed_record_size) {
+        // Jump straight to the record that crosses the next checkpoint
+        const auto size = *entry.fixed_record_size;
+        records = count - position;
+        const bool crossing = size > 0 && decoder.offset() < next_checkpoint;
+        if (crossing) {
+          records = (next_checkpoint - decoder.offset() + size - 1) / size;
+        }
+        if (!times.empty()) {
+          // or to the next record with a time, whichever comes last
+          const uint64_t current = record_number + position;
+          time_at(current + 1);
+          const auto to_time = next_time < times.size()
+              ? times[next_time].record_number - current
+              : count - position;
+          records = crossing ? std::max<std::size_t>(records, to_time)
+                             : to_time;
+        }
+        records = std::min(records, count - position);
+      }
+      decoder.skip(entry, records);
+      position += records;
+    }
+    record_number += count;
+  }
+  return checkpoints;
+}
+
+}  // namespace binary_log
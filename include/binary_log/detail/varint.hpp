@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+namespace binary_log
+{
+// Unsigned LEB128 varints: 7 bits a byte, low bits first, with the high
+// bit set on all bytes but the last. Format string indices are written
+// this way in the log, so that most records spend one byte on theirs.
+static constexpr std::size_t max_varint_size = 10;
+
+constexpr std::size_t varint_size(uint64_t value)
+{
+  std::size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+// Writes the varint_size(value) bytes of `value` to `out`, and returns
+// their number
+inline std::size_t write_varint(uint8_t* out, uint64_t value)
+{
+  std::size_t size = 1;
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+    ++size;
+  }
+  *out = static_cast<uint8_t>(value);
+  return size;
+}
+
+inline uint64_t read_varint(std::string_view data, std::size_t& offset)
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; offset < data.size() && shift < 64; shift += 7) {
+    const auto byte = static_cast<uint8_t>(data[offset++]);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  return value;
+}
+
+}  // namespace binary_log
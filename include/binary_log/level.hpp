@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// The levels as numbers for the preprocessor: the leveled macros below
+// BINARY_LOG_ACTIVE_LEVEL (see binary_log.hpp) expand to nothing
+#define BINARY_LOG_LEVEL_TRACE 0
+#define BINARY_LOG_LEVEL_DEBUG 1
+#define BINARY_LOG_LEVEL_INFO 2
+#define BINARY_LOG_LEVEL_WARN 3
+#define BINARY_LOG_LEVEL_ERROR 4
+
+namespace binary_log
+{
+// Severity of a call site, in its index entry
+enum class level : uint8_t
+{
+  trace = BINARY_LOG_LEVEL_TRACE,
+  debug = BINARY_LOG_LEVEL_DEBUG,
+  info = BINARY_LOG_LEVEL_INFO,
+  warn = BINARY_LOG_LEVEL_WARN,
+  error = BINARY_LOG_LEVEL_ERROR
+};
+
+// Set in the level byte of the index entry of the records that count the
+// calls a rate-limited call site, of the same format string, suppressed
+static constexpr uint8_t suppressed_count_flag = 0x80;
+
+constexpr level counting_suppressed(level severity)
+{
+  return static_cast<level>(static_cast<uint8_t>(severity)
+                            | suppressed_count_flag);
+}
+
+static constexpr std::array<std::string_view, 5> level_names = {
+    "trace", "debug", "info", "warn", "error"};
+
+inline std::string_view level_name(level value)
+{
+  const auto position = static_cast<std::size_t>(value);
+  return position < level_names.size() ? level_names[position] : "unknown";
+}
+
+inline std::optional<level> parse_level(std::string_view name)
+{
+  for (std::size_t i = 0; i < level_names.size(); ++i) {
+    if (level_names[i] == name) {
+      return static_cast<level>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace binary_log
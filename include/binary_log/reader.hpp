@@ -0,0 +1,741 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <system_error>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <binary_log/detail/container_format.hpp>
+#include <binary_log/detail/index_format.hpp>
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/mapped_file.hpp>
+#include <binary_log/detail/record_decoder.hpp>
+#include <binary_log/detail/seek_index.hpp>
+#include <binary_log/detail/seek_index_builder.hpp>
+
+namespace binary_log
+{
+// A decoded log record. The args are views into the log and index
+// buffers and are only valid until the iterator that produced the record
+// is advanced.
+class record
+{
+  std::size_t m_index {0};
+  const index_entry* m_entry {nullptr};
+  std::span<const arg_view> m_args;
+
+public:
+  record() = default;
+
+  record(std::size_t index,
+         const index_entry& entry,
+         std::span<const arg_view> args)
+      : m_index(index)
+      , m_entry(&entry)
+      , m_args(args)
+  {
+  }
+
+  // Position of the call site in the index table
+  std::size_t index() const
+  {
+    return m_index;
+  }
+
+  std::string_view format_string() const
+  {
+    return m_entry->format_string;
+  }
+
+  const index_entry& entry() const
+  {
+    return *m_entry;
+  }
+
+  std::span<const arg_view> args() const
+  {
+    return m_args;
+  }
+
+  const arg_view& operator[](std::size_t position) const
+  {
+    return m_args[position];
+  }
+};
+
+// Single-pass iterator over the records of a log, decoding each record
+// on increment into storage it reuses
+class record_iterator
+{
+  record_decoder m_decoder;
+  const std::vector<index_entry>* m_index_table {nullptr};
+
+  std::size_t m_index {0};  // of the current run
+  std::size_t m_remaining {0};  // records left in the current run
+  std::vector<arg_view> m_args;
+  record m_record;
+  bool m_done {true};
+
+  void advance()
+  {
+    while (m_remaining == 0) {
+      if (m_decoder.at_end()) {
+        m_done = true;
+        return;
+      }
+      const auto run = m_decoder.next_run();
+      m_index = run.index;
+      m_remaining = run.count;
+    }
+    const auto& entry = (*m_index_table)[m_index];
+    m_decoder.decode(entry, m_args);
+    --m_remaining;
+    m_record = record(m_index, entry, m_args);
+  }
+
+  // The current record views m_args, which a copy has its own of
+  void copy_from(const record_iterator& other)
+  {
+    m_decoder = other.m_decoder;
+    m_index_table = other.m_index_table;
+    m_index = other.m_index;
+    m_remaining = other.m_remaining;
+    m_args = other.m_args;
+    m_done = other.m_done;
+    if (!m_done) {
+      m_record = record(m_index, (*m_index_table)[m_index], m_args);
+    }
+  }
+
+public:
+  using value_type = record;
+  using difference_type = std::ptrdiff_t;
+  using iterator_concept = std::input_iterator_tag;
+
+  record_iterator() = default;
+
+  record_iterator(record_decoder decoder,
+                  const std::vector<index_entry>& index_table)
+      : m_decoder(decoder)
+      , m_index_table(&index_table)
+      , m_done(false)
+  {
+    advance();
+  }
+
+  record_iterator(const record_iterator& other)
+  {
+    copy_from(other);
+  }
+
+  record_iterator& operator=(const record_iterator& other)
+  {
+    if (this != &other) {
+      copy_from(other);
+    }
+    return *this;
+  }
+
+  record_iterator(record_iterator&&) noexcept = default;
+  record_iterator& operator=(record_iterator&&) noexcept = default;
+
+  const record& operator*() const
+  {
+    return m_record;
+  }
+
+  const record* operator->() const
+  {
+    return &m_record;
+  }
+
+  record_iterator& operator++()
+  {
+    advance();
+    return *this;
+  }
+
+  void operator++(int)
+  {
+    advance();
+  }
+
+  friend bool operator==(const record_iterator& it, std::default_sentinel_t)
+  {
+    return it.m_done;
+  }
+};
+
+// Lazy view of the records of a log, e.g.
+//
+//   for (const auto& r : reader.records()
+//            | std::views::filter([](const auto& r) { return r.index() == 3; }))
+//   {
+//     total += r[0].as<uint32_t>();
+//   }
+//
+// Every call to begin() starts over from the first record.
+class record_range : public std::ranges::view_interface<record_range>
+{
+  record_decoder m_decoder;
+  const std::vector<index_entry>* m_index_table {nullptr};
+
+public:
+  record_range() = default;
+
+  record_range(record_decoder decoder,
+               const std::vector<index_entry>& index_table)
+      : m_decoder(decoder)
+      , m_index_table(&index_table)
+  {
+  }
+
+  record_iterator begin() const
+  {
+    return record_iterator(m_decoder, *m_index_table);
+  }
+
+  std::default_sentinel_t end() const
+  {
+    return std::default_sentinel;
+  }
+};
+
+class reader;
+
+// Iterator over the records of a log from the last to the first. A log
+// can only be decoded forwards, so the records between two checkpoints of
+// the seek index, or those of a block of a container, are decoded
+// together, one such block at a time.
+class reverse_record_iterator
+{
+  const reader* m_reader {nullptr};
+
+  // Checkpoints built for a log without a seek file, shared by the copies
+  // of the iterator, in place of those of the reader
+  std::shared_ptr<const std::vector<seek_entry>> m_checkpoints;
+
+  // Record number of the current block, or its number in a container
+  std::size_t m_block_start {0};
+
+  // Decoded records of the current block
+  std::vector<std::size_t> m_indices;
+  std::vector<std::size_t> m_arg_offsets;  // into m_args, one past the end
+  std::vector<arg_view> m_args;
+  std::vector<arg_view> m_record_args;
+  std::size_t m_position {0};  // of the current record in the block
+
+  record m_record;
+  bool m_done {true};
+
+  void load_block(std::size_t end);
+  void update_record();
+
+public:
+  using value_type = record;
+  using difference_type = std::ptrdiff_t;
+  using iterator_concept = std::input_iterator_tag;
+
+  reverse_record_iterator() = default;
+
+  // Starts from the record before record `end`, or before block `end` of
+  // a container
+  reverse_record_iterator(
+      const reader& log,
+      std::size_t end,
+      std::shared_ptr<const std::vector<seek_entry>> checkpoints = {});
+
+  reverse_record_iterator(const reverse_record_iterator& other)
+      : m_reader(other.m_reader)
+      , m_checkpoints(other.m_checkpoints)
+      , m_block_start(other.m_block_start)
+      , m_indices(other.m_indices)
+      , m_arg_offsets(other.m_arg_offsets)
+      , m_args(other.m_args)
+      , m_position(other.m_position)
+      , m_done(other.m_done)
+  {
+    update_record();
+  }
+
+  reverse_record_iterator& operator=(const reverse_record_iterator& other)
+  {
+    if (this != &other) {
+      *this = reverse_record_iterator(other);
+    }
+    return *this;
+  }
+
+  reverse_record_iterator(reverse_record_iterator&&) noexcept = default;
+  reverse_record_iterator& operator=(reverse_record_iterator&&) noexcept =
+      default;
+
+  const record& operator*() const
+  {
+    return m_record;
+  }
+
+  const record* operator->() const
+  {
+    return &m_record;
+  }
+
+  reverse_record_iterator& operator++()
+  {
+    if (m_position > 0) {
+      --m_position;
+      update_record();
+    } else if (m_block_start > 0) {
+      load_block(m_block_start);
+    } else {
+      m_done = true;
+    }
+    return *this;
+  }
+
+  void operator++(int)
+  {
+    ++*this;
+  }
+
+  friend bool operator==(const reverse_record_iterator& it,
+                         std::default_sentinel_t)
+  {
+    return it.m_done;
+  }
+};
+
+class reverse_record_range
+    : public std::ranges::view_interface<reverse_record_range>
+{
+  const reader* m_reader {nullptr};
+  std::size_t m_end {0};
+  std::shared_ptr<const std::vector<seek_entry>> m_checkpoints;
+
+public:
+  reverse_record_range() = default;
+
+  reverse_record_range(
+      const reader& log,
+      std::size_t end,
+      std::shared_ptr<const std::vector<seek_entry>> checkpoints = {})
+      : m_reader(&log)
+      , m_end(end)
+      , m_checkpoints(std::move(checkpoints))
+  {
+  }
+
+  reverse_record_iterator begin() const
+  {
+    return reverse_record_iterator(*m_reader, m_end, m_checkpoints);
+  }
+
+  std::default_sentinel_t end() const
+  {
+    return std::default_sentinel;
+  }
+};
+
+// Reads a log written by binary_log: the log file and its .index,
+// .runlength and .seek side files, a container written by a
+// container_packer, or the same buffers supplied by the caller (e.g.
+// those of a ringbuffer_packer).
+//
+// Nothing is copied; records view the mapped files.
+class reader
+{
+  std::filesystem::path m_log_file_path;  // empty for caller buffers
+  mapped_file m_log_file;
+  mapped_file m_index_file;
+  mapped_file m_runlength_file;
+  mapped_file m_seek_file;
+
+  std::string_view m_log;
+  std::string_view m_runlength;
+  std::vector<index_entry> m_index_table;
+  seek_index m_seek_index;
+
+  // Containers have their index entries and runs in the log, and no seek
+  // index; their whole blocks, at m_blocks of the log, are committed
+  bool m_container {false};
+  std::size_t m_committed {0};
+  std::vector<std::size_t> m_blocks;
+
+  // Whether the log has a seek file, which the logger writes unless its
+  // seek_interval is 0
+  bool m_has_seek_file {false};
+
+  // Side files that are not always written are mapped if present
+  static mapped_file map_if_exists(const std::filesystem::path& log_file_path,
+                                   const char* extension)
+  {
+    auto path = log_file_path;
+    path += extension;
+    return std::filesystem::exists(path) ? mapped_file(path) : mapped_file();
+  }
+
+  // Maps `file` again if it has changed size on disk
+  static bool remap(mapped_file& file,
+                    const std::filesystem::path& log_file_path,
+                    const char* extension)
+  {
+    auto path = log_file_path;
+    path += extension;
+    std::error_code error;
+    const auto size = std::filesystem::file_size(path, error);
+    if (error || size == file.view().size()) {
+      return false;
+    }
+    file = mapped_file(path);
+    return true;
+  }
+
+  void load_container(std::string_view data)
+  {
+    read_container_header(data);
+    m_container = true;
+    m_log = data.substr(sizeof(container_header));
+    m_index_table.clear();
+    m_blocks.clear();
+    m_committed = scan_container(m_log, m_index_table, m_blocks);
+  }
+
+  std::size_t count_records(record_decoder decoder) const
+  {
+    std::size_t count = 0;
+    while (!decoder.at_end()) {
+      const auto [index, runlength] = decoder.next_run();
+      decoder.skip(m_index_table[index], runlength);
+      count += runlength;
+    }
+    return count;
+  }
+
+public:
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+  using clock = seek_index::clock;
+
+  // Opens a container if the log file starts with a container header,
+  // and the log file and its side files otherwise
+  explicit reader(const std::filesystem::path& log_file_path)
+      : m_log_file_path(log_file_path)
+      , m_log_file(log_file_path)
+  {
+    if (has_container_header(m_log_file.view())) {
+      load_container(m_log_file.view());
+      return;
+    }
+    m_index_file =
+        mapped_file(std::filesystem::path(log_file_path) += ".index");
+    m_runlength_file = map_if_exists(log_file_path, ".runlength");
+    m_seek_file = map_if_exists(log_file_path, ".seek");
+    m_has_seek_file = std::filesystem::exists(
+        std::filesystem::path(log_file_path) += ".seek");
+    m_log = m_log_file.view();
+    m_runlength = m_runlength_file.view();
+    m_index_table =
+        index_parser(index_file_entries(m_index_file.view())).parse();
+    m_seek_index = seek_index(m_seek_file.view());
+  }
+
+  // `log` may be a whole container, with no other buffers
+  reader(std::string_view log,
+         std::string_view index,
+         std::string_view runlength = {},
+         std::string_view seek = {})
+      : m_log(log)
+      , m_runlength(runlength)
+      , m_index_table(index_parser(index_file_entries(index)).parse())
+      , m_seek_index(seek)
+      , m_has_seek_file(!seek.empty())
+  {
+    if (index.empty() && has_container_header(log)) {
+      load_container(log);
+    }
+  }
+
+  const std::vector<index_entry>& index_table() const
+  {
+    return m_index_table;
+  }
+
+  const seek_index& checkpoints() const
+  {
+    return m_seek_index;
+  }
+
+  std::string_view log() const
+  {
+    return m_log;
+  }
+
+  std::string_view runlength() const
+  {
+    return m_runlength;
+  }
+
+  bool is_container() const
+  {
+    return m_container;
+  }
+
+  // Number of whole blocks of a container
+  std::size_t block_count() const
+  {
+    return m_blocks.size();
+  }
+
+  // Whether committed_log() knows how far a log that is still being
+  // written can be decoded: a three-file log needs its seek file, which
+  // has a checkpoint at the end of each flush
+  bool can_follow() const
+  {
+    return m_container || m_has_seek_file;
+  }
+
+  // The log up to the last flush of the logger, as far as a log that is
+  // still being written can be decoded: its tail may hold records that
+  // are partially written or whose runlength entries are not written yet.
+  // Empty if the reader cannot follow the log (see can_follow()).
+  std::string_view committed_log() const
+  {
+    if (m_container) {
+      return m_log.substr(0, m_committed);
+    }
+    if (m_seek_index.size() == 0) {
+      return {};
+    }
+    const auto end = m_seek_index.entry(m_seek_index.size() - 1).log_offset;
+    return m_log.substr(0, std::min<std::size_t>(end, m_log.size()));
+  }
+
+  // Maps again the files that the logger has written to since they were
+  // mapped, and parses the format strings it has added to the index.
+  // Returns false if nothing changed. Otherwise, records and decoders
+  // obtained before view unmapped memory: decoders must be extend()ed
+  // with the new buffers before they are used again.
+  bool refresh()
+  {
+    if (m_log_file_path.empty()) {
+      return false;
+    }
+
+    bool changed = remap(m_log_file, m_log_file_path, "");
+    if (m_container) {
+      if (changed) {
+        load_container(m_log_file.view());
+      }
+      return changed;
+    }
+    changed |= remap(m_runlength_file, m_log_file_path, ".runlength");
+    changed |= remap(m_seek_file, m_log_file_path, ".seek");
+    if (remap(m_index_file, m_log_file_path, ".index")) {
+      m_index_table =
+        index_parser(index_file_entries(m_index_file.view())).parse();
+      changed = true;
+    }
+
+    m_log = m_log_file.view();
+    m_runlength = m_runlength_file.view();
+    m_seek_index = seek_index(m_seek_file.view());
+    return changed;
+  }
+
+  // Run-level access to the records, for callers that can process or
+  // skip a whole run of records of the same call site at once
+  record_decoder decoder() const
+  {
+    if (m_container) {
+      return record_decoder(m_log, m_index_table);
+    }
+    return record_decoder(m_log, m_runlength, m_index_table);
+  }
+
+  // Run-level access to the records numbered [first, last), starting from
+  // the closest checkpoint of the seek index
+  record_decoder decoder(std::size_t first, std::size_t last = npos) const
+  {
+    auto result = decoder();
+    std::size_t position = 0;
+    if (const auto checkpoint = m_seek_index.before_record(first)) {
+      result.seek(*checkpoint);
+      position = checkpoint->record_number;
+    }
+    result.skip_records(first - position);
+    result.set_limit(last > first ? last - first : 0);
+    return result;
+  }
+
+  // Run-level access to the records of the blocks [first, last) of a
+  // container, which a block can be decoded from on its own
+  record_decoder block_decoder(std::size_t first, std::size_t last) const
+  {
+    const auto end = last < m_blocks.size() ? m_blocks[last] : m_committed;
+    auto result = record_decoder(m_log.substr(0, end), m_index_table);
+    result.seek_block(first < m_blocks.size() ? m_blocks[first] : end);
+    return result;
+  }
+
+  record_range records() const
+  {
+    return record_range(decoder(), m_index_table);
+  }
+
+  // Records numbered [first, last)
+  record_range records(std::size_t first, std::size_t last = npos) const
+  {
+    return record_range(decoder(first, last), m_index_table);
+  }
+
+  // Number of records in the log, counted from the last checkpoint of the
+  // seek index
+  std::size_t record_count() const
+  {
+    auto result = decoder();
+    std::size_t count = 0;
+    if (m_seek_index.size() > 0) {
+      const auto checkpoint = m_seek_index.entry(m_seek_index.size() - 1);
+      result.seek(checkpoint);
+      count = checkpoint.record_number;
+    }
+    return count + count_records(result);
+  }
+
+  // Run-level access to the last `count` records. The records of a
+  // container are counted from its last block back.
+  record_decoder tail_decoder(std::size_t count) const
+  {
+    if (!m_container) {
+      const auto total = record_count();
+      return decoder(total - std::min(count, total));
+    }
+    auto block = m_blocks.size();
+    std::size_t total = 0;
+    while (block > 0 && total < count) {
+      --block;
+      total += count_records(block_decoder(block, block + 1));
+    }
+    auto result = block_decoder(block, m_blocks.size());
+    result.skip_records(total - std::min(count, total));
+    return result;
+  }
+
+  // The last `count` records
+  record_range tail(std::size_t count) const
+  {
+    return record_range(tail_decoder(count), m_index_table);
+  }
+
+  // All records, from the last to the first. A log without a seek file
+  // is first scanned for checkpoints, so that only the records of one
+  // checkpoint interval are decoded in memory at a time.
+  reverse_record_range reverse_records() const
+  {
+    if (m_container) {
+      return reverse_record_range(*this, m_blocks.size());
+    }
+    if (m_has_seek_file) {
+      return reverse_record_range(*this, record_count());
+    }
+    auto checkpoints = std::make_shared<const std::vector<seek_entry>>(
+        build_checkpoints(decoder(), m_index_table));
+    auto last = decoder();
+    std::size_t count = 0;
+    if (!checkpoints->empty()) {
+      last.seek(checkpoints->back());
+      count = checkpoints->back().record_number;
+    }
+    count += count_records(last);
+    return reverse_record_range(*this, count, std::move(checkpoints));
+  }
+
+  // Records logged between `from` and `to`. Times are only known at the
+  // checkpoints of the seek index, so the range may start and end up to
+  // one checkpoint interval early or late.
+  record_range records_between(clock::time_point from,
+                               clock::time_point to) const
+  {
+    return records(m_seek_index.first_record_at(from),
+                   m_seek_index.last_record_at(to));
+  }
+};
+
+inline reverse_record_iterator::reverse_record_iterator(
+    const reader& log,
+    std::size_t end,
+    std::shared_ptr<const std::vector<seek_entry>> checkpoints)
+    : m_reader(&log)
+    , m_checkpoints(std::move(checkpoints))
+{
+  if (end > 0) {
+    load_block(end);
+  }
+}
+
+// Decodes the records from the last checkpoint before record `end` up to
+// `end`, or those of the last block of a container before block `end`
+// that has records, and moves to the last of them
+inline void reverse_record_iterator::load_block(std::size_t end)
+{
+  m_indices.clear();
+  m_arg_offsets.clear();
+  m_args.clear();
+  const auto& index_table = m_reader->index_table();
+  const auto checkpoints = m_checkpoints
+      ? seek_index(std::string_view(
+          reinterpret_cast<const char*>(m_checkpoints->data()),
+          m_checkpoints->size() * sizeof(seek_entry)))
+      : m_reader->checkpoints();
+  do {
+    record_decoder decoder;
+    if (m_reader->is_container()) {
+      // A block may only add call sites
+      m_block_start = end - 1;
+      decoder = m_reader->block_decoder(m_block_start, end);
+    } else {
+      const auto checkpoint = checkpoints.before_record(end - 1);
+      m_block_start = checkpoint ? checkpoint->record_number : 0;
+      decoder = m_reader->decoder();
+      if (checkpoint) {
+        decoder.seek(*checkpoint);
+      }
+      decoder.set_limit(end - m_block_start);
+    }
+    while (!decoder.at_end()) {
+      const auto [index, count] = decoder.next_run();
+      for (std::size_t i = 0; i < count; ++i) {
+        decoder.decode(index_table[index], m_record_args);
+        m_args.insert(
+            m_args.end(), m_record_args.begin(), m_record_args.end());
+        m_indices.push_back(index);
+        m_arg_offsets.push_back(m_args.size());
+      }
+    }
+    end = m_block_start;
+  } while (m_indices.empty() && end > 0);
+
+  m_done = m_indices.empty();
+  m_position = m_done ? 0 : m_indices.size() - 1;
+  update_record();
+}
+
+inline void reverse_record_iterator::update_record()
+{
+  if (m_done) {
+    return;
+  }
+  const auto first = m_position > 0 ? m_arg_offsets[m_position - 1] : 0;
+  const auto args = std::span<const arg_view>(m_args).subspan(
+      first, m_arg_offsets[m_position] - first);
+  const auto index = m_indices[m_position];
+  m_record = record(index, m_reader->index_table()[index], args);
+}
+
+}  // namespace binary_log
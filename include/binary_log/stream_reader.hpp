@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/container_format.hpp>
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/record_decoder.hpp>
+#include <binary_log/reader.hpp>
+
+namespace binary_log
+{
+// Reads a container written by container_packer from a pipe, a socket or
+// a file as it arrives, a block of records at a time. Only the index
+// entries and the block being decoded are kept in memory.
+class stream_reader
+{
+  std::FILE* m_file;
+
+  // Call site entries are copied out of their blocks, since the index
+  // entries are views into them
+  std::deque<std::string> m_call_sites;
+  std::vector<index_entry> m_index_table;
+
+  std::string m_block;
+  std::string_view m_log;
+
+  [[noreturn]] static void invalid(const char* reason)
+  {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+    throw std::runtime_error(std::string("Invalid log stream: ") + reason);
+#else
+    (void)reason;
+    abort();
+#endif
+  }
+
+  // Returns false at the end of the stream, which may only come before a
+  // block
+  bool read(void* data, std::size_t size, bool block_start = false)
+  {
+    const auto count = std::fread(data, 1, size, m_file);
+    if (count == size) {
+      return true;
+    }
+    if (count == 0 && block_start && std::feof(m_file)) {
+      return false;
+    }
+    invalid(std::ferror(m_file) ? "read failed" : "truncated");
+  }
+
+public:
+  // Largest block accepted, so that a stream that is not a log cannot
+  // make the reader allocate without bound
+  static constexpr std::size_t max_block_size = 256 * 1024 * 1024;
+
+  explicit stream_reader(std::FILE* file)
+      : m_file(file)
+  {
+    char header[sizeof(container_header)];
+    const auto count = std::fread(header, 1, sizeof(header), m_file);
+    if (!has_container_header(std::string_view(header, count))) {
+      invalid("not written by container_packer");
+    }
+    read_container_header(std::string_view(header, count));
+  }
+
+  // Reads the next block of records, adding the call sites it brings to
+  // the index table. Returns false at the end of the stream. Records and
+  // decoders of the previous block are invalidated.
+  bool next_block()
+  {
+    char marker[container_marker_size];
+    if (!read(marker, sizeof(marker), true)) {
+      m_log = {};
+      return false;
+    }
+    uint8_t tag = 0;
+    uint32_t size = 0;
+    read_container_marker(
+        std::string_view(marker, sizeof(marker)), 0, tag, size);
+    if (tag != container_tag::block) {
+      invalid("expected a block");
+    }
+    if (size > max_block_size) {
+      invalid("block too large");
+    }
+
+    m_block.resize(size);
+    read(m_block.data(), size);
+    const auto call_sites = container_call_sites(m_block);
+    if (!call_sites.empty()) {
+      parse_container_call_sites(m_call_sites.emplace_back(call_sites),
+                                 m_index_table);
+    }
+    m_log = std::string_view(m_block).substr(call_sites.size());
+    return true;
+  }
+
+  // Grows as the stream adds call sites; references to it stay valid
+  const std::vector<index_entry>& index_table() const
+  {
+    return m_index_table;
+  }
+
+  // Run-level access to the records of the block
+  record_decoder decoder() const
+  {
+    return record_decoder(m_log, m_index_table);
+  }
+
+  record_range records() const
+  {
+    return record_range(decoder(), m_index_table);
+  }
+};
+
+}  // namespace binary_log
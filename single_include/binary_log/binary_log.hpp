@@ -1,8 +1,4 @@
 #pragma once
-#include <cstdint>
-#include <type_traits>
-
-// #include <binary_log/constant.hpp>
 
 namespace binary_log
 {
@@ -18,7 +14,66 @@ struct constant
 };
 
 }  // namespace binary_log
-// #include <binary_log/detail/concepts.hpp>
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// The levels as numbers for the preprocessor: the leveled macros below
+// BINARY_LOG_ACTIVE_LEVEL (see binary_log.hpp) expand to nothing
+#define BINARY_LOG_LEVEL_TRACE 0
+#define BINARY_LOG_LEVEL_DEBUG 1
+#define BINARY_LOG_LEVEL_INFO 2
+#define BINARY_LOG_LEVEL_WARN 3
+#define BINARY_LOG_LEVEL_ERROR 4
+
+namespace binary_log
+{
+// Severity of a call site, in its index entry
+enum class level : uint8_t
+{
+  trace = BINARY_LOG_LEVEL_TRACE,
+  debug = BINARY_LOG_LEVEL_DEBUG,
+  info = BINARY_LOG_LEVEL_INFO,
+  warn = BINARY_LOG_LEVEL_WARN,
+  error = BINARY_LOG_LEVEL_ERROR
+};
+
+// Set in the level byte of the index entry of the records that count the
+// calls a rate-limited call site, of the same format string, suppressed
+static constexpr uint8_t suppressed_count_flag = 0x80;
+
+constexpr level counting_suppressed(level severity)
+{
+  return static_cast<level>(static_cast<uint8_t>(severity)
+                            | suppressed_count_flag);
+}
+
+static constexpr std::array<std::string_view, 5> level_names = {
+    "trace", "debug", "info", "warn", "error"};
+
+inline std::string_view level_name(level value)
+{
+  const auto position = static_cast<std::size_t>(value);
+  return position < level_names.size() ? level_names[position] : "unknown";
+}
+
+inline std::optional<level> parse_level(std::string_view name)
+{
+  for (std::size_t i = 0; i < level_names.size(); ++i) {
+    if (level_names[i] == name) {
+      return static_cast<level>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace binary_log
+
+
+#pragma once
 #include <concepts>
 #include <string>
 #include <string_view>
@@ -51,7 +106,8 @@ concept is_string_type =
               std::string_view>;
 
 }  // namespace binary_log
-// #include <binary_log/detail/is_specialization.hpp>
+
+#pragma once
 #include <type_traits>
 
 namespace binary_log
@@ -68,6 +124,14 @@ struct is_specialization<Template<Args...>, Template> : std::true_type
 
 }  // namespace binary_log
 
+#pragma once
+#include <cstdint>
+#include <type_traits>
+
+// #include <binary_log/constant.hpp>
+// #include <binary_log/detail/concepts.hpp>
+// #include <binary_log/detail/is_specialization.hpp>
+
 namespace binary_log
 {
 enum class fmt_arg_type
@@ -167,7 +231,7 @@ constexpr inline fmt_arg_type get_arg_type<uint64_t>()
 }
 
 template<typename U>
-constexpr inline fmt_arg_type get_arg_type() requires (std::is_same_v<U, std::size_t>) // && !std::is_same_v<U, uint64_t> && !std::is_same_v<U, uint32_t>)
+constexpr inline fmt_arg_type get_arg_type() requires (std::is_same_v<U, std::size_t>)
 {
   if constexpr (sizeof(std::size_t) == sizeof(uint64_t))
     return fmt_arg_type::type_uint64;
@@ -244,240 +308,2787 @@ constexpr static inline bool all_args_are_constants()
 
 
 #pragma once
-#include <array>
-#include <cstring>
-#include <filesystem>
-#include <iostream>
-#include <limits>
-#include <string>
+#include <cstdint>
 #include <string_view>
 
-// #include <binary_log/constant.hpp>
-// #include <binary_log/detail/args.hpp>
-
 namespace binary_log
 {
-template<size_t buffer_size= 1 * 1024 * 1024, size_t index_buffer_size = 32, size_t runlength_buffer_size = 32>
-class packer
+// Unsigned LEB128 varints: 7 bits a byte, low bits first, with the high
+// bit set on all bytes but the last. Format string indices are written
+// this way in the log, so that most records spend one byte on theirs.
+static constexpr std::size_t max_varint_size = 10;
+
+constexpr std::size_t varint_size(uint64_t value)
 {
-  std::filesystem::path m_path;
-  std::FILE* m_log_file;
-  std::FILE* m_index_file;
-  std::FILE* m_runlength_file;
+  std::size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
 
-  // This buffer is buffering fwrite calls
-  // to the log file.
-  //
-  // fwrite already has an internal buffer
-  // but this buffer is used to avoid
-  // multiple fwrite calls.
-  std::array<uint8_t, buffer_size> m_buffer;
-  std::size_t m_buffer_index = 0;
+// Writes the varint_size(value) bytes of `value` to `out`, and returns
+// their number
+inline std::size_t write_varint(uint8_t* out, uint64_t value)
+{
+  std::size_t size = 1;
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+    ++size;
+  }
+  *out = static_cast<uint8_t>(value);
+  return size;
+}
 
-  std::array<uint8_t, index_buffer_size> m_index_buffer;
-  std::size_t m_index_buffer_index = 0;
+inline uint64_t read_varint(std::string_view data, std::size_t& offset)
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; offset < data.size() && shift < 64; shift += 7) {
+    const auto byte = static_cast<uint8_t>(data[offset++]);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  return value;
+}
 
-  // Members for run-length encoding
-  // of the log file.
-  bool m_first_call = true;
-  std::array<uint8_t, runlength_buffer_size> m_runlength_buffer;
-  std::size_t m_runlength_buffer_index = 0;
-  std::size_t m_runlength_index = 0;
-  uint64_t m_current_runlength = 0;
+}  // namespace binary_log
 
-  template<typename T, std::size_t size>
-  void buffer_or_write(T* input)
-  {
-    std::size_t bytes_left = size;
-    auto* byte_array = reinterpret_cast<const uint8_t*>(input);
-    while (bytes_left) {
-      if (m_buffer_index + bytes_left >= buffer_size) {
-        fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
-        m_buffer_index = 0;
-      }
 
-      std::size_t bytes_to_copy = std::min(bytes_left, buffer_size);
-      std::copy_n(byte_array, bytes_to_copy, &m_buffer[m_buffer_index]);
-      byte_array += bytes_to_copy;
-      m_buffer_index += bytes_to_copy;
-      bytes_left -= bytes_to_copy;
-    }
-  }
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 
-  template<typename T>
-  void buffer_or_write(T* input, std::size_t size)
+namespace binary_log
+{
+// A loop that logs at a few call sites in turn, e.g. A B C A B C ..., has
+// no two records of the same call site in a row, and so no runs. The
+// packers write such records as a repeat: the call sites of a period of 2
+// to max_repeat_period records, listed once, and the args of the records
+// that log at them in turn, without an index of their own.
+static constexpr std::size_t max_repeat_period = 4;
+
+// The format string index that starts a repeat in a log file:
+//
+//   <repeat_index: varint> <count: 2 bytes> <period: 1 byte>
+//   <format-string-index: varint>...
+//
+// followed by the args of `count` records, of the `period` listed call
+// sites in turn. No call site has this index.
+static constexpr uint16_t repeat_index = 0xFFFF;
+static constexpr std::size_t max_repeat_count = 0xFFFF;
+
+// Finds the records that repeat the call sites of the records before them.
+// It is given the records that change call site, so that runs stay runs
+// and no period has the same call site twice in a row.
+class repeat_detector
+{
+  // One 16-bit lane of the history per record
+  static constexpr uint64_t lanes = 0x0001000100010001;
+  static_assert(max_repeat_period == 4);
+
+  // Indices of the last max_repeat_period records, 16 bits each, the last
+  // one in the lowest bits
+  uint64_t m_history {0};
+
+  // The records in a row, m_matches of them, that have had the index of
+  // the record m_period before them (0 if none)
+  std::size_t m_period {0};
+  std::size_t m_matches {0};
+
+public:
+  // Adds a record of `index` and returns the period of the repeat it
+  // starts, or 0. A record starts a repeat if it and the `period` records
+  // before it have the call site of the record `period` before them; the
+  // repeated call sites are then at(period), ..., at(1), `index` first.
+  std::size_t add(uint16_t index)
   {
-    std::size_t bytes_left = size;
-    auto* byte_array = reinterpret_cast<const uint8_t*>(input);
-    while (bytes_left) {
-      if (m_buffer_index + bytes_left >= buffer_size) {
-        fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
-        m_buffer_index = 0;
+    if (m_period > 0 && index == at(m_period)) {
+      if (++m_matches > m_period) {
+        return m_period;
       }
-
-      std::size_t bytes_to_copy = std::min(bytes_left, buffer_size);
-      std::copy_n(byte_array, bytes_to_copy, &m_buffer[m_buffer_index]);
-      byte_array += bytes_to_copy;
-      m_buffer_index += bytes_to_copy;
-      bytes_left -= bytes_to_copy;
+    } else {
+      // The lanes of the history with `index` are zero in `same`, and the
+      // lowest one of them is the first set in `found` (above it, lanes
+      // may be set by the borrow); the last record is not looked at
+      const uint64_t same = m_history ^ (lanes * index);
+      const uint64_t found =
+          (same - lanes) & ~same & (lanes << 15) & ~uint64_t {0xFFFF};
+      m_period = found == 0
+          ? 0
+          : static_cast<std::size_t>(std::countr_zero(found)) / 16 + 1;
+      m_matches = 1;
     }
+    m_history = (m_history << 16) | index;
+    return 0;
   }
 
-  template<typename T>
-  constexpr void buffer_or_write_index_file(T* input, std::size_t size)
+  // Forgets the matches so far, e.g. after a run
+  void clear()
   {
-    std::size_t bytes_left = size;
-    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
-    while (bytes_left) {
-      if (m_index_buffer_index + bytes_left >= index_buffer_size) {
-        fwrite(m_index_buffer.data(),
-               sizeof(uint8_t),
-               m_index_buffer_index,
-               m_index_file);
-        m_index_buffer_index = 0;
-      }
+    m_period = 0;
+  }
 
-      std::size_t bytes_to_copy = std::min(bytes_left, index_buffer_size-1);
-      std::copy_n(byte_array, bytes_to_copy, &m_index_buffer[m_index_buffer_index]);
-      byte_array += bytes_to_copy;
-      m_index_buffer_index += bytes_to_copy;
-      bytes_left -= bytes_to_copy;
-    }
+  // Index of the `back`-th last record
+  uint16_t at(std::size_t back) const
+  {
+    return static_cast<uint16_t>(m_history >> (16 * (back - 1)));
   }
 
-public:
-  packer(const std::filesystem::path& path) : m_path(path)
+  // Picks up after a repeat of `period` call sites that stopped before
+  // the `position`-th of them, so that the next record of the same call
+  // site starts another one
+  void resume(const uint16_t* call_sites,
+              std::size_t period,
+              std::size_t position)
   {
-    // Create the log file
-    // All the log contents go here
-    m_log_file = fopen(get_path().c_str(), "wb");
-    if (m_log_file == nullptr) {
-#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
-      throw std::invalid_argument("fopen failed");
-#else
-      abort();
-#endif
+    for (std::size_t i = 0; i < max_repeat_period; ++i) {
+      m_history = (m_history << 16)
+          | call_sites[(position + i + period * max_repeat_period
+                        - max_repeat_period)
+                       % period];
     }
+    m_period = period;
+    m_matches = period;
+  }
+};
 
-    // No fwrite buffering
-    setvbuf(m_log_file, nullptr, _IONBF, 0);
+}  // namespace binary_log
 
-    // Create the index file
-    m_index_file = fopen(get_index_path().c_str(), "wb");
-    if (m_index_file == nullptr) {
-#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
-      throw std::invalid_argument("fopen failed");
-#else
-      abort();
-#endif
-    }
 
-    // No fwrite buffering
-    setvbuf(m_index_file, nullptr, _IONBF, 0);
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
-    // Create the runlength file
-    m_runlength_file = fopen(get_runlength_path().c_str(), "wb");
-    if (m_runlength_file == nullptr) {
+namespace binary_log
+{
+// An index file starts with a header, followed by the entries of its call
+// sites:
+//
+//   <magic: "BLINDX"> <version: 2 bytes>
+//
+// The version is that of the format of the log file and its side files
+// as a whole. The index files of older versions of binary_log had no
+// header, and their logs, whose format string indices were single bytes
+// and whose entries did not end with the level of the call site, cannot
+// be read with this one. Version 1 keyed runlength entries by format
+// string index instead of by log file offset.
+struct index_header
+{
+  char magic[6];
+  uint16_t version;
+};
+static_assert(sizeof(index_header) == 8);
+
+static constexpr std::string_view index_magic = "BLINDX";
+static constexpr uint16_t index_version = 2;
+
+inline index_header make_index_header()
+{
+  index_header header {};
+  std::memcpy(header.magic, index_magic.data(), sizeof(header.magic));
+  header.version = index_version;
+  return header;
+}
+
+[[noreturn]] inline void invalid_index(const std::string& reason)
+{
 #if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
-      throw std::invalid_argument("fopen failed");
+  throw std::runtime_error("Invalid index file: " + reason);
 #else
-      abort();
+  (void)reason;
+  abort();
 #endif
-    }
+}
 
-    m_runlength_index = 0;
-    m_current_runlength = 0;
+// The entries of the index file `data`, after its header. An empty file
+// (of a logger that has just opened it) has none.
+inline std::string_view index_file_entries(std::string_view data)
+{
+  if (data.empty()) {
+    return data;
   }
-
-  packer(const char* path) : packer(std::filesystem::path {path})
-  {
+  if (data.size() < sizeof(index_header) || !data.starts_with(index_magic)) {
+    invalid_index(
+        "no header, the log was written by an older version of "
+        "binary_log");
   }
+  index_header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.version != index_version) {
+    invalid_index("unsupported version " + std::to_string(header.version)
+                  + " (this reader decodes version "
+                  + std::to_string(index_version) + ")");
+  }
+  return data.substr(sizeof(index_header));
+}
 
-  ~packer()
+}  // namespace binary_log
+
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+namespace binary_log
+{
+// Distance in log file bytes between two checkpoints of the seek index
+static constexpr std::size_t default_seek_interval = 1 * 1024 * 1024;
+
+// A checkpoint in the .seek file: where decoding can resume from.
+//
+// A checkpoint may fall inside a run of records; `run_position` records
+// of the run precede it, and the runlength entry of the run is the one at
+// `runlength_offset`.
+struct seek_entry
+{
+  uint64_t log_offset;
+  uint64_t record_number;  // of the first record after the checkpoint
+  uint64_t runlength_offset;
+  uint64_t run_index;  // format string index of the run
+  uint64_t run_position;
+  int64_t timestamp;  // nanoseconds since the epoch, 0 if unknown
+};
+
+// Sorted checkpoints of a log, searched in place in the .seek buffer
+class seek_index
+{
+  std::string_view m_buffer;
+
+  // First checkpoint for which `is_after` is true, or size()
+  template<typename Predicate>
+  std::size_t partition_point(Predicate is_after) const
   {
-    flush();
-    fclose(m_log_file);
-    fclose(m_index_file);
-    fclose(m_runlength_file);
+    std::size_t first = 0;
+    std::size_t count = size();
+    while (count > 0) {
+      const std::size_t step = count / 2;
+      if (!is_after(entry(first + step))) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
   }
 
-  std::filesystem::path get_path() const
+public:
+  using clock = std::chrono::system_clock;
+
+  seek_index() = default;
+
+  explicit seek_index(std::string_view buffer)
+      : m_buffer(buffer)
   {
-    return m_path;
   }
 
-  std::filesystem::path get_index_path() const
+  std::size_t size() const
   {
-    std::filesystem::path index_file_path = m_path;
-    index_file_path.replace_extension(m_path.extension().string() + ".index");
-    return index_file_path;
+    return m_buffer.size() / sizeof(seek_entry);
   }
 
-  std::filesystem::path get_runlength_path() const
+  seek_entry entry(std::size_t position) const
   {
-    std::filesystem::path runlength_file_path = m_path;
-    runlength_file_path.replace_extension(m_path.extension().string() + ".runlength");
-    return runlength_file_path;
+    seek_entry result;
+    std::memcpy(&result,
+                m_buffer.data() + position * sizeof(seek_entry),
+                sizeof(seek_entry));
+    return result;
   }
 
-  void flush_log_file()
+  // Indexes built offline from an existing log have no timestamps
+  bool has_timestamps() const
   {
-    if (m_log_file == nullptr) {
-      return;
-    }
-    fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
-    m_buffer_index = 0;
-    fflush(m_log_file);
+    return size() > 0 && entry(size() - 1).timestamp != 0;
   }
 
-  void flush_index_file()
+  // Time of the last checkpoint
+  clock::time_point last_time() const
   {
-    if (m_index_file == nullptr) {
-      return;
-    }
-    fwrite(m_index_buffer.data(),
-           sizeof(uint8_t),
-           m_index_buffer_index,
-           m_index_file);
-    m_index_buffer_index = 0;
-    fflush(m_index_file);
+    return clock::time_point(std::chrono::duration_cast<clock::duration>(
+        std::chrono::nanoseconds(entry(size() - 1).timestamp)));
   }
 
-  void flush_runlength_file()
+  // Last checkpoint at or before record `record_number`
+  std::optional<seek_entry> before_record(uint64_t record_number) const
   {
-    if (m_runlength_file == nullptr) {
-      return;
+    const auto position = partition_point(
+        [record_number](const seek_entry& checkpoint)
+        { return checkpoint.record_number > record_number; });
+    if (position == 0) {
+      return std::nullopt;
     }
-    fwrite(m_runlength_buffer.data(),
-           sizeof(uint8_t),
-           m_runlength_buffer_index,
-           m_runlength_file);
-    m_runlength_buffer_index = 0;
-    fflush(m_runlength_file);
+    return entry(position - 1);
   }
 
-  void flush()
+  // Record number from which records may have been logged at or after
+  // `time`, to the precision of the checkpoints
+  uint64_t first_record_at(clock::time_point time) const
   {
-    flush_index_file();
-    flush_log_file();
-    flush_runlength_file();
+    const auto nanoseconds = to_nanoseconds(time);
+    const auto position = partition_point(
+        [nanoseconds](const seek_entry& checkpoint)
+        { return checkpoint.timestamp > nanoseconds; });
+    return position == 0 ? 0 : entry(position - 1).record_number;
   }
 
-
-
-  template<typename T>
-  inline void write_arg_value_to_log_file(T&& input) = delete;
-
-  inline void write_arg_value_to_log_file(const char* input)
+  // Record number before which all records were logged at or before
+  // `time`, to the precision of the checkpoints
+  uint64_t last_record_at(clock::time_point time) const
   {
-    uint16_t size = static_cast<uint16_t>(std::strlen(input));
-    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
-    buffer_or_write(input, size);
+    const auto nanoseconds = to_nanoseconds(time);
+    const auto position = partition_point(
+        [nanoseconds](const seek_entry& checkpoint)
+        { return checkpoint.timestamp > nanoseconds; });
+    return position == size() ? std::numeric_limits<uint64_t>::max()
+                              : entry(position).record_number;
   }
 
-  inline void write_arg_value_to_log_file(char input)
+  static int64_t to_nanoseconds(clock::time_point time)
   {
-    buffer_or_write<char, sizeof(char)>(&input);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               time.time_since_epoch())
+        .count();
+  }
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// #include <binary_log/constant.hpp>
+// #include <binary_log/detail/args.hpp>
+// #include <binary_log/level.hpp>
+// #include <binary_log/detail/repeats.hpp>
+
+namespace binary_log
+{
+// Index entries are encoded as
+//
+//   <format-string-length> <format-string>
+//   <number-of-arguments> <arg-type-1> <arg-type-2> ... <arg-type-N>
+//   <arg-1-is-const> <arg-1-value>? <arg-2-is-const> <arg-2-value>? ...
+//   <level>
+//
+// where only constants have their value in the entry (and none in the
+// log), and the level is one byte, with suppressed_count_flag set in the
+// entries of call_site::suppressed_count
+template<typename T>
+inline void append_index_bytes(std::string& entry, const T& value)
+{
+  entry.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void append_index_value(std::string& entry, const char* value)
+{
+  const auto size = static_cast<uint16_t>(std::strlen(value));
+  append_index_bytes(entry, size);
+  entry.append(value, size);
+}
+
+template<typename T>
+requires is_numeric_type<T> inline void append_index_value(std::string& entry,
+                                                           const T& value)
+{
+  append_index_bytes(entry, value);
+}
+
+template<typename T>
+requires is_string_type<T> inline void append_index_value(std::string& entry,
+                                                          const T& value)
+{
+  const auto size = static_cast<uint16_t>(value.size());
+  append_index_bytes(entry, size);
+  entry.append(value.data(), size);
+}
+
+template<typename T>
+inline void append_arg_type(std::string& entry)
+{
+  using type = std::decay_t<T>;
+  if constexpr (is_specialization<type, constant> {}) {
+    append_index_bytes(
+        entry, static_cast<uint8_t>(get_arg_type<typename type::type>()));
+  } else {
+    append_index_bytes(entry, static_cast<uint8_t>(get_arg_type<type>()));
+  }
+}
+
+template<typename T>
+inline void append_arg_constness(std::string& entry, const T& arg)
+{
+  if constexpr (is_specialization<std::decay_t<T>, constant> {}) {
+    append_index_bytes(entry, true);
+    append_index_value(entry, arg.value);
+  } else {
+    append_index_bytes(entry, false);
+  }
+}
+
+template<class... Args>
+inline std::string make_index_entry_head(std::string_view format_string)
+{
+  std::string entry;
+  const auto length = static_cast<uint16_t>(format_string.size());
+  append_index_bytes(entry, length);
+  entry.append(format_string.data(), length);
+  append_index_bytes(entry, static_cast<uint8_t>(sizeof...(Args)));
+  ((void)append_arg_type<Args>(entry), ...);
+  return entry;
+}
+
+// Entry of a call site logging `args`
+template<class... Args>
+inline std::string make_index_entry(std::string_view format_string,
+                                    level severity,
+                                    const Args&... args)
+{
+  auto entry = make_index_entry_head<Args...>(format_string);
+  ((void)append_arg_constness(entry, args), ...);
+  append_index_bytes(entry, severity);
+  return entry;
+}
+
+// Entry of a call site without constants, from the types of its args
+template<class... Args>
+inline std::string make_index_entry_of(std::string_view format_string,
+                                       level severity)
+{
+  auto entry = make_index_entry_head<Args...>(format_string);
+  entry.append(sizeof...(Args), '\0');
+  append_index_bytes(entry, severity);
+  return entry;
+}
+
+// The index entries of all the call sites of the process, numbered in the
+// order they are added. A logger writes the entry of a call site to its
+// index when the call site first logs to it, with an index of its own.
+class call_site_registry
+{
+  mutable std::mutex m_mutex;
+  std::deque<std::string> m_entries;
+  std::deque<std::atomic<std::size_t>*> m_ids;
+
+public:
+  // Format string indices are 16-bit in the packers and the runlength
+  // file (and varints in the log), and the last one starts a repeat, so
+  // that any logger can take all the call sites
+  static constexpr std::size_t max_call_sites = repeat_index;
+
+  // Set in the id of a call site while it is disabled, for the macros to
+  // check with the relaxed load of the id they make anyway, before they
+  // evaluate their args (see call_site_control.hpp)
+  static constexpr std::size_t disabled = ~(~std::size_t {0} >> 1);
+
+  static call_site_registry& instance()
+  {
+    static call_site_registry registry;
+    return registry;
+  }
+
+  // Adds `entry` for the call site whose index plus one is `id`, unless
+  // it is added already
+  void add(std::atomic<std::size_t>& id, std::string entry)
+  {
+    std::lock_guard lock(m_mutex);
+    if (id.load(std::memory_order_relaxed) == 0) {
+      if (m_entries.size() == max_call_sites) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+        throw std::length_error("too many call sites");
+#else
+        abort();
+#endif
+      }
+      m_entries.push_back(std::move(entry));
+      m_ids.push_back(&id);
+      id.store(m_entries.size(), std::memory_order_release);
+    }
+  }
+
+  std::size_t size() const
+  {
+    std::lock_guard lock(m_mutex);
+    return m_entries.size();
+  }
+
+  // Entries are never moved, so the view stays valid
+  std::string_view entry(std::size_t index) const
+  {
+    std::lock_guard lock(m_mutex);
+    return m_entries[index];
+  }
+
+  void set_enabled(std::size_t index, bool enabled)
+  {
+    std::lock_guard lock(m_mutex);
+    if (enabled) {
+      m_ids[index]->fetch_and(~disabled, std::memory_order_relaxed);
+    } else {
+      m_ids[index]->fetch_or(disabled, std::memory_order_relaxed);
+    }
+  }
+
+  std::string_view format_string(std::size_t index) const
+  {
+    const auto bytes = entry(index);
+    uint16_t length = 0;
+    std::memcpy(&length, bytes.data(), sizeof(length));
+    return bytes.substr(sizeof(length), length);
+  }
+};
+
+// The call site of one BINARY_LOG expansion, whose format string array is
+// its own, logging at `severity`. Call sites without constants are added
+// to the registry before main(), when their static members are
+// initialized; the others at their first call, since the values of their
+// constants are only known then.
+template<const char* format_string, level severity, class... Args>
+struct call_site
+{
+  static constexpr bool has_constants =
+      (is_specialization<Args, constant> {} || ...);
+
+  // A copy of the format string: the array of an expansion in a function
+  // that is never emitted is not emitted either, while the registration
+  // of its call site is
+  static constexpr std::size_t length =
+      std::char_traits<char>::length(format_string);
+  static constexpr auto text = []
+  {
+    std::array<char, length + 1> text {};
+    std::copy_n(format_string, length, text.begin());
+    return text;
+  }();
+
+  static constexpr std::string_view format() { return {text.data(), length}; }
+
+  // The call site that logs how many calls a rate-limited call site
+  // suppressed, with its format string
+  using suppressed_count =
+      call_site<format_string, counting_suppressed(severity), uint32_t>;
+
+  // Index of the call site plus one, or zero until it is added, with
+  // call_site_registry::disabled set while it is disabled
+  static inline std::atomic<std::size_t> id {0};
+
+  static bool enabled()
+  {
+    return (id.load(std::memory_order_relaxed) & call_site_registry::disabled)
+        == 0;
+  }
+
+  static void add(const Args&... args)
+  {
+    call_site_registry::instance().add(
+        id, make_index_entry(format(), severity, args...));
+  }
+
+  static bool add_before_main()
+  {
+    if constexpr (!has_constants) {
+      call_site_registry::instance().add(
+          id, make_index_entry_of<Args...>(format(), severity));
+    }
+    return true;
+  }
+
+  static inline const bool added_before_main = add_before_main();
+};
+
+// The call site that binary_log::log() logs `args` at is the type of
+// of(args...), for the macros to name it in an unevaluated operand,
+// without evaluating the args
+template<const char* format_string, level severity>
+struct call_site_for
+{
+  template<class... Args>
+  static call_site<format_string, severity, std::decay_t<Args>...> of(
+      Args&&... args);
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace binary_log
+{
+// A BINARY_LOG_PROBE call site only logs while its semaphore is not zero,
+// like a USDT probe: a tool that attaches to it increments the semaphore,
+// and decrements it when it detaches. The call site is described to tools
+// by an entry in the binary_log_probes section of the executable, which
+// tools/probes reads, with the process' memory, through /proc.
+struct probe
+{
+  std::atomic<uint16_t>* semaphore;
+  const char* format_string;
+};
+static_assert(sizeof(probe) == 16);
+
+// The entries are written by the assembler, with the addresses of the
+// semaphore and format string as constants, which only an executable (or
+// code that is not position independent) has for the statics of inline
+// functions
+#if defined(__ELF__) && defined(__x86_64__) \
+    && (!defined(__PIC__) || defined(__PIE__))
+#  define BINARY_LOG_HAS_PROBES 1
+
+extern "C"
+{
+  extern const probe __start_binary_log_probes[] __attribute__((weak));
+  extern const probe __stop_binary_log_probes[] __attribute__((weak));
+}
+
+// The entries of the probes of the executable. A call site that is
+// inlined more than once has an entry for each copy, with one semaphore.
+inline std::span<const probe> probes()
+{
+  if (__start_binary_log_probes == nullptr) {
+    return {};
+  }
+  return {__start_binary_log_probes, __stop_binary_log_probes};
+}
+
+// Attaches to (or detaches from) the probes whose format string contains
+// `pattern`, in the process itself, and returns how many there are
+inline std::size_t attach_probes(std::string_view pattern, bool attach = true)
+{
+  std::vector<std::atomic<uint16_t>*> semaphores;
+  for (const auto& entry : probes()) {
+    if (std::string_view(entry.format_string).find(pattern)
+        != std::string_view::npos)
+    {
+      semaphores.push_back(entry.semaphore);
+    }
+  }
+  std::sort(semaphores.begin(), semaphores.end());
+  semaphores.erase(std::unique(semaphores.begin(), semaphores.end()),
+                   semaphores.end());
+  for (auto* semaphore : semaphores) {
+    if (attach) {
+      semaphore->fetch_add(1, std::memory_order_relaxed);
+    } else if (semaphore->load(std::memory_order_relaxed) != 0) {
+      semaphore->fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  return semaphores.size();
+}
+
+inline std::size_t detach_probes(std::string_view pattern)
+{
+  return attach_probes(pattern, false);
+}
+#endif
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__)
+#  include <time.h>
+#endif
+
+// Keeps the rare paths of the sampled and rate-limited call sites out of
+// their callers
+#if defined(__GNUC__)
+#  define BINARY_LOG_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#  define BINARY_LOG_NOINLINE __declspec(noinline)
+#else
+#  define BINARY_LOG_NOINLINE
+#endif
+
+namespace binary_log
+{
+// The clock of the windows of rate-limited call sites, read by a call
+// site once per window and then at each call it suppresses: on Linux,
+// CLOCK_MONOTONIC_COARSE, a few ns against tens for steady_clock, with
+// the resolution of the scheduler tick (a few ms)
+struct coarse_clock
+{
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<coarse_clock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept
+  {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return time_point(std::chrono::seconds(now.tv_sec)
+                      + std::chrono::nanoseconds(now.tv_nsec));
+#else
+    return time_point(std::chrono::duration_cast<duration>(
+        std::chrono::steady_clock::now().time_since_epoch()));
+#endif
+  }
+};
+
+// What a logger keeps of a sampled or rate-limited call site, next to its
+// index in the log
+struct sampling_state
+{
+  // Calls to skip before the next sampled record, or records left in the
+  // window of a rate-limited call site
+  uint32_t countdown {0};
+
+  // Calls suppressed since the window was full
+  uint32_t suppressed {0};
+
+  // Id of the call site that logs how many calls were suppressed (see
+  // call_site::suppressed_count)
+  std::size_t suppressed_count_id {0};
+
+  coarse_clock::time_point window_end {};
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// #include <binary_log/constant.hpp>
+// #include <binary_log/detail/args.hpp>
+// #include <binary_log/detail/index_format.hpp>
+// #include <binary_log/detail/repeats.hpp>
+// #include <binary_log/detail/seek_index.hpp>
+// #include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+template<size_t log_buffer_size= 1 * 1024 * 1024, size_t index_buffer_size = 32, size_t runlength_buffer_size = 32, size_t seek_interval = default_seek_interval>
+class packer
+{
+  std::filesystem::path m_path;
+  std::FILE* m_log_file;
+  std::FILE* m_index_file;
+  std::FILE* m_runlength_file;
+  std::FILE* m_seek_file {nullptr};
+
+  // This buffer is buffering fwrite calls
+  // to the log file.
+  //
+  // fwrite already has an internal buffer
+  // but this buffer is used to avoid
+  // multiple fwrite calls.
+  std::array<uint8_t, log_buffer_size> m_buffer;
+  std::size_t m_buffer_index = 0;
+
+  // Index entries waiting to be written, all at once, before the log
+  // file is next written to
+  std::vector<uint8_t> m_index_buffer;
+
+  // Members for run-length encoding
+  // of the log file.
+  bool m_first_call = true;
+  std::array<uint8_t, runlength_buffer_size> m_runlength_buffer;
+  std::size_t m_runlength_buffer_index = 0;
+  std::size_t m_runlength_index = 0;
+  uint64_t m_current_runlength = 0;
+
+  // Log file offset of the index of the run in progress, which keys its
+  // runlength entry: runs of one record have none, and a reader tells
+  // them from the run the next entry belongs to by their offsets
+  uint64_t m_run_offset = 0;
+
+  // Members for the seek index: a checkpoint is written
+  // every `seek_interval` bytes of the log file.
+  uint64_t m_log_file_size = 0;
+  uint64_t m_runlength_file_size = 0;
+  uint64_t m_record_count = 0;
+  uint64_t m_next_seek_offset = seek_interval;
+  uint64_t m_flushed_record_count = 0;
+
+  // Members for repeats (see repeats.hpp): while m_repeat_count > 0, the
+  // records that log at m_repeat_call_sites in turn are counted in the
+  // repeat at m_repeat_count_offset of m_buffer, which must not be
+  // written out before the repeat ends
+  repeat_detector m_repeats;
+  uint16_t m_repeat_call_sites[max_repeat_period] {};
+  std::size_t m_repeat_period = 0;
+  std::size_t m_repeat_position = 0;  // of the next record
+  std::size_t m_repeat_count = 0;
+  std::size_t m_repeat_count_offset = 0;
+
+  template<typename T, std::size_t size>
+  void buffer_or_write(T* input)
+  {
+    buffer_or_write(input, size);
+  }
+
+  template<typename T>
+  void buffer_or_write(T* input, std::size_t size)
+  {
+    std::size_t bytes_left = size;
+    auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    while (bytes_left) {
+      if (m_buffer_index + bytes_left >= log_buffer_size) {
+        end_repeat();
+        write_index_buffer();
+        fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
+        m_log_file_size += m_buffer_index;
+        m_buffer_index = 0;
+      }
+
+      std::size_t num_bytes_to_copy = std::min(bytes_left, log_buffer_size);
+      std::memcpy(&m_buffer[m_buffer_index], byte_array, num_bytes_to_copy);
+      byte_array += num_bytes_to_copy;
+      m_buffer_index += num_bytes_to_copy;
+      bytes_left -= num_bytes_to_copy;
+    }
+  }
+
+  void write_index_buffer()
+  {
+    if (m_index_buffer.empty()) {
+      return;
+    }
+    fwrite(m_index_buffer.data(),
+           sizeof(uint8_t),
+           m_index_buffer.size(),
+           m_index_file);
+    m_index_buffer.clear();
+  }
+
+  // Indices are varints: one byte for the first 128 call sites, two up
+  // to 16384 and three beyond
+  void write_format_string_index(uint16_t index)
+  {
+    uint8_t bytes[varint_size(UINT16_MAX)];
+    buffer_or_write(bytes, write_varint(bytes, index));
+  }
+
+  // Writes the repeat header for the record of `index`, which starts a
+  // repeat of `period` call sites
+  void start_repeat(uint16_t index, std::size_t period)
+  {
+    constexpr std::size_t index_size = varint_size(UINT16_MAX);
+    const uint16_t count = 1;
+    uint8_t header[index_size * (1 + max_repeat_period) + sizeof(count) + 1];
+    const auto count_offset = write_varint(header, repeat_index);
+    std::memcpy(header + count_offset, &count, sizeof(count));
+    header[count_offset + sizeof(count)] = static_cast<uint8_t>(period);
+    std::size_t size = count_offset + sizeof(count) + 1;
+    for (std::size_t i = 0; i < period; ++i) {
+      m_repeat_call_sites[i] = i == 0 ? index : m_repeats.at(period - i);
+      size += write_varint(header + size, m_repeat_call_sites[i]);
+    }
+    buffer_or_write(header, size);
+    m_repeat_count_offset = m_buffer_index - size + count_offset;
+    m_repeat_count = 1;
+    m_repeat_period = period;
+    m_repeat_position = 1;
+  }
+
+  // Counts the record of `index` in the repeat, if it logs at the next of
+  // its call sites. A repeat ends before a checkpoint, which must be at a
+  // format string index.
+  bool continue_repeat(uint16_t index)
+  {
+    if (index != m_repeat_call_sites[m_repeat_position]
+        || m_repeat_count == max_repeat_count)
+    {
+      return false;
+    }
+    if constexpr (seek_interval > 0) {
+      if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+        return false;
+      }
+      m_record_count++;
+    }
+    const auto count = static_cast<uint16_t>(++m_repeat_count);
+    std::memcpy(&m_buffer[m_repeat_count_offset], &count, sizeof(count));
+    if (++m_repeat_position == m_repeat_period) {
+      m_repeat_position = 0;
+    }
+    return true;
+  }
+
+  // The next record of the next call site starts another repeat
+  void end_repeat()
+  {
+    if (m_repeat_count > 0) {
+      m_repeats.resume(
+          m_repeat_call_sites, m_repeat_period, m_repeat_position);
+      m_repeat_count = 0;
+    }
+  }
+
+public:
+  packer(const std::filesystem::path& path) : m_path(path)
+  {
+    // Create the log file
+    // All the log contents go here
+    m_log_file = fopen(get_log_path().c_str(), "wb");
+    if (m_log_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::invalid_argument("fopen failed");
+#else
+      abort();
+#endif
+    }
+
+    // No fwrite buffering
+    setvbuf(m_log_file, nullptr, _IONBF, 0);
+
+    // Create the index file
+    m_index_file = fopen(get_index_path().c_str(), "wb");
+    if (m_index_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::invalid_argument("fopen failed");
+#else
+      abort();
+#endif
+    }
+
+    // No fwrite buffering
+    setvbuf(m_index_file, nullptr, _IONBF, 0);
+    const auto header = make_index_header();
+    fwrite(&header, sizeof(header), 1, m_index_file);
+
+    // Create the runlength file
+    m_runlength_file = fopen(get_runlength_path().c_str(), "wb");
+    if (m_runlength_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::invalid_argument("fopen failed");
+#else
+      abort();
+#endif
+    }
+
+    // Create the seek file
+    if constexpr (seek_interval > 0) {
+      m_seek_file = fopen(get_seek_path().c_str(), "wb");
+      if (m_seek_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+        throw std::invalid_argument("fopen failed");
+#else
+        abort();
+#endif
+      }
+    }
+
+    m_index_buffer.reserve(index_buffer_size);
+    m_runlength_index = 0;
+    m_current_runlength = 0;
+  }
+
+  packer(const char* path) : packer(std::filesystem::path {path})
+  {
+  }
+
+  ~packer()
+  {
+    flush();
+    fclose(m_log_file);
+    fclose(m_index_file);
+    fclose(m_runlength_file);
+    if (m_seek_file != nullptr) {
+      fclose(m_seek_file);
+    }
+  }
+
+  std::filesystem::path get_log_path() const
+  {
+    return m_path;
+  }
+
+  std::filesystem::path get_index_path() const
+  {
+    std::filesystem::path index_file_path = m_path;
+    index_file_path.replace_extension(m_path.extension().string() + ".index");
+    return index_file_path;
+  }
+
+  std::filesystem::path get_runlength_path() const
+  {
+    std::filesystem::path runlength_file_path = m_path;
+    runlength_file_path.replace_extension(m_path.extension().string() + ".runlength");
+    return runlength_file_path;
+  }
+
+  std::filesystem::path get_seek_path() const
+  {
+    std::filesystem::path seek_file_path = m_path;
+    seek_file_path.replace_extension(m_path.extension().string() + ".seek");
+    return seek_file_path;
+  }
+
+  void flush_log_file()
+  {
+    if (m_log_file == nullptr) {
+      return;
+    }
+    end_repeat();
+    fwrite(m_buffer.data(), sizeof(uint8_t), m_buffer_index, m_log_file);
+    m_log_file_size += m_buffer_index;
+    m_buffer_index = 0;
+    fflush(m_log_file);
+  }
+
+  void flush_index_file()
+  {
+    if (m_index_file == nullptr) {
+      return;
+    }
+    write_index_buffer();
+    fflush(m_index_file);
+  }
+
+  void flush_runlength_file()
+  {
+    if (m_runlength_file == nullptr) {
+      return;
+    }
+    // End the run in progress, so the next record starts a new run and
+    // everything flushed so far can be decoded
+    write_current_runlength_to_runlength_file();
+    m_current_runlength = 0;
+    fwrite(m_runlength_buffer.data(),
+           sizeof(uint8_t),
+           m_runlength_buffer_index,
+           m_runlength_file);
+    m_runlength_file_size += m_runlength_buffer_index;
+    m_runlength_buffer_index = 0;
+    fflush(m_runlength_file);
+  }
+
+  // Ends the seek file with a checkpoint at the end of the flushed log,
+  // which tells a reader following the log how far it can decode
+  void flush_seek_file()
+  {
+    if (m_seek_file == nullptr) {
+      return;
+    }
+    if (m_record_count > m_flushed_record_count) {
+      write_seek_entry(0, 0);
+      m_flushed_record_count = m_record_count;
+    }
+    fflush(m_seek_file);
+  }
+
+  // The index and runlength entries of the flushed records reach the disk
+  // before the records themselves, and the checkpoint last
+  void flush()
+  {
+    flush_index_file();
+    flush_runlength_file();
+    flush_log_file();
+    flush_seek_file();
+  }
+
+  template<typename T>
+  inline void write_arg_value_to_log_file(T&& input) = delete;
+
+  inline void write_arg_value_to_log_file(const char* input)
+  {
+    uint16_t size = static_cast<uint16_t>(std::strlen(input));
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input, size);
+  }
+
+  inline void write_arg_value_to_log_file(char input)
+  {
+    buffer_or_write<char, sizeof(char)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(bool input)
+  {
+    buffer_or_write<bool, sizeof(bool)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint8_t input)
+  {
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint16_t input)
+  {
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint32_t input)
+  {
+    buffer_or_write<uint32_t, sizeof(uint32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint64_t input)
+  {
+    buffer_or_write<uint64_t, sizeof(uint64_t)>(&input);
+  }
+
+  template<typename U>
+  inline void write_arg_value_to_log_file(U &input) requires (std::is_same_v<U, std::size_t>)
+  {
+    buffer_or_write<U, sizeof(U)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int8_t input)
+  {
+    buffer_or_write<int8_t, sizeof(int8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int16_t input)
+  {
+    buffer_or_write<int16_t, sizeof(int16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int32_t input)
+  {
+    buffer_or_write<int32_t, sizeof(int32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int64_t input)
+  {
+    buffer_or_write<int64_t, sizeof(int64_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(float input)
+  {
+    buffer_or_write<float, sizeof(float)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(double input)
+  {
+    buffer_or_write<double, sizeof(double)>(&input);
+  }
+
+  template<typename T>
+  requires is_string_type<T> inline void write_arg_value_to_log_file(T&& input)
+  {
+    uint16_t size = static_cast<uint16_t>(input.size());
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input.data(), size);
+  }
+
+  // Appends the args of a record as they are encoded in a log file, e.g.
+  // when copying records from another log
+  inline void write_encoded_args_to_log_file(const char* input,
+                                             std::size_t size)
+  {
+    buffer_or_write(input, size);
+  }
+
+  template<typename T>
+  constexpr inline void pack_arg(T&& input)
+  {
+    if constexpr (!is_specialization<T, constant> {}) {
+      write_arg_value_to_log_file(std::forward<T>(input));
+    }
+  }
+
+  // A runlength entry is the log file offset of the index of its run and
+  // the runlength, as varints
+  inline void write_runlength_entry(uint64_t offset, uint64_t count)
+  {
+    // make the bytes we'll write to the runlength file
+    uint8_t bytes[2 * max_varint_size];
+    // fill the bytes
+    size_t size = write_varint(bytes, offset);
+    size += write_varint(bytes + size, count);
+    size_t bytes_left = size;
+    const uint8_t* input = bytes;
+    // write the bytes
+    while (bytes_left) {
+      if (m_runlength_buffer_index + bytes_left >= runlength_buffer_size) {
+        fwrite(m_runlength_buffer.data(),
+               sizeof(uint8_t),
+               m_runlength_buffer_index,
+               m_runlength_file);
+        m_runlength_file_size += m_runlength_buffer_index;
+        m_runlength_buffer_index = 0;
+      }
+
+      std::size_t num_bytes_to_copy = std::min(bytes_left, runlength_buffer_size);
+      std::memcpy(&m_runlength_buffer[m_runlength_buffer_index], input, num_bytes_to_copy);
+      m_runlength_buffer_index += num_bytes_to_copy;
+      input += num_bytes_to_copy;
+      bytes_left -= num_bytes_to_copy;
+    }
+  }
+
+  inline void write_current_runlength_to_runlength_file()
+  {
+    if (m_current_runlength > 1) {
+      write_runlength_entry(m_run_offset, m_current_runlength);
+      // reset the runlength
+      m_current_runlength = 0;
+    }
+  }
+
+  // Writes a checkpoint for the record about to be packed, the
+  // `run_position`-th record of a run of `index`
+  inline void write_seek_entry(uint16_t index, uint64_t run_position)
+  {
+    const seek_entry entry {
+        m_log_file_size + m_buffer_index,
+        m_record_count,
+        m_runlength_file_size + m_runlength_buffer_index,
+        index,
+        run_position,
+        seek_index::to_nanoseconds(std::chrono::system_clock::now())};
+    fwrite(&entry, sizeof(entry), 1, m_seek_file);
+    m_next_seek_offset = entry.log_offset + seek_interval;
+  }
+
+  constexpr inline void pack_format_string_index(uint16_t index)
+  {
+    // Evaluate this index
+    //
+    // If index is the same as the m_runlength_index
+    // and a run is in progress, no need to write it, just update the runlength
+    //
+    // Otherwise, write (m_runlength_index + m_current_runlength)
+    // to the m_runlength_file and write the new index
+    // to the logfile
+    //
+    // A flush writes out the run in progress and resets m_current_runlength,
+    // so the next record starts a new run with its index in the log file
+    //
+    // Records of a single call site in a row that log at the call sites of
+    // the ones before them in turn are written as a repeat instead, with
+    // no index of their own (m_current_runlength is 0 meanwhile)
+
+    if (m_current_runlength > 0 && m_runlength_index == index) {
+      // No change to index
+      if constexpr (seek_interval > 0) {
+        if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+          write_seek_entry(index, m_current_runlength);
+        }
+        m_record_count++;
+      }
+      m_current_runlength++;
+    } else {
+      if (m_repeat_count > 0) [[unlikely]] {
+        if (continue_repeat(index)) {
+          return;
+        }
+        end_repeat();
+      }
+
+      // Only call sites of one record each make up a repeat
+      if (m_current_runlength > 1) {
+        m_repeats.clear();
+      }
+
+      // Write current runlength to file
+      write_current_runlength_to_runlength_file();
+
+      if constexpr (seek_interval > 0) {
+        if (m_log_file_size + m_buffer_index >= m_next_seek_offset) {
+          write_seek_entry(index, 0);
+        }
+        m_record_count++;
+      }
+
+      if (const auto period = m_repeats.add(index)) [[unlikely]] {
+        start_repeat(index, period);
+        m_current_runlength = 0;
+        return;
+      }
+
+      // Write index to log file
+      m_run_offset = m_log_file_size + m_buffer_index;
+      write_format_string_index(index);
+      m_current_runlength = 1;
+      m_runlength_index = index;
+    }
+  }
+
+  template<class... Args>
+  constexpr inline void update_log_file(Args&&... args)
+  {
+    ((void)pack_arg(std::forward<Args>(args)), ...);
+  }
+
+  // Appends an entry as it is encoded in an index file
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
+  {
+    m_index_buffer.insert(m_index_buffer.end(), entry.begin(), entry.end());
+  }
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <array>
+#include <deque>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// #include <binary_log/constant.hpp>
+// #include <binary_log/detail/args.hpp>
+// #include <binary_log/detail/index_format.hpp>
+// #include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+/// This Packer implementation uses a std::deque<uint8_t> to implement a ring
+/// buffer for the log file data, and std::array<uint8_t> to store the index and
+/// runfile data.
+template<size_t log_buffer_size= 1 * 1024 * 1024, size_t index_buffer_size = 1024, size_t runlength_buffer_size = 128>
+class ringbuffer_packer
+{
+  std::filesystem::path m_path;
+
+  // to be able to discard old data in the buffer, we need to keep a list of
+  // indices of the start of each log entry in the buffer, so that we can
+  // discard bytes from the buffer up to the start of the next log entry
+  std::queue<size_t> log_buffer_indices;
+
+  std::deque<uint8_t> m_buffer;
+  std::size_t m_buffer_index = 0;
+
+  // The index: the entries of the call sites the logger has logged at, in
+  // the order of their indices, copied from the call_site_registry of the
+  // process (the logger maps call site ids to indices in its m_indices)
+  std::vector<uint8_t> m_index_buffer;
+
+  // Members for run-length encoding
+  // of the log file.
+  bool m_first_call = true;
+  std::array<uint8_t, runlength_buffer_size> m_runlength_buffer;
+  std::size_t m_runlength_buffer_index = 0;
+  std::size_t m_runlength_index = 0;
+  uint64_t m_current_runlength = 0;
+  uint64_t m_run_offset = 0;  // in m_buffer, of the index of the run
+
+  template<typename T, std::size_t size>
+  void buffer_or_write(T* input)
+  {
+    buffer_or_write(input, size);
+  }
+
+  template<typename T>
+  void buffer_or_write(T* input, std::size_t size)
+  {
+    auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    // if the amount of space in the queue is less than the amount of bytes
+    // use the distance between oldest buffer index and the next index to
+    // determine how many bytes remove
+    while ((m_buffer.size() + size) >= log_buffer_size) {
+      // get the first and second elements in the buffer indices queue (and
+      // pop the first off)
+      size_t first = log_buffer_indices.front();
+      log_buffer_indices.pop();
+      size_t second = log_buffer_indices.front();
+      // compute the distance (size of this log), that will be the number of bytes to remove
+      size_t distance = second - first;
+      // remove the bytes from the buffer
+      for (size_t i = 0; i < distance; i++) {
+        m_buffer.pop_front();
+      }
+    }
+    // now we have enough space in the buffer to write the bytes
+    std::size_t num_bytes_to_copy = std::min(size, log_buffer_size);
+    for (std::size_t i = 0; i < num_bytes_to_copy; i++) {
+      m_buffer.push_back(byte_array[i]);
+    }
+    m_buffer_index += num_bytes_to_copy;
+  }
+
+  // Indices are varints: one byte for the first 128 call sites, two up
+  // to 16384 and three beyond
+  void write_format_string_index(uint16_t index)
+  {
+    uint8_t bytes[varint_size(UINT16_MAX)];
+    buffer_or_write(bytes, write_varint(bytes, index));
+  }
+
+public:
+  ringbuffer_packer(const std::filesystem::path& path) : m_path(path)
+  {
+    m_index_buffer.reserve(index_buffer_size);
+    const auto header = make_index_header();
+    const auto* header_bytes = reinterpret_cast<const uint8_t*>(&header);
+    m_index_buffer.assign(header_bytes, header_bytes + sizeof(header));
+    m_runlength_index = 0;
+    m_current_runlength = 0;
+  }
+
+  ringbuffer_packer(const char* path) : ringbuffer_packer(std::filesystem::path {path})
+  {
+  }
+
+  ~ringbuffer_packer()
+  {
+  }
+
+  std::filesystem::path get_log_path() const
+  {
+    return m_path;
+  }
+
+  std::filesystem::path get_index_path() const
+  {
+    std::filesystem::path index_file_path = m_path;
+    index_file_path.replace_extension(m_path.extension().string() + ".index");
+    return index_file_path;
+  }
+
+  std::filesystem::path get_runlength_path() const
+  {
+    std::filesystem::path runlength_file_path = m_path;
+    runlength_file_path.replace_extension(m_path.extension().string() + ".runlength");
+    return runlength_file_path;
+  }
+
+  std::vector<uint8_t> get_log_buffer() const
+  {
+    return std::vector<uint8_t>(m_buffer.begin(), m_buffer.end());
+  }
+
+  std::string_view get_index_buffer() const
+  {
+    return std::string_view(reinterpret_cast<const char*>(m_index_buffer.data()), m_index_buffer.size());
+  }
+
+  std::string_view get_runlength_buffer() const
+  {
+    return std::string_view(reinterpret_cast<const char*>(m_runlength_buffer.data()), m_runlength_buffer_index);
+  }
+
+  void flush_log_file()
+  {
+  }
+
+  void flush_index_file()
+  {
+  }
+
+  void flush_runlength_file()
+  {
+    write_current_runlength_to_runlength_file();
+  }
+
+  void flush()
+  {
+    flush_log_file();
+    flush_index_file();
+    flush_runlength_file();
+  }
+
+  template<typename T>
+  inline void write_arg_value_to_log_file(T&& input) = delete;
+
+  inline void write_arg_value_to_log_file(const char* input)
+  {
+    uint16_t size = static_cast<uint16_t>(std::strlen(input));
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input, size);
+  }
+
+  inline void write_arg_value_to_log_file(char input)
+  {
+    buffer_or_write<char, sizeof(char)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(bool input)
+  {
+    buffer_or_write<bool, sizeof(bool)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint8_t input)
+  {
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint16_t input)
+  {
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint32_t input)
+  {
+    buffer_or_write<uint32_t, sizeof(uint32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(uint64_t input)
+  {
+    buffer_or_write<uint64_t, sizeof(uint64_t)>(&input);
+  }
+
+  template<typename U>
+  inline void write_arg_value_to_log_file(U &input) requires (std::is_same_v<U, std::size_t>)
+  {
+    buffer_or_write<U, sizeof(U)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int8_t input)
+  {
+    buffer_or_write<int8_t, sizeof(int8_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int16_t input)
+  {
+    buffer_or_write<int16_t, sizeof(int16_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int32_t input)
+  {
+    buffer_or_write<int32_t, sizeof(int32_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(int64_t input)
+  {
+    buffer_or_write<int64_t, sizeof(int64_t)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(float input)
+  {
+    buffer_or_write<float, sizeof(float)>(&input);
+  }
+
+  inline void write_arg_value_to_log_file(double input)
+  {
+    buffer_or_write<double, sizeof(double)>(&input);
+  }
+
+  template<typename T>
+  requires is_string_type<T> inline void write_arg_value_to_log_file(T&& input)
+  {
+    uint16_t size = static_cast<uint16_t>(input.size());
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input.data(), size);
+  }
+
+  template<typename T>
+  constexpr inline void pack_arg(T&& input)
+  {
+    if constexpr (!is_specialization<T, constant> {}) {
+      write_arg_value_to_log_file(std::forward<T>(input));
+    }
+  }
+
+  inline void write_current_runlength_to_runlength_file()
+  {
+    if (m_current_runlength > 1) {
+      // make the bytes we'll write to the runlength file: the offset of
+      // the index of the run and the runlength, as varints
+      uint8_t bytes[2 * max_varint_size];
+      // fill the bytes
+      size_t size = write_varint(bytes, m_run_offset);
+      size += write_varint(bytes + size, m_current_runlength);
+      if (m_runlength_buffer_index + size >= runlength_buffer_size) {
+        abort();
+      }
+      // write the bytes
+      std::size_t num_bytes_to_copy = std::min(size, runlength_buffer_size);
+      std::memcpy(&m_runlength_buffer[m_runlength_buffer_index], bytes, num_bytes_to_copy);
+      m_runlength_buffer_index += num_bytes_to_copy;
+      // reset the runlength
+      m_current_runlength = 0;
+    }
+  }
+
+  constexpr inline void pack_format_string_index(uint16_t index)
+  {
+    // Evaluate this index
+    //
+    // If index is the same as the m_runlength_index
+    // but m_current_runlength is 0, write it and increment m_current_runlength
+    // else, no need to write it, just update the runlength
+    //
+    // If the index is different from m_runlength_index
+    // then, write (m_runlength_index + m_current_runlength)
+    // to the m_runlength_file and write the new index
+    // to the logfile
+
+    // NOTE: this is the first function called on the packer within the
+    // `binary_log::log` function, so this is where we'll write that we're
+    // writing a new log entry
+    log_buffer_indices.push(m_buffer_index);
+
+    if (m_runlength_index == 0 && index == 0) {
+      // First index
+      if (m_current_runlength == 0) {
+        // First call
+        // Write index to log file
+        m_run_offset = m_buffer.size();
+        write_format_string_index(index);
+        m_current_runlength++;
+      } else if (m_current_runlength >= 1) {
+        m_current_runlength++;
+      }
+    } else {
+      // Not first index
+      if (m_runlength_index == index) {
+        // No change to index
+        m_current_runlength++;
+      } else {
+        // Write current runlength to file
+        write_current_runlength_to_runlength_file();
+
+        // Write index to log file
+        m_run_offset = m_buffer.size();
+        write_format_string_index(index);
+        m_current_runlength = 1;
+        m_runlength_index = index;
+      }
+    }
+  }
+
+  template<class... Args>
+  constexpr inline void update_log_file(Args&&... args)
+  {
+    ((void)pack_arg(std::forward<Args>(args)), ...);
+  }
+
+  // Appends an entry as it is encoded in an index file
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
+  {
+    m_index_buffer.insert(m_index_buffer.end(), entry.begin(), entry.end());
+  }
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// #include <binary_log/detail/args.hpp>
+// #include <binary_log/detail/index_format.hpp>
+// #include <binary_log/level.hpp>
+
+namespace binary_log
+{
+// One row of the index file: the static part of a call site
+struct index_entry
+{
+  struct arg
+  {
+    fmt_arg_type type;
+    bool is_constant;
+
+    // if constant, this will have the static data
+    std::string_view arg_data;
+  };
+
+  std::string_view format_string;
+  std::vector<arg> args;
+  ::binary_log::level level {::binary_log::level::info};
+
+  // Whether the records of this entry have one arg, the number of calls
+  // that the rate-limited call site of the same format string suppressed
+  bool counts_suppressed {false};
+
+  // Number of bytes each record of this entry occupies in the log file
+  // (after the index) when none of its logged args are strings
+  std::optional<std::size_t> fixed_record_size;
+
+  // The entry as it is in the index file
+  std::string_view bytes;
+};
+
+// Parses the contents of an index file.
+//
+// The entries are views into `buffer`, which must outlive them.
+class index_parser
+{
+  std::string_view m_buffer;
+  std::size_t m_index {0};  // into m_buffer
+
+  std::vector<index_entry> m_entries;
+
+  bool available(std::size_t size) const
+  {
+    return m_buffer.size() - m_index >= size;
+  }
+
+  uint8_t next_byte()
+  {
+    return static_cast<uint8_t>(m_buffer[m_index++]);
+  }
+
+  uint16_t next_two_bytes()
+  {
+    uint16_t bytes;
+    std::memcpy(&bytes, m_buffer.data() + m_index, sizeof(bytes));
+    m_index += sizeof(bytes);
+    return bytes;
+  }
+
+  // Returns false, leaving m_index unchanged, if the buffer ends before
+  // the entry does (the writer may not have flushed all of it yet)
+  bool parse_entry()
+  {
+    const std::size_t entry_start = m_index;
+    auto incomplete = [&]
+    {
+      m_index = entry_start;
+      return false;
+    };
+
+    index_entry entry;
+
+    // First, parse the size of the format string
+    if (!available(sizeof(uint16_t))) {
+      return incomplete();
+    }
+    const std::size_t format_string_size = next_two_bytes();
+
+    // Next, parse the format string and the number of arguments
+    if (!available(format_string_size + 1)) {
+      return incomplete();
+    }
+    entry.format_string = m_buffer.substr(m_index, format_string_size);
+    m_index += format_string_size;
+    const std::size_t num_args = next_byte();
+
+    // Parse the arg type of each arg
+    // This is 1 byte * num_args
+    if (!available(num_args)) {
+      return incomplete();
+    }
+    entry.args.resize(num_args);
+    for (auto& arg : entry.args) {
+      arg.type = static_cast<fmt_arg_type>(next_byte());
+    }
+
+    // The next set of bytes will have the format
+    // <is_constant> <arg-value>? <is_constant> <arg-value>? ...
+    for (auto& arg : entry.args) {
+      if (!available(1)) {
+        return incomplete();
+      }
+      arg.is_constant = next_byte();
+      if (!arg.is_constant) {
+        continue;
+      }
+
+      std::size_t size = 0;
+      if (arg.type == fmt_arg_type::type_string) {
+        // the next two bytes will be the size of the string
+        if (!available(sizeof(uint16_t))) {
+          return incomplete();
+        }
+        size = next_two_bytes();
+      } else {
+        // size is determined by the type of the arg
+        size = sizeof_arg_type(arg.type);
+      }
+      if (!available(size)) {
+        return incomplete();
+      }
+      arg.arg_data = m_buffer.substr(m_index, size);
+      m_index += size;
+    }
+
+    if (!available(1)) {
+      return incomplete();
+    }
+    // The entries of a log of another format would be misread from here
+    // on
+    const auto level_byte = next_byte();
+    const auto level =
+        static_cast<uint8_t>(level_byte & ~suppressed_count_flag);
+    if (level >= level_names.size()) {
+      invalid_index("unknown level " + std::to_string(level) + " of \""
+                    + std::string(entry.format_string) + "\"");
+    }
+    entry.level = static_cast<::binary_log::level>(level);
+    entry.counts_suppressed = (level_byte & suppressed_count_flag) != 0;
+
+    std::size_t record_size = 0;
+    bool is_fixed_size = true;
+    for (const auto& arg : entry.args) {
+      if (arg.is_constant) {
+        continue;
+      }
+      if (arg.type == fmt_arg_type::type_string) {
+        is_fixed_size = false;
+        break;
+      }
+      record_size += sizeof_arg_type(arg.type);
+    }
+    if (is_fixed_size) {
+      entry.fixed_record_size = record_size;
+    }
+    entry.bytes = m_buffer.substr(entry_start, m_index - entry_start);
+
+    m_entries.push_back(std::move(entry));
+    return true;
+  }
+
+public:
+  index_parser() = default;
+
+  explicit index_parser(std::string_view buffer)
+      : m_buffer(buffer)
+  {
+  }
+
+  // Parses every complete entry in the buffer; a partially written entry
+  // at the end is left out
+  std::vector<index_entry> parse()
+  {
+    while (m_index < m_buffer.size() && parse_entry()) {
+    }
+    return m_entries;
+  }
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// #include <binary_log/detail/index_parser.hpp>
+// #include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+// A log, its index entries and its runs in one file or one byte stream
+// (see container_packer), for pipes, sockets and any log that is easier
+// to handle as a single file:
+//
+//   <container_header> <block> <block> ...
+//
+// A block holds whole records, and is written by the packer at once:
+//
+//   <block tag> <size: 4 bytes> <call sites> <records>
+//
+// The `size` bytes after the marker are the call site entries added by
+// the block, if any, and its records. Each call site entry is
+//
+//   <call site tag> <size: 4 bytes> <index entry>
+//
+// with the entry as in an index file; the call sites are numbered in the
+// order of their entries. Each record is
+//
+//   <code: varint> <args>
+//
+// where the code is the format string index plus container_tag::count,
+// the codes below it being the tags, unless it starts a run of records of
+// the same call site:
+//
+//   <run tag> <count: varint> <code: varint> <args>...
+//
+// where the code is followed by the args of all `count` records, or a
+// repeat (see repeats.hpp):
+//
+//   <repeat tag> <count: varint> <period: varint> <code: varint>...
+//
+// where the codes of the `period` call sites are followed by the args of
+// `count` records that log at them in turn. Varints are unsigned LEB128
+// (see varint.hpp), and each tag is a single byte. No run or repeat goes
+// on from one block to the next.
+//
+// A packer writing with index_coding::huffman moves the codes of the
+// records of each block, and those of its runs and repeats, into a bit
+// stream in
+// front of them:
+//
+//   <block tag> <size: 4 bytes> <call sites> <codes tag> <size: 4 bytes>
+//   <codes> <rest>
+//
+// where the `size` bytes of <codes> hold the codes with Huffman codes
+// built for the block (see huffman.hpp), and <rest> what remains of its
+// records: the count of each run, the count and period of each repeat,
+// and the args.
+struct container_header
+{
+  char magic[6];
+  uint16_t version;
+  uint32_t flags;  // none defined yet
+  uint32_t block_size;  // of the packer's buffer, as a hint for readers
+};
+static_assert(sizeof(container_header) == 16);
+
+static constexpr std::string_view container_magic = "BINLOG";
+// Version 1 had 4-byte run counts, version 2 2-byte tags and indices,
+// version 3 no coded blocks, version 4 no repeats, version 5 no level in
+// the call site entries
+static constexpr uint16_t container_version = 6;
+
+// Codes of the record positions that are not records
+namespace container_tag
+{
+static constexpr uint8_t run = 0;
+static constexpr uint8_t call_site = 1;
+static constexpr uint8_t block = 2;
+static constexpr uint8_t codes = 3;
+static constexpr uint8_t repeat = 4;
+static constexpr uint8_t count = 5;
+}  // namespace container_tag
+
+// How a container_packer writes the codes of its records: as varints,
+// or with Huffman codes, which spend fewer bits on the call sites that
+// log the most in each block at some cost to the packer at the end of
+// the block and to readers
+enum class index_coding
+{
+  varint,
+  huffman
+};
+
+static constexpr std::size_t container_marker_size =
+    sizeof(uint8_t) + sizeof(uint32_t);
+
+inline uint64_t container_code(std::size_t index)
+{
+  return index + container_tag::count;
+}
+
+[[noreturn]] inline void invalid_container(const char* reason)
+{
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+  throw std::runtime_error(std::string("Invalid log container: ") + reason);
+#else
+  (void)reason;
+  abort();
+#endif
+}
+
+inline bool has_container_header(std::string_view data)
+{
+  return data.starts_with(container_magic);
+}
+
+// The header at the start of `data`, which must be a container whose
+// version this reader knows
+inline container_header read_container_header(std::string_view data)
+{
+  container_header header;
+  if (data.size() < sizeof(header) || !has_container_header(data)) {
+    invalid_container("no container header");
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.version != container_version) {
+    invalid_container(("unsupported version "
+                       + std::to_string(header.version))
+                          .c_str());
+  }
+  return header;
+}
+
+// Reads the tag and size of the marker at `offset` of `data`
+inline bool read_container_marker(std::string_view data,
+                                  std::size_t offset,
+                                  uint8_t& tag,
+                                  uint32_t& size)
+{
+  if (offset + container_marker_size > data.size()) {
+    return false;
+  }
+  std::memcpy(&tag, data.data() + offset, sizeof(tag));
+  std::memcpy(&size, data.data() + offset + sizeof(tag), sizeof(size));
+  return true;
+}
+
+// The call site entries at the start of `block`, the bytes that follow a
+// block marker
+inline std::string_view container_call_sites(std::string_view block)
+{
+  std::size_t end = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(block, end, tag, size)
+         && tag == container_tag::call_site)
+  {
+    if (size > block.size() - end - container_marker_size) {
+      invalid_container("truncated call site");
+    }
+    end += container_marker_size + size;
+  }
+  return block.substr(0, end);
+}
+
+// Adds the entries of `call_sites`, as returned by container_call_sites(),
+// to `index_table`. The entries view `call_sites`.
+inline void parse_container_call_sites(std::string_view call_sites,
+                                       std::vector<index_entry>& index_table)
+{
+  std::size_t offset = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(call_sites, offset, tag, size)) {
+    const auto bytes = call_sites.substr(offset + container_marker_size, size);
+    auto entries = index_parser(bytes).parse();
+    if (entries.size() != 1 || entries.front().bytes.size() != size) {
+      invalid_container("malformed call site");
+    }
+    index_table.push_back(std::move(entries.front()));
+    offset += container_marker_size + size;
+  }
+}
+
+// Adds the call sites of the blocks of `log`, the container after its
+// header, to `index_table` and the offsets of the blocks to `blocks`,
+// going from block to block. Returns the size of the whole blocks: the
+// log of a logger that is still writing may end in part of a block.
+inline std::size_t scan_container(std::string_view log,
+                                  std::vector<index_entry>& index_table,
+                                  std::vector<std::size_t>& blocks)
+{
+  std::size_t offset = 0;
+  uint8_t tag = 0;
+  uint32_t size = 0;
+  while (read_container_marker(log, offset, tag, size)) {
+    if (tag != container_tag::block) {
+      invalid_container("expected a block");
+    }
+    if (size > log.size() - offset - container_marker_size) {
+      break;
+    }
+    const auto block = log.substr(offset + container_marker_size, size);
+    parse_container_call_sites(container_call_sites(block), index_table);
+    blocks.push_back(offset);
+    offset += container_marker_size + size;
+  }
+  return offset;
+}
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// #include <binary_log/detail/container_format.hpp>
+// #include <binary_log/detail/varint.hpp>
+
+namespace binary_log
+{
+// Canonical Huffman codes for the codes of the records of a container
+// block (see container_format.hpp), which are written as
+//
+//   <symbol count: varint> (<delta: varint> <length: 1 byte>)...
+//   <code count: varint> <bits>
+//
+// listing the symbols that occur in the block in increasing order, each
+// as its difference from the previous one (the first from 0), with the
+// length in bits of its code. Codes are assigned in order of length, then
+// of symbol, and the bits hold the codes of `code count` symbols, most
+// significant bit first, up to the end of the codes.
+static constexpr unsigned max_huffman_code_length = 24;
+
+class huffman_encoder
+{
+  struct node
+  {
+    uint64_t weight;
+    uint32_t id;
+
+    bool operator>(const node& other) const
+    {
+      return weight > other.weight;
+    }
+  };
+
+  // By symbol, kept zero for the symbols of no block
+  std::vector<uint32_t> m_frequencies;
+  std::vector<uint32_t> m_codes;
+  std::vector<uint8_t> m_lengths;
+
+  // Scratch space, kept from block to block
+  std::vector<uint32_t> m_symbols;  // of the block, in increasing order
+  std::vector<uint64_t> m_weights;
+  std::vector<uint32_t> m_parents;
+  std::vector<uint8_t> m_depths;
+  std::vector<node> m_heap;
+
+  // Code lengths from a Huffman tree of the symbol frequencies. Rare
+  // symbols of large alphabets may be deeper than the longest code: the
+  // frequencies are then halved, flattening the tree, until they fit.
+  void build_lengths()
+  {
+    const auto count = m_symbols.size();
+    if (count == 1) {
+      m_lengths[m_symbols.front()] = 1;
+      return;
+    }
+
+    m_weights.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      m_weights[i] = m_frequencies[m_symbols[i]];
+    }
+    for (;;) {
+      // Leaves are the nodes [0, count), and each internal node comes
+      // after its children
+      m_heap.clear();
+      for (std::size_t i = 0; i < count; ++i) {
+        m_heap.push_back({m_weights[i], static_cast<uint32_t>(i)});
+      }
+      std::make_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+      m_parents.resize(2 * count - 1);
+      auto next = static_cast<uint32_t>(count);
+      while (m_heap.size() > 1) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+        const auto first = m_heap.back();
+        m_heap.pop_back();
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+        const auto second = m_heap.back();
+        m_heap.pop_back();
+        m_parents[first.id] = next;
+        m_parents[second.id] = next;
+        m_heap.push_back({first.weight + second.weight, next++});
+        std::push_heap(m_heap.begin(), m_heap.end(), std::greater<> {});
+      }
+
+      m_depths.assign(2 * count - 1, 0);
+      unsigned longest = 0;
+      for (auto i = 2 * count - 1; i-- > 0;) {
+        if (i + 1 < 2 * count - 1) {
+          m_depths[i] = static_cast<uint8_t>(m_depths[m_parents[i]] + 1);
+        }
+        if (i < count) {
+          longest = std::max<unsigned>(longest, m_depths[i]);
+        }
+      }
+      if (longest <= max_huffman_code_length) {
+        break;
+      }
+      for (auto& weight : m_weights) {
+        weight = 1 + weight / 2;
+      }
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+      m_lengths[m_symbols[i]] = m_depths[i];
+    }
+  }
+
+  void assign_codes()
+  {
+    // Symbols by length, then symbol
+    std::stable_sort(m_symbols.begin(),
+                     m_symbols.end(),
+                     [this](uint32_t a, uint32_t b)
+                     { return m_lengths[a] < m_lengths[b]; });
+    uint32_t code = 0;
+    unsigned length = m_lengths[m_symbols.front()];
+    for (const auto symbol : m_symbols) {
+      code <<= m_lengths[symbol] - length;
+      length = m_lengths[symbol];
+      m_codes[symbol] = code++;
+    }
+  }
+
+  static void append_varint(std::vector<uint8_t>& out, uint64_t value)
+  {
+    uint8_t bytes[max_varint_size];
+    out.insert(out.end(), bytes, bytes + write_varint(bytes, value));
+  }
+
+public:
+  // Appends the table and the codes of `symbols` to `out`
+  void encode(const std::vector<uint32_t>& symbols, std::vector<uint8_t>& out)
+  {
+    m_symbols.clear();
+    for (const auto symbol : symbols) {
+      if (symbol >= m_frequencies.size()) {
+        m_frequencies.resize(symbol + 1);
+        m_codes.resize(symbol + 1);
+        m_lengths.resize(symbol + 1);
+      }
+      if (m_frequencies[symbol]++ == 0) {
+        m_symbols.push_back(symbol);
+      }
+    }
+    std::sort(m_symbols.begin(), m_symbols.end());
+
+    append_varint(out, m_symbols.size());
+    if (!m_symbols.empty()) {
+      build_lengths();
+      uint32_t previous = 0;
+      for (const auto symbol : m_symbols) {
+        append_varint(out, symbol - previous);
+        out.push_back(m_lengths[symbol]);
+        previous = symbol;
+      }
+      assign_codes();
+    }
+
+    append_varint(out, symbols.size());
+    for (const auto symbol : m_symbols) {
+      m_frequencies[symbol] = 0;
+    }
+
+    // Whole bytes leave the top of `pending`
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+    for (const auto symbol : symbols) {
+      pending = (pending << m_lengths[symbol]) | m_codes[symbol];
+      pending_bits += m_lengths[symbol];
+      while (pending_bits >= 8) {
+        pending_bits -= 8;
+        out.push_back(static_cast<uint8_t>(pending >> pending_bits));
+      }
+    }
+    if (pending_bits > 0) {
+      out.push_back(static_cast<uint8_t>(pending << (8 - pending_bits)));
+    }
+  }
+};
+
+class huffman_decoder
+{
+  // Codes up to lookup_bits long are decoded with one lookup of the
+  // next bits, as (symbol << 8) | length; longer codes, a length at a
+  // time
+  static constexpr unsigned lookup_bits = 11;
+
+  unsigned m_lookup_bits {0};
+  unsigned m_max_length {0};
+  std::vector<uint32_t> m_lookup;
+  std::vector<uint32_t> m_sorted;  // symbols in the order of their codes
+  std::array<uint32_t, max_huffman_code_length + 1> m_first_code {};
+  std::array<uint32_t, max_huffman_code_length + 1> m_first_position {};
+  std::array<uint32_t, max_huffman_code_length + 1> m_count {};
+
+  // Compilers make a single instruction of this
+  static constexpr uint64_t byteswap(uint64_t value)
+  {
+    value = ((value & 0x00FF00FF00FF00FF) << 8)
+        | ((value >> 8) & 0x00FF00FF00FF00FF);
+    value = ((value & 0x0000FFFF0000FFFF) << 16)
+        | ((value >> 16) & 0x0000FFFF0000FFFF);
+    return (value << 32) | (value >> 32);
+  }
+
+  // The 32 bits at bit `position` of `bits`, past its end as zeros
+  static uint32_t peek(std::string_view bits, std::size_t position)
+  {
+    const auto byte = position / 8;
+    uint64_t window = 0;
+    if (byte + sizeof(window) <= bits.size()) {
+      std::memcpy(&window, bits.data() + byte, sizeof(window));
+      if constexpr (std::endian::native == std::endian::little) {
+        window = byteswap(window);
+      }
+    } else {
+      for (std::size_t i = 0; byte + i < bits.size(); ++i) {
+        window |= uint64_t {static_cast<uint8_t>(bits[byte + i])}
+            << (56 - 8 * i);
+      }
+    }
+    return static_cast<uint32_t>((window << (position % 8)) >> 32);
+  }
+
+public:
+  // Reads the table at `offset` of `data`, and moves past it
+  void read_table(std::string_view data, std::size_t& offset)
+  {
+    const auto count = read_varint(data, offset);
+    if (count > data.size() - std::min(offset, data.size())) {
+      invalid_container("truncated code table");
+    }
+
+    m_sorted.clear();
+    m_count.fill(0);
+    m_max_length = 0;
+    std::vector<uint8_t> lengths;
+    lengths.reserve(count);
+    uint64_t symbol = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+      symbol += read_varint(data, offset);
+      if (offset >= data.size()) {
+        invalid_container("truncated code table");
+      }
+      const auto length = static_cast<uint8_t>(data[offset++]);
+      if (length == 0 || length > max_huffman_code_length
+          || symbol > std::numeric_limits<uint32_t>::max() >> 8)
+      {
+        invalid_container("malformed code table");
+      }
+      m_sorted.push_back(static_cast<uint32_t>(symbol));
+      lengths.push_back(length);
+      m_count[length]++;
+      m_max_length = std::max<unsigned>(m_max_length, length);
+    }
+
+    // Canonical order: by length, then symbol
+    std::vector<uint32_t> order(m_sorted.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = static_cast<uint32_t>(i);
+    }
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&lengths](uint32_t a, uint32_t b)
+                     { return lengths[a] < lengths[b]; });
+
+    uint64_t code = 0;
+    uint32_t position = 0;
+    for (unsigned length = 1; length <= m_max_length; ++length) {
+      m_first_code[length] = static_cast<uint32_t>(code);
+      m_first_position[length] = position;
+      code += m_count[length];
+      position += m_count[length];
+      if (code > (uint64_t {1} << length)) {
+        invalid_container("oversubscribed code table");
+      }
+      code <<= 1;
+    }
+
+    m_lookup_bits = std::min(lookup_bits, m_max_length);
+    m_lookup.assign(std::size_t {1} << m_lookup_bits, 0);
+    std::vector<uint32_t> sorted(m_sorted.size());
+    std::vector<uint32_t> next_code(m_first_code.begin(), m_first_code.end());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      const auto symbol = m_sorted[order[i]];
+      const auto length = lengths[order[i]];
+      sorted[i] = symbol;
+      const auto symbol_code = next_code[length]++;
+      if (length <= m_lookup_bits) {
+        const auto first = symbol_code << (m_lookup_bits - length);
+        std::fill_n(m_lookup.begin() + first,
+                    std::size_t {1} << (m_lookup_bits - length),
+                    (symbol << 8) | length);
+      }
+    }
+    m_sorted = std::move(sorted);
+  }
+
+  // Decodes the symbol at bit `position` of `bits`, and moves past it
+  uint32_t decode(std::string_view bits, std::size_t& position) const
+  {
+    const auto window = peek(bits, position);
+    if (m_lookup_bits > 0) {
+      const auto entry = m_lookup[window >> (32 - m_lookup_bits)];
+      if (entry != 0) {
+        position += entry & 0xFF;
+        return entry >> 8;
+      }
+    }
+    for (auto length = m_lookup_bits + 1; length <= m_max_length; ++length) {
+      const auto code = window >> (32 - length);
+      if (code - m_first_code[length] < m_count[length]) {
+        position += length;
+        return m_sorted[m_first_position[length] + code
+                        - m_first_code[length]];
+      }
+    }
+    invalid_container("invalid code");
+  }
+};
+
+}  // namespace binary_log
+
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// #include <binary_log/constant.hpp>
+// #include <binary_log/detail/args.hpp>
+// #include <binary_log/detail/container_format.hpp>
+// #include <binary_log/detail/huffman.hpp>
+// #include <binary_log/detail/repeats.hpp>
+
+namespace binary_log
+{
+/// This Packer implementation writes the log, its index entries and its
+/// runs to a single file (see container_format.hpp), through one buffer,
+/// instead of a log file and its side files. A pipe or a socket is enough
+/// to carry it, e.g.
+///
+///   binary_log::binary_log<binary_log::container_packer<>> log("-");
+///
+/// logs to stdout, for `app | unpacker -`. The records are written in
+/// blocks of about `log_buffer_size` bytes, which end at a record, and at
+/// every flush().
+///
+/// With index_coding::huffman, the codes of the records of each block are
+/// kept apart and Huffman coded as the block is closed, e.g.
+///
+///   binary_log::binary_log<binary_log::container_packer<
+///       64 * 1024, binary_log::index_coding::huffman>> log("app.log");
+///
+/// so that a call site logging most of the records of a block spends a
+/// bit or two on each instead of a byte.
+template<size_t log_buffer_size = 64 * 1024,
+         index_coding coding = index_coding::varint>
+class container_packer
+{
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  std::filesystem::path m_path;
+  std::FILE* m_file;
+
+  std::vector<uint8_t> m_buffer;
+  std::vector<uint8_t> m_index_buffer;  // entries of new call sites
+
+  std::size_t m_block_start {npos};  // of the open block in m_buffer
+
+  // With index_coding::huffman, the codes of the open block, whose
+  // records start at m_records_start of m_buffer
+  std::vector<uint32_t> m_codes;
+  std::size_t m_records_start {0};
+  huffman_encoder m_encoder;
+  std::vector<uint8_t> m_encoded_codes;
+
+  // A tagged run costs the tag and the count (2 bytes up to 127 records)
+  // more than the code of its first record, and saves the code of the
+  // others: records only become a run from the min_run_length-th record
+  // of the same call site in a row
+  static constexpr std::size_t min_run_length = 3;
+
+  // The last records of the same call site: m_record_offsets holds their
+  // offsets in m_buffer until they become a run, and m_run_offset the
+  // offset of the count of the run, which takes m_run_count_size bytes.
+  // Coded records start with their args in m_buffer.
+  std::size_t m_record_offsets[min_run_length - 1] {};
+  std::size_t m_run_offset {0};
+  std::size_t m_run_count_size {0};
+  uint16_t m_run_index {0};
+  std::size_t m_run_count {0};
+  std::vector<uint8_t> m_run_args;
+
+  // The repeat of the open block (see repeats.hpp), if m_repeat_count > 0:
+  // the records that log at m_repeat_call_sites in turn, whose count takes
+  // m_repeat_count_size bytes at m_repeat_offset of m_buffer
+  repeat_detector m_repeats;
+  uint16_t m_repeat_call_sites[max_repeat_period] {};
+  std::size_t m_repeat_period {0};
+  std::size_t m_repeat_position {0};  // of the next record
+  std::size_t m_repeat_count {0};
+  std::size_t m_repeat_offset {0};
+  std::size_t m_repeat_count_size {0};
+
+  template<typename T, std::size_t size>
+  void buffer_or_write(T* input)
+  {
+    buffer_or_write(input, size);
+  }
+
+  template<typename T>
+  void buffer_or_write(T* input, std::size_t size)
+  {
+    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    m_buffer.insert(m_buffer.end(), byte_array, byte_array + size);
+  }
+
+  template<typename T>
+  constexpr void buffer_or_write_index_file(T* input, std::size_t size)
+  {
+    const auto* byte_array = reinterpret_cast<const uint8_t*>(input);
+    m_index_buffer.insert(m_index_buffer.end(), byte_array, byte_array + size);
+  }
+
+  void write_marker(uint8_t tag, uint32_t size)
+  {
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&tag);
+    buffer_or_write<uint32_t, sizeof(uint32_t)>(&size);
+  }
+
+  void write_code(uint16_t index)
+  {
+    const auto value = container_code(index);
+    if constexpr (coding == index_coding::huffman) {
+      m_codes.push_back(static_cast<uint32_t>(value));
+      return;
+    }
+    if (value < 0x80) {
+      auto code = static_cast<uint8_t>(value);
+      buffer_or_write<uint8_t, sizeof(uint8_t)>(&code);
+      return;
+    }
+    uint8_t code[max_varint_size];
+    buffer_or_write(code, write_varint(code, value));
+  }
+
+  void write_tag(uint8_t tag)
+  {
+    if constexpr (coding == index_coding::huffman) {
+      m_codes.push_back(tag);
+      return;
+    }
+    buffer_or_write<uint8_t, sizeof(uint8_t)>(&tag);
+  }
+
+  void close_block()
+  {
+    end_repeat();
+    if (m_block_start == npos) {
+      return;
+    }
+    if (coding == index_coding::huffman && !m_codes.empty()) {
+      m_encoded_codes.resize(container_marker_size);
+      m_encoder.encode(m_codes, m_encoded_codes);
+      m_encoded_codes[0] = container_tag::codes;
+      const auto size = static_cast<uint32_t>(m_encoded_codes.size()
+                                              - container_marker_size);
+      std::memcpy(&m_encoded_codes[sizeof(uint8_t)], &size, sizeof(size));
+      m_buffer.insert(
+          m_buffer.begin() + static_cast<std::ptrdiff_t>(m_records_start),
+          m_encoded_codes.begin(),
+          m_encoded_codes.end());
+      m_codes.clear();
+    }
+    const auto size = static_cast<uint32_t>(m_buffer.size() - m_block_start
+                                            - container_marker_size);
+    auto* marker = m_buffer.data() + m_block_start;
+    std::memcpy(marker + sizeof(uint8_t), &size, sizeof(size));
+    m_block_start = npos;
+  }
+
+  // Runs do not go on from one block to the next
+  void open_block()
+  {
+    close_block();
+    m_block_start = m_buffer.size();
+    write_marker(container_tag::block, 0);
+    m_records_start = m_buffer.size();
+    m_run_count = 0;
+  }
+
+  // Rewrites the last records, of m_run_index, as a run that the next
+  // record joins
+  void start_run()
+  {
+    if constexpr (coding == index_coding::huffman) {
+      // The run only takes its count in front of the args
+      m_codes.resize(m_codes.size() - m_run_count);
+      m_codes.push_back(container_tag::run);
+      m_codes.push_back(static_cast<uint32_t>(container_code(m_run_index)));
+      m_run_count++;
+      m_run_offset = m_record_offsets[0];
+      m_run_count_size = varint_size(m_run_count);
+      uint8_t count[max_varint_size];
+      write_varint(count, m_run_count);
+      m_buffer.insert(m_buffer.begin()
+                          + static_cast<std::ptrdiff_t>(m_run_offset),
+                      count,
+                      count + m_run_count_size);
+      return;
+    }
+    const auto first = m_record_offsets[0];
+    const auto code_size = varint_size(container_code(m_run_index));
+    m_run_args.clear();
+    for (std::size_t i = 0; i < m_run_count; ++i) {
+      const auto end =
+          i + 1 < m_run_count ? m_record_offsets[i + 1] : m_buffer.size();
+      m_run_args.insert(m_run_args.end(),
+                        m_buffer.begin() + static_cast<std::ptrdiff_t>(
+                            m_record_offsets[i] + code_size),
+                        m_buffer.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+    m_run_count++;
+    m_run_offset = first + sizeof(uint8_t);
+    m_run_count_size = varint_size(m_run_count);
+    m_buffer.resize(m_run_offset + m_run_count_size);
+    m_buffer[first] = container_tag::run;
+    write_varint(m_buffer.data() + m_run_offset, m_run_count);
+    write_code(m_run_index);
+    m_buffer.insert(m_buffer.end(), m_run_args.begin(), m_run_args.end());
+  }
+
+  // Starts a repeat of `period` call sites with the record of `index`
+  void start_repeat(uint16_t index, std::size_t period)
+  {
+    write_tag(container_tag::repeat);
+    m_repeat_offset = m_buffer.size();
+    m_repeat_count = 1;
+    m_repeat_count_size = 1;
+    const uint8_t header[2] = {1, static_cast<uint8_t>(period)};
+    buffer_or_write<const uint8_t, sizeof(header)>(header);
+    for (std::size_t i = 0; i < period; ++i) {
+      m_repeat_call_sites[i] = i == 0 ? index : m_repeats.at(period - i);
+      write_code(m_repeat_call_sites[i]);
+    }
+    m_repeat_period = period;
+    m_repeat_position = 1;
+  }
+
+  // Counts the record of `index` in the repeat, if it logs at the next of
+  // its call sites
+  bool continue_repeat(uint16_t index)
+  {
+    if (index != m_repeat_call_sites[m_repeat_position]) {
+      return false;
+    }
+    m_repeat_count++;
+    if (varint_size(m_repeat_count) > m_repeat_count_size) {
+      m_buffer.insert(
+          m_buffer.begin() + static_cast<std::ptrdiff_t>(m_repeat_offset), 0);
+      m_repeat_count_size++;
+    }
+    write_varint(m_buffer.data() + m_repeat_offset, m_repeat_count);
+    if (++m_repeat_position == m_repeat_period) {
+      m_repeat_position = 0;
+    }
+    return true;
+  }
+
+  // The next record of the next call site starts another repeat
+  void end_repeat()
+  {
+    if (m_repeat_count > 0) {
+      m_repeats.resume(
+          m_repeat_call_sites, m_repeat_period, m_repeat_position);
+      m_repeat_count = 0;
+    }
+  }
+
+  // New call sites open a block, so that readers find their entries
+  // without decoding the records
+  void write_call_sites()
+  {
+    open_block();
+    m_buffer.insert(
+        m_buffer.end(), m_index_buffer.begin(), m_index_buffer.end());
+    m_index_buffer.clear();
+    m_records_start = m_buffer.size();
+  }
+
+  void write_blocks()
+  {
+    close_block();
+    fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    m_buffer.clear();
+    m_run_count = 0;
+  }
+
+public:
+  // Writes to stdout if `path` is "-"
+  container_packer(const std::filesystem::path& path) : m_path(path)
+  {
+    if (m_path == "-") {
+      m_file = stdout;
+    } else {
+      m_file = fopen(m_path.c_str(), "wb");
+    }
+    if (m_file == nullptr) {
+#if defined(__cpp_exceptions) && __cpp_exceptions >= 199711L
+      throw std::invalid_argument("fopen failed");
+#else
+      abort();
+#endif
+    }
+    // A record may overshoot the block a little
+    m_buffer.reserve(log_buffer_size + 4096);
+
+    container_header header {};
+    std::memcpy(header.magic, container_magic.data(), sizeof(header.magic));
+    header.version = container_version;
+    header.block_size = static_cast<uint32_t>(log_buffer_size);
+    fwrite(&header, sizeof(header), 1, m_file);
+  }
+
+  container_packer(const char* path)
+      : container_packer(std::filesystem::path {path})
+  {
+  }
+
+  ~container_packer()
+  {
+    flush();
+    if (m_file != stdout) {
+      fclose(m_file);
+    }
+  }
+
+  std::filesystem::path get_log_path() const
+  {
+    return m_path;
+  }
+
+  void flush()
+  {
+    if (!m_index_buffer.empty()) {
+      write_call_sites();
+    }
+    write_blocks();
+    fflush(m_file);
+  }
+
+  template<typename T>
+  inline void write_arg_value_to_log_file(T&& input) = delete;
+
+  inline void write_arg_value_to_log_file(const char* input)
+  {
+    uint16_t size = static_cast<uint16_t>(std::strlen(input));
+    buffer_or_write<uint16_t, sizeof(uint16_t)>(&size);
+    buffer_or_write(input, size);
+  }
+
+  inline void write_arg_value_to_log_file(char input)
+  {
+    buffer_or_write<char, sizeof(char)>(&input);
   }
 
   inline void write_arg_value_to_log_file(bool input)
@@ -506,7 +3117,7 @@ public:
   }
 
   template<typename U>
-  inline void write_arg_value_to_log_file(U &input) requires (std::is_same_v<U, std::size_t>) // && !std::is_same_v<U, uint64_t> && !std::is_same_v<U, uint32_t>)
+  inline void write_arg_value_to_log_file(U &input) requires (std::is_same_v<U, std::size_t>)
   {
     buffer_or_write<U, sizeof(U)>(&input);
   }
@@ -557,70 +3168,55 @@ public:
     }
   }
 
-  inline void write_current_runlength_to_runlength_file()
+  constexpr inline void pack_format_string_index(uint16_t index)
   {
-    if (m_current_runlength > 1) {
-      size_t bytes_left = sizeof(uint16_t) + sizeof(uint64_t);
-      // make the bytes we'll write to the runlength file
-      uint8_t bytes[sizeof(uint16_t) + sizeof(uint64_t)];
-      // fill the bytes
-      std::memcpy(&bytes[0], &m_runlength_index, sizeof(uint16_t));
-      std::memcpy(&bytes[sizeof(uint16_t)], &m_current_runlength, sizeof(uint64_t));
-      // write the bytes
-      while (bytes_left) {
-        if (m_runlength_buffer_index + bytes_left >= runlength_buffer_size) {
-          fwrite(m_runlength_buffer.data(),
-                 sizeof(uint8_t),
-                 m_runlength_buffer_index,
-                 m_runlength_file);
-          m_runlength_buffer_index = 0;
-        }
+    // A full buffer is written before the next record
+    if (m_buffer.size() >= log_buffer_size) {
+      write_blocks();
+    }
+    if (!m_index_buffer.empty()) {
+      write_call_sites();
+    } else if (m_block_start == npos) {
+      open_block();
+    }
 
-        std::size_t bytes_to_copy = std::min(bytes_left, runlength_buffer_size);
-        std::copy_n(bytes, bytes_to_copy, &m_runlength_buffer[m_runlength_buffer_index]);
-        m_runlength_buffer_index += bytes_to_copy;
-        bytes_left -= bytes_to_copy;
+    if (m_repeat_count > 0) [[unlikely]] {
+      if (continue_repeat(index)) {
+        return;
       }
+      end_repeat();
     }
-  }
-
-  constexpr inline void pack_format_string_index(uint16_t index)
-  {
-    // Evaluate this index
-    //
-    // If index is the same as the m_runlength_index
-    // but m_current_runlength is 0, write it and increment m_current_runlength
-    // else, no need to write it, just update the runlength
-    //
-    // If the index is different from m_runlength_index
-    // then, write (m_runlength_index + m_current_runlength)
-    // to the m_runlength_file and write the new index
-    // to the logfile
 
-    if (m_runlength_index == 0 && index == 0) {
-      // First index
-      if (m_current_runlength == 0) {
-        // First call
-        // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
-        m_current_runlength++;
-      } else if (m_current_runlength >= 1) {
-        m_current_runlength++;
+    if (m_run_count >= min_run_length && m_run_index == index) {
+      m_run_count++;
+      if (varint_size(m_run_count) > m_run_count_size) {
+        // Rarely: the count needs one more byte, in front of the args
+        m_buffer.insert(m_buffer.begin()
+                            + static_cast<std::ptrdiff_t>(m_run_offset),
+                        0);
+        m_run_count_size++;
       }
+      write_varint(m_buffer.data() + m_run_offset, m_run_count);
+    } else if (m_run_count == min_run_length - 1 && m_run_index == index) {
+      start_run();
     } else {
-      // Not first index
-      if (m_runlength_index == index) {
-        // No change to index
-        m_current_runlength++;
-      } else {
-        // Write current runlength to file
-        write_current_runlength_to_runlength_file();
-
-        // Write index to log file
-        buffer_or_write<uint16_t, sizeof(uint16_t)>(&index);
-        m_current_runlength = 1;
-        m_runlength_index = index;
+      if (m_run_count == 0 || m_run_index != index
+          || m_run_count >= min_run_length)
+      {
+        // Only call sites of one record each make up a repeat
+        if (m_run_count > 1) {
+          m_repeats.clear();
+        }
+        if (const auto period = m_repeats.add(index)) [[unlikely]] {
+          start_repeat(index, period);
+          m_run_count = 0;
+          return;
+        }
+        m_run_index = index;
+        m_run_count = 0;
       }
+      m_record_offsets[m_run_count++] = m_buffer.size();
+      write_code(index);
     }
   }
 
@@ -630,84 +3226,14 @@ public:
     ((void)pack_arg(std::forward<Args>(args)), ...);
   }
 
-  template<fmt_arg_type T>
-  constexpr inline void write_arg_type()
-  {
-    constexpr uint8_t type_byte = static_cast<uint8_t>(T);
-    buffer_or_write_index_file(&type_byte, sizeof(uint8_t));
-  }
-
-  template<typename T>
-  constexpr inline void save_arg_type()
-  {
-    using type = typename std::decay<T>::type;
-
-    if constexpr (is_specialization<type, constant> {}) {
-      // This is a constant
-      using inner_type = typename T::type;
-      write_arg_type<binary_log::get_arg_type<inner_type>()>();
-    } else {
-      write_arg_type<binary_log::get_arg_type<type>()>();
-    }
-  }
-
-  template<typename T>
-  inline void write_arg_value_to_index_file(T&& input) = delete;
-
-  inline void write_arg_value_to_index_file(const char* input)
-  {
-    const uint16_t size = static_cast<uint16_t>(std::strlen(input));
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input, size);
-  }
-
-  template<typename T>
-  requires is_numeric_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    buffer_or_write_index_file(&input, sizeof(T));
-  }
-
-  template<typename T>
-  requires is_string_type<T> inline void write_arg_value_to_index_file(
-      T&& input)
-  {
-    const uint16_t size = static_cast<uint16_t>(input.size());
-    buffer_or_write_index_file(&size, sizeof(uint16_t));
-    buffer_or_write_index_file(input.data(), input.size());
-  }
-
-  template<typename T>
-  constexpr inline void save_arg_constness(T&& input)
-  {
-    if constexpr (!is_specialization<T, constant> {}) {
-      constexpr bool is_constant = false;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-    } else {
-      constexpr bool is_constant = true;
-      buffer_or_write_index_file(&is_constant, sizeof(bool));
-      write_arg_value_to_index_file(input.value);
-    }
-  }
-
-  template<class... Args>
-  constexpr inline void update_index_file(Args&&... args)
-  {
-    ((void)save_arg_type<Args>(), ...);
-    ((void)save_arg_constness(std::forward<Args>(args)), ...);
-  }
-
-  template<const char* format_string>
-  void write_format_string_to_index_file()
-  {
-    const uint16_t length = static_cast<uint16_t>(std::strlen(format_string));
-    buffer_or_write_index_file(&length, sizeof(uint16_t));
-    buffer_or_write_index_file(format_string, length);
-  }
-
-  constexpr inline void write_num_args_to_index_file(const uint8_t& num_args)
+  // The entries of new call sites go out with the next record
+  inline void write_encoded_entry_to_index_file(std::string_view entry)
   {
-    buffer_or_write_index_file(&num_args, sizeof(uint8_t));
+    const uint8_t tag = container_tag::call_site;
+    const auto size = static_cast<uint32_t>(entry.size());
+    buffer_or_write_index_file(&tag, sizeof(tag));
+    buffer_or_write_index_file(&size, sizeof(size));
+    buffer_or_write_index_file(entry.data(), entry.size());
   }
 };
 
@@ -715,13 +3241,23 @@ public:
 
 
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <vector>
 
 // #include <binary_log/constant.hpp>
+// #include <binary_log/level.hpp>
 // #include <binary_log/detail/args.hpp>
+// #include <binary_log/detail/call_site.hpp>
 // #include <binary_log/detail/packer.hpp>
+// #include <binary_log/detail/probe.hpp>
+// #include <binary_log/detail/sampling.hpp>
+// #include <binary_log/detail/ringbuffer_packer.hpp>
+// #include <binary_log/detail/container_packer.hpp>
 
 namespace binary_log
 {
@@ -729,7 +3265,110 @@ template<class Packer = packer<1 * 1024 * 1024, 32, 32>>
 class binary_log
 {
   Packer m_packer;
-  uint8_t m_format_string_index {0};
+
+  // Index of each call site in this log plus one, by the id of the call
+  // site in the registry (see call_site), or 0 until it logs here. Call
+  // sites are numbered by each logger in the order they first log to it,
+  // so a log only has the call sites that log to it, with the lowest
+  // indices for the first ones.
+  std::vector<uint16_t> m_indices;
+
+  // Call sites that have logged here so far
+  uint16_t m_call_sites {0};
+
+  // State of the sampled and rate-limited call sites in this log, by the
+  // index of the call site in the registry (its id minus one)
+  std::vector<sampling_state> m_sampling;
+
+  // State of the call site whose first call is being logged while the
+  // call site is not in the registry yet (one with constants), moved to
+  // m_sampling once its record has added it
+  std::optional<sampling_state> m_first_call;
+
+  // Records of the leveled macros below this level are not logged
+  level m_level {level::trace};
+
+  // Gives the call site of `id` the next index of this log, writing its
+  // entry to the index
+  uint16_t add_call_site(std::size_t id)
+  {
+    const auto& registry = call_site_registry::instance();
+    if (id >= m_indices.size()) {
+      m_indices.resize(std::max(id, registry.size()) + 1);
+    }
+    m_packer.write_encoded_entry_to_index_file(registry.entry(id - 1));
+    m_indices[id] = ++m_call_sites;
+    return m_call_sites;
+  }
+
+  // Position of the state of `site` in m_sampling, past its end until
+  // the call site first calls here
+  template<class site>
+  static std::size_t sampling_slot()
+  {
+    return (site::id.load(std::memory_order_relaxed)
+            & ~call_site_registry::disabled)
+        - 1;
+  }
+
+  // Adds the state at `slot`, or m_first_call while the call site is not
+  // in the registry. Out of line, as are the records and the clock, for
+  // the decision of a call that does not log to need no registers saved.
+  BINARY_LOG_NOINLINE sampling_state& add_sampling_state(std::size_t slot)
+  {
+    if (slot == static_cast<std::size_t>(-1)) {
+      return m_first_call.emplace();
+    }
+    if (slot >= m_sampling.size()) {
+      m_sampling.resize(
+          std::max(slot + 1, call_site_registry::instance().size()));
+    }
+    return m_sampling[slot];
+  }
+
+  // Starts the next window of a rate-limited call site if its window is
+  // over, and counts the call as suppressed otherwise
+  template<class suppressed_count_site>
+  BINARY_LOG_NOINLINE bool next_window(sampling_state& state,
+                                       uint32_t max_records,
+                                       coarse_clock::duration window)
+  {
+    const auto now = coarse_clock::now();
+    if (now < state.window_end) {
+      if (state.suppressed == 0) {
+        (void)suppressed_count_site::added_before_main;
+        if (suppressed_count_site::id.load(std::memory_order_relaxed) == 0) {
+          suppressed_count_site::add(uint32_t {});
+        }
+        state.suppressed_count_id =
+            suppressed_count_site::id.load(std::memory_order_acquire)
+            & ~call_site_registry::disabled;
+      }
+      if (++state.suppressed == UINT32_MAX) {
+        log_suppressed_count(state);
+      }
+      return false;
+    }
+    if (state.suppressed != 0) {
+      log_suppressed_count(state);
+    }
+    state.window_end = now + window;
+    state.countdown = max_records - 1;
+    return true;
+  }
+
+  // Logs how many calls the rate-limited call site of `state` suppressed
+  void log_suppressed_count(sampling_state& state)
+  {
+    const auto id = state.suppressed_count_id;
+    uint16_t index = id < m_indices.size() ? m_indices[id] : 0;
+    if (index == 0) {
+      index = add_call_site(id);
+    }
+    m_packer.pack_format_string_index(static_cast<uint16_t>(index - 1));
+    m_packer.update_log_file(state.suppressed);
+    state.suppressed = 0;
+  }
 
 public:
   binary_log(const char* path)
@@ -749,6 +3388,12 @@ public:
 
   ~binary_log()
   {
+    // The calls suppressed in the last window of each call site
+    for (auto& state : m_sampling) {
+      if (state.suppressed != 0) {
+        log_suppressed_count(state);
+      }
+    }
     m_packer.flush();
   }
 
@@ -757,40 +3402,108 @@ public:
     m_packer.flush();
   }
 
-  template<const char* format_string, class... Args>
-  constexpr inline uint8_t log_index(Args&&... args)
+  void set_level(level threshold)
   {
-    // SPEC:
-    // <format-string-length> <format-string>
-    // <number-of-arguments> <arg-type-1> <arg-type-2> ... <arg-type-N>
-    // <arg-1-is- const> <arg-1-value>? <arg-2-is- const> <arg-2-value>?
-    // ...
-    //
-    // If the arg is not an lvalue, it is stored in the index file
-    // and the value is not stored in the log file
-    constexpr uint8_t num_args = sizeof...(Args);
+    m_level = threshold;
+  }
 
-    m_format_string_index++;
+  level get_level() const
+  {
+    return m_level;
+  }
 
-    // Write the length of the format string
-    m_packer.template write_format_string_to_index_file<format_string>();
+  // Checked by the leveled macros before their args are evaluated
+  bool should_log(level severity) const
+  {
+    return severity >= m_level;
+  }
 
-    // Write the number of args taken by the format string
-    m_packer.write_num_args_to_index_file(num_args);
+  // Whether the call of `site` is the first of every `n` calls, the one
+  // that BINARY_LOG_SAMPLED logs: a decrement and a compare
+  template<class site, uint32_t n>
+  bool sample()
+  {
+    static_assert(n > 0, "a sampled call site logs 1 in n calls");
+    const auto slot = sampling_slot<site>();
+    if (slot >= m_sampling.size()) [[unlikely]] {
+      add_sampling_state(slot).countdown = n - 1;
+      return true;
+    }
+    auto& countdown = m_sampling[slot].countdown;
+    if (countdown != 0) {
+      --countdown;
+      return false;
+    }
+    countdown = n - 1;
+    return true;
+  }
 
-    // Write the type of each argument
-    if constexpr (num_args > 0) {
-      m_packer.update_index_file(std::forward<Args>(args)...);
+  // Whether BINARY_LOG_RATE_LIMITED logs the call of `site`: the first
+  // `max_records` calls of a window do, a decrement and a compare each,
+  // and the next window starts at the first call after it is over. The
+  // calls in between are counted, a read of coarse_clock each, and the
+  // count is logged at site::suppressed_count before the first record of
+  // the next window (or when the log is closed).
+  template<class site, uint32_t max_records>
+  bool rate_limit(coarse_clock::duration window)
+  {
+    static_assert(max_records > 0, "a rate-limited call site logs records");
+    const auto slot = sampling_slot<site>();
+    if (slot >= m_sampling.size()) [[unlikely]] {
+      return next_window<typename site::suppressed_count>(
+          add_sampling_state(slot), max_records, window);
     }
+    auto& state = m_sampling[slot];
+    if (state.countdown != 0) {
+      --state.countdown;
+      return true;
+    }
+    return next_window<typename site::suppressed_count>(
+        state, max_records, window);
+  }
 
-    return m_format_string_index - 1;
+  // log(), out of line for the sampled and rate-limited macros (see
+  // add_sampling_state), which keeps the state of the first call of a
+  // call site once the record has added the call site to the registry
+  template<const char* format_string, class... Args>
+  BINARY_LOG_NOINLINE void log_sampled(Args&&... args)
+  {
+    log<format_string>(std::forward<Args>(args)...);
+    if (m_first_call) [[unlikely]] {
+      using site =
+          call_site<format_string, level::info, std::decay_t<Args>...>;
+      add_sampling_state(sampling_slot<site>()) = *m_first_call;
+      m_first_call.reset();
+    }
   }
 
-  template<class... Args>
-  inline void log(std::size_t pos, Args&&... args)
+  // Logs whatever the level set, as BINARY_LOG does, at info unless
+  // given a level
+  template<const char* format_string,
+           level severity = level::info,
+           class... Args>
+  inline void log(Args&&... args)
   {
+    using site = call_site<format_string, severity, std::decay_t<Args>...>;
     constexpr auto num_args = sizeof...(Args);
 
+    // The call site's id, then its index in this log: two loads once it
+    // has logged here
+    const auto id = site::id.load(std::memory_order_relaxed)
+        & ~call_site_registry::disabled;
+    uint16_t index = id < m_indices.size() ? m_indices[id] : 0;
+    if (index == 0) [[unlikely]] {
+      // Call sites without constants are in the registry since before
+      // main(), and naming added_before_main is what has it initialized
+      // then; the others are added at their first call
+      (void)site::added_before_main;
+      if (id == 0) {
+        site::add(args...);
+      }
+      index = add_call_site(site::id.load(std::memory_order_acquire)
+                            & ~call_site_registry::disabled);
+    }
+
     // Write to the main log file
     // SPEC:
     // <format-string-index> <arg1> <arg2> ... <argN>
@@ -798,8 +3511,7 @@ public:
     //   <format-string-index> is the index of the format string in the index
     //   file <arg1> <arg2> ... <argN> are the arguments to the format string
     //     Each <arg> is a pair: <type, value>
-    uint16_t current_index = static_cast<uint16_t>(pos);
-    m_packer.pack_format_string_index(current_index);
+    m_packer.pack_format_string_index(static_cast<uint16_t>(index - 1));
 
     // Write the args
     if constexpr (num_args > 0) {
@@ -815,16 +3527,271 @@ public:
 #define BINARY_LOG_CONCAT0(a, b) a##b
 #define BINARY_LOG_CONCAT(a, b) BINARY_LOG_CONCAT0(a, b)
 
-#define BINARY_LOG(logger, format_string, ...) \
+#define BINARY_LOG_FORMAT_STRING \
+  BINARY_LOG_CONCAT(__binary_log_format_string, __LINE__)
+
+// Logs at `severity` if the call site is enabled (see
+// call_site_control.hpp), checked before the args are evaluated
+#define BINARY_LOG_IF_ENABLED(logger, severity, format_string, ...) \
+  { \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             severity>::of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled()) { \
+      logger.template log<BINARY_LOG_FORMAT_STRING, severity>(__VA_ARGS__); \
+    } \
+  }
+
+#define BINARY_LOG(logger, ...) \
+  BINARY_LOG_IF_ENABLED(logger, ::binary_log::level::info, __VA_ARGS__)
+
+// Logs at `severity` if the logger's level lets it, a single branch before
+// the args are evaluated
+#define BINARY_LOG_AT_LEVEL(logger, severity, ...) \
+  { \
+    if (logger.should_log(severity)) { \
+      BINARY_LOG_IF_ENABLED(logger, severity, __VA_ARGS__) \
+    } \
+  }
+
+// Logs 1 in `n` calls, the first of every `n`, like BINARY_LOG; the
+// others cost a decrement and a compare, before the args are evaluated
+#define BINARY_LOG_SAMPLED(logger, n, format_string, ...) \
+  { \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             ::binary_log::level::info>:: \
+                     of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled() \
+        && logger.template sample<binary_log_call_site, n>()) \
+    { \
+      logger.template log_sampled<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+    } \
+  }
+
+// Logs at most `max_records` calls per `window` (a std::chrono duration)
+// like BINARY_LOG, and then a record of how many calls it suppressed,
+// which the unpacker prints as "[<count> suppressed] <format string>"
+#define BINARY_LOG_RATE_LIMITED( \
+    logger, max_records, window, format_string, ...) \
   { \
-    constexpr static char BINARY_LOG_CONCAT(__binary_log_format_string, \
-                                            __LINE__)[] = format_string; \
-    static std::size_t BINARY_LOG_CONCAT(__binary_log_format_string_id_pos, \
-                                         __LINE__) = \
-        logger.template log_index<BINARY_LOG_CONCAT(__binary_log_format_string, \
-                                           __LINE__)>(__VA_ARGS__); \
-    logger.template log(BINARY_LOG_CONCAT(__binary_log_format_string_id_pos, __LINE__), \
-               ##__VA_ARGS__); \
+    constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+    using binary_log_call_site = \
+        decltype(::binary_log::call_site_for<BINARY_LOG_FORMAT_STRING, \
+                                             ::binary_log::level::info>:: \
+                     of(__VA_ARGS__)); \
+    if (binary_log_call_site::enabled() \
+        && logger.template rate_limit<binary_log_call_site, max_records>( \
+            window)) \
+    { \
+      logger.template log_sampled<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+    } \
+  }
+
+// Logs like BINARY_LOG while a tool is attached to the call site (see
+// probe.hpp), and costs a relaxed load of its semaphore otherwise
+#if defined(BINARY_LOG_HAS_PROBES)
+#  define BINARY_LOG_PROBE(logger, format_string, ...) \
+    { \
+      constexpr static char BINARY_LOG_FORMAT_STRING[] = format_string; \
+      static std::atomic<uint16_t> binary_log_semaphore {0}; \
+      asm volatile(".pushsection binary_log_probes, \"aw?\"\n" \
+                   ".balign 8\n" \
+                   ".quad %c0\n" \
+                   ".quad %c1\n" \
+                   ".popsection" \
+                   : \
+                   : "i"(&binary_log_semaphore), \
+                     "i"(BINARY_LOG_FORMAT_STRING)); \
+      if (binary_log_semaphore.load(std::memory_order_relaxed) != 0) \
+          [[unlikely]] { \
+        using binary_log_call_site = decltype(::binary_log::call_site_for< \
+                                              BINARY_LOG_FORMAT_STRING, \
+                                              ::binary_log::level::info>:: \
+                                                  of(__VA_ARGS__)); \
+        if (binary_log_call_site::enabled()) { \
+          logger.template log<BINARY_LOG_FORMAT_STRING>(__VA_ARGS__); \
+        } \
+      } \
+    }
+#else
+#  define BINARY_LOG_PROBE(logger, ...) BINARY_LOG(logger, __VA_ARGS__)
+#endif
+
+// The leveled macros below this level (BINARY_LOG_LEVEL_TRACE and so on)
+// expand to nothing: no code, no call site and no index entry
+#ifndef BINARY_LOG_ACTIVE_LEVEL
+#  define BINARY_LOG_ACTIVE_LEVEL BINARY_LOG_LEVEL_TRACE
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_TRACE
+#  define BINARY_LOG_TRACE(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::trace, __VA_ARGS__)
+#else
+#  define BINARY_LOG_TRACE(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_DEBUG
+#  define BINARY_LOG_DEBUG(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::debug, __VA_ARGS__)
+#else
+#  define BINARY_LOG_DEBUG(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_INFO
+#  define BINARY_LOG_INFO(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::info, __VA_ARGS__)
+#else
+#  define BINARY_LOG_INFO(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_WARN
+#  define BINARY_LOG_WARN(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::warn, __VA_ARGS__)
+#else
+#  define BINARY_LOG_WARN(logger, ...) {}
+#endif
+
+#if BINARY_LOG_ACTIVE_LEVEL <= BINARY_LOG_LEVEL_ERROR
+#  define BINARY_LOG_ERROR(logger, ...) \
+    BINARY_LOG_AT_LEVEL(logger, ::binary_log::level::error, __VA_ARGS__)
+#else
+#  define BINARY_LOG_ERROR(logger, ...) {}
+#endif
+
+
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// #include <binary_log/detail/call_site.hpp>
+
+namespace binary_log
+{
+// Enables or disables the call sites of the process whose format string
+// contains `pattern` (all of them if it is empty) and returns how many
+// there are. A call site with a constant is only known from its first
+// call on, and is enabled then.
+inline std::size_t set_call_sites_enabled(std::string_view pattern,
+                                          bool enabled)
+{
+  auto& registry = call_site_registry::instance();
+  std::size_t matched = 0;
+  for (std::size_t index = 0, size = registry.size(); index < size; ++index) {
+    if (registry.format_string(index).find(pattern) != std::string_view::npos)
+    {
+      registry.set_enabled(index, enabled);
+      ++matched;
+    }
+  }
+  return matched;
+}
+
+inline std::size_t enable_call_sites(std::string_view pattern)
+{
+  return set_call_sites_enabled(pattern, true);
+}
+
+inline std::size_t disable_call_sites(std::string_view pattern)
+{
+  return set_call_sites_enabled(pattern, false);
+}
+
+// Switches call sites as a control file says, whenever it changes. Each
+// line of the file is
+//
+//   -<pattern>    to disable the call sites whose format string contains
+//                 the pattern
+//   +<pattern>    to enable them again
+//
+// applied in order to call sites that are all enabled to begin with, so
+// that the last matching line wins; other lines, such as # comments, are
+// skipped. Removing the file enables all call sites again. Call sites
+// added since the file was applied, such as those with constants at their
+// first call, are switched at the next poll.
+class call_site_control
+{
+  std::filesystem::path m_path;
+
+  // Write time of the file when it was last applied, if it was
+  std::optional<std::filesystem::file_time_type> m_applied;
+  std::vector<std::pair<bool, std::string>> m_rules;
+
+  // Number of call sites of the registry the rules were applied to
+  std::size_t m_switched {0};
+
+  // Switches the call sites from `first` on, each once, to the state the
+  // rules give it
+  void apply(std::size_t first)
+  {
+    auto& registry = call_site_registry::instance();
+    std::size_t index = first;
+    for (const auto size = registry.size(); index < size; ++index) {
+      const auto format_string = registry.format_string(index);
+      bool enabled = true;
+      for (const auto& [enable, pattern] : m_rules) {
+        if (format_string.find(pattern) != std::string_view::npos) {
+          enabled = enable;
+        }
+      }
+      registry.set_enabled(index, enabled);
+    }
+    m_switched = index;
+  }
+
+public:
+  explicit call_site_control(std::filesystem::path path)
+      : m_path(std::move(path))
+  {
+    poll();
+  }
+
+  // Applies the file if it changed since it was last applied, or to the
+  // call sites added since, and returns whether it did. Costs a stat()
+  // otherwise, to be called from a timer or an idle loop.
+  bool poll()
+  {
+    std::error_code error;
+    const auto write_time = std::filesystem::last_write_time(m_path, error);
+    if (error) {
+      if (!m_applied) {
+        return false;
+      }
+      m_applied.reset();
+      m_rules.clear();
+      apply(0);
+      return true;
+    }
+    if (m_applied == write_time) {
+      if (m_switched == call_site_registry::instance().size()) {
+        return false;
+      }
+      apply(m_switched);
+      return true;
+    }
+
+    m_rules.clear();
+    std::ifstream file(m_path);
+    for (std::string line; std::getline(file, line);) {
+      if (!line.empty() && (line.front() == '+' || line.front() == '-')) {
+        m_rules.emplace_back(line.front() == '+', line.substr(1));
+      }
+    }
+    apply(0);
+    m_applied = write_time;
+    return true;
   }
+};
+
+}  // namespace binary_log
 
 
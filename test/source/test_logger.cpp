@@ -0,0 +1,269 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// BINARY_LOG_TRACE is compiled out
+#define BINARY_LOG_ACTIVE_LEVEL BINARY_LOG_LEVEL_DEBUG
+#include <binary_log/binary_log.hpp>
+#include <binary_log/call_site_control.hpp>
+#include <binary_log/reader.hpp>
+#include <doctest.hpp>
+
+using doctest::test_suite;
+
+static constexpr auto logger_test_file = "test_logger.log";
+static constexpr auto logger_test_file_index = "test_logger.log.index";
+static constexpr auto logger_test_file_runlength = "test_logger.log.runlength";
+static constexpr auto logger_test_file_seek = "test_logger.log.seek";
+
+static void remove_logger_test_files()
+{
+  remove(logger_test_file);
+  remove(logger_test_file_index);
+  remove(logger_test_file_runlength);
+  remove(logger_test_file_seek);
+}
+
+TEST_CASE("binary_log logs the level of each call site"
+          * test_suite("logger"))
+{
+  uint32_t evaluated = 0;
+  auto next = [&evaluated] { return ++evaluated; };
+  {
+    binary_log::binary_log log(logger_test_file);
+    BINARY_LOG_TRACE(log, "Trace {}", next());
+    BINARY_LOG_DEBUG(log, "Debug {}", next());
+    BINARY_LOG_INFO(log, "Info {}", next());
+
+    // Records below the logger's level do not evaluate their args
+    log.set_level(binary_log::level::warn);
+    REQUIRE(log.get_level() == binary_log::level::warn);
+    BINARY_LOG_INFO(log, "Skipped {}", next());
+    BINARY_LOG_WARN(log, "Warn {}", next());
+    BINARY_LOG_ERROR(log, "Error {}", binary_log::constant(7u));
+    BINARY_LOG(log, "Plain {}", next());
+  }
+  REQUIRE(evaluated == 4);
+
+  // A compiled out call site is not even in the registry
+  const auto& registry = binary_log::call_site_registry::instance();
+  for (std::size_t i = 0; i < registry.size(); ++i) {
+    REQUIRE(registry.entry(i).find("Trace {}") == std::string_view::npos);
+  }
+
+  {
+    const binary_log::reader reader(logger_test_file);
+    std::vector<std::pair<std::string, binary_log::level>> records;
+    for (const auto& record : reader.records()) {
+      records.emplace_back(
+          std::string(record.format_string()) + " "
+              + std::to_string(record[0].as<uint32_t>()),
+          record.entry().level);
+    }
+    using binary_log::level;
+    REQUIRE(records
+            == std::vector<std::pair<std::string, level>> {
+                {"Debug {} 1", level::debug},
+                {"Info {} 2", level::info},
+                {"Warn {} 3", level::warn},
+                {"Error {} 7", level::error},
+                {"Plain {} 4", level::info}});
+  }
+
+  remove_logger_test_files();
+}
+
+TEST_CASE("binary_log logs at the call sites left enabled"
+          * test_suite("logger"))
+{
+  static constexpr auto control_file = "test_logger.control";
+  uint32_t evaluated = 0;
+  auto next = [&evaluated] { return ++evaluated; };
+  {
+    binary_log::binary_log log(logger_test_file);
+    const auto log_all = [&]
+    {
+      BINARY_LOG(log, "Switched alpha {}", next());
+      BINARY_LOG(log, "Switched beta {}", next());
+      BINARY_LOG_WARN(log, "Switched gamma {}", next());
+    };
+    log_all();
+
+    // Disabled call sites do not evaluate their args
+    REQUIRE(binary_log::disable_call_sites("Switched") == 3);
+    REQUIRE(binary_log::enable_call_sites("beta") == 1);
+    log_all();
+    REQUIRE(evaluated == 4);
+
+    {
+      std::ofstream(control_file) << "# noisy\n-Switched\n+gamma\n";
+    }
+    binary_log::call_site_control control(control_file);
+    log_all();
+    REQUIRE(evaluated == 5);
+    REQUIRE(!control.poll());
+
+    // A call site with a constant is added at its first call, after the
+    // file was applied, and is switched at the next poll
+    const auto log_constant = [&]
+    {
+      BINARY_LOG(
+          log, "Switched delta {} {}", binary_log::constant(0), next());
+    };
+    log_constant();
+    REQUIRE(evaluated == 6);
+    REQUIRE(control.poll());
+    REQUIRE(!control.poll());
+    log_constant();
+    REQUIRE(evaluated == 6);
+
+    // Removing the file enables them all
+    remove(control_file);
+    REQUIRE(control.poll());
+    log_all();
+    log_constant();
+  }
+  REQUIRE(evaluated == 10);
+
+  {
+    const binary_log::reader reader(logger_test_file);
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records()) {
+      const std::vector<binary_log::arg_view> args(record.args().begin(),
+                                                   record.args().end());
+      values.push_back(args.back().as<uint32_t>());
+    }
+    REQUIRE(values
+            == std::vector<uint32_t> {1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+  }
+
+  remove_logger_test_files();
+}
+
+TEST_CASE("binary_log samples records and counts those it suppresses"
+          * test_suite("logger"))
+{
+  using namespace std::chrono_literals;
+  uint32_t evaluated = 0;
+  auto next = [&evaluated] { return ++evaluated; };
+  {
+    binary_log::binary_log log(logger_test_file);
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG_SAMPLED(log, 4, "Sampled {}", i);
+    }
+
+    // Calls that are not logged do not evaluate their args
+    for (int i = 0; i < 10; ++i) {
+      BINARY_LOG_RATE_LIMITED(log, 3, 1h, "Limited {}", next());
+    }
+    REQUIRE(evaluated == 3);
+
+    // The count of a window is logged before the next window
+    const auto burst = [&log](uint32_t i)
+    { BINARY_LOG_RATE_LIMITED(log, 2, 20ms, "Burst {}", i); };
+    for (uint32_t i = 0; i < 5; ++i) {
+      burst(i);
+    }
+    std::this_thread::sleep_for(50ms);
+    burst(5);
+
+    // A call site with constants is only added to the registry by its
+    // first call, which counts like any other
+    const auto constant_sampled = [&log](uint32_t i)
+    {
+      BINARY_LOG_SAMPLED(
+          log, 3, "Constant {} {}", binary_log::constant(7), i);
+    };
+    const auto constant_limited = [&log](uint32_t i)
+    {
+      BINARY_LOG_RATE_LIMITED(
+          log, 2, 1h, "Constant {} {}", binary_log::constant(8), i);
+    };
+    for (uint32_t i = 0; i < 7; ++i) {
+      constant_sampled(i);
+      constant_limited(i);
+    }
+  }
+
+  // and the count of the last window when the log is closed
+  const std::vector<std::tuple<std::string_view, bool, uint32_t>> expected {
+      {"Sampled {}", false, 0},
+      {"Sampled {}", false, 4},
+      {"Sampled {}", false, 8},
+      {"Limited {}", false, 1},
+      {"Limited {}", false, 2},
+      {"Limited {}", false, 3},
+      {"Burst {}", false, 0},
+      {"Burst {}", false, 1},
+      {"Burst {}", true, 3},
+      {"Burst {}", false, 5},
+      {"Constant {} {}", false, 0},
+      {"Constant {} {}", false, 0},
+      {"Constant {} {}", false, 1},
+      {"Constant {} {}", false, 3},
+      {"Constant {} {}", false, 6},
+      {"Limited {}", true, 7},
+      {"Constant {} {}", true, 5}};
+  {
+    const binary_log::reader reader(logger_test_file);
+    std::vector<std::tuple<std::string_view, bool, uint32_t>> records;
+    for (const auto& record : reader.records()) {
+      const std::vector<binary_log::arg_view> args(record.args().begin(),
+                                                   record.args().end());
+      records.emplace_back(record.format_string(),
+                           record.entry().counts_suppressed,
+                           args.back().as<uint32_t>());
+    }
+    REQUIRE(records == expected);
+  }
+
+  remove_logger_test_files();
+}
+
+#if defined(BINARY_LOG_HAS_PROBES)
+TEST_CASE("binary_log logs at probes while they are attached"
+          * test_suite("logger"))
+{
+  uint32_t evaluated = 0;
+  auto next = [&evaluated] { return ++evaluated; };
+  {
+    binary_log::binary_log log(logger_test_file);
+    const auto probe = [&]
+    { BINARY_LOG_PROBE(log, "Probed delta {}", next()); };
+
+    // Detached probes do not evaluate their args
+    probe();
+    REQUIRE(evaluated == 0);
+
+    REQUIRE(binary_log::attach_probes("Probed delta") == 1);
+    probe();
+    REQUIRE(binary_log::attach_probes("delta") == 1);
+    REQUIRE(binary_log::detach_probes("delta") == 1);
+    probe();
+    REQUIRE(binary_log::detach_probes("delta") == 1);
+    probe();
+    REQUIRE(binary_log::detach_probes("delta") == 1);
+    probe();
+  }
+  REQUIRE(evaluated == 2);
+
+  {
+    const binary_log::reader reader(logger_test_file);
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records()) {
+      REQUIRE(record.format_string() == "Probed delta {}");
+      values.push_back(record[0].as<uint32_t>());
+    }
+    REQUIRE(values == std::vector<uint32_t> {1, 2});
+  }
+
+  remove_logger_test_files();
+}
+#endif
@@ -0,0 +1,1143 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <filesystem>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <binary_log/binary_log.hpp>
+#include <binary_log/reader.hpp>
+#include <binary_log/stream_reader.hpp>
+#include <doctest.hpp>
+
+using doctest::test_suite;
+
+static constexpr auto reader_test_file = "test_reader.log";
+static constexpr auto reader_test_file_index = "test_reader.log.index";
+static constexpr auto reader_test_file_runlength = "test_reader.log.runlength";
+static constexpr auto reader_test_file_seek = "test_reader.log.seek";
+
+static void remove_reader_test_files()
+{
+  remove(reader_test_file);
+  remove(reader_test_file_index);
+  remove(reader_test_file_runlength);
+  remove(reader_test_file_seek);
+}
+
+TEST_CASE("reader decodes format strings and args" * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    BINARY_LOG(log, "Hello, world!");
+    BINARY_LOG(log, "{} {}", 42, std::string_view("foo"));
+    BINARY_LOG(log, "{}", binary_log::constant(3.5));
+  }
+
+  {
+    // Only the call sites that logged are in the index
+    binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.index_table().size() == 3);
+
+    std::vector<binary_log::record> records;
+    std::vector<std::vector<binary_log::arg_view>> args;
+    for (const auto& record : reader.records()) {
+      records.push_back(record);
+      args.emplace_back(record.args().begin(), record.args().end());
+    }
+    REQUIRE(records.size() == 3);
+
+    REQUIRE(records[0].format_string() == "Hello, world!");
+    REQUIRE(args[0].empty());
+
+    REQUIRE(records[1].format_string() == "{} {}");
+    REQUIRE(args[1].size() == 2);
+    REQUIRE(args[1][0].as<int32_t>() == 42);
+    REQUIRE(args[1][1].is_string());
+    REQUIRE(args[1][1].value == "foo");
+
+    // Constants are served from the index file
+    REQUIRE(args[2].size() == 1);
+    REQUIRE(args[2][0].as<double>() == 3.5);
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader rejects the logs of older versions" * test_suite("reader"))
+{
+  const auto write_file = [](const char* path, std::string_view bytes)
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  };
+  const auto error_of = [](const char* path) -> std::string
+  {
+    try {
+      const binary_log::reader reader(path);
+    } catch (const std::runtime_error& error) {
+      return error.what();
+    }
+    return {};
+  };
+
+  // An index without a header, as binary_log wrote before varint indices
+  using namespace std::string_view_literals;
+  write_file(reader_test_file, "\x00"sv);
+  write_file(reader_test_file_index, "\x0d\x00Hello, world!\x00"sv);
+  write_file(reader_test_file_runlength, ""sv);
+  REQUIRE(error_of(reader_test_file).find("written by an older version")
+          != std::string::npos);
+
+  // An index of another version
+  auto header = binary_log::make_index_header();
+  header.version = binary_log::index_version + 1;
+  std::string index(reinterpret_cast<const char*>(&header), sizeof(header));
+  write_file(reader_test_file_index, index);
+  REQUIRE(error_of(reader_test_file).find("unsupported version")
+          != std::string::npos);
+
+  // An index of the version whose runlength entries were keyed by index
+  header.version = 1;
+  std::memcpy(index.data(), &header, sizeof(header));
+  write_file(reader_test_file_index, index);
+  REQUIRE(error_of(reader_test_file).find("unsupported version 1")
+          != std::string::npos);
+
+  // An entry that does not end with a level
+  index += "\x05\x00Hello\x00\x07"sv;
+  header.version = binary_log::index_version;
+  std::memcpy(index.data(), &header, sizeof(header));
+  write_file(reader_test_file_index, index);
+  REQUIRE(error_of(reader_test_file).find("unknown level 7")
+          != std::string::npos);
+
+  // A container of the version before levels
+  remove_reader_test_files();
+  {
+    binary_log::binary_log<binary_log::container_packer<>> log(
+        reader_test_file);
+    BINARY_LOG(log, "Hello, world!");
+  }
+  std::string container;
+  {
+    std::ifstream file(reader_test_file, std::ios::binary);
+    container.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  REQUIRE(error_of(reader_test_file).empty());
+  const uint16_t older_version = 5;
+  std::memcpy(container.data()
+                  + offsetof(binary_log::container_header, version),
+              &older_version,
+              sizeof(older_version));
+  write_file(reader_test_file, container);
+  REQUIRE(error_of(reader_test_file).find("unsupported version 5")
+          != std::string::npos);
+  remove_reader_test_files();
+
+  // A logger that has not flushed yet has an index of just the header
+  {
+    binary_log::binary_log log(reader_test_file);
+    BINARY_LOG(log, "Hello, world!");
+    const binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.index_table().empty());
+  }
+  REQUIRE(std::filesystem::file_size(reader_test_file_index)
+          > sizeof(binary_log::index_header));
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader reads integer args as a sign and a magnitude"
+          * test_suite("reader"))
+{
+  using binary_log::integer_value;
+  constexpr auto int64_min = std::numeric_limits<int64_t>::min();
+  constexpr auto uint64_max = std::numeric_limits<uint64_t>::max();
+  {
+    binary_log::binary_log log(reader_test_file);
+    BINARY_LOG(log, "{} {} {} {}", int64_min, uint64_max, int8_t {-5}, true);
+  }
+
+  {
+    const binary_log::reader reader(reader_test_file);
+    std::vector<binary_log::arg_view> record;
+    for (const auto& logged : reader.records()) {
+      record.assign(logged.args().begin(), logged.args().end());
+    }
+    REQUIRE(record.size() == 4);
+    REQUIRE(record[0].as_integer() == integer_value {uint64_t {1} << 63, true});
+    REQUIRE(record[0].as_integer().as_int64() == int64_min);
+    REQUIRE(record[1].as_integer() == integer_value {uint64_max, false});
+    REQUIRE(record[2].as_integer().as_int64() == -5);
+    REQUIRE(record[3].as_integer() == integer_value::of(uint64_t {1}));
+    REQUIRE(record[0].as_integer() < record[2].as_integer());
+    REQUIRE(record[2].as_integer() < record[3].as_integer());
+    REQUIRE(record[3].as_integer() < record[1].as_integer());
+    REQUIRE(record[2].as_double() == -5.0);
+  }
+
+  // 128-bit values saturate beyond 64 bits
+  REQUIRE(integer_value::of_128_bits(5, 0, true)
+          == integer_value::of(int64_t {5}));
+  REQUIRE(integer_value::of_128_bits(0 - uint64_t {5}, uint64_max, true)
+          == integer_value::of(int64_t {-5}));
+  REQUIRE(integer_value::of_128_bits(0, 1, false)
+          == integer_value {uint64_max, false});
+  REQUIRE(integer_value::of_128_bits(0, uint64_max, false)
+          == integer_value {uint64_max, false});
+  REQUIRE(integer_value::of_128_bits(0, uint64_max, true)
+          == integer_value {uint64_max, true});
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader decodes loggers that share call sites in another order"
+          * test_suite("reader"))
+{
+  static constexpr auto other_file = "test_reader_other.log";
+  {
+    binary_log::binary_log log(reader_test_file);
+    binary_log::binary_log other(other_file);
+    auto first = [](binary_log::binary_log<>& log, uint32_t i)
+    { BINARY_LOG(log, "First {}", i); };
+    auto second = [](binary_log::binary_log<>& log, uint32_t i)
+    { BINARY_LOG(log, "Second {}", i); };
+    first(log, 1);
+    second(other, 2);
+    second(log, 3);
+    first(other, 4);
+    BINARY_LOG(other, "Third {}", binary_log::constant(5));
+  }
+
+  const auto values = [](const binary_log::reader& reader)
+  {
+    std::vector<std::string> values;
+    for (const auto& record : reader.records()) {
+      values.push_back(std::string(record.format_string()) + " "
+                       + std::to_string(record[0].as<uint32_t>()));
+    }
+    return values;
+  };
+
+  // Each log numbers the call sites in the order they first logged to it
+  {
+    const binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.index_table().size() == 2);
+    REQUIRE(reader.index_table()[0].format_string == "First {}");
+    REQUIRE(values(reader)
+            == std::vector<std::string> {"First {} 1", "Second {} 3"});
+  }
+  {
+    const binary_log::reader reader(other_file);
+    REQUIRE(reader.index_table().size() == 3);
+    REQUIRE(reader.index_table()[0].format_string == "Second {}");
+    REQUIRE(values(reader)
+            == std::vector<std::string> {
+                "Second {} 2", "First {} 4", "Third {} 5"});
+  }
+
+  remove_reader_test_files();
+  for (const auto* suffix : {"", ".index", ".runlength", ".seek"}) {
+    remove((std::string(other_file) + suffix).c_str());
+  }
+}
+
+TEST_CASE("reader expands run-length encoded records" * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "Value: {}", i);
+    }
+    BINARY_LOG(log, "Done");
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records()) {
+      if (record.format_string() == "Value: {}") {
+        values.push_back(record[0].as<uint32_t>());
+      }
+    }
+    REQUIRE(values.size() == 10);
+    for (uint32_t i = 0; i < 10; ++i) {
+      REQUIRE(values[i] == i);
+    }
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader tells a lone record from a later run of its call site"
+          * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    auto value = [&log](uint32_t i) { BINARY_LOG(log, "Value: {}", i); };
+    value(0);
+    BINARY_LOG(log, "Other");
+    value(1);
+    log.flush();
+    value(2);
+    value(3);
+    value(4);
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records()) {
+      values.push_back(record.format_string() == "Value: {}"
+                           ? record[0].as<uint32_t>()
+                           : 1000);
+    }
+    REQUIRE(values == std::vector<uint32_t> {0, 1000, 1, 2, 3, 4});
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader decodes the runs of a call site after its lone records"
+          * test_suite("reader"))
+{
+  // Lone records of a call site, some before a checkpoint, between those
+  // of five others (which never repeat), then a run of it
+  using packer = binary_log::packer<1 << 16, 32, 32, 16>;
+  {
+    binary_log::binary_log<packer> log(reader_test_file);
+    auto value = [&log](uint32_t i) { BINARY_LOG(log, "Value: {}", i); };
+    auto other = [&log](uint32_t i)
+    {
+      switch (i % 5) {
+        case 0: BINARY_LOG(log, "B {}", i); break;
+        case 1: BINARY_LOG(log, "C {}", i); break;
+        case 2: BINARY_LOG(log, "D {}", i); break;
+        case 3: BINARY_LOG(log, "E {}", i); break;
+        default: BINARY_LOG(log, "F {}", i); break;
+      }
+    };
+    for (uint32_t i = 0; i < 10; ++i) {
+      value(i);
+      other(i);
+    }
+    for (uint32_t i = 10; i < 110; ++i) {
+      value(i);
+    }
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.checkpoints().size() > 1);
+
+    std::vector<std::size_t> runs;
+    auto decoder = reader.decoder();
+    while (!decoder.at_end()) {
+      const auto [index, count] = decoder.next_run();
+      decoder.skip(reader.index_table()[index], count);
+      runs.push_back(count);
+    }
+    REQUIRE(runs.size() == 21);
+    REQUIRE(runs.back() == 100);
+
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records(10)) {
+      values.push_back(record.format_string() == "Value: {}"
+                           ? record[0].as<uint32_t>()
+                           : 1000);
+    }
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 5; i < 10; ++i) {
+      expected.insert(expected.end(), {i, 1000});
+    }
+    for (uint32_t i = 10; i < 110; ++i) {
+      expected.push_back(i);
+    }
+    REQUIRE(values == expected);
+
+    // From a checkpoint inside the run
+    REQUIRE(reader.records(60).begin()->operator[](0).as<uint32_t>() == 50);
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader decoder resumes a run cut short by its limit"
+          * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "Value: {}", i);
+    }
+    BINARY_LOG(log, "Done");
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    auto decoder = reader.decoder();
+    std::vector<binary_log::arg_view> args;
+    std::vector<uint32_t> values;
+    for (const std::size_t limit : {3, 4, 4}) {
+      decoder.set_limit(limit);
+      while (!decoder.at_end()) {
+        const auto [index, count] = decoder.next_run();
+        for (std::size_t i = 0; i < count; ++i) {
+          const auto& entry = reader.index_table()[index];
+          decoder.decode(entry, args);
+          values.push_back(entry.format_string == "Value: {}"
+                               ? args[0].as<uint32_t>()
+                               : 1000);
+        }
+      }
+    }
+    REQUIRE(values
+            == std::vector<uint32_t> {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 1000});
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader records compose with range adaptors" * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    for (uint32_t i = 0; i < 100; ++i) {
+      BINARY_LOG(log, "Value: {}", i);
+      BINARY_LOG(log, "Other: {}", 1.0);
+    }
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    auto even_values = reader.records()
+        | std::views::filter([](const binary_log::record& r)
+                             { return r.format_string() == "Value: {}"; })
+        | std::views::transform([](const binary_log::record& r)
+                                { return r[0].as<uint32_t>(); })
+        | std::views::filter([](uint32_t value) { return value % 2 == 0; });
+
+    uint32_t count = 0;
+    uint32_t sum = 0;
+    for (const auto value : even_values) {
+      ++count;
+      sum += value;
+    }
+    REQUIRE(count == 50);
+    REQUIRE(sum == 2450);
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader seeks to records through the seek index"
+          * test_suite("reader"))
+{
+  // A checkpoint every 64 bytes, many of them inside runs
+  using packer = binary_log::packer<1024 * 1024, 32, 32, 64>;
+  {
+    binary_log::binary_log<packer> log(reader_test_file);
+    for (uint32_t i = 0; i < 200; ++i) {
+      if (i % 50 == 0) {
+        BINARY_LOG(log, "Name: {}", std::to_string(i));
+      }
+      BINARY_LOG(log, "Value: {}", i);
+      if (i == 120) {
+        // Ends the run in the middle
+        log.flush();
+      }
+    }
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.checkpoints().size() > 1);
+    REQUIRE(reader.checkpoints().has_timestamps());
+
+    std::vector<uint32_t> all;
+    for (const auto& record : reader.records()) {
+      all.push_back(record.format_string() == "Value: {}"
+                        ? record[0].as<uint32_t>()
+                        : 1000);
+    }
+    REQUIRE(all.size() == 204);
+
+    for (std::size_t first = 0; first < all.size(); first += 7) {
+      std::vector<uint32_t> range;
+      for (const auto& record : reader.records(first, first + 10)) {
+        range.push_back(record.format_string() == "Value: {}"
+                            ? record[0].as<uint32_t>()
+                            : 1000);
+      }
+      const auto last = std::min(all.size(), first + 10);
+      REQUIRE(range.size() == last - first);
+      for (std::size_t i = first; i < last; ++i) {
+        REQUIRE(range[i - first] == all[i]);
+      }
+    }
+  }
+
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader follows a log that is still being written"
+          * test_suite("reader"))
+{
+  {
+    binary_log::binary_log log(reader_test_file);
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "Value: {}", i);
+    }
+    log.flush();
+
+    binary_log::reader reader(reader_test_file);
+    auto decoder = reader.decoder();
+    decoder.extend(reader.committed_log(), reader.runlength());
+
+    std::vector<uint32_t> values;
+    std::vector<binary_log::arg_view> args;
+    auto decode_committed = [&]
+    {
+      while (!decoder.at_end()) {
+        const auto [index, count] = decoder.next_run();
+        for (std::size_t i = 0; i < count; ++i) {
+          const auto& entry = reader.index_table()[index];
+          decoder.decode(entry, args);
+          values.push_back(entry.format_string == "Value: {}"
+                               ? args[0].as<uint32_t>()
+                               : 1000);
+        }
+      }
+    };
+    decode_committed();
+    REQUIRE(values.size() == 10);
+
+    // Unflushed records are not committed yet. A call site adds its entry
+    // at its first call to the logger.
+    const auto committed = reader.committed_log().size();
+    const auto call_sites = reader.index_table().size();
+    BINARY_LOG(log, "Value: {}", 10u);
+    BINARY_LOG(log, "New call site {}", binary_log::constant(1.5));
+    reader.refresh();
+    REQUIRE(reader.committed_log().size() == committed);
+
+    log.flush();
+    REQUIRE(reader.refresh());
+    REQUIRE(reader.index_table().size() == call_sites + 2);
+    decoder.extend(reader.committed_log(), reader.runlength());
+    decode_committed();
+    REQUIRE(values.size() == 12);
+    REQUIRE(values[10] == 10);
+    REQUIRE(values[11] == 1000);
+    REQUIRE(reader.can_follow());
+  }
+  remove_reader_test_files();
+
+  // Without a seek file, how far the log is flushed is not known
+  {
+    binary_log::binary_log<binary_log::packer<1 << 16, 32, 32, 0>> log(
+        reader_test_file);
+    BINARY_LOG(log, "Value: {}", 1u);
+    log.flush();
+
+    binary_log::reader reader(reader_test_file);
+    REQUIRE_FALSE(reader.can_follow());
+    REQUIRE(reader.committed_log().empty());
+  }
+  remove_reader_test_files();
+}
+
+TEST_CASE("reader iterates backwards and takes the tail of the log"
+          * test_suite("reader"))
+{
+  using packer = binary_log::packer<1024 * 1024, 32, 32, 64>;
+  {
+    binary_log::binary_log<packer> log(reader_test_file);
+    for (uint32_t i = 0; i < 300; ++i) {
+      if (i % 40 == 0) {
+        BINARY_LOG(log, "Name: {}", std::to_string(i));
+      }
+      BINARY_LOG(log, "Value: {}", i);
+    }
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.checkpoints().size() > 1);
+
+    auto value_of = [](const binary_log::record& record)
+    {
+      return record.format_string() == "Value: {}" ? record[0].as<uint32_t>()
+                                                   : 1000;
+    };
+
+    std::vector<uint32_t> all;
+    for (const auto& record : reader.records()) {
+      all.push_back(value_of(record));
+    }
+    REQUIRE(reader.record_count() == all.size());
+
+    std::vector<uint32_t> reversed;
+    for (const auto& record : reader.reverse_records()) {
+      reversed.push_back(value_of(record));
+    }
+    REQUIRE(reversed == std::vector<uint32_t>(all.rbegin(), all.rend()));
+
+    for (const std::size_t count : {0, 1, 5, 100, 1000}) {
+      std::vector<uint32_t> tail;
+      for (const auto& record : reader.tail(count)) {
+        tail.push_back(value_of(record));
+      }
+      const auto expected = std::min(count, all.size());
+      REQUIRE(tail == std::vector<uint32_t>(all.end() - expected, all.end()));
+    }
+  }
+  remove_reader_test_files();
+
+  // Without a seek file, the checkpoints are built before going back, for
+  // a log that spans several of their intervals
+  {
+    binary_log::binary_log<binary_log::packer<1 << 16, 32, 32, 0>> log(
+        reader_test_file);
+    const auto name = [&log](uint32_t i)
+    { BINARY_LOG(log, "Name: {}", "record number " + std::to_string(i)); };
+    for (uint32_t i = 0; i < 150000; ++i) {
+      if (i % 3 != 0) {
+        name(i);
+      }
+      BINARY_LOG(log, "Value: {}", i);
+    }
+  }
+
+  {
+    binary_log::reader reader(reader_test_file);
+    REQUIRE(reader.checkpoints().size() == 0);
+    REQUIRE(binary_log::build_checkpoints(reader.decoder(),
+                                          reader.index_table())
+                .size()
+            > 1);
+
+    std::vector<std::string> all;
+    for (const auto& record : reader.records()) {
+      all.emplace_back(record[0].value);
+    }
+    std::vector<std::string> reversed;
+    for (const auto& record : reader.reverse_records()) {
+      reversed.emplace_back(record[0].value);
+    }
+    REQUIRE(reversed.size() == all.size());
+    REQUIRE(reversed == std::vector<std::string>(all.rbegin(), all.rend()));
+  }
+  remove_reader_test_files();
+}
+
+template<class Packer>
+static void check_container_reverse(const char* file)
+{
+  // Blocks of about 64 bytes, with a call site added in a later one
+  std::vector<uint32_t> expected;
+  {
+    binary_log::binary_log<Packer> log(file);
+    for (uint32_t i = 0; i < 300; ++i) {
+      if (i % 40 == 0) {
+        BINARY_LOG(log, "Name: {} {}", std::to_string(i),
+                   binary_log::constant(i == 0));
+        expected.push_back(1000);
+      }
+      BINARY_LOG(log, "Value: {}", i);
+      expected.push_back(i);
+    }
+  }
+
+  const binary_log::reader reader(file);
+  REQUIRE(reader.is_container());
+  REQUIRE(reader.block_count() > 10);
+
+  auto value_of = [](const binary_log::record& record)
+  {
+    return record.format_string() == "Value: {}" ? record[0].as<uint32_t>()
+                                                 : 1000;
+  };
+  std::vector<uint32_t> reversed;
+  for (const auto& record : reader.reverse_records()) {
+    reversed.push_back(value_of(record));
+  }
+  REQUIRE(reversed
+          == std::vector<uint32_t>(expected.rbegin(), expected.rend()));
+
+  for (const std::size_t count : {0, 1, 5, 100, 1000}) {
+    std::vector<uint32_t> tail;
+    for (const auto& record : reader.tail(count)) {
+      tail.push_back(value_of(record));
+    }
+    const auto size = std::min(count, expected.size());
+    REQUIRE(tail
+            == std::vector<uint32_t>(expected.end() - size, expected.end()));
+  }
+
+  // The last record is found in the last block
+  const auto last_block =
+      reader.block_decoder(reader.block_count() - 1, reader.block_count());
+  REQUIRE(reader.tail_decoder(1).offset() >= last_block.offset());
+  remove(file);
+}
+
+TEST_CASE("reader goes back through a container a block at a time"
+          * test_suite("reader"))
+{
+  check_container_reverse<binary_log::container_packer<64>>(
+      "test_reader_reverse.log");
+  check_container_reverse<binary_log::container_packer<
+      64,
+      binary_log::index_coding::huffman>>("test_reader_huffman_reverse.log");
+}
+
+TEST_CASE("reader reads records copied as they are encoded"
+          * test_suite("reader"))
+{
+  static constexpr auto copy_file = "test_reader_copy.log";
+  {
+    binary_log::binary_log log(reader_test_file);
+    for (uint32_t i = 0; i < 20; ++i) {
+      BINARY_LOG(log,
+                 "Copied name: {} {}",
+                 std::to_string(i),
+                 binary_log::constant(7));
+      if (i % 2 == 0) {
+        BINARY_LOG(log, "Copied value: {}", i);
+      }
+    }
+  }
+
+  {
+    // Copy the records of the second call site, then of the first
+    binary_log::reader reader(reader_test_file);
+    const auto index_of = [&reader](std::string_view format_string)
+    {
+      const auto& table = reader.index_table();
+      for (std::size_t i = 0; i < table.size(); ++i) {
+        if (table[i].format_string == format_string) {
+          return i;
+        }
+      }
+      return table.size();
+    };
+    const auto name_index = index_of("Copied name: {} {}");
+    const auto value_index = index_of("Copied value: {}");
+    binary_log::packer<1024, 64, 64, 0> copy(copy_file);
+    copy.write_encoded_entry_to_index_file(
+        reader.index_table()[value_index].bytes);
+    copy.write_encoded_entry_to_index_file(
+        reader.index_table()[name_index].bytes);
+
+    auto copy_records = [&](std::size_t source_index, uint16_t index)
+    {
+      auto decoder = reader.decoder();
+      std::vector<binary_log::arg_view> args;
+      while (!decoder.at_end()) {
+        const auto [run_index, count] = decoder.next_run();
+        for (std::size_t i = 0; i < count; ++i) {
+          const char* first = decoder.position();
+          decoder.decode(reader.index_table()[run_index], args);
+          if (run_index == source_index) {
+            copy.pack_format_string_index(index);
+            copy.write_encoded_args_to_log_file(first,
+                                                decoder.position() - first);
+          }
+        }
+      }
+    };
+    copy_records(value_index, 0);
+    copy_records(name_index, 1);
+  }
+
+  {
+    binary_log::reader reader(copy_file);
+    REQUIRE(reader.index_table().size() == 2);
+    REQUIRE(reader.index_table()[0].format_string == "Copied value: {}");
+    REQUIRE(reader.index_table()[1].format_string == "Copied name: {} {}");
+
+    std::vector<uint32_t> values;
+    std::vector<std::string> names;
+    for (const auto& record : reader.records()) {
+      if (record.index() == 0) {
+        values.push_back(record[0].as<uint32_t>());
+      } else {
+        names.emplace_back(record[0].value);
+        REQUIRE(record[1].as<int32_t>() == 7);
+      }
+    }
+    REQUIRE(values.size() == 10);
+    REQUIRE(values[9] == 18);
+    REQUIRE(names.size() == 20);
+    REQUIRE(names[19] == "19");
+  }
+
+  remove_reader_test_files();
+  for (auto extension : {"", ".index", ".runlength"}) {
+    remove((std::string(copy_file) + extension).c_str());
+  }
+}
+
+template<std::size_t Site, class Packer>
+static void log_at_site(binary_log::binary_log<Packer>& log, uint32_t value)
+{
+  BINARY_LOG(log, "Site {}", value);
+}
+
+template<class Packer, std::size_t... Sites>
+static void log_at_sites(binary_log::binary_log<Packer>& log,
+                         std::index_sequence<Sites...>)
+{
+  // Every site once, then a run at each
+  ((void)log_at_site<Sites>(log, Sites), ...);
+  ((void)(log_at_site<Sites>(log, Sites), log_at_site<Sites>(log, Sites),
+          log_at_site<Sites>(log, Sites)),
+   ...);
+}
+
+TEST_CASE("reader decodes the records of hundreds of call sites"
+          * test_suite("reader"))
+{
+  // Indices from 128 up take two bytes, and from 256 up took a wider type
+  static constexpr std::size_t num_sites = 300;
+  std::vector<uint32_t> expected;
+  for (uint32_t site = 0; site < num_sites; ++site) {
+    expected.push_back(site);
+  }
+  for (uint32_t site = 0; site < num_sites; ++site) {
+    expected.insert(expected.end(), 3, site);
+  }
+
+  const auto check = [&](const char* path)
+  {
+    const binary_log::reader reader(path);
+    REQUIRE(reader.index_table().size() == num_sites);
+    std::vector<uint32_t> values;
+    for (const auto& record : reader.records()) {
+      values.push_back(record[0].as<uint32_t>());
+    }
+    REQUIRE(values == expected);
+  };
+
+  {
+    binary_log::binary_log log(reader_test_file);
+    log_at_sites(log, std::make_index_sequence<num_sites> {});
+  }
+  check(reader_test_file);
+  remove_reader_test_files();
+
+  static constexpr auto container_file = "test_reader_sites.log";
+  {
+    binary_log::binary_log<binary_log::container_packer<>> log(
+        container_file);
+    log_at_sites(log, std::make_index_sequence<num_sites> {});
+  }
+  check(container_file);
+  remove(container_file);
+
+  {
+    binary_log::binary_log<binary_log::container_packer<
+        64 * 1024,
+        binary_log::index_coding::huffman>>
+        log(container_file);
+    log_at_sites(log, std::make_index_sequence<num_sites> {});
+  }
+  check(container_file);
+  remove(container_file);
+}
+
+// Never called, and so never emitted: its call site is registered all the
+// same, and must not refer to the format string of the expansion
+[[maybe_unused]] static void log_unused(binary_log::binary_log<>& log)
+{
+  BINARY_LOG(log, "Unused {}", 1);
+}
+
+TEST_CASE("reader decodes a call site shared by two logs"
+          * test_suite("reader"))
+{
+  static constexpr auto other_file = "test_reader_other.log";
+  {
+    binary_log::binary_log first(reader_test_file);
+    binary_log::binary_log other(other_file);
+    const auto value = [](auto& log, uint32_t i)
+    { BINARY_LOG(log, "Shared: {}", i); };
+    value(first, 1);
+    BINARY_LOG(other, "Other only");
+    value(other, 2);
+    value(first, 3);
+  }
+
+  const auto values_of = [](const char* path)
+  {
+    const binary_log::reader reader(path);
+    std::vector<std::string> values;
+    for (const auto& record : reader.records()) {
+      values.push_back(record.format_string() == "Shared: {}"
+                           ? std::to_string(record[0].as<uint32_t>())
+                           : std::string(record.format_string()));
+    }
+    return values;
+  };
+  REQUIRE(values_of(reader_test_file) == std::vector<std::string> {"1", "3"});
+  REQUIRE(values_of(other_file)
+          == std::vector<std::string> {"Other only", "2"});
+
+  remove_reader_test_files();
+  for (auto extension : {"", ".index", ".runlength", ".seek"}) {
+    remove((std::string(other_file) + extension).c_str());
+  }
+}
+
+template<class Packer>
+static void check_container_file_and_stream(const char* container_file)
+{
+  {
+    binary_log::binary_log<Packer> log(container_file);
+    for (uint32_t i = 0; i < 100; ++i) {
+      for (uint32_t j = 0; j < i % 7; ++j) {
+        BINARY_LOG(log, "Value: {}", i);
+      }
+      if (i % 3 == 0) {
+        BINARY_LOG(
+            log, "Name: {} {}", std::to_string(i), binary_log::constant(7));
+      }
+      if (i == 50) {
+        log.flush();
+      }
+    }
+  }
+
+  std::vector<std::string> expected;
+  for (uint32_t i = 0; i < 100; ++i) {
+    for (uint32_t j = 0; j < i % 7; ++j) {
+      expected.push_back(std::to_string(i));
+    }
+    if (i % 3 == 0) {
+      expected.push_back(std::to_string(i) + " 7");
+    }
+  }
+
+  const auto to_string = [](const binary_log::record& record)
+  {
+    if (record.format_string() == "Value: {}") {
+      return std::to_string(record[0].as<uint32_t>());
+    }
+    return std::string(record[0].value) + " "
+        + std::to_string(record[1].as<int>());
+  };
+
+  {
+    const binary_log::reader log(container_file);
+    REQUIRE(log.is_container());
+    REQUIRE(log.index_table().size() == 2);
+    REQUIRE(log.committed_log().size() == log.log().size());
+    REQUIRE(log.record_count() == expected.size());
+
+    std::vector<std::string> values;
+    for (const auto& record : log.records()) {
+      values.push_back(to_string(record));
+    }
+    REQUIRE(values == expected);
+
+    values.clear();
+    for (const auto& record : log.records(10, 20)) {
+      values.push_back(to_string(record));
+    }
+    REQUIRE(values
+            == std::vector<std::string>(expected.begin() + 10,
+                                        expected.begin() + 20));
+  }
+
+  std::FILE* file = std::fopen(container_file, "rb");
+  REQUIRE(file != nullptr);
+  {
+    binary_log::stream_reader stream(file);
+    std::vector<std::string> values;
+    std::size_t blocks = 0;
+    while (stream.next_block()) {
+      ++blocks;
+      for (const auto& record : stream.records()) {
+        values.push_back(to_string(record));
+      }
+    }
+    REQUIRE(blocks > 10);
+    REQUIRE(stream.index_table().size() == 2);
+    REQUIRE(values == expected);
+  }
+  std::fclose(file);
+  remove(container_file);
+}
+
+TEST_CASE("reader decodes a container as a file and as a stream"
+          * test_suite("reader"))
+{
+  // Blocks of about 64 bytes end runs of all lengths
+  check_container_file_and_stream<binary_log::container_packer<64>>(
+      "test_reader_container.log");
+  check_container_file_and_stream<binary_log::container_packer<
+      64,
+      binary_log::index_coding::huffman>>("test_reader_huffman.log");
+}
+
+template<class Packer>
+static void check_container_runs(const char* container_file)
+{
+  // Run counts grow from one byte to three, in one block
+  const std::vector<uint32_t> lengths = {1, 2, 3, 4, 127, 128, 300, 16384, 2};
+  {
+    binary_log::binary_log<Packer> log(container_file);
+    for (std::size_t i = 0; i < lengths.size(); ++i) {
+      for (uint32_t j = 0; j < lengths[i]; ++j) {
+        if (i % 2 == 0) {
+          BINARY_LOG(log, "Even {}", j);
+        } else {
+          BINARY_LOG(log, "Odd {}", j);
+        }
+      }
+    }
+  }
+
+  // Runs start from the third record of a call site in a row
+  std::vector<std::size_t> expected_runs;
+  std::vector<uint32_t> expected;
+  for (const auto length : lengths) {
+    if (length < 3) {
+      expected_runs.insert(expected_runs.end(), length, 1);
+    } else {
+      expected_runs.push_back(length);
+    }
+    for (uint32_t j = 0; j < length; ++j) {
+      expected.push_back(j);
+    }
+  }
+
+  const binary_log::reader log(container_file);
+  auto decoder = log.decoder();
+  std::vector<std::size_t> runs;
+  while (!decoder.at_end()) {
+    const auto [index, count] = decoder.next_run();
+    decoder.skip(log.index_table()[index], count);
+    runs.push_back(count);
+  }
+  REQUIRE(runs == expected_runs);
+
+  std::vector<uint32_t> values;
+  for (const auto& record : log.records()) {
+    values.push_back(record[0].as<uint32_t>());
+  }
+  REQUIRE(values == expected);
+  remove(container_file);
+}
+
+TEST_CASE("reader decodes container runs of any length"
+          * test_suite("reader"))
+{
+  check_container_runs<binary_log::container_packer<1024 * 1024>>(
+      "test_reader_runs.log");
+  check_container_runs<binary_log::container_packer<
+      1024 * 1024,
+      binary_log::index_coding::huffman>>("test_reader_huffman_runs.log");
+}
+
+template<class Packer>
+static void check_repeats(const char* file)
+{
+  // Loops over two, three and four call sites, with runs and other call
+  // sites breaking them, and a flush in the middle of one
+  std::vector<std::pair<char, uint32_t>> expected;
+  {
+    binary_log::binary_log<Packer> log(file);
+    for (uint32_t i = 0; i < 300; ++i) {
+      BINARY_LOG(log, "A {}", i);
+      BINARY_LOG(log, "B {}", i);
+      expected.insert(expected.end(), {{'A', i}, {'B', i}});
+      if (i == 150) {
+        log.flush();
+      }
+    }
+    for (uint32_t i = 0; i < 200; ++i) {
+      BINARY_LOG(log, "C {}", i);
+      BINARY_LOG(log, "A {}", i);
+      expected.insert(expected.end(), {{'C', i}, {'A', i}});
+      if (i % 40 == 39) {
+        BINARY_LOG(log, "A {}", i);
+        expected.push_back({'A', i});
+      }
+      BINARY_LOG(log, "B {}", i);
+      expected.push_back({'B', i});
+    }
+    for (uint32_t i = 0; i < 100; ++i) {
+      BINARY_LOG(log, "D {}", i);
+      BINARY_LOG(log, "C {}", i);
+      BINARY_LOG(log, "B {}", i);
+      BINARY_LOG(log, "A {}", i);
+      expected.insert(expected.end(), {{'D', i}, {'C', i}, {'B', i}, {'A', i}});
+    }
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "D {}", i);
+      expected.push_back({'D', i});
+    }
+  }
+
+  const binary_log::reader log(file);
+  std::vector<std::pair<char, uint32_t>> values;
+  for (const auto& record : log.records()) {
+    values.push_back({record.format_string()[0], record[0].as<uint32_t>()});
+  }
+  REQUIRE(values == expected);
+
+  // The repeated records have no format string index of their own
+  auto size = std::filesystem::file_size(file);
+  if (log.is_container()) {
+    size -= sizeof(binary_log::container_header);
+    for (const auto& entry : log.index_table()) {
+      size -= binary_log::container_marker_size + entry.bytes.size();
+    }
+  }
+  REQUIRE(size < expected.size() * sizeof(uint32_t) + expected.size() / 2);
+
+  for (std::size_t first = 0; first < expected.size(); first += 97) {
+    std::vector<std::pair<char, uint32_t>> range;
+    for (const auto& record : log.records(first, first + 30)) {
+      range.push_back({record.format_string()[0], record[0].as<uint32_t>()});
+    }
+    const auto last = std::min(expected.size(), first + 30);
+    REQUIRE(range.size() == last - first);
+    for (std::size_t i = first; i < last; ++i) {
+      REQUIRE(range[i - first] == expected[i]);
+    }
+  }
+
+  std::vector<std::pair<char, uint32_t>> tail;
+  for (const auto& record : log.tail(25)) {
+    tail.push_back({record.format_string()[0], record[0].as<uint32_t>()});
+  }
+  REQUIRE(tail
+          == std::vector<std::pair<char, uint32_t>>(expected.end() - 25,
+                                                    expected.end()));
+}
+
+TEST_CASE("reader decodes records that repeat the call sites before them"
+          * test_suite("reader"))
+{
+  // Checkpoints every 256 bytes end repeats on the way
+  check_repeats<binary_log::packer<1024 * 1024, 32, 32, 256>>(
+      reader_test_file);
+  remove_reader_test_files();
+
+  // Blocks of about 512 bytes end repeats too
+  check_repeats<binary_log::container_packer<512>>(
+      "test_reader_repeats.log");
+  remove("test_reader_repeats.log");
+  check_repeats<binary_log::container_packer<
+      512,
+      binary_log::index_coding::huffman>>("test_reader_huffman_repeats.log");
+  remove("test_reader_huffman_repeats.log");
+}
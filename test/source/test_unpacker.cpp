@@ -0,0 +1,738 @@
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <binary_log/binary_log.hpp>
+#include <binary_log/reader.hpp>
+#include <doctest.hpp>
+#include <exporter.hpp>
+#include <fcntl.h>
+#include <log_extractor.hpp>
+#include <log_file_parser.hpp>
+#include <log_merger.hpp>
+#include <output_writer.hpp>
+#include <pthread.h>
+#include <query.hpp>
+#include <record_filter.hpp>
+#include <segment_unpacker.hpp>
+#include <unistd.h>
+
+using doctest::test_suite;
+
+static void remove_log(const std::string& path)
+{
+  for (const auto* suffix : {"", ".index", ".runlength", ".seek"}) {
+    remove((path + suffix).c_str());
+  }
+}
+
+static std::string read_text(const std::filesystem::path& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// The records of `log` selected by `expression`, by their position in the
+// log
+static std::vector<std::size_t> matching_records(const binary_log::reader& log,
+                                                 std::string_view expression)
+{
+  binary_log::query predicate(expression);
+  predicate.compile(log.index_table());
+  std::vector<std::size_t> matches;
+  std::size_t position = 0;
+  for (const auto& record : log.records()) {
+    const std::vector<binary_log::arg_view> args(record.args().begin(),
+                                                 record.args().end());
+    if (predicate.satisfiable(record.index())
+        && predicate.evaluate(record.index(), args))
+    {
+      matches.push_back(position);
+    }
+    ++position;
+  }
+  return matches;
+}
+
+TEST_CASE("output_writer hands its text to a sink a buffer at a time"
+          * test_suite("unpacker"))
+{
+  std::vector<std::string> chunks;
+  {
+    auto output = binary_log::output_writer(
+        [&chunks](std::string_view text) { chunks.emplace_back(text); }, 16);
+    output.write("0123456789");
+    REQUIRE(chunks.empty());
+    output.write("abcdef");
+    REQUIRE(chunks == std::vector<std::string> {"0123456789abcdef"});
+
+    fmt::dynamic_format_arg_store<fmt::format_context> store;
+    store.push_back(42);
+    store.push_back(std::string("x"));
+    output.write_line("{} {}", store);
+    REQUIRE(chunks.size() == 1);
+    output.write("a longer line of text\n");
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[1] == "42 x\na longer line of text\n");
+    REQUIRE(output.bytes_written() == 16 + 27);
+
+    output.write("tail");
+    output.flush();
+    output.flush();
+    REQUIRE(chunks.size() == 3);
+    output.write("left at exit");
+  }
+  REQUIRE(chunks
+          == std::vector<std::string> {"0123456789abcdef",
+                                       "42 x\na longer line of text\n",
+                                       "tail",
+                                       "left at exit"});
+}
+
+TEST_CASE("output_writer writes everything when interrupted by a signal"
+          * test_suite("unpacker"))
+{
+  // Without SA_RESTART, a write(2) blocked on a full pipe fails with EINTR
+  // when the signal arrives
+  struct sigaction action {};
+  action.sa_handler = [](int) {};
+  sigemptyset(&action.sa_mask);
+  struct sigaction previous {};
+  REQUIRE(sigaction(SIGUSR1, &action, &previous) == 0);
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  const auto flags = fcntl(fds[1], F_GETFL);
+  fcntl(fds[1], F_SETFL, flags | O_NONBLOCK);
+  std::string filler(4096, '-');
+  std::size_t filled = 0;
+  for (ssize_t written;
+       (written = ::write(fds[1], filler.data(), filler.size())) > 0;)
+  {
+    filled += static_cast<std::size_t>(written);
+  }
+  fcntl(fds[1], F_SETFL, flags);
+
+  std::string text;
+  for (int i = 0; text.size() < 256 * 1024; ++i) {
+    text += "line " + std::to_string(i) + "\n";
+  }
+
+  std::string received;
+  const auto writer = pthread_self();
+  std::thread reader(
+      [&]
+      {
+        for (int i = 0; i < 3; ++i) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          pthread_kill(writer, SIGUSR1);
+        }
+        char buffer[4096];
+        for (ssize_t size; (size = ::read(fds[0], buffer, sizeof(buffer))) > 0;)
+        {
+          received.append(buffer, static_cast<std::size_t>(size));
+        }
+      });
+
+  {
+    auto output = binary_log::output_writer(fds[1], text.size());
+    output.write(text);
+    REQUIRE(output.bytes_written() == text.size());
+  }
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  sigaction(SIGUSR1, &previous, nullptr);
+
+  REQUIRE(received.size() == filled + text.size());
+  REQUIRE(received.substr(filled) == text);
+}
+
+TEST_CASE("record_filter selects call sites by index, substring or regex"
+          * test_suite("unpacker"))
+{
+  using binary_log::level;
+  std::vector<binary_log::index_entry> index_table(4);
+  index_table[0].format_string = "Opened {} in {} ms";
+  index_table[0].level = level::debug;
+  index_table[1].format_string = "Order {} filled";
+  index_table[2].format_string = "Order {} rejected";
+  index_table[2].level = level::warn;
+  index_table[3].format_string = "Disk 12 full";
+  index_table[3].level = level::error;
+
+  // The call sites selected by a filter, and an unknown one
+  const auto selected = [&](const binary_log::record_filter& filter)
+  {
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < index_table.size(); ++i) {
+      if (filter.selected(i)) {
+        indices.push_back(i);
+      }
+    }
+    REQUIRE(filter.selected(index_table.size()));
+    return indices;
+  };
+  using indices = std::vector<std::size_t>;
+
+  REQUIRE(selected({index_table, {}, {}}) == indices {0, 1, 2, 3});
+  // A pattern made of digits only is an index, not a substring
+  REQUIRE(selected({index_table, {"Order"}, {}}) == indices {1, 2});
+  REQUIRE(selected({index_table, {"2"}, {}}) == indices {2});
+  REQUIRE(selected({index_table, {"12"}, {}}).empty());
+  REQUIRE(selected({index_table, {"0", "filled"}, {}}) == indices {0, 1});
+  // Without --regex, patterns are plain substrings
+  REQUIRE(selected({index_table, {"^Order"}, {}}).empty());
+  REQUIRE(selected({index_table, {"^Order"}, {}, true}) == indices {1, 2});
+  REQUIRE(selected({index_table, {"[0-9]+ full$"}, {}, true})
+          == indices {3});
+
+  // Excludes override includes, and apply to every call site otherwise
+  REQUIRE(selected({index_table, {"Order"}, {"rejected"}}) == indices {1});
+  REQUIRE(selected({index_table, {"Order"}, {"1"}}) == indices {2});
+  REQUIRE(selected({index_table, {}, {"^Order", "3"}, true})
+          == indices {0});
+
+  // Levels are a threshold, applied before the patterns
+  REQUIRE(selected({index_table, {}, {}, false, level::info})
+          == indices {1, 2, 3});
+  REQUIRE(selected({index_table, {}, {}, false, level::warn})
+          == indices {2, 3});
+  REQUIRE(selected({index_table, {"Order"}, {}, false, level::warn})
+          == indices {2});
+  REQUIRE(selected({index_table, {"Opened"}, {}, false, level::error})
+          .empty());
+
+  // An invalid regex is reported once, when the filter is built
+  REQUIRE_THROWS_AS(
+      binary_log::record_filter(index_table, {"("}, {}, true),
+      std::runtime_error);
+  REQUIRE_NOTHROW(binary_log::record_filter(index_table, {"("}, {}));
+}
+
+TEST_CASE("query evaluates comparisons on the raw args of each call site"
+          * test_suite("unpacker"))
+{
+  static constexpr auto file = "test_unpacker_query.log";
+  {
+    binary_log::binary_log log(file);
+    const auto trade =
+        [&log](std::string symbol, uint32_t quantity, double price)
+    { BINARY_LOG(log, "Trade {} {} {}", symbol, quantity, price); };
+    const auto delta = [&log](int64_t value)
+    { BINARY_LOG(log, "Delta {}", value); };
+    const auto flag = [&log](bool value)
+    { BINARY_LOG(log, "Flag {}", value); };
+    trade("AAPL", 100, 1.5);
+    trade("MSFT", 2000, 3.25);
+    trade("AAPL", 5000, -2.0);
+    delta(-7);
+    delta(7);
+    flag(true);
+    flag(false);
+  }
+
+  {
+    const binary_log::reader log(file);
+    using positions = std::vector<std::size_t>;
+    REQUIRE(matching_records(log, "arg0 == 'AAPL'") == positions {0, 2});
+    REQUIRE(matching_records(log, "arg1 > 1000 && arg0 == \"AAPL\"")
+            == positions {2});
+    REQUIRE(matching_records(log, "arg0 < -5") == positions {3});
+    REQUIRE(matching_records(log, "arg2 < 0 || arg0 == 7")
+            == positions {2, 4});
+    REQUIRE(matching_records(log, "arg2 >= 1.5") == positions {0, 1});
+    REQUIRE(matching_records(log, "arg0 == true") == positions {5});
+    REQUIRE(matching_records(log, "arg0 != false") == positions {3, 4, 5});
+    REQUIRE(matching_records(log, "(arg0 == -7 || arg0 == 7) && arg0 > 0")
+            == positions {4});
+
+    // A comparison with an arg a call site does not have, or of another
+    // type, is false there, and its negation true
+    REQUIRE(matching_records(log, "!(arg1 == 100)")
+            == positions {1, 2, 3, 4, 5, 6});
+
+    // Call sites where no record can match are known before decoding
+    binary_log::query predicate("arg0 == 'AAPL'");
+    predicate.compile(log.index_table());
+    REQUIRE(predicate.satisfiable(0));
+    REQUIRE_FALSE(predicate.satisfiable(1));
+    REQUIRE_FALSE(predicate.satisfiable(2));
+  }
+
+  remove_log(file);
+}
+
+TEST_CASE("query reports where an expression is invalid"
+          * test_suite("unpacker"))
+{
+  auto error_of = [](std::string_view expression) -> std::string
+  {
+    try {
+      binary_log::query predicate(expression);
+    } catch (const std::runtime_error& error) {
+      return error.what();
+    }
+    return "";
+  };
+  REQUIRE(error_of("value == 1")
+          == "Invalid query at offset 0: expected 'arg<N>'");
+  REQUIRE(error_of("arg == 1")
+          == "Invalid query at offset 3: expected an argument number after "
+             "'arg'");
+  REQUIRE(error_of("arg0 = 1")
+          == "Invalid query at offset 5: expected a comparison operator");
+  REQUIRE(error_of("arg0 == 'x")
+          == "Invalid query at offset 8: unterminated string literal");
+  REQUIRE(error_of("arg0 == abc")
+          == "Invalid query at offset 8: expected a number, string, true or "
+             "false");
+  REQUIRE(error_of("(arg0 == 1") == "Invalid query at offset 10: expected ')'");
+  REQUIRE(error_of("arg0 == 1 arg1")
+          == "Invalid query at offset 10: unexpected trailing characters");
+  REQUIRE(error_of(" arg0 >= +5 ") == "");
+}
+
+TEST_CASE("histogram finds percentiles to within a bucket"
+          * test_suite("unpacker"))
+{
+  binary_log::histogram empty;
+  REQUIRE(empty.percentile(50) == 0);
+
+  // Integers below 256 have buckets of their own
+  binary_log::histogram small;
+  for (int i = 1; i <= 200; ++i) {
+    small.add(i);
+  }
+  REQUIRE(small.percentile(0) == 1);
+  REQUIRE(small.percentile(50) == 100);
+  REQUIRE(small.percentile(25) == 50);
+  REQUIRE(small.percentile(100) == 200);
+
+  // Buckets are narrower than 1% of their values
+  binary_log::histogram large;
+  for (int i = 1; i <= 100000; ++i) {
+    large.add(i);
+  }
+  for (const double percent : {10.0, 50.0, 90.0, 99.0, 99.9}) {
+    const double exact = percent * 1000;
+    REQUIRE(large.percentile(percent) <= exact);
+    REQUIRE(large.percentile(percent) > exact * 0.99);
+  }
+
+  // Negative values come first, largest magnitude first
+  binary_log::histogram mixed;
+  mixed.add(-3, 2);
+  mixed.add(-100);
+  mixed.add(5);
+  uint64_t keys[] = {binary_log::histogram::key(7),
+                     binary_log::histogram::key(7),
+                     binary_log::histogram::key(9)};
+  mixed.add_keys(keys, 3);
+  REQUIRE(mixed.percentile(10) == -100);
+  REQUIRE(mixed.percentile(40) == -3);
+  REQUIRE(mixed.percentile(50) == 5);
+  REQUIRE(mixed.percentile(80) == 7);
+  REQUIRE(mixed.percentile(100) == 9);
+}
+
+// The columns of the lines printed by the aggregator for the records of
+// `file` that match `expression`, if any, without the header line
+static std::vector<std::vector<std::string>> aggregate(
+    const char* file, std::string_view expression = {})
+{
+  const binary_log::reader log(file);
+  binary_log::log_file_parser parser(log);
+  if (!expression.empty()) {
+    binary_log::query predicate(expression);
+    predicate.compile(log.index_table());
+    parser.set_query(std::move(predicate));
+  }
+  binary_log::aggregator statistics(log.index_table());
+  parser.parse_and_aggregate(statistics);
+
+  std::string text;
+  {
+    binary_log::output_writer out([&text](std::string_view written)
+                                  { text += written; });
+    statistics.print(log.index_table(), out);
+  }
+  std::vector<std::vector<std::string>> lines;
+  std::istringstream stream(text);
+  std::getline(stream, text);
+  for (std::string line; std::getline(stream, line);) {
+    std::istringstream words(line);
+    auto& columns = lines.emplace_back();
+    for (std::string word; words >> word;) {
+      columns.push_back(word);
+    }
+  }
+  return lines;
+}
+
+TEST_CASE("aggregator sums runs and decoded records of numeric args"
+          * test_suite("unpacker"))
+{
+  static constexpr auto file = "test_unpacker_aggregate.log";
+  {
+    binary_log::binary_log log(file);
+    for (uint32_t i = 1; i <= 100; ++i) {
+      BINARY_LOG(log, "Value {}", i);
+    }
+    for (int64_t i = -50; i < 50; ++i) {
+      BINARY_LOG(log, "Signed {} {}", std::to_string(i), i);
+    }
+  }
+
+  // Runs of fixed-size records are aggregated without decoding, and
+  // string args are left out
+  using columns = std::vector<std::string>;
+  auto lines = aggregate(file);
+  REQUIRE(lines.size() == 2);
+  REQUIRE(columns(lines[0].begin(), lines[0].begin() + 7)
+          == columns {"0", "0", "100", "5050", "1", "100", "50.5"});
+  REQUIRE(lines[0][7] == "50");
+  REQUIRE(lines[0].back() == "{}");
+  REQUIRE(columns(lines[1].begin(), lines[1].begin() + 7)
+          == columns {"1", "1", "100", "-50", "-50", "49", "-0.5"});
+
+  // A query makes every record of the call site be decoded
+  lines = aggregate(file, "arg0 < 10 || arg1 < 10");
+  REQUIRE(lines.size() == 2);
+  REQUIRE(columns(lines[0].begin(), lines[0].begin() + 7)
+          == columns {"0", "0", "9", "45", "1", "9", "5"});
+  REQUIRE(columns(lines[1].begin(), lines[1].begin() + 7)
+          == columns {"1", "1", "60", "-1230", "-50", "9", "-20.5"});
+
+  remove_log(file);
+}
+
+TEST_CASE("call site stats count records, bytes and suppressed calls"
+          * test_suite("unpacker"))
+{
+  using namespace std::chrono_literals;
+  static constexpr auto file = "test_unpacker_stats.log";
+  {
+    binary_log::binary_log log(file);
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "Value {}", i);
+    }
+    for (uint32_t i = 0; i < 5; ++i) {
+      BINARY_LOG_RATE_LIMITED(log, 2, 1h, "Limited {}", uint64_t {i});
+    }
+  }
+
+  {
+    const binary_log::reader log(file);
+    const auto& index_table = log.index_table();
+    REQUIRE(index_table.size() == 3);
+    REQUIRE(index_table[2].counts_suppressed);
+    REQUIRE(binary_log::suppressing_call_site(index_table, 2) == 1);
+
+    binary_log::log_file_parser parser(log);
+    const auto stats = parser.parse_and_count();
+    REQUIRE(stats[0].records == 10);
+    REQUIRE(stats[0].arg_bytes == 10 * sizeof(uint32_t));
+    REQUIRE(stats[1].records == 2);
+    REQUIRE(stats[1].arg_bytes == 2 * sizeof(uint64_t));
+    REQUIRE(stats[2].records == 1);
+    REQUIRE(stats[2].suppressed == 3);
+    REQUIRE(stats[0].bytes() + stats[1].bytes() + stats[2].bytes()
+            == log.log().size());
+
+    // The most expensive call sites first, with the suppressed calls on
+    // the line of the call site that suppressed them
+    std::string text;
+    {
+      binary_log::output_writer out([&text](std::string_view written)
+                                    { text += written; });
+      binary_log::print_call_site_stats(
+          index_table, stats, {}, parser.log_file_size(), out);
+    }
+    std::istringstream lines(text);
+    std::vector<std::pair<std::string, std::string>> sites;
+    std::getline(lines, text);
+    for (std::string line; std::getline(lines, line);) {
+      std::istringstream words(line);
+      std::string index, records, bytes, average, share, suppressed;
+      words >> index >> records >> bytes >> average >> share >> suppressed;
+      sites.emplace_back(index, suppressed);
+    }
+    REQUIRE(sites
+            == std::vector<std::pair<std::string, std::string>> {
+                {"0", "0"}, {"1", "3"}, {"2", "0"}});
+  }
+
+  remove_log(file);
+}
+
+TEST_CASE("exporters write the args of the selected records"
+          * test_suite("unpacker"))
+{
+  static constexpr auto file = "test_unpacker_export.log";
+  static constexpr auto directory = "test_unpacker_export";
+  {
+    binary_log::binary_log log(file);
+    const auto row = [&log](uint32_t number, std::string text)
+    { BINARY_LOG(log, "Row {} {}", number, text); };
+    const auto level = [&log](double value)
+    { BINARY_LOG(log, "Level {}", value); };
+    row(1, "a,b");
+    row(2, "plain");
+    row(3, "say \"hi\"");
+    level(0.5);
+    level(-2.0);
+  }
+
+  const binary_log::reader log(file);
+  auto export_lines = [&log](std::vector<std::size_t> projection)
+  {
+    std::string text;
+    {
+      binary_log::output_writer out([&text](std::string_view written)
+                                    { text += written; });
+      binary_log::jsonl_exporter exporter(
+          out, log.index_table(), projection);
+      binary_log::log_file_parser parser(log);
+      parser.parse_and_export(exporter);
+    }
+    return text;
+  };
+  REQUIRE(export_lines({})
+          == "{\"site\":0,\"arg0\":1,\"arg1\":\"a,b\"}\n"
+             "{\"site\":0,\"arg0\":2,\"arg1\":\"plain\"}\n"
+             "{\"site\":0,\"arg0\":3,\"arg1\":\"say \\\"hi\\\"\"}\n"
+             "{\"site\":1,\"arg0\":0.5}\n"
+             "{\"site\":1,\"arg0\":-2}\n");
+  REQUIRE(export_lines({1})
+          == "{\"site\":0,\"arg1\":\"a,b\"}\n"
+             "{\"site\":0,\"arg1\":\"plain\"}\n"
+             "{\"site\":0,\"arg1\":\"say \\\"hi\\\"\"}\n"
+             "{\"site\":1}\n"
+             "{\"site\":1}\n");
+
+  {
+    binary_log::csv_exporter exporter(directory, log.index_table());
+    binary_log::log_file_parser parser(log);
+    parser.parse_and_export(exporter);
+  }
+  REQUIRE(read_text(std::filesystem::path(directory) / "site0.csv")
+          == "arg0,arg1\n1,\"a,b\"\n2,plain\n3,\"say \"\"hi\"\"\"\n");
+  REQUIRE(read_text(std::filesystem::path(directory) / "site1.csv")
+          == "arg0\n0.5\n-2\n");
+  REQUIRE(std::filesystem::exists(std::filesystem::path(directory)
+                                  / "schema.json"));
+  std::filesystem::remove_all(directory);
+
+  // The runs of fixed-size records are copied a column at a time
+  {
+    binary_log::columnar_exporter exporter(directory, log.index_table());
+    binary_log::log_file_parser parser(log);
+    parser.parse_and_export(exporter);
+  }
+  auto column = [](const char* name)
+  { return read_text(std::filesystem::path(directory) / name); };
+  const uint32_t numbers[] = {1, 2, 3};
+  REQUIRE(column("site0.arg0")
+          == std::string(reinterpret_cast<const char*>(numbers),
+                         sizeof(numbers)));
+  REQUIRE(column("site0.arg1") == "a,bplainsay \"hi\"");
+  const uint64_t offsets[] = {0, 3, 8, 16};
+  REQUIRE(column("site0.arg1.offsets")
+          == std::string(reinterpret_cast<const char*>(offsets),
+                         sizeof(offsets)));
+  const double levels[] = {0.5, -2.0};
+  REQUIRE(column("site1.arg0")
+          == std::string(reinterpret_cast<const char*>(levels),
+                         sizeof(levels)));
+  REQUIRE(column("schema.json").find("\"format\": \"columnar\"")
+          != std::string::npos);
+  std::filesystem::remove_all(directory);
+
+  remove_log(file);
+}
+
+TEST_CASE("log_extractor copies the selected records into a new log"
+          * test_suite("unpacker"))
+{
+  static constexpr auto file = "test_unpacker_source.log";
+  static constexpr auto extract_file = "test_unpacker_extract.log";
+  {
+    binary_log::binary_log log(file);
+    const auto kept = [&log](uint32_t value)
+    { BINARY_LOG(log, "Kept {}", value); };
+    for (uint32_t i = 0; i < 10; ++i) {
+      BINARY_LOG(log, "Dropped {}", i);
+      kept(i);
+      kept(i + 100);
+      BINARY_LOG(log, "Kept name {}", std::to_string(i));
+    }
+  }
+
+  auto extract = [](std::string_view expression)
+  {
+    const binary_log::reader log(file);
+    binary_log::log_file_parser parser(log);
+    parser.set_filter(
+        binary_log::record_filter(log.index_table(), {"Kept"}, {}));
+    if (!expression.empty()) {
+      binary_log::query predicate(expression);
+      predicate.compile(log.index_table());
+      parser.set_query(std::move(predicate));
+    }
+    binary_log::log_extractor extractor(extract_file);
+    extractor.set_source(log);
+    parser.parse_and_extract(extractor);
+  };
+
+  auto records_of_extract = []
+  {
+    const binary_log::reader log(extract_file);
+    std::vector<std::string> records;
+    for (const auto& record : log.records()) {
+      records.push_back(std::string(record.format_string()) + " "
+                        + (record[0].is_string()
+                               ? std::string(record[0].value)
+                               : std::to_string(record[0].as<uint32_t>())));
+    }
+    REQUIRE(log.checkpoints().size() > 0);
+    REQUIRE(log.checkpoints().entry(log.checkpoints().size() - 1).record_number
+            == records.size());
+    return std::make_pair(log.index_table().size(), records);
+  };
+
+  // Runs of fixed-size records are copied whole, others a record at a time
+  extract("");
+  auto [call_sites, records] = records_of_extract();
+  REQUIRE(call_sites == 2);
+  REQUIRE(records.size() == 30);
+  REQUIRE(records[0] == "Kept {} 0");
+  REQUIRE(records[1] == "Kept {} 100");
+  REQUIRE(records[2] == "Kept name {} 0");
+  REQUIRE(records[29] == "Kept name {} 9");
+
+  // Call sites no record of which matches the query are left out
+  extract("arg0 > 108");
+  std::tie(call_sites, records) = records_of_extract();
+  REQUIRE(call_sites == 1);
+  REQUIRE(records == std::vector<std::string> {"Kept {} 109"});
+
+  remove_log(file);
+  remove_log(extract_file);
+}
+
+TEST_CASE("log_merger interleaves the blocks of logs in order of time"
+          * test_suite("unpacker"))
+{
+  using namespace std::chrono_literals;
+  static constexpr auto first_file = "test_unpacker_merge_a.log";
+  static constexpr auto second_file = "test_unpacker_merge_b.log";
+  {
+    binary_log::binary_log first(first_file);
+    binary_log::binary_log second(second_file);
+    for (uint32_t i = 0; i < 3; ++i) {
+      BINARY_LOG(first, "First {}", i);
+      BINARY_LOG(first, "First {}", i + 10);
+      first.flush();
+      std::this_thread::sleep_for(1ms);
+      BINARY_LOG(second, "Second {}", i);
+      second.flush();
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  const binary_log::reader first(first_file);
+  const binary_log::reader second(second_file);
+  std::vector<binary_log::log_file_parser> parsers;
+  parsers.reserve(2);
+  binary_log::log_merger merger;
+  for (const auto* log : {&first, &second}) {
+    auto& parser = parsers.emplace_back(*log);
+    parser.set_prefix(log == &first ? "a: " : "b: ");
+    merger.add(*log, parser, 0, log->record_count());
+  }
+
+  std::string text;
+  {
+    binary_log::output_writer out([&text](std::string_view written)
+                                  { text += written; });
+    merger.merge([&](std::size_t position)
+                 { parsers[position].print_records(out); });
+  }
+  REQUIRE(text
+          == "a: First 0\na: First 10\nb: Second 0\n"
+             "a: First 1\na: First 11\nb: Second 1\n"
+             "a: First 2\na: First 12\nb: Second 2\n");
+
+  remove_log(first_file);
+  remove_log(second_file);
+}
+
+TEST_CASE("segment_unpacker prints many logs in order on several threads"
+          * test_suite("unpacker"))
+{
+  static constexpr auto directory = "test_unpacker_segments";
+  std::string expected;
+  for (uint32_t segment = 0; segment < 5; ++segment) {
+    binary_log::binary_log log("test_unpacker_segment.log."
+                               + std::to_string(segment));
+    for (uint32_t i = 0; i < 100; ++i) {
+      BINARY_LOG(log, "Segment {} record {}", segment, i);
+      expected += "Segment " + std::to_string(segment) + " record "
+          + std::to_string(i) + "\n";
+    }
+  }
+
+  // The side files of the logs are left out of a glob
+  const auto paths =
+      binary_log::expand_log_paths({"test_unpacker_segment.log.*"});
+  REQUIRE(paths.size() == 5);
+  REQUIRE(paths.front() == "test_unpacker_segment.log.0");
+  REQUIRE(paths.back() == "test_unpacker_segment.log.4");
+  REQUIRE_THROWS_AS(binary_log::expand_log_paths({"test_unpacker_none.*"}),
+                    std::runtime_error);
+
+  // Small buffers make the threads wait for the logs before theirs
+  {
+    static constexpr auto output = "test_unpacker_segments.txt";
+    const int fd = ::open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(fd >= 0);
+    binary_log::segment_unpacker(paths, 3, 64, {}).unpack_in_order(fd);
+    ::close(fd);
+    REQUIRE(read_text(output) == expected);
+    remove(output);
+  }
+
+  // Each log to its own file, through the setup of its parser
+  binary_log::segment_unpacker(
+      paths,
+      2,
+      64,
+      [](const binary_log::reader& log, binary_log::log_file_parser& parser)
+      {
+        parser.set_filter(
+            binary_log::record_filter(log.index_table(), {}, {"Segment"}));
+      })
+      .unpack_to_directory(directory);
+  for (const auto& path : paths) {
+    REQUIRE(read_text(std::filesystem::path(directory) / (path + ".txt"))
+            == "");
+  }
+  std::filesystem::remove_all(directory);
+
+  for (const auto& path : paths) {
+    remove_log(path);
+  }
+}
@@ -0,0 +1,259 @@
+// Lists, attaches to and detaches from the BINARY_LOG_PROBE call sites of
+// a running process, without stopping it: their entries are found in the
+// binary_log_probes section of its executable, and their semaphores are
+// read and written through /proc/<pid>/mem (which takes the permission to
+// ptrace the process).
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+static constexpr std::string_view probes_section = "binary_log_probes";
+
+// A probe entry as BINARY_LOG_PROBE writes it (see probe.hpp)
+struct probe_entry
+{
+  uint64_t semaphore;
+  uint64_t format_string;
+};
+
+class file_descriptor
+{
+  int m_fd;
+
+public:
+  file_descriptor(const std::string& path, int flags)
+      : m_fd(open(path.c_str(), flags))
+  {
+    if (m_fd < 0) {
+      throw std::runtime_error("Could not open " + path + ": "
+                               + std::strerror(errno));
+    }
+  }
+
+  file_descriptor(const file_descriptor&) = delete;
+  file_descriptor& operator=(const file_descriptor&) = delete;
+
+  ~file_descriptor()
+  {
+    close(m_fd);
+  }
+
+  void read(uint64_t offset, void* data, std::size_t size) const
+  {
+    if (pread(m_fd, data, size, static_cast<off_t>(offset))
+        != static_cast<ssize_t>(size))
+    {
+      throw std::runtime_error("Could not read at "
+                               + std::to_string(offset));
+    }
+  }
+
+  void write(uint64_t offset, const void* data, std::size_t size) const
+  {
+    if (pwrite(m_fd, data, size, static_cast<off_t>(offset))
+        != static_cast<ssize_t>(size))
+    {
+      throw std::runtime_error("Could not write at "
+                               + std::to_string(offset) + ": "
+                               + std::strerror(errno));
+    }
+  }
+};
+
+// Where the probe entries of an executable are, in its own addresses
+struct probes_location
+{
+  uint64_t address {0};
+  uint64_t size {0};
+  uint64_t first_segment {0};  // page of the lowest loaded address
+  bool position_independent {false};
+};
+
+static probes_location find_probes(const std::string& executable)
+{
+  const file_descriptor file(executable, O_RDONLY);
+  Elf64_Ehdr header;
+  file.read(0, &header, sizeof(header));
+  if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+      || header.e_ident[EI_CLASS] != ELFCLASS64)
+  {
+    throw std::runtime_error(executable + " is not a 64-bit ELF file");
+  }
+
+  probes_location location;
+  location.position_independent = header.e_type == ET_DYN;
+  location.first_segment = UINT64_MAX;
+  for (std::size_t i = 0; i < header.e_phnum; ++i) {
+    Elf64_Phdr segment;
+    file.read(header.e_phoff + i * header.e_phentsize,
+              &segment,
+              sizeof(segment));
+    if (segment.p_type == PT_LOAD) {
+      const auto page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      location.first_segment =
+          std::min(location.first_segment, segment.p_vaddr & ~(page - 1));
+    }
+  }
+
+  std::vector<Elf64_Shdr> sections(header.e_shnum);
+  for (std::size_t i = 0; i < sections.size(); ++i) {
+    file.read(header.e_shoff + i * header.e_shentsize,
+              &sections[i],
+              sizeof(Elf64_Shdr));
+  }
+  if (header.e_shstrndx >= sections.size()) {
+    throw std::runtime_error(executable + " has no section names");
+  }
+  const auto& names = sections[header.e_shstrndx];
+  std::string name_table(names.sh_size, '\0');
+  file.read(names.sh_offset, name_table.data(), name_table.size());
+  for (const auto& section : sections) {
+    if (section.sh_name < name_table.size()
+        && name_table.c_str() + section.sh_name == probes_section)
+    {
+      location.address = section.sh_addr;
+      location.size = section.sh_size;
+    }
+  }
+  return location;
+}
+
+// Offset of the addresses of the process from those of its executable
+static uint64_t load_bias(int pid, const probes_location& location)
+{
+  if (!location.position_independent) {
+    return 0;
+  }
+  const auto proc = "/proc/" + std::to_string(pid);
+  const auto executable =
+      std::filesystem::read_symlink(proc + "/exe").string();
+  std::ifstream maps(proc + "/maps");
+  for (std::string line; std::getline(maps, line);) {
+    // <start>-<end> <permissions> <offset> <device> <inode> <path>
+    std::istringstream fields(line);
+    std::string range, permissions, offset, device, inode, path;
+    fields >> range >> permissions >> offset >> device >> inode;
+    std::getline(fields >> std::ws, path);
+    if (path == executable && std::stoull(offset, nullptr, 16) == 0) {
+      return std::stoull(range.substr(0, range.find('-')), nullptr, 16)
+          - location.first_segment;
+    }
+  }
+  throw std::runtime_error("Could not find " + executable + " in "
+                           + proc + "/maps");
+}
+
+struct probe_site
+{
+  uint64_t semaphore;
+  std::string format_string;
+};
+
+// The probes of the process, each once
+static std::vector<probe_site> read_probes(int pid,
+                                           const file_descriptor& memory)
+{
+  const auto location =
+      find_probes("/proc/" + std::to_string(pid) + "/exe");
+  const auto bias = load_bias(pid, location);
+
+  std::vector<probe_entry> entries(location.size / sizeof(probe_entry));
+  if (!entries.empty()) {
+    memory.read(location.address + bias,
+                entries.data(),
+                entries.size() * sizeof(probe_entry));
+  }
+
+  std::vector<probe_site> sites;
+  for (const auto& entry : entries) {
+    const auto same = [&](const probe_site& site)
+    { return site.semaphore == entry.semaphore; };
+    if (entry.semaphore == 0
+        || std::any_of(sites.begin(), sites.end(), same))
+    {
+      continue;
+    }
+    std::string format_string;
+    for (uint64_t address = entry.format_string;; ++address) {
+      char c = 0;
+      memory.read(address, &c, 1);
+      if (c == '\0') {
+        break;
+      }
+      format_string.push_back(c);
+    }
+    sites.push_back({entry.semaphore, std::move(format_string)});
+  }
+  return sites;
+}
+
+static void usage()
+{
+  std::cerr << "Usage: probes <pid> [list]\n"
+               "       probes <pid> attach <pattern>\n"
+               "       probes <pid> detach <pattern>\n\n"
+               "Lists the BINARY_LOG_PROBE call sites of a process, or "
+               "attaches to (or detaches\nfrom) those whose format string "
+               "contains the pattern, so that they log (or stop).\n";
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 4) {
+    usage();
+    return 1;
+  }
+  const std::string command = argc > 2 ? argv[2] : "list";
+  const bool list = command == "list" && argc == 2 + (argc > 2);
+  const bool attach = command == "attach" && argc == 4;
+  const bool detach = command == "detach" && argc == 4;
+  if (!list && !attach && !detach) {
+    usage();
+    return 1;
+  }
+
+  const std::string_view pid_text = argv[1];
+  int pid = 0;
+  const auto [end, error] = std::from_chars(
+      pid_text.data(), pid_text.data() + pid_text.size(), pid);
+  if (error != std::errc() || end != pid_text.data() + pid_text.size()) {
+    std::cerr << "Invalid pid " << pid_text << std::endl;
+    return 1;
+  }
+
+  try {
+    const file_descriptor memory(
+        "/proc/" + std::to_string(pid) + "/mem", list ? O_RDONLY : O_RDWR);
+    for (const auto& site : read_probes(pid, memory)) {
+      uint16_t semaphore = 0;
+      memory.read(site.semaphore, &semaphore, sizeof(semaphore));
+      if (!list) {
+        if (site.format_string.find(argv[3]) == std::string::npos) {
+          continue;
+        }
+        if (attach && semaphore < UINT16_MAX) {
+          ++semaphore;
+        } else if (detach && semaphore > 0) {
+          --semaphore;
+        }
+        memory.write(site.semaphore, &semaphore, sizeof(semaphore));
+      }
+      std::cout << semaphore << '\t' << site.format_string << '\n';
+    }
+  } catch (const std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,383 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <binary_log/detail/record_decoder.hpp>
+#include <binary_log/detail/index_parser.hpp>
+#include <output_writer.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+namespace binary_log
+{
+// Log-linear histogram over doubles, in the spirit of HdrHistogram.
+//
+// The bucket of a value is the top bits of its IEEE-754 representation:
+// sign, exponent and the `sub_bucket_bits` most significant mantissa
+// bits, so every bucket is narrower than 1% of the values it holds and
+// finding it is a shift. Buckets are allocated one power of two at a time.
+class histogram
+{
+  static constexpr int sub_bucket_bits = 7;
+  static constexpr std::size_t sub_buckets = std::size_t {1} << sub_bucket_bits;
+  static constexpr int mantissa_bits = 52;
+  static constexpr std::size_t exponents = 4096;  // including the sign bit
+
+  using block = std::array<uint64_t, sub_buckets>;
+  std::vector<std::unique_ptr<block>> m_blocks;
+  uint64_t m_count {0};
+
+  static double bucket_value(std::size_t exponent, std::size_t sub_bucket)
+  {
+    // Smallest magnitude in the bucket, which is exact for small integers
+    const uint64_t key = (exponent << sub_bucket_bits) | sub_bucket;
+    return std::bit_cast<double>(key << (mantissa_bits - sub_bucket_bits));
+  }
+
+public:
+  histogram()
+      : m_blocks(exponents)
+  {
+  }
+
+  static uint64_t key(double value)
+  {
+    return std::bit_cast<uint64_t>(value) >> (mantissa_bits - sub_bucket_bits);
+  }
+
+  void add_key(uint64_t key, uint64_t count)
+  {
+    auto& bucket_block = m_blocks[key >> sub_bucket_bits];
+    if (!bucket_block) {
+      bucket_block = std::make_unique<block>();
+    }
+    (*bucket_block)[key & (sub_buckets - 1)] += count;
+    m_count += count;
+  }
+
+  void add(double value, uint64_t count = 1)
+  {
+    add_key(key(value), count);
+  }
+
+  // Adds many bucket keys, merging neighbours that fall in the same bucket
+  // (slowly changing values are the common case in logs)
+  void add_keys(const uint64_t* keys, std::size_t count)
+  {
+    std::size_t i = 0;
+    while (i < count) {
+      std::size_t j = i + 1;
+      while (j < count && keys[j] == keys[i]) {
+        ++j;
+      }
+      add_key(keys[i], j - i);
+      i = j;
+    }
+  }
+
+  // Approximate value at the given percentile (0-100)
+  double percentile(double percent) const
+  {
+    if (m_count == 0) {
+      return 0;
+    }
+    const auto rank = std::max<uint64_t>(
+        1,
+        static_cast<uint64_t>(
+            std::ceil(percent / 100.0 * static_cast<double>(m_count))));
+
+    uint64_t seen = 0;
+    auto visit = [&](std::size_t exponent, std::size_t sub_bucket) -> bool
+    {
+      seen += (*m_blocks[exponent])[sub_bucket];
+      return seen >= rank;
+    };
+
+    // Negative values, largest magnitude first
+    for (std::size_t exponent = exponents; exponent-- > exponents / 2;) {
+      if (!m_blocks[exponent]) {
+        continue;
+      }
+      for (std::size_t sub_bucket = sub_buckets; sub_bucket-- > 0;) {
+        if (visit(exponent, sub_bucket)) {
+          return bucket_value(exponent, sub_bucket);
+        }
+      }
+    }
+
+    // Then positive values, smallest magnitude first
+    for (std::size_t exponent = 0; exponent < exponents / 2; ++exponent) {
+      if (!m_blocks[exponent]) {
+        continue;
+      }
+      for (std::size_t sub_bucket = 0; sub_bucket < sub_buckets; ++sub_bucket)
+      {
+        if (visit(exponent, sub_bucket)) {
+          return bucket_value(exponent, sub_bucket);
+        }
+      }
+    }
+    return 0;
+  }
+};
+
+// Count, sum, min, max and the distribution of one argument of one call site
+struct arg_statistics
+{
+  uint64_t count {0};
+  __int128_t integer_sum {0};
+  double real_sum {0};
+  double min {std::numeric_limits<double>::infinity()};
+  double max {-std::numeric_limits<double>::infinity()};
+  histogram values;
+
+  double sum() const
+  {
+    return real_sum + static_cast<double>(integer_sum);
+  }
+};
+
+class aggregator
+{
+  // Values are reduced in chunks small enough to stay in L1 between the
+  // vectorizable sum/min/max pass and the histogram pass
+  static constexpr std::size_t chunk_size = 4096;
+
+  // [index][arg position], only numeric args get an entry
+  std::vector<std::vector<std::unique_ptr<arg_statistics>>> m_statistics;
+  std::vector<std::size_t> m_projection;
+
+  template<typename T>
+  static void add_chunk(arg_statistics& statistics,
+                        const char* first,
+                        std::size_t stride,
+                        std::size_t count)
+  {
+    using accumulator = std::conditional_t<
+        std::is_floating_point_v<T>,
+        double,
+        std::conditional_t<(sizeof(T) <= 4),
+                           std::conditional_t<std::is_signed_v<T>,
+                                              int64_t,
+                                              uint64_t>,
+                           __int128_t>>;
+
+    T values[chunk_size];
+    for (std::size_t i = 0; i < count; ++i) {
+      std::memcpy(&values[i], first + i * stride, sizeof(T));
+    }
+
+    T lo;
+    std::memcpy(&lo, first, sizeof(T));
+    T hi = lo;
+    accumulator sum = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      lo = std::min(lo, values[i]);
+      hi = std::max(hi, values[i]);
+      sum += values[i];
+    }
+
+    uint64_t keys[chunk_size];
+    for (std::size_t i = 0; i < count; ++i) {
+      keys[i] = histogram::key(static_cast<double>(values[i]));
+    }
+    statistics.values.add_keys(keys, count);
+
+    statistics.count += count;
+    if constexpr (std::is_floating_point_v<T>) {
+      statistics.real_sum += sum;
+    } else {
+      statistics.integer_sum += sum;
+    }
+    statistics.min = std::min(statistics.min, static_cast<double>(lo));
+    statistics.max = std::max(statistics.max, static_cast<double>(hi));
+  }
+
+  template<typename T>
+  static void add_strided(arg_statistics& statistics,
+                          const char* first,
+                          std::size_t stride,
+                          std::size_t count)
+  {
+    while (count) {
+      const auto n = std::min(count, chunk_size);
+      add_chunk<T>(statistics, first, stride, n);
+      first += n * stride;
+      count -= n;
+    }
+  }
+
+  static void add_strided(arg_statistics& statistics,
+                          fmt_arg_type type,
+                          const char* first,
+                          std::size_t stride,
+                          std::size_t count)
+  {
+    switch (type) {
+      case fmt_arg_type::type_bool:
+        return add_strided<bool>(statistics, first, stride, count);
+      case fmt_arg_type::type_char:
+        return add_strided<char>(statistics, first, stride, count);
+      case fmt_arg_type::type_uint8:
+        return add_strided<uint8_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_uint16:
+        return add_strided<uint16_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_uint32:
+        return add_strided<uint32_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_uint64:
+        return add_strided<uint64_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_int8:
+        return add_strided<int8_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_int16:
+        return add_strided<int16_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_int32:
+        return add_strided<int32_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_int64:
+        return add_strided<int64_t>(statistics, first, stride, count);
+      case fmt_arg_type::type_float:
+        return add_strided<float>(statistics, first, stride, count);
+      case fmt_arg_type::type_double:
+        return add_strided<double>(statistics, first, stride, count);
+      default:
+        // 128-bit integers go through the slow path
+        for (std::size_t i = 0; i < count; ++i) {
+          add(statistics, arg_view {type, {first + i * stride, 16}}, 1);
+        }
+        return;
+    }
+  }
+
+  static void add(arg_statistics& statistics,
+                  const arg_view& arg,
+                  uint64_t count)
+  {
+    const double value = arg.as_double();
+    statistics.count += count;
+    if (arg.is_floating_point()) {
+      statistics.real_sum += value * static_cast<double>(count);
+    } else {
+      const auto integer = arg.as_integer();
+      const auto sum =
+          static_cast<__int128_t>(integer.magnitude) * count;
+      statistics.integer_sum += integer.negative ? -sum : sum;
+    }
+    statistics.min = std::min(statistics.min, value);
+    statistics.max = std::max(statistics.max, value);
+    statistics.values.add(value, count);
+  }
+
+public:
+  aggregator(const std::vector<index_entry>& index_table,
+             std::vector<std::size_t> projection = {})
+      : m_statistics(index_table.size())
+      , m_projection(std::move(projection))
+  {
+    for (std::size_t i = 0; i < index_table.size(); ++i) {
+      const auto& args = index_table[i].args;
+      m_statistics[i].resize(args.size());
+      for (std::size_t j = 0; j < args.size(); ++j) {
+        const bool projected = m_projection.empty()
+            || std::find(m_projection.begin(), m_projection.end(), j)
+                != m_projection.end();
+        if (projected && args[j].type != fmt_arg_type::type_string) {
+          m_statistics[i][j] = std::make_unique<arg_statistics>();
+        }
+      }
+    }
+  }
+
+  // Aggregates a run of `count` records of a call site whose logged args
+  // are all fixed-size, laid out back to back from `first`
+  void add_run(std::size_t index,
+               const index_entry& entry,
+               const char* first,
+               std::size_t count)
+  {
+    const auto stride = *entry.fixed_record_size;
+    std::size_t offset = 0;
+    for (std::size_t j = 0; j < entry.args.size(); ++j) {
+      const auto& arg = entry.args[j];
+      auto* statistics = m_statistics[index][j].get();
+      if (arg.is_constant) {
+        if (statistics) {
+          add(*statistics, arg_view {arg.type, arg.arg_data}, count);
+        }
+        continue;
+      }
+      if (statistics) {
+        add_strided(*statistics, arg.type, first + offset, stride, count);
+      }
+      offset += sizeof_arg_type(arg.type);
+    }
+  }
+
+  // Aggregates one decoded record
+  void add_record(std::size_t index, const std::vector<arg_view>& args)
+  {
+    for (std::size_t j = 0; j < args.size(); ++j) {
+      if (auto* statistics = m_statistics[index][j].get()) {
+        add(*statistics, args[j], 1);
+      }
+    }
+  }
+
+  void print(const std::vector<index_entry>& index_table,
+             output_writer& out) const
+  {
+    out.write(fmt::format("{:>5} {:>3} {:>12} {:>14} {:>14} {:>14} {:>14} "
+                          "{:>14} {:>14} {:>14} {:>14}  {}\n",
+                          "index",
+                          "arg",
+                          "count",
+                          "sum",
+                          "min",
+                          "max",
+                          "mean",
+                          "p50",
+                          "p90",
+                          "p99",
+                          "p99.9",
+                          "format string"));
+    for (std::size_t i = 0; i < m_statistics.size(); ++i) {
+      for (std::size_t j = 0; j < m_statistics[i].size(); ++j) {
+        const auto* statistics = m_statistics[i][j].get();
+        if (!statistics || statistics->count == 0) {
+          continue;
+        }
+        const double sum = statistics->sum();
+        // Bucket bounds may lie just outside the observed range
+        auto percentile = [statistics](double percent)
+        {
+          return std::clamp(statistics->values.percentile(percent),
+                            statistics->min,
+                            statistics->max);
+        };
+        out.write(fmt::format(
+            "{:>5} {:>3} {:>12} {:>14.6g} {:>14.6g} {:>14.6g} {:>14.6g} "
+            "{:>14.6g} {:>14.6g} {:>14.6g} {:>14.6g}  {}\n",
+            i,
+            j,
+            statistics->count,
+            sum,
+            statistics->min,
+            statistics->max,
+            sum / static_cast<double>(statistics->count),
+            percentile(50),
+            percentile(90),
+            percentile(99),
+            percentile(99.9),
+            index_table[i].format_string));
+      }
+    }
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include <binary_log/detail/index_parser.hpp>
+#include <output_writer.hpp>
+#include <record_filter.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+namespace binary_log
+{
+// How much of the log file one call site is responsible for
+struct call_site_stats
+{
+  uint64_t records {0};
+  uint64_t index_bytes {0};  // format string indices written for the site
+  uint64_t arg_bytes {0};  // logged argument values
+
+  // Calls counted by the records of an entry that counts_suppressed
+  uint64_t suppressed {0};
+
+  uint64_t bytes() const
+  {
+    return index_bytes + arg_bytes;
+  }
+};
+
+// The rate-limited call site whose suppressed calls the entry at `index`
+// counts: the last one before it with its format string and level, since
+// a call site logs before it suppresses
+static inline std::size_t suppressing_call_site(
+    const std::vector<index_entry>& index_table, std::size_t index)
+{
+  const auto& counter = index_table[index];
+  for (std::size_t site = index; site-- > 0;) {
+    const auto& entry = index_table[site];
+    if (!entry.counts_suppressed && entry.level == counter.level
+        && entry.format_string == counter.format_string)
+    {
+      return site;
+    }
+  }
+  return index;
+}
+
+// Prints one line per call site, the most expensive sites first, with the
+// calls that a rate-limited call site suppressed on its line
+static inline void print_call_site_stats(
+    const std::vector<index_entry>& index_table,
+    const std::vector<call_site_stats>& stats,
+    const record_filter& filter,
+    std::size_t log_file_size,
+    output_writer& out)
+{
+  std::vector<std::size_t> order(stats.size());
+  std::iota(order.begin(), order.end(), std::size_t {0});
+  std::stable_sort(order.begin(),
+                   order.end(),
+                   [&stats](std::size_t lhs, std::size_t rhs)
+                   { return stats[lhs].bytes() > stats[rhs].bytes(); });
+
+  std::vector<uint64_t> suppressed(stats.size());
+  for (std::size_t index = 0; index < stats.size(); ++index) {
+    if (index_table[index].counts_suppressed) {
+      suppressed[suppressing_call_site(index_table, index)] +=
+          stats[index].suppressed;
+    }
+  }
+
+  out.write(fmt::format("{:>5} {:>14} {:>16} {:>14} {:>8} {:>14}  {}\n",
+                        "index",
+                        "records",
+                        "bytes",
+                        "avg arg bytes",
+                        "share",
+                        "suppressed",
+                        "format string"));
+  for (const auto index : order) {
+    const auto& site = stats[index];
+    if (!filter.selected(index)) {
+      continue;
+    }
+    const double average_arg_bytes = site.records
+        ? static_cast<double>(site.arg_bytes) / static_cast<double>(site.records)
+        : 0.0;
+    const double share = log_file_size
+        ? 100.0 * static_cast<double>(site.bytes())
+            / static_cast<double>(log_file_size)
+        : 0.0;
+    const auto& entry = index_table[index];
+    out.write(fmt::format(
+        "{:>5} {:>14} {:>16} {:>14.2f} {:>7.2f}% {:>14}  {}{}\n",
+        index,
+        site.records,
+        site.bytes(),
+        average_arg_bytes,
+        share,
+        suppressed[index],
+        entry.counts_suppressed ? "[suppressed count] " : "",
+        entry.format_string));
+  }
+}
+
+}  // namespace binary_log
@@ -0,0 +1,619 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/index_parser.hpp>
+#include <binary_log/detail/record_decoder.hpp>
+#include <output_writer.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+namespace binary_log
+{
+// Type of an exported column, named after the numpy dtype where there is one
+static inline const char* export_type_name(fmt_arg_type type)
+{
+  switch (type) {
+    case fmt_arg_type::type_bool:
+      return "bool";
+    case fmt_arg_type::type_char:
+      return "char";
+    case fmt_arg_type::type_uint8:
+      return "uint8";
+    case fmt_arg_type::type_uint16:
+      return "uint16";
+    case fmt_arg_type::type_uint32:
+      return "uint32";
+    case fmt_arg_type::type_uint64:
+      return "uint64";
+    case fmt_arg_type::type_uint128:
+      return "uint128";
+    case fmt_arg_type::type_int8:
+      return "int8";
+    case fmt_arg_type::type_int16:
+      return "int16";
+    case fmt_arg_type::type_int32:
+      return "int32";
+    case fmt_arg_type::type_int64:
+      return "int64";
+    case fmt_arg_type::type_int128:
+      return "int128";
+    case fmt_arg_type::type_float:
+      return "float32";
+    case fmt_arg_type::type_double:
+      return "float64";
+    case fmt_arg_type::type_string:
+      return "string";
+  }
+  return "unknown";
+}
+
+// Positions of the args of `entry` to export: the projected ones, or all
+static inline std::vector<std::size_t> export_columns(
+    const index_entry& entry, const std::vector<std::size_t>& projection)
+{
+  std::vector<std::size_t> columns;
+  if (projection.empty()) {
+    for (std::size_t j = 0; j < entry.args.size(); ++j) {
+      columns.push_back(j);
+    }
+  } else {
+    for (const auto position : projection) {
+      if (position < entry.args.size()) {
+        columns.push_back(position);
+      }
+    }
+  }
+  return columns;
+}
+
+template<typename T>
+static inline void append_chars(fmt::memory_buffer& out, T value)
+{
+  char text[64];
+  const auto result = std::to_chars(text, text + sizeof(text), value);
+  out.append(text, result.ptr);
+}
+
+// 128-bit integers are not supported by std::to_chars everywhere
+static inline void append_uint128(fmt::memory_buffer& out, __uint128_t value)
+{
+  char text[40];
+  char* first = text + sizeof(text);
+  do {
+    *--first = static_cast<char>('0' + static_cast<int>(value % 10));
+    value /= 10;
+  } while (value != 0);
+  out.append(first, text + sizeof(text));
+}
+
+// Appends a numeric or bool arg as text, with the shortest representation
+// that reads back to the same value. Returns false for other types.
+static inline bool append_number(fmt::memory_buffer& out, const arg_view& arg)
+{
+  switch (arg.type) {
+    case fmt_arg_type::type_bool: {
+      const std::string_view text = arg.as<bool>() ? "true" : "false";
+      out.append(text.data(), text.data() + text.size());
+      return true;
+    }
+    case fmt_arg_type::type_uint128:
+      append_uint128(out, arg.as<__uint128_t>());
+      return true;
+    case fmt_arg_type::type_int128: {
+      const auto value = arg.as<__int128_t>();
+      if (value < 0) {
+        out.push_back('-');
+        append_uint128(out, -static_cast<__uint128_t>(value));
+      } else {
+        append_uint128(out, static_cast<__uint128_t>(value));
+      }
+      return true;
+    }
+    case fmt_arg_type::type_float:
+      append_chars(out, arg.as<float>());
+      return true;
+    case fmt_arg_type::type_double:
+      append_chars(out, arg.as<double>());
+      return true;
+    case fmt_arg_type::type_uint64:
+      append_chars(out, arg.as<uint64_t>());
+      return true;
+    case fmt_arg_type::type_char:
+    case fmt_arg_type::type_string:
+      return false;
+    default:
+      append_chars(out, arg.as_integer().as_int64());
+      return true;
+  }
+}
+
+static inline void append_json_string(fmt::memory_buffer& out,
+                                      std::string_view text)
+{
+  out.push_back('"');
+  for (const char c : text) {
+    switch (c) {
+      case '"':
+        out.append(std::string_view("\\\""));
+        break;
+      case '\\':
+        out.append(std::string_view("\\\\"));
+        break;
+      case '\n':
+        out.append(std::string_view("\\n"));
+        break;
+      case '\r':
+        out.append(std::string_view("\\r"));
+        break;
+      case '\t':
+        out.append(std::string_view("\\t"));
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          fmt::format_to(std::back_inserter(out),
+                         "\\u{:04x}",
+                         static_cast<unsigned>(c));
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+static inline void append_json_value(fmt::memory_buffer& out,
+                                     const arg_view& arg)
+{
+  if (arg.is_floating_point() && !std::isfinite(arg.as_double())) {
+    // JSON has no NaN or infinities
+    out.append(std::string_view("null"));
+  } else if (arg.is_string() || arg.type == fmt_arg_type::type_char) {
+    append_json_string(out, arg.value);
+  } else {
+    append_number(out, arg);
+  }
+}
+
+static inline void append_csv_value(fmt::memory_buffer& out,
+                                    const arg_view& arg)
+{
+  if (!arg.is_string() && arg.type != fmt_arg_type::type_char) {
+    append_number(out, arg);
+    return;
+  }
+  const auto text = arg.value;
+  if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+    out.append(text.data(), text.data() + text.size());
+    return;
+  }
+  out.push_back('"');
+  for (const char c : text) {
+    if (c == '"') {
+      out.push_back('"');
+    }
+    out.push_back(c);
+  }
+  out.push_back('"');
+}
+
+// An output file written in large appends, so that an export can have
+// more tables or columns open than the process has file descriptors
+class export_file
+{
+  std::filesystem::path m_path;
+  fmt::memory_buffer m_buffer;
+  bool m_created {false};
+
+public:
+  static constexpr std::size_t buffer_size = 256 * 1024;
+
+  explicit export_file(std::filesystem::path path)
+      : m_path(std::move(path))
+  {
+  }
+
+  const std::filesystem::path& path() const
+  {
+    return m_path;
+  }
+
+  fmt::memory_buffer& buffer()
+  {
+    return m_buffer;
+  }
+
+  void write(const void* data, std::size_t size)
+  {
+    const auto* bytes = static_cast<const char*>(data);
+    m_buffer.append(bytes, bytes + size);
+    if (m_buffer.size() >= buffer_size) {
+      flush();
+    }
+  }
+
+  // Writes out the buffer if it has grown past the buffer size
+  void maybe_flush()
+  {
+    if (m_buffer.size() >= buffer_size) {
+      flush();
+    }
+  }
+
+  void flush()
+  {
+    std::FILE* file =
+        std::fopen(m_path.string().c_str(), m_created ? "ab" : "wb");
+    if (file == nullptr) {
+      throw std::runtime_error("Could not open " + m_path.string());
+    }
+    m_created = true;
+    const auto written = std::fwrite(m_buffer.data(), 1, m_buffer.size(), file);
+    std::fclose(file);
+    if (written != m_buffer.size()) {
+      throw std::runtime_error("Could not write " + m_path.string());
+    }
+    m_buffer.clear();
+  }
+};
+
+// An exporter that can take a run of fixed-size records as it is in the
+// log file
+template<typename Exporter>
+concept run_exporter = requires(Exporter exporter,
+                                const index_entry& entry,
+                                const char* first) {
+  exporter.add_run(std::size_t {}, entry, first, std::size_t {});
+};
+
+// One JSON object per record, on one line:
+//
+//   {"site":0,"arg0":42,"arg1":"AAPL"}
+class jsonl_exporter
+{
+  struct key
+  {
+    std::size_t position;  // of the arg
+    std::string text;  // ,"argN":
+  };
+
+  output_writer& m_out;
+  std::vector<std::string> m_prefixes;  // [index], {"site":N
+  std::vector<std::vector<key>> m_keys;  // [index]
+  fmt::memory_buffer m_line;
+
+public:
+  jsonl_exporter(output_writer& out,
+                 const std::vector<index_entry>& index_table,
+                 const std::vector<std::size_t>& projection = {})
+      : m_out(out)
+      , m_prefixes(index_table.size())
+      , m_keys(index_table.size())
+  {
+    for (std::size_t i = 0; i < index_table.size(); ++i) {
+      m_prefixes[i] = fmt::format("{{\"site\":{}", i);
+      for (const auto position : export_columns(index_table[i], projection)) {
+        m_keys[i].push_back({position, fmt::format(",\"arg{}\":", position)});
+      }
+    }
+  }
+
+  void add_record(std::size_t index, const std::vector<arg_view>& args)
+  {
+    m_line.clear();
+    m_line.append(m_prefixes[index]);
+    for (const auto& [position, text] : m_keys[index]) {
+      m_line.append(text);
+      append_json_value(m_line, args[position]);
+    }
+    m_line.append(std::string_view("}\n"));
+    m_out.write(std::string_view(m_line.data(), m_line.size()));
+  }
+
+  void finish()
+  {
+    m_out.flush();
+  }
+};
+
+// Exports to a directory: one table per call site, and a schema.json that
+// describes the tables
+class table_exporter
+{
+protected:
+  struct column
+  {
+    std::size_t position;  // of the arg
+    fmt_arg_type type;
+
+    // Files of the columnar format; strings also have offsets
+    std::optional<export_file> data;
+    std::optional<export_file> offsets;
+    uint64_t string_bytes {0};
+  };
+
+  struct table
+  {
+    std::size_t records {0};
+    std::optional<export_file> file;  // of the csv format
+    std::vector<column> columns;
+  };
+
+  std::filesystem::path m_directory;
+  const std::vector<index_entry>& m_index_table;
+  std::vector<std::size_t> m_projection;
+  std::vector<std::optional<table>> m_tables;  // [index], created on use
+
+  table_exporter(std::filesystem::path directory,
+                 const std::vector<index_entry>& index_table,
+                 std::vector<std::size_t> projection)
+      : m_directory(std::move(directory))
+      , m_index_table(index_table)
+      , m_projection(std::move(projection))
+      , m_tables(index_table.size())
+  {
+    std::filesystem::create_directories(m_directory);
+  }
+
+  std::filesystem::path path_of(std::string_view name) const
+  {
+    return m_directory / std::string(name);
+  }
+
+  void write_schema(std::string_view format)
+  {
+    fmt::memory_buffer json;
+    fmt::format_to(std::back_inserter(json),
+                   "{{\n  \"format\": \"{}\",\n  \"sites\": [",
+                   format);
+    bool first_table = true;
+    for (std::size_t i = 0; i < m_tables.size(); ++i) {
+      if (!m_tables[i]) {
+        continue;
+      }
+      const auto& current = *m_tables[i];
+      json.append(std::string_view(first_table ? "\n" : ",\n"));
+      first_table = false;
+      fmt::format_to(std::back_inserter(json),
+                     "    {{\"site\": {}, \"format_string\": ",
+                     i);
+      append_json_string(json, m_index_table[i].format_string);
+      fmt::format_to(
+          std::back_inserter(json), ", \"records\": {}", current.records);
+      if (current.file) {
+        json.append(std::string_view(", \"file\": "));
+        append_json_string(json, current.file->path().filename().string());
+      }
+      json.append(std::string_view(", \"columns\": ["));
+      for (std::size_t j = 0; j < current.columns.size(); ++j) {
+        const auto& col = current.columns[j];
+        fmt::format_to(std::back_inserter(json),
+                       "{}{{\"name\": \"arg{}\", \"type\": \"{}\"",
+                       j > 0 ? ", " : "",
+                       col.position,
+                       export_type_name(col.type));
+        if (col.data) {
+          json.append(std::string_view(", \"file\": "));
+          append_json_string(json, col.data->path().filename().string());
+        }
+        if (col.offsets) {
+          json.append(std::string_view(", \"offsets\": "));
+          append_json_string(json, col.offsets->path().filename().string());
+        }
+        json.push_back('}');
+      }
+      json.append(std::string_view("]}"));
+    }
+    json.append(std::string_view("\n  ]\n}\n"));
+
+    export_file schema(path_of("schema.json"));
+    schema.write(json.data(), json.size());
+    schema.flush();
+  }
+
+  void flush_tables()
+  {
+    for (auto& current : m_tables) {
+      if (!current) {
+        continue;
+      }
+      if (current->file) {
+        current->file->flush();
+      }
+      for (auto& col : current->columns) {
+        if (col.data) {
+          col.data->flush();
+        }
+        if (col.offsets) {
+          col.offsets->flush();
+        }
+      }
+    }
+  }
+};
+
+// One CSV file per call site, site<index>.csv, with a header row of the
+// arg names
+class csv_exporter : public table_exporter
+{
+  table& table_of(std::size_t index)
+  {
+    auto& current = m_tables[index];
+    if (!current) {
+      current.emplace();
+      current->file.emplace(path_of(fmt::format("site{}.csv", index)));
+      auto& buffer = current->file->buffer();
+      const auto& entry = m_index_table[index];
+      for (const auto position : export_columns(entry, m_projection)) {
+        current->columns.push_back(
+            {position, entry.args[position].type, {}, {}});
+        if (buffer.size() > 0) {
+          buffer.push_back(',');
+        }
+        fmt::format_to(std::back_inserter(buffer), "arg{}", position);
+      }
+      buffer.push_back('\n');
+    }
+    return *current;
+  }
+
+public:
+  csv_exporter(std::filesystem::path directory,
+               const std::vector<index_entry>& index_table,
+               std::vector<std::size_t> projection = {})
+      : table_exporter(
+          std::move(directory), index_table, std::move(projection))
+  {
+  }
+
+  void add_record(std::size_t index, const std::vector<arg_view>& args)
+  {
+    auto& current = table_of(index);
+    auto& buffer = current.file->buffer();
+    bool first = true;
+    for (const auto& col : current.columns) {
+      if (!first) {
+        buffer.push_back(',');
+      }
+      first = false;
+      append_csv_value(buffer, args[col.position]);
+    }
+    buffer.push_back('\n');
+    current.file->maybe_flush();
+    current.records++;
+  }
+
+  void finish()
+  {
+    for (auto& current : m_tables) {
+      if (current) {
+        current->file->flush();
+      }
+    }
+    write_schema("csv");
+  }
+};
+
+// One file per call site and arg, site<index>.arg<position>, holding the
+// raw little-endian values of the column back to back (e.g. for
+// numpy.fromfile). String columns hold the bytes of the strings, and a
+// .offsets file with the uint64 offset of each string and of the end, as
+// in Arrow.
+class columnar_exporter : public table_exporter
+{
+  table& table_of(std::size_t index)
+  {
+    auto& current = m_tables[index];
+    if (!current) {
+      current.emplace();
+      const auto& entry = m_index_table[index];
+      for (const auto position : export_columns(entry, m_projection)) {
+        const auto name = fmt::format("site{}.arg{}", index, position);
+        const auto type = entry.args[position].type;
+        auto& col = current->columns.emplace_back(
+            column {position, type, export_file(path_of(name)), {}});
+        if (type == fmt_arg_type::type_string) {
+          auto& offsets = col.offsets.emplace(path_of(name + ".offsets"));
+          const uint64_t start = 0;
+          offsets.write(&start, sizeof(start));
+        }
+      }
+    }
+    return *current;
+  }
+
+  void add_value(column& col, const arg_view& arg)
+  {
+    col.data->write(arg.value.data(), arg.value.size());
+    if (col.offsets) {
+      col.string_bytes += arg.value.size();
+      col.offsets->write(&col.string_bytes, sizeof(col.string_bytes));
+    }
+  }
+
+public:
+  columnar_exporter(std::filesystem::path directory,
+                    const std::vector<index_entry>& index_table,
+                    std::vector<std::size_t> projection = {})
+      : table_exporter(
+          std::move(directory), index_table, std::move(projection))
+  {
+  }
+
+  // Exports a run of `count` fixed-size records starting at `first`, a
+  // column at a time
+  void add_run(std::size_t index,
+               const index_entry& entry,
+               const char* first,
+               std::size_t count)
+  {
+    auto& current = table_of(index);
+    const auto stride = *entry.fixed_record_size;
+    for (auto& col : current.columns) {
+      const auto& arg = entry.args[col.position];
+      if (arg.is_constant) {
+        for (std::size_t i = 0; i < count; ++i) {
+          add_value(col, arg_view {arg.type, arg.arg_data});
+        }
+        continue;
+      }
+
+      std::size_t offset = 0;
+      for (std::size_t j = 0; j < col.position; ++j) {
+        if (!entry.args[j].is_constant) {
+          offset += sizeof_arg_type(entry.args[j].type);
+        }
+      }
+      const auto size = sizeof_arg_type(arg.type);
+      auto& buffer = col.data->buffer();
+      // A buffer at a time, so that long runs do not grow the buffer
+      const auto chunk =
+          std::max<std::size_t>(export_file::buffer_size / size, 1);
+      for (std::size_t done = 0; done < count; done += chunk) {
+        const auto records = std::min(chunk, count - done);
+        const char* in = first + done * stride + offset;
+        if (stride == size) {
+          // A single-arg record: the run is the column already
+          buffer.append(in, in + records * size);
+        } else {
+          const auto start = buffer.size();
+          buffer.resize(start + records * size);
+          char* out = buffer.data() + start;
+          for (std::size_t i = 0; i < records; ++i) {
+            std::memcpy(out + i * size, in + i * stride, size);
+          }
+        }
+        col.data->maybe_flush();
+      }
+    }
+    current.records += count;
+  }
+
+  void add_record(std::size_t index, const std::vector<arg_view>& args)
+  {
+    auto& current = table_of(index);
+    for (auto& col : current.columns) {
+      add_value(col, args[col.position]);
+    }
+    current.records++;
+  }
+
+  void finish()
+  {
+    flush_tables();
+    write_schema("columnar");
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,192 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/packer.hpp>
+#include <binary_log/reader.hpp>
+#include <seek_index_builder.hpp>
+
+namespace binary_log
+{
+// Copies records of logs, as they are encoded, into a new log with its
+// own index, runlength and seek files. Only the call sites that have
+// records copied are in the new index file, numbered in order of their
+// first record, and runs are formed again by the packer.
+class log_extractor
+{
+  // The seek file is built once the records are copied, with checkpoints
+  // where the source log has them, so that they keep their times
+  using extract_packer = packer<1024 * 1024, 4096, 4096, 0>;
+
+  struct source
+  {
+    const reader* log;
+    std::vector<std::optional<uint16_t>> indices;  // [source index]
+
+    // Position in the seek index of the next checkpoint not passed, and
+    // its record number (none if the checkpoints have no times)
+    std::size_t next_checkpoint {0};
+    uint64_t next_checkpoint_record {std::numeric_limits<uint64_t>::max()};
+  };
+
+  std::filesystem::path m_path;
+  std::unique_ptr<extract_packer> m_packer;
+
+  std::vector<source> m_sources;
+  source* m_source {nullptr};  // of the records being added
+  std::size_t m_index_count {0};
+  uint64_t m_record_count {0};
+
+  // Copied records that follow a checkpoint of their log, and its time.
+  // Records merged from several logs have no such times (see finish()).
+  std::vector<timed_record> m_times;
+
+  uint16_t index_of(std::size_t source_index)
+  {
+    auto& index = m_source->indices[source_index];
+    if (!index) {
+      if (m_index_count > std::numeric_limits<uint16_t>::max()) {
+        throw std::runtime_error("Too many call sites to extract");
+      }
+      index = static_cast<uint16_t>(m_index_count++);
+      m_packer->write_encoded_entry_to_index_file(
+          m_source->log->index_table()[source_index].bytes);
+    }
+    return *index;
+  }
+
+  // The first copied record after a checkpoint of the source log was
+  // logged after its time, and the records copied before it, before
+  void pass_checkpoints(uint64_t source_record, std::size_t count)
+  {
+    if (m_source->next_checkpoint_record >= source_record + count) {
+      return;
+    }
+    const auto& checkpoints = m_source->log->checkpoints();
+    while (m_source->next_checkpoint < checkpoints.size()) {
+      const auto checkpoint = checkpoints.entry(m_source->next_checkpoint);
+      if (checkpoint.record_number >= source_record + count) {
+        m_source->next_checkpoint_record = checkpoint.record_number;
+        return;
+      }
+      const uint64_t record_number = m_record_count
+          + (checkpoint.record_number > source_record
+                 ? checkpoint.record_number - source_record
+                 : 0);
+      if (!m_times.empty() && m_times.back().record_number == record_number) {
+        m_times.back().timestamp = checkpoint.timestamp;
+      } else {
+        m_times.push_back({record_number, checkpoint.timestamp});
+      }
+      ++m_source->next_checkpoint;
+    }
+    m_source->next_checkpoint_record = std::numeric_limits<uint64_t>::max();
+  }
+
+  // Time of the end of the copied records: that of the next checkpoint
+  // of the source log, or of the last one passed
+  int64_t end_timestamp() const
+  {
+    const auto& checkpoints = m_source->log->checkpoints();
+    if (m_source->next_checkpoint < checkpoints.size()) {
+      return checkpoints.entry(m_source->next_checkpoint).timestamp;
+    }
+    return m_times.empty() ? 0 : m_times.back().timestamp;
+  }
+
+public:
+  explicit log_extractor(std::filesystem::path path)
+      : m_path(std::move(path))
+  {
+    m_packer = std::make_unique<extract_packer>(m_path);
+    std::filesystem::remove(m_packer->get_seek_path());
+  }
+
+  // Takes the records added next from `log`, whose records must be added
+  // in order. Call sites of different logs are kept apart.
+  void set_source(const reader& log)
+  {
+    for (auto& current : m_sources) {
+      if (current.log == &log) {
+        m_source = &current;
+        return;
+      }
+    }
+    auto& added = m_sources.emplace_back();
+    added.log = &log;
+    added.indices.resize(log.index_table().size());
+    if (log.checkpoints().has_timestamps()) {
+      added.next_checkpoint_record = 0;
+    }
+    m_source = &added;
+  }
+
+  // Copies a run of `count` records of fixed size, the first of which is
+  // record `source_record` of the source log and starts at `first`
+  void add_run(std::size_t source_index,
+               uint64_t source_record,
+               const char* first,
+               std::size_t count)
+  {
+    pass_checkpoints(source_record, count);
+    const auto index = index_of(source_index);
+    const auto size =
+        *m_source->log->index_table()[source_index].fixed_record_size;
+    for (std::size_t i = 0; i < count; ++i) {
+      m_packer->pack_format_string_index(index);
+      m_packer->write_encoded_args_to_log_file(first + i * size, size);
+    }
+    m_record_count += count;
+  }
+
+  // Copies one record, whose encoded args are `args`
+  void add_record(std::size_t source_index,
+                  uint64_t source_record,
+                  std::string_view args)
+  {
+    pass_checkpoints(source_record, 1);
+    m_packer->pack_format_string_index(index_of(source_index));
+    m_packer->write_encoded_args_to_log_file(args.data(), args.size());
+    m_record_count++;
+  }
+
+  // Closes the new log and writes its seek file, which ends with a
+  // checkpoint at the end of the log like that of a logger's flush().
+  // The records of several logs are not ordered by time precisely enough
+  // for checkpoint times, so their seek file has none.
+  void finish()
+  {
+    m_packer.reset();
+
+    const reader extract(m_path);
+    const bool timed = m_sources.size() == 1
+        && m_sources.front().log->checkpoints().has_timestamps();
+    std::vector<seek_entry> checkpoints;
+    if (!timed) {
+      checkpoints = build_seek_index(extract);
+    } else if (!m_times.empty()) {
+      checkpoints =
+          build_seek_index(extract, default_seek_interval, m_times);
+    }
+    if (m_record_count > 0) {
+      checkpoints.push_back({extract.log().size(),
+                             m_record_count,
+                             extract.runlength().size(),
+                             0,
+                             0,
+                             timed ? end_timestamp() : 0});
+    }
+    std::filesystem::path seek_path = m_path;
+    seek_path += ".seek";
+    write_seek_index(seek_path, checkpoints);
+  }
+};
+
+}  // namespace binary_log
@@ -1,10 +1,17 @@
 #pragma once
 #include <iostream>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
-#include <index_file_parser.hpp>
-#include <mio.hpp>
+#include <aggregator.hpp>
+#include <binary_log/reader.hpp>
+#include <call_site_stats.hpp>
+#include <exporter.hpp>
+#include <output_writer.hpp>
+#include <query.hpp>
+#include <record_filter.hpp>
 
 #define FMT_HEADER_ONLY
 #include <fmt/args.h>
@@ -14,211 +21,152 @@ namespace binary_log
 {
 class log_file_parser
 {
-  // Members for parsing the log file
-  mio::mmap_source m_logfile_mmap;
-  const char* m_logfile_buffer {nullptr};
-  size_t m_logfile_buffer_size {0};
-  std::size_t m_logfile_index {0};  // into m_logfile_buffer
-
-  // Members for parsing the runlength file
-  mio::mmap_source m_runlengthfile_mmap;
-  const char* m_runlengthfile_buffer {nullptr};
-  size_t m_runlengthfile_buffer_size {0};
-  std::size_t m_runlengthfile_index {0};  // into m_runlength_buffer
-
-  struct arg
-  {
-    fmt_arg_type type;
-    std::size_t size;
-    std::string_view value;
-  };
-
-  uint8_t next_byte_in_log_file()
-  {
-    return *reinterpret_cast<const uint8_t*>(
-        &m_logfile_buffer[m_logfile_index++]);
-  }
-
-  uint8_t current_byte_in_log_file()
-  {
-    return *reinterpret_cast<const uint8_t*>(
-        &m_logfile_buffer[m_logfile_index]);
-  }
-  
-  template <typename T>
-  T reinterpret_bytes_as(const char* buffer, std::size_t& index, bool update_index)
-  {
-    const T* x = reinterpret_cast<const T*>(&buffer[index]);
-    if (update_index) {
-      index += sizeof(T);
-    }
-    return *x;
-  }
+  const std::vector<index_entry>& m_index_table;
+  std::size_t m_log_file_size;
+  std::size_t m_record_number;  // of the next record, for extraction
+  record_decoder m_decoder;
 
-  template <typename T>
-  T reinterpret_log_bytes_as(bool update_index)
-  {
-    return reinterpret_bytes_as<T>(m_logfile_buffer, m_logfile_index, update_index);
-  }
+  // Records of call sites rejected by the filter are skipped unformatted
+  record_filter m_filter;
 
-  uint8_t next_byte_in_runlength_file()
-  {
-    return *reinterpret_cast<const uint8_t*>(
-        &m_runlengthfile_buffer[m_runlengthfile_index++]);
-  }
+  // Records are only printed if they satisfy the query, and only the
+  // projected args are printed if a projection is set
+  std::optional<query> m_query;
+  std::vector<std::size_t> m_projection;
 
-  uint8_t current_byte_in_runlength_file()
-  {
-    return *reinterpret_cast<const uint8_t*>(
-        &m_runlengthfile_buffer[m_runlengthfile_index]);
-  }
+  // Printed before every line, e.g. to tell merged logs apart
+  std::string m_prefix;
 
-  template <typename T>
-  T reinterpret_runlength_bytes_as(bool update_index)
-  {
-    return reinterpret_bytes_as<T>(m_runlengthfile_buffer, m_runlengthfile_index, update_index);
-  }
+  // Args of the record being decoded
+  std::vector<arg_view> m_args;
+  fmt::memory_buffer m_line;
 
-  void parse_and_print_log_entry(
-      const std::vector<index_file_parser::index_entry>& index_table)
+  void parse_and_print_log_entry(output_writer& out)
   {
     // First parse the index into the index table
+    const auto [index, runlength] = m_decoder.next_run();
+    const auto& index_entry = m_index_table[index];
 
-    // If the runlength is > 0, then the index is in the runlength file
-    // If the runlength is 0, then the index is in the log file
-    // Check runlength first
-    std::size_t index;
-    std::size_t runlength = 1;
+    if (!m_filter.selected(index)) {
+      m_decoder.skip(index_entry, runlength);
+      return;
+    }
 
-    index = reinterpret_log_bytes_as<uint16_t>(false);
+    if (m_query && !m_query->satisfiable(index)) {
+      m_decoder.skip(index_entry, runlength);
+      return;
+    }
 
-    if (m_runlengthfile_buffer_size == 0 /* empty runlength file */
-        || m_runlengthfile_index >= m_runlengthfile_buffer_size)
-    {
-      // No more runlengths in the runlength file
-      index = reinterpret_log_bytes_as<uint16_t>(true);
-    } else {
-      const std::size_t index_in_runlength_file =
-          reinterpret_runlength_bytes_as<uint16_t>(false);
+    // Now we know the format string and the number of arguments
+    // along with the type of each argument to be parsed
 
-      if (index_in_runlength_file == index) {
-        // The current index has a runlength of some amount
-        // parse `runlength` number of args in the log file
+    for (std::size_t i = 0; i < runlength; ++i) {
+      m_decoder.decode(index_entry, m_args);
 
-        // get past the runlength in the log file
-        reinterpret_log_bytes_as<uint16_t>(true);
+      if (m_query && !m_query->evaluate(index, m_args)) {
+        continue;
+      }
 
-        // get past the index in the run length file
-        index = reinterpret_runlength_bytes_as<uint16_t>(true);
+      if (!m_prefix.empty()) {
+        out.write(m_prefix);
+      }
 
-        // the runlength is stored as an integer
-        runlength = reinterpret_runlength_bytes_as<std::size_t>(true);
-      } else {
-        // The current index in the log file
-        // has a runlength of one
-        index = reinterpret_log_bytes_as<uint16_t>(true);
+      if (!m_projection.empty()) {
+        print_projection(out);
+        continue;
       }
-    }
 
-    auto index_entry = index_table[index];
+      if (index_entry.counts_suppressed && !m_args.empty()) {
+        print_suppressed_count(index_entry, out);
+        continue;
+      }
 
-    // std::cout << "Index: " << index << " "
-    //           << "Runlength: " << runlength << " "
-    //           << "m_logfile_index: " << m_logfile_index << " "
-    //           << "m_runlengthfile_index: " << m_runlengthfile_index << " "
-    //           << "format string: " << index_entry.format_string << " "
-    //           << "Current byte in log file: " <<
-    //           (int)current_byte_in_log_file()
-    //           << std::endl;
+      fmt::dynamic_format_arg_store<fmt::format_context> store;
+      for (const auto& arg : m_args) {
+        update_store(store, arg);
+      }
+      out.write_line(index_entry.format_string, store);
+    }
+  }
 
-    // Now we know the format string and the number of arguments
-    // along with the type of each argument to be parsed
+  // Prints a record of the calls a rate-limited call site suppressed, with
+  // the format string of the call site as it is
+  void print_suppressed_count(const index_entry& entry, output_writer& out)
+  {
+    m_line.clear();
+    fmt::format_to(std::back_inserter(m_line),
+                   "[{} suppressed] {}\n",
+                   m_args.front().as_integer().magnitude,
+                   entry.format_string);
+    out.write(std::string_view(m_line.data(), m_line.size()));
+  }
 
-    for (std::size_t i = 0; i < runlength; ++i) {
-      fmt::dynamic_format_arg_store<fmt::format_context> store;
-      for (const auto& arg_info : index_entry.args) {
-        arg new_arg;
-        new_arg.type = arg_info.type;
-
-        if (arg_info.is_constant) {
-          // The argument value is in the index table
-          new_arg.size = sizeof_arg_type(arg_info.type);
-          new_arg.value = arg_info.arg_data;
-        } else {
-          // argument is not constant
-          // need to parse it from the log file
-          //
-          // first find out how many bytes the argument takes
-          // then parse the argument
-
-          std::size_t size = 0;
-          if (arg_info.type == fmt_arg_type::type_string) {
-            // Next byte is the size
-            // For strings, this is the string length
-            size = reinterpret_log_bytes_as<uint16_t>(true);
-          } else {
-            // size if the size of the type
-            size = sizeof_arg_type(arg_info.type);
-          }
-          // the next bytes will be the data
-          new_arg.size = size;
-          new_arg.value = std::string_view(
-              reinterpret_cast<const char*>(&m_logfile_buffer[m_logfile_index]),
-              size);
-          m_logfile_index += size;
-        }
-        update_store(store, new_arg);
+  // Prints only the projected args of the decoded record, tab-separated
+  void print_projection(output_writer& out)
+  {
+    m_line.clear();
+    bool first = true;
+    for (const auto position : m_projection) {
+      if (!first) {
+        m_line.push_back('\t');
+      }
+      first = false;
+      if (position < m_args.size()) {
+        fmt::dynamic_format_arg_store<fmt::format_context> store;
+        update_store(store, m_args[position]);
+        fmt::vformat_to(std::back_inserter(m_line), "{}", store);
       }
-      fmt::print("{}\n", fmt::vformat(index_entry.format_string, store));
     }
+    m_line.push_back('\n');
+    out.write(std::string_view(m_line.data(), m_line.size()));
   }
 
   void update_store(fmt::dynamic_format_arg_store<fmt::format_context>& store,
-                    arg& arg)
+                    const arg_view& arg)
   {
-    if (arg.type == binary_log::fmt_arg_type::type_bool) {
+    if (arg.type == fmt_arg_type::type_bool) {
       bool value = *(bool*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_char) {
+    } else if (arg.type == fmt_arg_type::type_char) {
       char value = *(char*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_uint8) {
+    } else if (arg.type == fmt_arg_type::type_uint8) {
       uint8_t value = *(uint8_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_uint16) {
+    } else if (arg.type == fmt_arg_type::type_uint16) {
       uint16_t value = *(uint16_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_uint32) {
+    } else if (arg.type == fmt_arg_type::type_uint32) {
       uint32_t value = *(uint32_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_uint64) {
+    } else if (arg.type == fmt_arg_type::type_uint64) {
       uint64_t value = *(uint64_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_uint128) {
+    } else if (arg.type == fmt_arg_type::type_uint128) {
       __uint128_t value = *(__uint128_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_int8) {
+    } else if (arg.type == fmt_arg_type::type_int8) {
       int8_t value = *(int8_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_int16) {
+    } else if (arg.type == fmt_arg_type::type_int16) {
       int16_t value = *(int16_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_int32) {
+    } else if (arg.type == fmt_arg_type::type_int32) {
       int32_t value = *(int32_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_int64) {
+    } else if (arg.type == fmt_arg_type::type_int64) {
       int64_t value = *(int64_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_int128) {
+    } else if (arg.type == fmt_arg_type::type_int128) {
       __int128_t value = *(__int128_t*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_float) {
+    } else if (arg.type == fmt_arg_type::type_float) {
       float value = *(float*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_double) {
+    } else if (arg.type == fmt_arg_type::type_double) {
       double value = *(double*)&arg.value.data()[0];
       store.push_back(value);
-    } else if (arg.type == binary_log::fmt_arg_type::type_string) {
+    } else if (arg.type == fmt_arg_type::type_string) {
       std::string value =
           std::string((char*)&arg.value.data()[0], arg.value.size());
       store.push_back(value);
@@ -226,38 +174,224 @@ class log_file_parser
   }
 
 public:
-  log_file_parser(const char* log_file_path, const char* runlength_file_path)
+  // Parses the records numbered [first, last) of the log
+  explicit log_file_parser(const reader& log,
+                           std::size_t first = 0,
+                           std::size_t last = reader::npos)
+      : m_index_table(log.index_table())
+      , m_log_file_size(log.log().size())
+      , m_record_number(first)
+      , m_decoder(log.decoder(first, last))
+  {
+  }
+
+  // Parses records of call sites of `index_table` once given a decoder,
+  // e.g. the chunks of a stream (see set_decoder())
+  explicit log_file_parser(const std::vector<index_entry>& index_table)
+      : m_index_table(index_table)
+      , m_log_file_size(0)
+      , m_record_number(0)
+  {
+  }
+
+  // Goes on with the records of `decoder`, e.g. the next chunk of a stream
+  void set_decoder(record_decoder decoder)
+  {
+    m_decoder = decoder;
+  }
+
+  // Continues with the records flushed to a log that is still being
+  // written, after log.refresh()
+  void extend(const reader& log)
+  {
+    m_decoder.extend(log.committed_log(), log.runlength());
+    m_log_file_size = log.log().size();
+  }
+
+  void set_filter(record_filter filter)
+  {
+    m_filter = std::move(filter);
+  }
+
+  void set_query(query compiled_query)
   {
-    m_logfile_mmap = mio::mmap_source(log_file_path);
-    if (!m_logfile_mmap.is_open() || !m_logfile_mmap.is_mapped()) {
-      throw std::runtime_error("Could not open log file");
+    m_query = std::move(compiled_query);
+  }
+
+  void set_projection(std::vector<std::size_t> projection)
+  {
+    m_projection = std::move(projection);
+  }
+
+  void set_prefix(std::string prefix)
+  {
+    m_prefix = std::move(prefix);
+  }
+
+  // Stops after `count` more records, e.g. to parse a log a block of
+  // records at a time
+  void set_limit(std::size_t count)
+  {
+    m_decoder.set_limit(count);
+  }
+
+  // Prints the records up to the end or the limit, leaving the last of
+  // them in the buffer of `out`
+  void print_records(output_writer& out)
+  {
+    while (!m_decoder.at_end()) {
+      parse_and_print_log_entry(out);
     }
+  }
 
-    m_logfile_buffer = m_logfile_mmap.data();
-    m_logfile_buffer_size = m_logfile_mmap.mapped_length();
+  void parse_and_print(output_writer& out)
+  {
+    print_records(out);
+    out.flush();
+  }
 
-    try {
-      m_runlengthfile_mmap = mio::mmap_source(runlength_file_path);
-      if (!m_runlengthfile_mmap.is_open() || !m_runlengthfile_mmap.is_mapped())
-      {
-        throw std::runtime_error("Could not open runlength file");
+  // Counts the records and bytes of every call site without decoding any
+  // args; runs of fixed-size records are accounted for in one step
+  std::vector<call_site_stats> parse_and_count()
+  {
+    std::vector<call_site_stats> stats(m_index_table.size());
+    while (!m_decoder.at_end()) {
+      const std::size_t record_start = m_decoder.offset();
+      const auto [index, runlength] = m_decoder.next_run();
+      const std::size_t args_start = m_decoder.offset();
+      auto& site = stats[index];
+      const auto& entry = m_index_table[index];
+      if (entry.counts_suppressed && !entry.args.empty()) {
+        for (std::size_t i = 0; i < runlength; ++i) {
+          m_decoder.decode(entry, m_args);
+          site.suppressed += m_args.front().as_integer().magnitude;
+        }
+      } else {
+        m_decoder.skip(entry, runlength);
       }
-      m_runlengthfile_buffer = m_runlengthfile_mmap.data();
-      m_runlengthfile_buffer_size = m_runlengthfile_mmap.mapped_length();
-    } catch (const std::exception& e) {
-      // Assume that the runlength file is empty
-      // This means that there is no runlength information
-      m_runlengthfile_buffer = nullptr;
-      m_runlengthfile_buffer_size = 0;
+
+      site.records += runlength;
+      site.index_bytes += args_start - record_start;
+      site.arg_bytes += m_decoder.offset() - args_start;
     }
+    return stats;
+  }
+
+  std::size_t log_file_size() const
+  {
+    return m_log_file_size;
   }
 
-  void parse_and_print(
-      const std::vector<index_file_parser::index_entry>& index_table)
+  void parse_and_aggregate(aggregator& statistics)
   {
-    while (m_logfile_index < m_logfile_buffer_size) {
-      parse_and_print_log_entry(index_table);
+    while (!m_decoder.at_end()) {
+      const auto [index, runlength] = m_decoder.next_run();
+      const auto& index_entry = m_index_table[index];
+
+      if (!m_filter.selected(index)
+          || (m_query && !m_query->satisfiable(index))) {
+        m_decoder.skip(index_entry, runlength);
+        continue;
+      }
+
+      if (index_entry.fixed_record_size && !m_query) {
+        // The whole run is a strided array of fixed-size args
+        statistics.add_run(
+            index, index_entry, m_decoder.position(), runlength);
+        m_decoder.skip(index_entry, runlength);
+        continue;
+      }
+
+      for (std::size_t i = 0; i < runlength; ++i) {
+        m_decoder.decode(index_entry, m_args);
+        if (m_query && !m_query->evaluate(index, m_args)) {
+          continue;
+        }
+        statistics.add_record(index, m_args);
+      }
+    }
+  }
+
+  // Hands the typed args of the selected records to `exporter` instead of
+  // formatting them. Exporters that take whole runs of fixed-size records
+  // get them without decoding.
+  template<typename Exporter>
+  void parse_and_export(Exporter& exporter)
+  {
+    while (!m_decoder.at_end()) {
+      const auto [index, runlength] = m_decoder.next_run();
+      const auto& index_entry = m_index_table[index];
+
+      if (!m_filter.selected(index)
+          || (m_query && !m_query->satisfiable(index))) {
+        m_decoder.skip(index_entry, runlength);
+        continue;
+      }
+
+      if constexpr (run_exporter<Exporter>) {
+        if (index_entry.fixed_record_size && !m_query) {
+          exporter.add_run(
+              index, index_entry, m_decoder.position(), runlength);
+          m_decoder.skip(index_entry, runlength);
+          continue;
+        }
+      }
+
+      for (std::size_t i = 0; i < runlength; ++i) {
+        m_decoder.decode(index_entry, m_args);
+        if (m_query && !m_query->evaluate(index, m_args)) {
+          continue;
+        }
+        exporter.add_record(index, m_args);
+      }
     }
+    exporter.finish();
+  }
+
+  // Copies the selected records up to the end or the limit, as they are
+  // encoded, to `extractor` (see log_extractor). Runs of fixed-size
+  // records are copied whole.
+  template<typename Extractor>
+  void extract_records(Extractor& extractor)
+  {
+    while (!m_decoder.at_end()) {
+      const auto [index, runlength] = m_decoder.next_run();
+      const auto& index_entry = m_index_table[index];
+
+      if (!m_filter.selected(index)
+          || (m_query && !m_query->satisfiable(index))) {
+        m_decoder.skip(index_entry, runlength);
+        m_record_number += runlength;
+        continue;
+      }
+
+      if (index_entry.fixed_record_size && !m_query) {
+        extractor.add_run(
+            index, m_record_number, m_decoder.position(), runlength);
+        m_decoder.skip(index_entry, runlength);
+        m_record_number += runlength;
+        continue;
+      }
+
+      for (std::size_t i = 0; i < runlength; ++i, ++m_record_number) {
+        const char* first = m_decoder.position();
+        m_decoder.decode(index_entry, m_args);
+        if (m_query && !m_query->evaluate(index, m_args)) {
+          continue;
+        }
+        extractor.add_record(
+            index,
+            m_record_number,
+            std::string_view(first, m_decoder.position() - first));
+      }
+    }
+  }
+
+  template<typename Extractor>
+  void parse_and_extract(Extractor& extractor)
+  {
+    extract_records(extractor);
+    extractor.finish();
   }
 };
 }  // namespace binary_log
@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <binary_log/reader.hpp>
+#include <log_file_parser.hpp>
+
+namespace binary_log
+{
+// Merges logs into one stream ordered by time, to the precision of their
+// checkpoints. Records carry no times of their own: the records of a log
+// between two of its checkpoints (a block) are only known to have been
+// logged before the time of the second one, so blocks are taken from the
+// logs in order of that time, with a heap of the next block of each log.
+// A logger writes a checkpoint every seek interval and at every flush(),
+// so loggers that flush often merge finely.
+class log_merger
+{
+  struct source
+  {
+    const reader* log;
+    log_file_parser* parser;
+    uint64_t record_number;  // of the next record to parse
+    uint64_t last_record;  // excluded
+    std::size_t next_checkpoint;  // first after record_number
+  };
+
+  // Time of the next block of a source, and the source
+  using block = std::pair<int64_t, std::size_t>;
+
+  std::vector<source> m_sources;
+
+  // Number of records of the next block of `current` and the time before
+  // which they were logged; the block after the last checkpoint has no
+  // such time and goes last.
+  static int64_t next_block(source& current, std::size_t& count)
+  {
+    const auto& checkpoints = current.log->checkpoints();
+    while (current.next_checkpoint < checkpoints.size()
+           && checkpoints.entry(current.next_checkpoint).record_number
+               <= current.record_number)
+    {
+      ++current.next_checkpoint;
+    }
+    if (current.next_checkpoint == checkpoints.size()) {
+      count = current.last_record - current.record_number;
+      return std::numeric_limits<int64_t>::max();
+    }
+    const auto checkpoint = checkpoints.entry(current.next_checkpoint);
+    count = std::min(checkpoint.record_number, current.last_record)
+        - current.record_number;
+    return checkpoint.timestamp;
+  }
+
+public:
+  // Merges the records numbered [first, last) of `log`, parsed by `parser`
+  // (which starts at `first`)
+  void add(const reader& log,
+           log_file_parser& parser,
+           uint64_t first,
+           uint64_t last)
+  {
+    m_sources.push_back({&log, &parser, first, last, 0});
+  }
+
+  // Calls `parse_block(position)` for every block, in order of time, with
+  // the parser of the log added at `position` limited to the block
+  template<typename Function>
+  void merge(Function&& parse_block)
+  {
+    std::priority_queue<block, std::vector<block>, std::greater<>> heap;
+    std::vector<std::size_t> counts(m_sources.size());
+    for (std::size_t i = 0; i < m_sources.size(); ++i) {
+      if (m_sources[i].record_number < m_sources[i].last_record) {
+        heap.push({next_block(m_sources[i], counts[i]), i});
+      }
+    }
+
+    while (!heap.empty()) {
+      const auto [time, position] = heap.top();
+      heap.pop();
+      auto& current = m_sources[position];
+      current.parser->set_limit(counts[position]);
+      parse_block(position);
+      current.record_number += counts[position];
+
+      if (time != std::numeric_limits<int64_t>::max()
+          && current.record_number < current.last_record)
+      {
+        heap.push({next_block(current, counts[position]), position});
+      }
+    }
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,124 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <unistd.h>
+
+#define FMT_HEADER_ONLY
+#include <fmt/args.h>
+#include <fmt/format.h>
+
+namespace binary_log
+{
+class output_writer
+{
+public:
+  // Takes the buffered text in place of a file descriptor, e.g. to put
+  // the output of several threads in order
+  using sink = std::function<void(std::string_view)>;
+
+private:
+  int m_fd;
+  sink m_sink;
+  std::size_t m_capacity;
+  std::size_t m_bytes_written {0};
+
+  // Formatted lines are accumulated here and handed to the kernel
+  // with one write(2) call per `m_capacity` bytes instead of one
+  // stdio call per line.
+  fmt::memory_buffer m_buffer;
+
+  void write_all(const char* data, std::size_t size)
+  {
+    if (m_sink) {
+      m_sink(std::string_view(data, size));
+      m_bytes_written += size;
+      return;
+    }
+    while (size) {
+      const ssize_t written = ::write(m_fd, data, size);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::string("write failed: ")
+                                 + std::strerror(errno));
+      }
+      data += written;
+      size -= static_cast<std::size_t>(written);
+      m_bytes_written += static_cast<std::size_t>(written);
+    }
+  }
+
+public:
+  static constexpr std::size_t default_buffer_size = 4 * 1024 * 1024;
+
+  output_writer(int fd = STDOUT_FILENO,
+                std::size_t capacity = default_buffer_size)
+      : m_fd(fd)
+      , m_capacity(capacity ? capacity : 1)
+  {
+    // The last line written may overshoot the capacity a little
+    m_buffer.reserve(m_capacity + 4096);
+  }
+
+  explicit output_writer(sink text_sink,
+                         std::size_t capacity = default_buffer_size)
+      : output_writer(-1, capacity)
+  {
+    m_sink = std::move(text_sink);
+  }
+
+  output_writer(const output_writer&) = delete;
+  output_writer& operator=(const output_writer&) = delete;
+
+  ~output_writer()
+  {
+    try {
+      flush();
+    } catch (const std::exception&) {
+      // Nothing sensible to do with a failed write at this point
+    }
+  }
+
+  void write_line(
+      std::string_view format_string,
+      const fmt::dynamic_format_arg_store<fmt::format_context>& store)
+  {
+    fmt::vformat_to(std::back_inserter(m_buffer), format_string, store);
+    m_buffer.push_back('\n');
+    if (m_buffer.size() >= m_capacity) {
+      flush();
+    }
+  }
+
+  void write(std::string_view text)
+  {
+    m_buffer.append(text.data(), text.data() + text.size());
+    if (m_buffer.size() >= m_capacity) {
+      flush();
+    }
+  }
+
+  void flush()
+  {
+    if (m_buffer.size() == 0) {
+      return;
+    }
+    write_all(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+  }
+
+  std::size_t bytes_written() const
+  {
+    return m_bytes_written;
+  }
+};
+
+}  // namespace binary_log
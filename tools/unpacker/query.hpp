@@ -0,0 +1,442 @@
+#pragma once
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/record_decoder.hpp>
+#include <binary_log/detail/index_parser.hpp>
+
+namespace binary_log
+{
+// A predicate over the arguments of a record, e.g.
+//
+//   arg2 > 1000 && arg0 == 'AAPL'
+//
+// Grammar:
+//
+//   expression := and-expr ( '||' and-expr )*
+//   and-expr   := unary ( '&&' unary )*
+//   unary      := '!' unary | '(' expression ')' | comparison
+//   comparison := 'arg' <N> <op> <literal>
+//   op         := '==' | '!=' | '<' | '<=' | '>' | '>='
+//   literal    := integer | real | 'string' | "string" | true | false
+//
+// The predicate is compiled once per call site against its argument
+// types, and evaluated on the raw argument values before any formatting.
+class query
+{
+  enum class op
+  {
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
+  };
+
+  enum class literal_kind
+  {
+    integer,
+    real,
+    string,
+  };
+
+  struct comparison
+  {
+    std::size_t arg;
+    op oper;
+    literal_kind kind;
+    integer_value integer {};
+    double real {0};
+    std::string text;
+  };
+
+  struct node
+  {
+    enum class kind
+    {
+      compare,
+      all,
+      any,
+      negate,
+    };
+
+    kind type {kind::compare};
+    std::size_t comparison {0};  // into m_comparisons
+    std::vector<node> children;
+  };
+
+  // How a comparison is evaluated at a particular call site
+  enum class plan : uint8_t
+  {
+    never,
+    integer,
+    real,
+    string,
+  };
+
+  std::string_view m_expression;
+  std::size_t m_position {0};  // into m_expression
+
+  std::vector<comparison> m_comparisons;
+  node m_root;
+
+  std::vector<std::vector<plan>> m_plans;  // [index][comparison]
+  std::vector<bool> m_satisfiable;  // [index]
+
+  [[noreturn]] void error(const std::string& message) const
+  {
+    throw std::runtime_error("Invalid query at offset "
+                             + std::to_string(m_position) + ": " + message);
+  }
+
+  void skip_whitespace()
+  {
+    while (m_position < m_expression.size()
+           && std::isspace(static_cast<unsigned char>(m_expression[m_position])))
+    {
+      ++m_position;
+    }
+  }
+
+  bool consume(std::string_view token)
+  {
+    skip_whitespace();
+    if (m_expression.substr(m_position, token.size()) == token) {
+      m_position += token.size();
+      return true;
+    }
+    return false;
+  }
+
+  std::size_t parse_arg_position()
+  {
+    if (!consume("arg")) {
+      error("expected 'arg<N>'");
+    }
+    const auto* first = m_expression.data() + m_position;
+    const auto* last = m_expression.data() + m_expression.size();
+    std::size_t position = 0;
+    auto [ptr, ec] = std::from_chars(first, last, position);
+    if (ec != std::errc()) {
+      error("expected an argument number after 'arg'");
+    }
+    m_position += static_cast<std::size_t>(ptr - first);
+    return position;
+  }
+
+  op parse_op()
+  {
+    // Two-character operators first
+    if (consume("==")) {
+      return op::eq;
+    } else if (consume("!=")) {
+      return op::ne;
+    } else if (consume("<=")) {
+      return op::le;
+    } else if (consume(">=")) {
+      return op::ge;
+    } else if (consume("<")) {
+      return op::lt;
+    } else if (consume(">")) {
+      return op::gt;
+    }
+    error("expected a comparison operator");
+  }
+
+  void parse_literal(comparison& result)
+  {
+    skip_whitespace();
+    if (m_position >= m_expression.size()) {
+      error("expected a literal");
+    }
+
+    const char quote = m_expression[m_position];
+    if (quote == '\'' || quote == '"') {
+      const auto end = m_expression.find(quote, m_position + 1);
+      if (end == std::string_view::npos) {
+        error("unterminated string literal");
+      }
+      result.kind = literal_kind::string;
+      result.text = std::string(
+          m_expression.substr(m_position + 1, end - m_position - 1));
+      m_position = end + 1;
+      return;
+    }
+
+    if (consume("true")) {
+      result.kind = literal_kind::integer;
+      result.integer = integer_value::of(uint64_t {1});
+      return;
+    } else if (consume("false")) {
+      result.kind = literal_kind::integer;
+      result.integer = integer_value {};
+      return;
+    }
+
+    auto end = m_position;
+    while (end < m_expression.size()
+           && (std::isalnum(static_cast<unsigned char>(m_expression[end]))
+               || m_expression[end] == '.' || m_expression[end] == '-'
+               || m_expression[end] == '+'))
+    {
+      ++end;
+    }
+    const auto number = m_expression.substr(m_position, end - m_position);
+    const auto* first = number.data();
+    const auto* last = number.data() + number.size();
+    if (first != last && *first == '+') {
+      ++first;
+    }
+
+    int64_t signed_value = 0;
+    uint64_t unsigned_value = 0;
+    if (auto [ptr, ec] = std::from_chars(first, last, signed_value);
+        ec == std::errc() && ptr == last)
+    {
+      result.kind = literal_kind::integer;
+      result.integer = integer_value::of(signed_value);
+    } else if (auto [ptr, ec] = std::from_chars(first, last, unsigned_value);
+               ec == std::errc() && ptr == last)
+    {
+      result.kind = literal_kind::integer;
+      result.integer = integer_value::of(unsigned_value);
+    } else if (auto [ptr, ec] = std::from_chars(first, last, result.real);
+               ec == std::errc() && ptr == last)
+    {
+      result.kind = literal_kind::real;
+    } else {
+      error("expected a number, string, true or false");
+    }
+    m_position = end;
+  }
+
+  node parse_comparison()
+  {
+    comparison result;
+    result.arg = parse_arg_position();
+    result.oper = parse_op();
+    parse_literal(result);
+
+    node leaf;
+    leaf.type = node::kind::compare;
+    leaf.comparison = m_comparisons.size();
+    m_comparisons.push_back(std::move(result));
+    return leaf;
+  }
+
+  node parse_unary()
+  {
+    if (consume("!")) {
+      node negation;
+      negation.type = node::kind::negate;
+      negation.children.push_back(parse_unary());
+      return negation;
+    } else if (consume("(")) {
+      node inner = parse_expression();
+      if (!consume(")")) {
+        error("expected ')'");
+      }
+      return inner;
+    }
+    return parse_comparison();
+  }
+
+  node parse_and()
+  {
+    node result;
+    result.type = node::kind::all;
+    result.children.push_back(parse_unary());
+    while (consume("&&")) {
+      result.children.push_back(parse_unary());
+    }
+    return result.children.size() == 1 ? std::move(result.children[0])
+                                        : std::move(result);
+  }
+
+  node parse_expression()
+  {
+    node result;
+    result.type = node::kind::any;
+    result.children.push_back(parse_and());
+    while (consume("||")) {
+      result.children.push_back(parse_and());
+    }
+    return result.children.size() == 1 ? std::move(result.children[0])
+                                       : std::move(result);
+  }
+
+  static plan make_plan(const comparison& comparison,
+                        const index_entry& entry)
+  {
+    if (comparison.arg >= entry.args.size()) {
+      return plan::never;
+    }
+    const auto type = entry.args[comparison.arg].type;
+    if (type == fmt_arg_type::type_string) {
+      return comparison.kind == literal_kind::string ? plan::string
+                                                     : plan::never;
+    }
+    if (comparison.kind == literal_kind::string) {
+      return plan::never;
+    }
+    if (comparison.kind == literal_kind::real
+        || type == fmt_arg_type::type_float
+        || type == fmt_arg_type::type_double)
+    {
+      return plan::real;
+    }
+    return plan::integer;
+  }
+
+  // Returns 0 if `root` is false at a call site regardless of the argument
+  // values, 1 if it is always true, and -1 if it depends on the values
+  int fold(const node& root, const std::vector<plan>& plans) const
+  {
+    switch (root.type) {
+      case node::kind::compare:
+        return plans[root.comparison] == plan::never ? 0 : -1;
+      case node::kind::negate: {
+        const int inner = fold(root.children[0], plans);
+        return inner < 0 ? inner : 1 - inner;
+      }
+      case node::kind::all: {
+        int result = 1;
+        for (const auto& child : root.children) {
+          const int value = fold(child, plans);
+          if (value == 0) {
+            return 0;
+          } else if (value < 0) {
+            result = -1;
+          }
+        }
+        return result;
+      }
+      case node::kind::any: {
+        int result = 0;
+        for (const auto& child : root.children) {
+          const int value = fold(child, plans);
+          if (value == 1) {
+            return 1;
+          } else if (value < 0) {
+            result = -1;
+          }
+        }
+        return result;
+      }
+    }
+    return -1;
+  }
+
+  template<typename T>
+  static bool compare(op oper, const T& lhs, const T& rhs)
+  {
+    switch (oper) {
+      case op::eq:
+        return lhs == rhs;
+      case op::ne:
+        return lhs != rhs;
+      case op::lt:
+        return lhs < rhs;
+      case op::le:
+        return lhs <= rhs;
+      case op::gt:
+        return lhs > rhs;
+      case op::ge:
+        return lhs >= rhs;
+    }
+    return false;
+  }
+
+  bool evaluate(const node& root,
+                const std::vector<plan>& plans,
+                const std::vector<arg_view>& args) const
+  {
+    switch (root.type) {
+      case node::kind::compare: {
+        const auto& comparison = m_comparisons[root.comparison];
+        switch (plans[root.comparison]) {
+          case plan::never:
+            return false;
+          case plan::integer:
+            return compare(comparison.oper,
+                           args[comparison.arg].as_integer(),
+                           comparison.integer);
+          case plan::real:
+            return compare(comparison.oper,
+                           args[comparison.arg].as_double(),
+                           comparison.kind == literal_kind::real
+                               ? comparison.real
+                               : comparison.integer.as_double());
+          case plan::string:
+            return compare(comparison.oper,
+                           args[comparison.arg].value,
+                           std::string_view(comparison.text));
+        }
+        return false;
+      }
+      case node::kind::negate:
+        return !evaluate(root.children[0], plans, args);
+      case node::kind::all:
+        for (const auto& child : root.children) {
+          if (!evaluate(child, plans, args)) {
+            return false;
+          }
+        }
+        return true;
+      case node::kind::any:
+        for (const auto& child : root.children) {
+          if (evaluate(child, plans, args)) {
+            return true;
+          }
+        }
+        return false;
+    }
+    return false;
+  }
+
+public:
+  explicit query(std::string_view expression)
+      : m_expression(expression)
+  {
+    m_root = parse_expression();
+    skip_whitespace();
+    if (m_position != m_expression.size()) {
+      error("unexpected trailing characters");
+    }
+    m_expression = {};
+  }
+
+  // Resolves every comparison against the argument types of each call site
+  void compile(const std::vector<index_entry>& index_table)
+  {
+    m_plans.resize(index_table.size());
+    m_satisfiable.resize(index_table.size());
+    for (std::size_t i = 0; i < index_table.size(); ++i) {
+      auto& plans = m_plans[i];
+      plans.clear();
+      for (const auto& comparison : m_comparisons) {
+        plans.push_back(make_plan(comparison, index_table[i]));
+      }
+      m_satisfiable[i] = fold(m_root, plans) != 0;
+    }
+  }
+
+  // False if no record of this call site can match
+  bool satisfiable(std::size_t index) const
+  {
+    return index < m_satisfiable.size() && m_satisfiable[index];
+  }
+
+  bool evaluate(std::size_t index, const std::vector<arg_view>& args) const
+  {
+    return evaluate(m_root, m_plans[index], args);
+  }
+};
+
+}  // namespace binary_log
@@ -0,0 +1,118 @@
+#pragma once
+#include <charconv>
+#include <optional>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <binary_log/detail/index_parser.hpp>
+
+namespace binary_log
+{
+// Selects call sites by format string (substring or regex) or by index,
+// and by level.
+//
+// Patterns are compiled once and resolved against the index table so
+// that the per-record check is a single lookup. An invalid regex throws
+// std::runtime_error.
+class record_filter
+{
+  // A pattern compiled once: an index, a substring or a regex
+  struct pattern
+  {
+    std::string text;
+    std::optional<std::size_t> index;
+    std::optional<std::regex> regex;
+
+    bool matches(std::size_t i, std::string_view format_string) const
+    {
+      if (index) {
+        return *index == i;
+      }
+      if (regex) {
+        return std::regex_search(
+            format_string.begin(), format_string.end(), *regex);
+      }
+      return format_string.find(text) != std::string_view::npos;
+    }
+  };
+
+  std::vector<bool> m_selected;
+
+  static std::optional<std::size_t> parse_index(std::string_view text)
+  {
+    std::size_t index = 0;
+    const auto* first = text.data();
+    const auto* last = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(first, last, index);
+    if (ec != std::errc() || ptr != last) {
+      return std::nullopt;
+    }
+    return index;
+  }
+
+  static std::vector<pattern> compile(const std::vector<std::string>& texts,
+                                      bool use_regex)
+  {
+    std::vector<pattern> patterns;
+    for (const auto& text : texts) {
+      auto& compiled = patterns.emplace_back(pattern {text, {}, {}});
+      compiled.index = parse_index(text);
+      if (!compiled.index && use_regex) {
+        try {
+          compiled.regex.emplace(text);
+        } catch (const std::regex_error& err) {
+          throw std::runtime_error("Invalid regex '" + text
+                                   + "': " + err.what());
+        }
+      }
+    }
+    return patterns;
+  }
+
+  static bool matches_any(const std::vector<pattern>& patterns,
+                          std::size_t index,
+                          std::string_view format_string)
+  {
+    for (const auto& pattern : patterns) {
+      if (pattern.matches(index, format_string)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  record_filter() = default;
+
+  record_filter(const std::vector<index_entry>& index_table,
+                const std::vector<std::string>& includes,
+                const std::vector<std::string>& excludes,
+                bool use_regex = false,
+                level min_level = level::trace)
+  {
+    const auto include_patterns = compile(includes, use_regex);
+    const auto exclude_patterns = compile(excludes, use_regex);
+    m_selected.resize(index_table.size());
+    for (std::size_t i = 0; i < index_table.size(); ++i) {
+      const auto format_string = index_table[i].format_string;
+      bool selected = index_table[i].level >= min_level
+          && (include_patterns.empty()
+              || matches_any(include_patterns, i, format_string));
+      if (selected && matches_any(exclude_patterns, i, format_string)) {
+        selected = false;
+      }
+      m_selected[i] = selected;
+    }
+  }
+
+  // Call sites not known to the filter are always selected
+  bool selected(std::size_t index) const
+  {
+    return index >= m_selected.size() || m_selected[index];
+  }
+};
+
+}  // namespace binary_log
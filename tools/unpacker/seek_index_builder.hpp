@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include <binary_log/reader.hpp>
+
+namespace binary_log
+{
+// Builds the seek index of a log that was written without one (see
+// build_checkpoints)
+static inline std::vector<seek_entry> build_seek_index(
+    const reader& log,
+    std::size_t interval = default_seek_interval,
+    const std::vector<timed_record>& times = {})
+{
+  return build_checkpoints(log.decoder(), log.index_table(), interval, times);
+}
+
+static inline void write_seek_index(const std::filesystem::path& path,
+                                    const std::vector<seek_entry>& checkpoints)
+{
+  std::FILE* file = std::fopen(path.string().c_str(), "wb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not open " + path.string());
+  }
+  std::fwrite(checkpoints.data(), sizeof(seek_entry), checkpoints.size(), file);
+  std::fclose(file);
+}
+
+}  // namespace binary_log
@@ -0,0 +1,283 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <binary_log/reader.hpp>
+#include <fcntl.h>
+#include <glob.h>
+#include <log_file_parser.hpp>
+#include <output_writer.hpp>
+#include <unistd.h>
+
+namespace binary_log
+{
+// Paths of the logs named by `patterns`, which may be globs such as
+// "app.out.*". The matches of a glob are sorted, as by the shell, and the
+// .index, .runlength and .seek files it matches are left out.
+inline std::vector<std::string> expand_log_paths(
+    const std::vector<std::string>& patterns)
+{
+  std::vector<std::string> paths;
+  for (const auto& pattern : patterns) {
+    glob_t matches;
+    const int result = ::glob(pattern.c_str(), 0, nullptr, &matches);
+    if (result != 0) {
+      globfree(&matches);
+      throw std::runtime_error(result == GLOB_NOMATCH
+                                   ? "No log file matches " + pattern
+                                   : "Cannot expand " + pattern);
+    }
+    for (std::size_t i = 0; i < matches.gl_pathc; ++i) {
+      const std::string_view path = matches.gl_pathv[i];
+      if (path != pattern
+          && (path.ends_with(".index") || path.ends_with(".runlength")
+              || path.ends_with(".seek")))
+      {
+        continue;
+      }
+      paths.emplace_back(path);
+    }
+    globfree(&matches);
+  }
+  return paths;
+}
+
+// Unpacks independent logs, such as rotated or per-thread segments, on a
+// pool of threads. Each log is decoded by one thread from start to end,
+// and the threads take the logs in order.
+class segment_unpacker
+{
+public:
+  // Sets up the parser of a log (filter, query, projection); called by
+  // the threads, so it must not change shared state
+  using setup_function = std::function<void(const reader&, log_file_parser&)>;
+
+  // Buffers of text a thread may have waiting for the logs before its own
+  static constexpr std::size_t max_waiting_buffers = 2;
+
+private:
+  struct segment
+  {
+    std::vector<std::string> buffers;  // waiting to be written
+    bool done {false};
+  };
+
+  std::vector<std::string> m_paths;
+  std::size_t m_jobs;
+  std::size_t m_buffer_size;
+  setup_function m_setup;
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::size_t m_claimed {0};  // logs taken by the threads
+  std::size_t m_writing {0};  // log whose text is being written, in order
+  std::size_t m_window;  // logs that may be taken ahead of m_writing
+  std::vector<segment> m_segments;
+  std::exception_ptr m_error;
+
+  // Position of the next log to unpack, or none once they are all taken
+  // or a thread has failed
+  std::optional<std::size_t> claim()
+  {
+    std::unique_lock lock(m_mutex);
+    m_changed.wait(lock,
+                   [this]
+                   {
+                     return m_error || m_claimed == m_paths.size()
+                         || m_claimed < m_writing + m_window;
+                   });
+    if (m_error || m_claimed == m_paths.size()) {
+      return std::nullopt;
+    }
+    return m_claimed++;
+  }
+
+  void fail(std::exception_ptr error)
+  {
+    std::lock_guard lock(m_mutex);
+    if (!m_error) {
+      m_error = std::move(error);
+    }
+    m_changed.notify_all();
+  }
+
+  void print(const std::string& path, output_writer& out)
+  {
+    const reader log(path);
+    auto parser = log_file_parser(log);
+    if (m_setup) {
+      m_setup(log, parser);
+    }
+    parser.parse_and_print(out);
+  }
+
+  // Runs `unpack(position)` for every log on m_jobs threads, and `wait()`
+  // on this one while they run
+  template<typename Unpack, typename Wait>
+  void run(Unpack&& unpack, Wait&& wait)
+  {
+    std::vector<std::thread> threads;
+    const auto count = std::min(m_jobs, m_paths.size());
+    for (std::size_t i = 0; i < count; ++i) {
+      threads.emplace_back(
+          [&]
+          {
+            while (const auto position = claim()) {
+              try {
+                unpack(*position);
+              } catch (...) {
+                fail(std::current_exception());
+                return;
+              }
+            }
+          });
+    }
+
+    try {
+      wait();
+    } catch (...) {
+      fail(std::current_exception());
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (m_error) {
+      std::rethrow_exception(m_error);
+    }
+  }
+
+  // Hands a buffer of text of log `position` to the writing thread,
+  // waiting if too many of its buffers are waiting already
+  void hand_over(std::size_t position, std::string_view text)
+  {
+    std::unique_lock lock(m_mutex);
+    auto& current = m_segments[position];
+    m_changed.wait(lock,
+                   [&]
+                   {
+                     return m_error
+                         || current.buffers.size() < max_waiting_buffers;
+                   });
+    if (m_error) {
+      throw std::runtime_error("Unpacking stopped");
+    }
+    current.buffers.emplace_back(text);
+    m_changed.notify_all();
+  }
+
+  void write_in_order(output_writer& out)
+  {
+    std::unique_lock lock(m_mutex);
+    while (m_writing < m_segments.size()) {
+      auto& current = m_segments[m_writing];
+      m_changed.wait(
+          lock,
+          [&] { return m_error || !current.buffers.empty() || current.done; });
+      if (m_error) {
+        return;
+      }
+      if (current.buffers.empty()) {
+        ++m_writing;
+        m_changed.notify_all();
+        continue;
+      }
+      const auto text = std::move(current.buffers.front());
+      current.buffers.erase(current.buffers.begin());
+      m_changed.notify_all();
+      lock.unlock();
+      out.write(text);
+      lock.lock();
+    }
+    lock.unlock();
+    out.flush();
+  }
+
+public:
+  segment_unpacker(std::vector<std::string> paths,
+                   std::size_t jobs,
+                   std::size_t buffer_size,
+                   setup_function setup)
+      : m_paths(std::move(paths))
+      , m_jobs(std::max<std::size_t>(jobs, 1))
+      , m_buffer_size(buffer_size)
+      , m_setup(std::move(setup))
+      , m_window(m_jobs)
+  {
+  }
+
+  // Writes the text of every log to `fd`, in the order of the paths. A
+  // thread only takes a log while fewer than `jobs` logs wait to be
+  // written, and stops when that log has two buffers waiting, so memory
+  // does not grow with the number or the size of the logs.
+  void unpack_in_order(int fd)
+  {
+    m_segments.assign(m_paths.size(), segment {});
+    auto out = output_writer(fd, m_buffer_size);
+    run(
+        [this](std::size_t position)
+        {
+          {
+            auto text = output_writer(
+                [this, position](std::string_view text)
+                { hand_over(position, text); },
+                m_buffer_size);
+            print(m_paths[position], text);
+          }
+          std::lock_guard lock(m_mutex);
+          m_segments[position].done = true;
+          m_changed.notify_all();
+        },
+        [&] { write_in_order(out); });
+  }
+
+  // Writes the text of every log to its own file in `directory`, named
+  // after the log with ".txt" appended
+  void unpack_to_directory(const std::filesystem::path& directory)
+  {
+    std::filesystem::create_directories(directory);
+    std::set<std::filesystem::path> names;
+    for (const auto& path : m_paths) {
+      const auto name = std::filesystem::path(path).filename();
+      if (!names.insert(name).second) {
+        throw std::runtime_error("Two logs are named " + name.string());
+      }
+    }
+
+    m_window = m_paths.size();
+    run(
+        [&](std::size_t position)
+        {
+          auto output_path = directory
+              / std::filesystem::path(m_paths[position]).filename();
+          output_path += ".txt";
+          const int fd =
+              ::open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          if (fd < 0) {
+            throw std::runtime_error("Cannot create " + output_path.string());
+          }
+          try {
+            auto out = output_writer(fd, m_buffer_size);
+            print(m_paths[position], out);
+          } catch (...) {
+            ::close(fd);
+            throw;
+          }
+          ::close(fd);
+        },
+        [] {});
+  }
+};
+
+}  // namespace binary_log
@@ -1,19 +1,422 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #include <argparse.hpp>
-#include <index_file_parser.hpp>
+#include <binary_log/reader.hpp>
+#include <binary_log/stream_reader.hpp>
+#include <log_extractor.hpp>
 #include <log_file_parser.hpp>
+#include <log_merger.hpp>
+#include <output_writer.hpp>
+#include <record_filter.hpp>
+#include <seek_index_builder.hpp>
+#include <segment_unpacker.hpp>
 
 #define FMT_HEADER_ONLY
 #include <fmt/args.h>
 #include <fmt/format.h>
 
+using log_clock = binary_log::reader::clock;
+
+namespace binary_log
+{
+// For the default of --level in the help
+static std::ostream& operator<<(std::ostream& out, level value)
+{
+  return out << level_name(value);
+}
+}  // namespace binary_log
+
+// How often --follow looks for records flushed by the logger
+static constexpr auto follow_poll_interval = std::chrono::milliseconds(100);
+
+// Parses "N" (record N only), "N:M" (records N to M, M excluded) or "N:"
+// (record N onwards)
+static void parse_record_range(const std::string& text,
+                               std::size_t& first,
+                               std::size_t& last)
+{
+  const auto colon = text.find(':');
+  first = std::stoull(text.substr(0, colon));
+  if (colon == std::string::npos) {
+    last = first + 1;
+  } else if (colon + 1 == text.size()) {
+    last = binary_log::reader::npos;
+  } else {
+    last = std::stoull(text.substr(colon + 1));
+  }
+}
+
+// Parses seconds since the epoch, or a duration before `end` such as
+// "90s", "5m", "2h" or "1d"
+static log_clock::time_point parse_time(const std::string& text,
+                                        log_clock::time_point end)
+{
+  std::size_t length = 0;
+  const double value = std::stod(text, &length);
+  const auto unit = text.substr(length);
+  auto to_duration = [](double seconds)
+  {
+    return std::chrono::duration_cast<log_clock::duration>(
+        std::chrono::duration<double>(seconds));
+  };
+
+  if (unit.empty()) {
+    return log_clock::time_point(to_duration(value));
+  } else if (unit == "s") {
+    return end - to_duration(value);
+  } else if (unit == "m") {
+    return end - to_duration(value * 60);
+  } else if (unit == "h") {
+    return end - to_duration(value * 60 * 60);
+  } else if (unit == "d") {
+    return end - to_duration(value * 24 * 60 * 60);
+  }
+  throw std::runtime_error("Invalid time: " + text);
+}
+
+// Parses the arg positions of --select, e.g. "0,2"
+static std::vector<std::size_t> parse_projection(const std::string& text)
+{
+  std::vector<std::size_t> projection;
+  std::stringstream select(text);
+  for (std::string position; std::getline(select, position, ',');) {
+    std::size_t value = 0;
+    const auto* last = position.data() + position.size();
+    auto [ptr, ec] = std::from_chars(position.data(), last, value);
+    if (ec != std::errc() || ptr != last) {
+      throw std::runtime_error("Invalid --select: " + text
+                               + ", expected arg positions such as 0,2");
+    }
+    projection.push_back(value);
+  }
+  return projection;
+}
+
+// Prints the records of several logs merged by time, each line prefixed
+// with the path of its log, or extracts them into one log. Every log has
+// its own call sites, so filters and queries are compiled for each.
+static void merge_logs(const argparse::ArgumentParser& program,
+                       const std::vector<std::string>& paths)
+{
+  for (const auto option : {"--record",
+                            "--tail",
+                            "--follow",
+                            "--stats",
+                            "--aggregate",
+                            "--export",
+                            "--build-seek"})
+  {
+    if (program.is_used(option)) {
+      throw std::runtime_error(std::string(option)
+                               + " cannot be used with --merge");
+    }
+  }
+
+  // Readers and parsers are referred to by the merger, so they are kept
+  // in deques, which do not move them as they grow
+  std::deque<binary_log::reader> logs;
+  for (const auto& path : paths) {
+    const auto& log = logs.emplace_back(path);
+    if (!log.checkpoints().has_timestamps()) {
+      throw std::runtime_error(
+          path + ": --merge needs a seek index written by the logger");
+    }
+  }
+
+  // --from/--to durations are before the end of the latest log
+  auto end = log_clock::time_point::min();
+  for (const auto& log : logs) {
+    end = std::max(end, log.checkpoints().last_time());
+  }
+  const auto from = program.present("--from");
+  const auto to = program.present("--to");
+  const auto projection =
+      parse_projection(program.get<std::string>("--select"));
+  const auto predicate = program.present("--where");
+
+  std::deque<binary_log::log_file_parser> parsers;
+  binary_log::log_merger merger;
+  for (std::size_t i = 0; i < logs.size(); ++i) {
+    const auto& log = logs[i];
+    const auto& checkpoints = log.checkpoints();
+    const std::size_t first_record =
+        from ? checkpoints.first_record_at(parse_time(*from, end)) : 0;
+    const std::size_t last_record = std::min(
+        log.record_count(),
+        to ? checkpoints.last_record_at(parse_time(*to, end))
+           : binary_log::reader::npos);
+
+    auto& parser = parsers.emplace_back(log, first_record, last_record);
+    parser.set_filter(binary_log::record_filter(
+        log.index_table(),
+        program.get<std::vector<std::string>>("--include"),
+        program.get<std::vector<std::string>>("--exclude"),
+        program.get<bool>("--regex"),
+        program.get<binary_log::level>("--level")));
+    if (predicate) {
+      auto where = binary_log::query(*predicate);
+      where.compile(log.index_table());
+      parser.set_query(std::move(where));
+    }
+    parser.set_projection(projection);
+    parser.set_prefix("[" + paths[i] + "] ");
+    merger.add(log, parser, first_record, last_record);
+  }
+
+  if (auto path = program.present("--extract")) {
+    for (const auto& source : paths) {
+      if (std::filesystem::exists(*path)
+          && std::filesystem::equivalent(*path, source)) {
+        throw std::runtime_error("Cannot extract a log into itself");
+      }
+    }
+    auto extractor = binary_log::log_extractor(*path);
+    merger.merge(
+        [&](std::size_t position)
+        {
+          extractor.set_source(logs[position]);
+          parsers[position].extract_records(extractor);
+        });
+    extractor.finish();
+    return;
+  }
+
+  auto output = binary_log::output_writer(
+      STDOUT_FILENO, program.get<std::size_t>("--buffer-size"));
+  merger.merge([&](std::size_t position)
+               { parsers[position].print_records(output); });
+  output.flush();
+}
+
+// Prints independent logs (or globs of them), such as rotated segments,
+// one after the other or each to its own file, decoding them in parallel
+static void unpack_segments(const argparse::ArgumentParser& program,
+                            const std::vector<std::string>& patterns)
+{
+  for (const auto option : {"--record",
+                            "--tail",
+                            "--from",
+                            "--to",
+                            "--follow",
+                            "--stats",
+                            "--aggregate",
+                            "--export",
+                            "--extract",
+                            "--build-seek"})
+  {
+    if (program.is_used(option)) {
+      throw std::runtime_error(std::string(option)
+                               + " cannot be used with --segments");
+    }
+  }
+
+  const auto includes = program.get<std::vector<std::string>>("--include");
+  const auto excludes = program.get<std::vector<std::string>>("--exclude");
+  const auto regex = program.get<bool>("--regex");
+  const auto min_level = program.get<binary_log::level>("--level");
+  const auto predicate = program.present("--where");
+  const auto projection =
+      parse_projection(program.get<std::string>("--select"));
+
+  auto jobs = program.get<std::size_t>("--jobs");
+  if (jobs == 0) {
+    jobs = std::thread::hardware_concurrency();
+  }
+  auto unpacker = binary_log::segment_unpacker(
+      binary_log::expand_log_paths(patterns),
+      jobs,
+      program.get<std::size_t>("--buffer-size"),
+      [&](const binary_log::reader& log, binary_log::log_file_parser& parser)
+      {
+        parser.set_filter(binary_log::record_filter(
+            log.index_table(), includes, excludes, regex, min_level));
+        if (predicate) {
+          auto where = binary_log::query(*predicate);
+          where.compile(log.index_table());
+          parser.set_query(std::move(where));
+        }
+        parser.set_projection(projection);
+      });
+
+  if (auto directory = program.present("--output-dir")) {
+    unpacker.unpack_to_directory(*directory);
+  } else {
+    unpacker.unpack_in_order(STDOUT_FILENO);
+  }
+}
+
+// Prints a container streamed on stdin by a container_packer, a block at
+// a time as the logger writes them
+static void unpack_stream(const argparse::ArgumentParser& program)
+{
+  for (const auto option : {"--record",
+                            "--tail",
+                            "--from",
+                            "--to",
+                            "--follow",
+                            "--stats",
+                            "--aggregate",
+                            "--export",
+                            "--extract",
+                            "--build-seek"})
+  {
+    if (program.is_used(option)) {
+      throw std::runtime_error(std::string(option)
+                               + " cannot be used with a stream");
+    }
+  }
+
+  auto stream = binary_log::stream_reader(stdin);
+  const auto& index_entries = stream.index_table();
+  auto parser = binary_log::log_file_parser(index_entries);
+  parser.set_projection(
+      parse_projection(program.get<std::string>("--select")));
+  std::optional<binary_log::query> where;
+  if (auto predicate = program.present("--where")) {
+    where.emplace(*predicate);
+  }
+
+  auto output = binary_log::output_writer(
+      STDOUT_FILENO, program.get<std::size_t>("--buffer-size"));
+  std::size_t call_sites = 0;
+  while (stream.next_block()) {
+    // Filters and queries are set up again as call sites arrive
+    if (index_entries.size() != call_sites) {
+      call_sites = index_entries.size();
+      parser.set_filter(binary_log::record_filter(
+          index_entries,
+          program.get<std::vector<std::string>>("--include"),
+          program.get<std::vector<std::string>>("--exclude"),
+          program.get<bool>("--regex"),
+          program.get<binary_log::level>("--level")));
+      if (where) {
+        where->compile(index_entries);
+        parser.set_query(*where);
+      }
+    }
+    parser.set_decoder(stream.decoder());
+    parser.parse_and_print(output);
+  }
+}
+
 int main(int argc, char* argv[])
 {
   argparse::ArgumentParser program("unpacker");
-  program.add_argument("log file").help("binary_log log file to deflate");
+  program.add_argument("log file")
+      .help("binary_log log file or container to deflate, or - for a "
+            "container streamed on stdin")
+      .default_value(std::string {});
+  program.add_argument("-b", "--buffer-size")
+      .help("size of the output buffer in bytes")
+      .default_value(binary_log::output_writer::default_buffer_size)
+      .scan<'u', std::size_t>();
+  program.add_argument("-i", "--include")
+      .help("only print call sites whose format string contains this "
+            "pattern (or whose index equals it); may be repeated")
+      .default_value(std::vector<std::string> {})
+      .append();
+  program.add_argument("-e", "--exclude")
+      .help("skip call sites whose format string contains this pattern "
+            "(or whose index equals it); may be repeated")
+      .default_value(std::vector<std::string> {})
+      .append();
+  program.add_argument("-w", "--where")
+      .help("only print records whose args satisfy this predicate, "
+            "e.g. \"arg1 > 1000 && arg0 == 'AAPL'\"");
+  program.add_argument("-s", "--select")
+      .help("only print these args of each record (tab-separated), "
+            "e.g. 0,2")
+      .default_value(std::string {});
+  program.add_argument("-a", "--aggregate")
+      .help("print count, sum, min, max, mean and percentiles of each "
+            "numeric arg per call site instead of the records")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--stats")
+      .help("print the record count, bytes used and share of the log file "
+            "of each call site instead of the records")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--export")
+      .help("write the typed args of the records instead of formatted "
+            "text: jsonl (to stdout), or csv or columnar (one table per "
+            "call site in --export-dir)");
+  program.add_argument("--export-dir")
+      .help("directory of the csv and columnar tables and their "
+            "schema.json")
+      .default_value(std::string {"."});
+  program.add_argument("--extract")
+      .help("copy the selected records, unformatted, into a new log at "
+            "this path (with its .index, .runlength and .seek files)");
+  program.add_argument("--record")
+      .help("only print record N, or records N:M (M excluded) or N: (to "
+            "the end), jumping to them through the seek index");
+  program.add_argument("-n", "--tail")
+      .help("only print the last N records (of those selected by --record "
+            "or --from/--to), found through the seek index")
+      .scan<'u', std::size_t>();
+  program.add_argument("--from")
+      .help("only print records logged at or after this time: seconds "
+            "since the epoch, or a duration before the end of the log, e.g. "
+            "5m for the last 5 minutes (also s, h, d)");
+  program.add_argument("--to")
+      .help("only print records logged at or before this time (same format "
+            "as --from)");
+  program.add_argument("-f", "--follow")
+      .help("keep printing records as the logger flushes them, like "
+            "tail -f")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--build-seek")
+      .help("write the seek index (<log file>.seek) of a log written "
+            "without one, then exit")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("-l", "--level")
+      .help("only print call sites at or above this level: trace, debug, "
+            "info (that of BINARY_LOG), warn or error")
+      .default_value(binary_log::level::trace)
+      .action(
+          [](const std::string& name)
+          {
+            if (const auto parsed = binary_log::parse_level(name)) {
+              return *parsed;
+            }
+            throw std::runtime_error("Invalid level: " + name);
+          });
+  program.add_argument("-r", "--regex")
+      .help("treat --include/--exclude patterns as regular expressions")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--merge")
+      .help("merge these logs (and the log file, if given) by time, "
+            "prefixing each line with the path of its log; takes the rest "
+            "of the command line")
+      .default_value(std::vector<std::string> {})
+      .remaining();
+  program.add_argument("--segments")
+      .help("print these logs or globs of logs (and the log file, if "
+            "given) one after the other, decoding them in parallel; takes "
+            "the rest of the command line")
+      .default_value(std::vector<std::string> {})
+      .remaining();
+  program.add_argument("-j", "--jobs")
+      .help("number of threads decoding --segments (0 for one per core)")
+      .default_value(std::size_t {0})
+      .scan<'u', std::size_t>();
+  program.add_argument("--output-dir")
+      .help("write the text of each of the --segments to <name>.txt in "
+            "this directory instead of stdout");
 
   try {
     program.parse_args(argc, argv);
@@ -24,16 +427,266 @@ int main(int argc, char* argv[])
   }
 
   auto log_file_path = program.get<std::string>("log file");
-  auto index_file_path = log_file_path + ".index";
-  auto runlength_file_path = log_file_path + ".runlength";
-
-  // Parse index file
-  auto index_file_parser =
-      binary_log::index_file_parser(index_file_path.c_str());
-  auto index_entries = index_file_parser.parse();
-
-  // Parse log file
-  auto log_file_parser = binary_log::log_file_parser(
-      log_file_path.c_str(), runlength_file_path.c_str());
-  log_file_parser.parse_and_print(index_entries);
+
+  if (auto merged = program.get<std::vector<std::string>>("--merge");
+      !merged.empty())
+  {
+    if (!log_file_path.empty()) {
+      merged.insert(merged.begin(), log_file_path);
+    }
+    try {
+      merge_logs(program, merged);
+    } catch (const std::exception& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  if (auto segments = program.get<std::vector<std::string>>("--segments");
+      !segments.empty())
+  {
+    if (!log_file_path.empty()) {
+      segments.insert(segments.begin(), log_file_path);
+    }
+    try {
+      unpack_segments(program, segments);
+    } catch (const std::exception& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  if (log_file_path == "-") {
+    try {
+      unpack_stream(program);
+    } catch (const std::exception& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  if (log_file_path.empty()) {
+    std::cerr << "No log file given" << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  // Map the log file and its index and runlength files
+  std::optional<binary_log::reader> log;
+  try {
+    log.emplace(log_file_path);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::exit(1);
+  }
+  const auto& index_entries = log->index_table();
+
+  if (program.get<bool>("--build-seek")) {
+    if (log->is_container()) {
+      std::cerr << "A container has no seek index" << std::endl;
+      std::exit(1);
+    }
+    try {
+      binary_log::write_seek_index(log_file_path + ".seek",
+                                   binary_log::build_seek_index(*log));
+    } catch (const std::runtime_error& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  // Records to parse, located through the seek index
+  std::size_t first_record = 0;
+  std::size_t last_record = binary_log::reader::npos;
+  // The last records of a container, found from its last block back
+  std::optional<std::size_t> container_tail;
+  try {
+    if (auto records = program.present("--record")) {
+      parse_record_range(*records, first_record, last_record);
+    }
+
+    const auto from = program.present("--from");
+    const auto to = program.present("--to");
+    if (from || to) {
+      const auto& checkpoints = log->checkpoints();
+      if (!checkpoints.has_timestamps()) {
+        throw std::runtime_error(
+            "--from/--to need a seek index written by the logger");
+      }
+      const auto end = checkpoints.last_time();
+      if (from) {
+        first_record = std::max<std::size_t>(
+            first_record, checkpoints.first_record_at(parse_time(*from, end)));
+      }
+      if (to) {
+        last_record = std::min<std::size_t>(
+            last_record, checkpoints.last_record_at(parse_time(*to, end)));
+      }
+    }
+
+    if (auto count = program.present<std::size_t>("--tail")) {
+      if (log->is_container() && first_record == 0
+          && last_record == binary_log::reader::npos)
+      {
+        container_tail = count;
+      } else {
+        const auto end = std::min(last_record, log->record_count());
+        first_record = std::max(first_record, end - std::min(*count, end));
+      }
+    }
+  } catch (const std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    std::exit(1);
+  }
+
+  auto log_file_parser =
+      binary_log::log_file_parser(*log, first_record, last_record);
+  if (container_tail) {
+    log_file_parser.set_decoder(log->tail_decoder(*container_tail));
+  }
+  // Rebuilt by --follow when the logger adds call sites
+  auto make_filter = [&]
+  {
+    return binary_log::record_filter(
+        index_entries,
+        program.get<std::vector<std::string>>("--include"),
+        program.get<std::vector<std::string>>("--exclude"),
+        program.get<bool>("--regex"),
+        program.get<binary_log::level>("--level"));
+  };
+  binary_log::record_filter filter;
+  try {
+    filter = make_filter();
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::exit(1);
+  }
+  log_file_parser.set_filter(filter);
+
+  std::optional<binary_log::query> where;
+  if (auto predicate = program.present("--where")) {
+    try {
+      where.emplace(*predicate);
+      where->compile(index_entries);
+      log_file_parser.set_query(*where);
+    } catch (const std::runtime_error& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  std::vector<std::size_t> projection;
+  try {
+    projection = parse_projection(program.get<std::string>("--select"));
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::exit(1);
+  }
+
+  auto output = binary_log::output_writer(
+      STDOUT_FILENO, program.get<std::size_t>("--buffer-size"));
+
+  if (program.get<bool>("--stats")) {
+    const auto stats = log_file_parser.parse_and_count();
+    binary_log::print_call_site_stats(index_entries,
+                                      stats,
+                                      filter,
+                                      log_file_parser.log_file_size(),
+                                      output);
+    output.flush();
+    return 0;
+  }
+
+  if (program.get<bool>("--aggregate")) {
+    auto statistics =
+        binary_log::aggregator(index_entries, std::move(projection));
+    log_file_parser.parse_and_aggregate(statistics);
+    statistics.print(index_entries, output);
+    output.flush();
+    return 0;
+  }
+
+  if (auto path = program.present("--extract")) {
+    try {
+      if (std::filesystem::exists(*path)
+          && std::filesystem::equivalent(*path, log_file_path)) {
+        throw std::runtime_error("Cannot extract a log into itself");
+      }
+      auto extractor = binary_log::log_extractor(*path);
+      extractor.set_source(*log);
+      log_file_parser.parse_and_extract(extractor);
+    } catch (const std::exception& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  if (auto format = program.present("--export")) {
+    try {
+      const auto directory = program.get<std::string>("--export-dir");
+      if (*format == "jsonl") {
+        auto exporter = binary_log::jsonl_exporter(
+            output, index_entries, std::move(projection));
+        log_file_parser.parse_and_export(exporter);
+      } else if (*format == "csv") {
+        auto exporter = binary_log::csv_exporter(
+            directory, index_entries, std::move(projection));
+        log_file_parser.parse_and_export(exporter);
+      } else if (*format == "columnar") {
+        auto exporter = binary_log::columnar_exporter(
+            directory, index_entries, std::move(projection));
+        log_file_parser.parse_and_export(exporter);
+      } else {
+        throw std::runtime_error("Unknown export format: " + *format);
+      }
+    } catch (const std::exception& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+
+  log_file_parser.set_projection(std::move(projection));
+
+  if (program.get<bool>("--follow")) {
+    if (!log->can_follow()) {
+      std::cerr << "--follow needs the seek file " << log_file_path
+                << ".seek, which tells how far the logger has flushed the "
+                   "log (its packer writes none with a seek_interval of 0)"
+                << std::endl;
+      std::exit(1);
+    }
+
+    // Only what the logger has flushed can be decoded; the log is
+    // remapped as it grows, until the unpacker is interrupted
+    try {
+      log_file_parser.extend(*log);
+      for (;;) {
+        log_file_parser.parse_and_print(output);
+        std::this_thread::sleep_for(follow_poll_interval);
+        const auto call_sites = index_entries.size();
+        if (!log->refresh()) {
+          continue;
+        }
+        if (index_entries.size() != call_sites) {
+          log_file_parser.set_filter(make_filter());
+          if (where) {
+            where->compile(index_entries);
+            log_file_parser.set_query(*where);
+          }
+        }
+        log_file_parser.extend(*log);
+      }
+    } catch (const std::runtime_error& err) {
+      std::cerr << err.what() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  log_file_parser.parse_and_print(output);
 }